@@ -132,9 +132,10 @@ HRESULT CSampleCredential::_CaptureKeystroke(PCWSTR pwzOldValue, PCWSTR pwzNewVa
     LARGE_INTEGER currentTime;
     
     // Get high-resolution timestamp
-    if (!QueryPerformanceCounter(&currentTime))
+    hr = GetCurrentTimeStamp(&currentTime);
+    if (FAILED(hr))
     {
-        return GetLastErrorAsHRESULT();
+        return hr;
     }
     
     // Initialize timing on first keystroke
@@ -155,10 +156,14 @@ HRESULT CSampleCredential::_CaptureKeystroke(PCWSTR pwzOldValue, PCWSTR pwzNewVa
         // Key was pressed (character added)
         WCHAR newChar = pwzNewValue[newLen - 1];
         
+        // Times go out as microseconds since the first keystroke, not raw
+        // counter ticks the server has no frequency for
+        LONGLONG elapsedUs = CalculateElapsedMicroseconds(m_firstKeystrokeTime, currentTime);
+        
         KeystrokeData keystroke;
         keystroke.key = newChar;
-        keystroke.keyDownTime = currentTime.QuadPart;
-        keystroke.keyUpTime = currentTime.QuadPart; // Approximate key up time
+        keystroke.keyDownTime = elapsedUs;
+        keystroke.keyUpTime = elapsedUs; // Approximate key up time
         keystroke.position = static_cast<DWORD>(newLen - 1);
         
         // Add to biometric profile
@@ -0,0 +1,109 @@
+#include "BatchScorer.h"
+
+struct BatchScoreContext
+{
+    const TypingScorer* pScorer;
+    const TimingFeatureSet* rgAttempts;
+    DWORD cAttempts;
+    const TypingTemplate* const* rgpTemplates;
+    DWORD cTemplates;
+    float* rgDistances;
+    volatile LONG iNextBlock;
+};
+
+static void ScoreBlock(const BatchScoreContext& context, DWORD iFirst, DWORD cBlock)
+{
+    for (DWORD t = 0; t < context.cTemplates; t++)
+    {
+        const TypingTemplate& typingTemplate = *context.rgpTemplates[t];
+        for (DWORD a = iFirst; a < iFirst + cBlock; a++)
+        {
+            double distance = 0.0;
+            HRESULT hr = context.pScorer->ComputeDistance(context.rgAttempts[a], typingTemplate, &distance);
+            context.rgDistances[static_cast<SIZE_T>(a) * context.cTemplates + t] =
+                (hr == S_OK) ? static_cast<float>(distance) : BATCH_DISTANCE_NOT_COMPARABLE;
+        }
+    }
+}
+
+static VOID CALLBACK s_ScoreBatchCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext, PTP_WORK pWork)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pWork);
+
+    BatchScoreContext* pContext = static_cast<BatchScoreContext*>(pvContext);
+    DWORD cBlocks = (pContext->cAttempts + BATCH_SCORE_BLOCK_SIZE - 1) / BATCH_SCORE_BLOCK_SIZE;
+
+    // Claim blocks until none are left, so fast workers pick up the slack
+    for (;;)
+    {
+        DWORD iBlock = static_cast<DWORD>(InterlockedIncrement(&pContext->iNextBlock) - 1);
+        if (iBlock >= cBlocks)
+        {
+            break;
+        }
+
+        DWORD iFirst = iBlock * BATCH_SCORE_BLOCK_SIZE;
+        DWORD cBlock = pContext->cAttempts - iFirst;
+        if (cBlock > BATCH_SCORE_BLOCK_SIZE)
+        {
+            cBlock = BATCH_SCORE_BLOCK_SIZE;
+        }
+        ScoreBlock(*pContext, iFirst, cBlock);
+    }
+}
+
+HRESULT ScoreBatch(const TypingScorer& scorer,
+                   const TimingFeatureSet* rgAttempts, DWORD cAttempts,
+                   const TypingTemplate* const* rgpTemplates, DWORD cTemplates,
+                   float* rgDistances, DWORD cThreads)
+{
+    if ((cAttempts > 0 && !rgAttempts) || (cTemplates > 0 && !rgpTemplates) ||
+        (cAttempts > 0 && cTemplates > 0 && !rgDistances))
+    {
+        return E_INVALIDARG;
+    }
+
+    BatchScoreContext context;
+    context.pScorer = &scorer;
+    context.rgAttempts = rgAttempts;
+    context.cAttempts = cAttempts;
+    context.rgpTemplates = rgpTemplates;
+    context.cTemplates = cTemplates;
+    context.rgDistances = rgDistances;
+    context.iNextBlock = 0;
+
+    if (cThreads == 0)
+    {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        cThreads = systemInfo.dwNumberOfProcessors;
+    }
+
+    DWORD cBlocks = (cAttempts + BATCH_SCORE_BLOCK_SIZE - 1) / BATCH_SCORE_BLOCK_SIZE;
+    if (cThreads > cBlocks)
+    {
+        cThreads = cBlocks;
+    }
+
+    if (cThreads <= 1)
+    {
+        s_ScoreBatchCallback(nullptr, &context, nullptr);
+        return S_OK;
+    }
+
+    PTP_WORK pWork = CreateThreadpoolWork(s_ScoreBatchCallback, &context, nullptr);
+    if (!pWork)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    for (DWORD i = 0; i < cThreads; i++)
+    {
+        SubmitThreadpoolWork(pWork);
+    }
+    WaitForThreadpoolWorkCallbacks(pWork, FALSE);
+    CloseThreadpoolWork(pWork);
+
+    return S_OK;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <windows.h>
+#include <float.h>
+#include "TypingScorer.h"
+
+// Distance recorded for an attempt and template that cannot be compared,
+// e.g. because they are for passwords of different lengths
+#define BATCH_DISTANCE_NOT_COMPARABLE   FLT_MAX
+
+// Attempts a worker claims at a time. Each block is scored against one
+// template after another, so a template stays in cache for the whole block.
+#define BATCH_SCORE_BLOCK_SIZE          32
+
+// Score cAttempts recorded attempts against cTemplates templates in one
+// call, for offline threshold tuning.
+//
+// rgDistances receives cAttempts * cTemplates values, row by attempt:
+// rgDistances[attempt * cTemplates + template] is ScoreResult::distance,
+// lower meaning more alike, or BATCH_DISTANCE_NOT_COMPARABLE. Blocks of
+// attempts are spread over cThreads threadpool callbacks, or one per
+// logical processor when cThreads is 0. The scorer must not change while
+// a batch runs.
+HRESULT ScoreBatch(const TypingScorer& scorer,
+                   const TimingFeatureSet* rgAttempts, DWORD cAttempts,
+                   const TypingTemplate* const* rgpTemplates, DWORD cTemplates,
+                   float* rgDistances, DWORD cThreads);
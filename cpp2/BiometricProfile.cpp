@@ -0,0 +1,220 @@
+#include "BiometricProfile.h"
+#include "JsonWriter.h"
+#include "CborWriter.h"
+#include <string.h>
+
+// Schema 1 keystrokes: one object per keystroke with absolute times
+static void WriteKeystrokeObjects(JsonWriter& json, const KeystrokeTimeline& timeline)
+{
+    json.BeginArray();
+    for (DWORD i = 0; i < timeline.count; ++i)
+    {
+        json.BeginObject();
+        json.Name("key");
+        json.String(&timeline.keyId[i], 1);
+        json.Name("keyDownTime");
+        json.UInt(timeline.keyDownUs[i]);
+        json.Name("keyUpTime");
+        json.UInt(timeline.keyUpUs[i]);
+        json.Name("position");
+        json.UInt(timeline.position[i]);
+        json.Name("flags");
+        json.UInt(timeline.flags[i]);
+        json.EndObject();
+    }
+    json.EndArray();
+}
+
+// Schema 2 keystrokes: one array per lane of the timeline. Key-down times
+// are deltas from the previous keystroke (the first from the first
+// keystroke of the attempt) and release times are dwells, so most values
+// are a few digits.
+static void WriteKeystrokeColumns(JsonWriter& json, const KeystrokeTimeline& timeline)
+{
+    json.BeginObject();
+    
+    json.Name("keys");
+    json.BeginArray();
+    for (DWORD i = 0; i < timeline.count; ++i)
+    {
+        json.String(&timeline.keyId[i], 1);
+    }
+    json.EndArray();
+    
+    json.Name("downDeltas");
+    json.BeginArray();
+    UINT32 prevDownUs = 0;
+    for (DWORD i = 0; i < timeline.count; ++i)
+    {
+        json.Int(static_cast<LONGLONG>(timeline.keyDownUs[i]) - prevDownUs);
+        prevDownUs = timeline.keyDownUs[i];
+    }
+    json.EndArray();
+    
+    json.Name("dwells");
+    json.BeginArray();
+    for (DWORD i = 0; i < timeline.count; ++i)
+    {
+        json.Int(static_cast<LONGLONG>(timeline.keyUpUs[i]) - timeline.keyDownUs[i]);
+    }
+    json.EndArray();
+    
+    json.Name("positions");
+    json.BeginArray();
+    for (DWORD i = 0; i < timeline.count; ++i)
+    {
+        json.UInt(timeline.position[i]);
+    }
+    json.EndArray();
+    
+    json.Name("flags");
+    json.BeginArray();
+    for (DWORD i = 0; i < timeline.count; ++i)
+    {
+        json.UInt(timeline.flags[i]);
+    }
+    json.EndArray();
+    
+    json.EndObject();
+}
+
+// JSON utilities for AI communication
+HRESULT CreateJSONPayload(const BiometricProfile& profile, DWORD dwSchema, char* pchBuffer, size_t cchBuffer, size_t* pcchPayload)
+{
+    JsonWriter json(pchBuffer, cchBuffer);
+    json.BeginObject();
+    
+    // Schema 1 predates the version member and is sent as it always was
+    const KeystrokeTimeline& timeline = profile.keystrokes.GetTimeline();
+    if (dwSchema == PAYLOAD_SCHEMA_COLUMNAR)
+    {
+        json.Name("schemaVersion");
+        json.UInt(PAYLOAD_SCHEMA_COLUMNAR);
+        json.Name("keystrokes");
+        WriteKeystrokeColumns(json, timeline);
+    }
+    else
+    {
+        json.Name("keystrokes");
+        WriteKeystrokeObjects(json, timeline);
+    }
+    
+    json.Name("passwordLength");
+    json.UInt(profile.passwordLength);
+    json.Name("totalTypingTime");
+    json.Int(profile.totalTypingTime);
+    
+    json.Name("edits");
+    json.BeginObject();
+    json.Name("insert");
+    json.UInt(profile.editCounts[KEK_INSERT]);
+    json.Name("delete");
+    json.UInt(profile.editCounts[KEK_DELETE]);
+    json.Name("replace");
+    json.UInt(profile.editCounts[KEK_REPLACE]);
+    json.Name("paste");
+    json.UInt(profile.editCounts[KEK_PASTE]);
+    json.EndObject();
+    
+    // Schema 1 keeps the member names servers already read: flight for
+    // up-down and digraph for down-down. Schema 2 names them as
+    // TIMING_FEATURE does.
+    static const PCSTR rgszSchema1Names[] = { "flightMean", "flightStdDev", "digraphMean", "digraphStdDev" };
+    static const PCSTR rgszSchema2Names[] = { "upDownMean", "upDownStdDev", "downDownMean", "downDownStdDev" };
+    const PCSTR* rgszNames = (dwSchema == PAYLOAD_SCHEMA_COLUMNAR) ? rgszSchema2Names : rgszSchema1Names;
+    json.Name("features");
+    json.BeginObject();
+    json.Name("dwellMean");
+    json.Number(profile.features.dwellMeanUs);
+    json.Name("dwellStdDev");
+    json.Number(profile.features.dwellStdDevUs);
+    json.Name(rgszNames[0], strlen(rgszNames[0]));
+    json.Number(profile.features.upDownMeanUs);
+    json.Name(rgszNames[1], strlen(rgszNames[1]));
+    json.Number(profile.features.upDownStdDevUs);
+    json.Name(rgszNames[2], strlen(rgszNames[2]));
+    json.Number(profile.features.downDownMeanUs);
+    json.Name(rgszNames[3], strlen(rgszNames[3]));
+    json.Number(profile.features.downDownStdDevUs);
+    json.Name("pauses");
+    json.UInt(profile.features.pauseCount);
+    json.Name("backspaceRatio");
+    json.Number(profile.features.backspaceRatio);
+    json.EndObject();
+    
+    json.Name("username");
+    json.String(profile.username.c_str(), profile.username.length());
+    json.Name("timestamp");
+    json.UInt(GetTickCount64());
+    
+    json.EndObject();
+    return json.Finish(pcchPayload);
+}
+
+// Binary counterpart of CreateJSONPayload with the schema 1 members. Each
+// keystroke is a positional array rather than a map, so the per-keystroke
+// names are not repeated.
+HRESULT CreateCBORPayload(const BiometricProfile& profile, BYTE* pbBuffer, size_t cbBuffer, size_t* pcbPayload)
+{
+    const KeystrokeTimeline& timeline = profile.keystrokes.GetTimeline();
+    
+    CborWriter cbor(pbBuffer, cbBuffer);
+    cbor.BeginMap(7);
+    
+    // [key, keyDownTime, keyUpTime, position, flags] per keystroke. The key
+    // is its UTF-16 code unit as an integer: a text string cannot carry half
+    // of a surrogate pair, and each half is a keystroke of its own.
+    cbor.Name("keystrokes");
+    cbor.BeginArray(timeline.count);
+    for (DWORD i = 0; i < timeline.count; ++i)
+    {
+        cbor.BeginArray(5);
+        cbor.UInt(timeline.keyId[i]);
+        cbor.UInt(timeline.keyDownUs[i]);
+        cbor.UInt(timeline.keyUpUs[i]);
+        cbor.UInt(timeline.position[i]);
+        cbor.UInt(timeline.flags[i]);
+    }
+    
+    cbor.Name("passwordLength");
+    cbor.UInt(profile.passwordLength);
+    cbor.Name("totalTypingTime");
+    cbor.Int(profile.totalTypingTime);
+    
+    cbor.Name("edits");
+    cbor.BeginMap(4);
+    cbor.Name("insert");
+    cbor.UInt(profile.editCounts[KEK_INSERT]);
+    cbor.Name("delete");
+    cbor.UInt(profile.editCounts[KEK_DELETE]);
+    cbor.Name("replace");
+    cbor.UInt(profile.editCounts[KEK_REPLACE]);
+    cbor.Name("paste");
+    cbor.UInt(profile.editCounts[KEK_PASTE]);
+    
+    cbor.Name("features");
+    cbor.BeginMap(8);
+    cbor.Name("dwellMean");
+    cbor.Number(profile.features.dwellMeanUs);
+    cbor.Name("dwellStdDev");
+    cbor.Number(profile.features.dwellStdDevUs);
+    cbor.Name("flightMean");
+    cbor.Number(profile.features.upDownMeanUs);
+    cbor.Name("flightStdDev");
+    cbor.Number(profile.features.upDownStdDevUs);
+    cbor.Name("digraphMean");
+    cbor.Number(profile.features.downDownMeanUs);
+    cbor.Name("digraphStdDev");
+    cbor.Number(profile.features.downDownStdDevUs);
+    cbor.Name("pauses");
+    cbor.UInt(profile.features.pauseCount);
+    cbor.Name("backspaceRatio");
+    cbor.Number(profile.features.backspaceRatio);
+    
+    cbor.Name("username");
+    cbor.String(profile.username.c_str(), profile.username.length());
+    cbor.Name("timestamp");
+    cbor.UInt(GetTickCount64());
+    
+    return cbor.Finish(pcbPayload);
+}
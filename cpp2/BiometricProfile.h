@@ -0,0 +1,42 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include "KeystrokeBuffer.h"
+
+// Longest username the payload is sized for, in characters
+#define MAX_USERNAME_LENGTH         256
+
+// Longest payload CreateJSONPayload can write: every keystroke and the
+// username at their longest escaped form, plus the fixed members. The
+// CBOR form of the same profile is always shorter.
+#define JSON_PAYLOAD_CAPACITY       (MAX_KEYSTROKE_COUNT * 128 + MAX_USERNAME_LENGTH * 6 + 1024)
+
+// Encoding of the AI model request, through CONFIG_PAYLOAD_FORMAT
+#define PAYLOAD_FORMAT_JSON         0   // application/json
+#define PAYLOAD_FORMAT_CBOR         1   // application/cbor, keystrokes as positional arrays
+
+// Layout of the JSON request, through CONFIG_PAYLOAD_SCHEMA
+#define PAYLOAD_SCHEMA_OBJECTS      1   // One object per keystroke, absolute times
+#define PAYLOAD_SCHEMA_COLUMNAR     2   // Parallel arrays of deltas and dwells, with schemaVersion
+
+// Biometric profile structure
+struct BiometricProfile
+{
+    KeystrokeBuffer keystrokes;
+    std::wstring username;
+    LONGLONG startTime;
+    LONGLONG totalTypingTime;
+    DWORD passwordLength;
+    LONGLONG performanceFrequency;
+    DWORD editCounts[KEK_NUM_KINDS]; // Edits seen per KEYSTROKE_EDIT_KIND
+    TypingFeatures features;
+};
+
+// JSON utilities for AI communication. The payload is written as UTF-8
+// straight into the caller's buffer, without allocating, in one of the
+// PAYLOAD_SCHEMA_* layouts.
+HRESULT CreateJSONPayload(const BiometricProfile& profile, DWORD dwSchema, char* pchBuffer, size_t cchBuffer, size_t* pcchPayload);
+
+// The same payload as CBOR (RFC 8949), for CONFIG_PAYLOAD_FORMAT
+HRESULT CreateCBORPayload(const BiometricProfile& profile, BYTE* pbBuffer, size_t cbBuffer, size_t* pcbPayload);
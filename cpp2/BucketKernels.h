@@ -0,0 +1,173 @@
+#pragma once
+
+#include <windows.h>
+#include <math.h>
+
+// Password lengths fall in a few fixed buckets. Each bucket instantiates
+// the kernels below with a compile-time trip count, so the compiler fully
+// unrolls and vectorizes them with no tail loop. Elements past the real
+// count are computed but masked out of every reduction. They must still
+// hold initialized values up to the bucket size: feature vectors are zero
+// filled to it by ExtractTimingFeatures, and timelines and templates are
+// zeroed when created and wiped as they shrink.
+inline DWORD SelectLengthBucket(DWORD c)
+{
+    return (c <= 8) ? 8 :
+           (c <= 16) ? 16 :
+           (c <= 32) ? 32 :
+           (c <= 64) ? 64 : 0;
+}
+
+// Zero lanes [c, bucket size) so the bucket kernels never read a stale or
+// uninitialized value past the count
+inline void ZeroFillLengthBucket(INT32* pValues, DWORD c)
+{
+    DWORD cBucket = SelectLengthBucket(c);
+    if (cBucket > c)
+    {
+        ZeroMemory(pValues + c, (cBucket - c) * sizeof(INT32));
+    }
+}
+
+template <DWORD N>
+struct LengthBucket
+{
+    // Writes all N differences; callers ignore those past their count
+    static void Subtract(const UINT32* pMinuend, const UINT32* pSubtrahend, DWORD c, INT32* pOut)
+    {
+        UNREFERENCED_PARAMETER(c);
+        for (DWORD i = 0; i < N; i++)
+        {
+            pOut[i] = static_cast<INT32>(pMinuend[i] - pSubtrahend[i]);
+        }
+    }
+
+    static LONGLONG Sum(const INT32* pValues, DWORD c)
+    {
+        LONGLONG sum = 0;
+        for (DWORD i = 0; i < N; i++)
+        {
+            sum += (i < c) ? pValues[i] : 0;
+        }
+        return sum;
+    }
+
+    static void MinMax(const INT32* pValues, DWORD c, INT32* pMin, INT32* pMax)
+    {
+        INT32 minimum = *pMin;
+        INT32 maximum = *pMax;
+        for (DWORD i = 0; i < N; i++)
+        {
+            INT32 low = (i < c) ? pValues[i] : minimum;
+            INT32 high = (i < c) ? pValues[i] : maximum;
+            minimum = (low < minimum) ? low : minimum;
+            maximum = (high > maximum) ? high : maximum;
+        }
+        *pMin = minimum;
+        *pMax = maximum;
+    }
+
+    static double SumSquaredDeviation(const INT32* pValues, DWORD c, double mean)
+    {
+        double sum = 0.0;
+        for (DWORD i = 0; i < N; i++)
+        {
+            double d = (i < c) ? pValues[i] - mean : 0.0;
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    // Sum of |x - mean| / max(spread, minSpread), the scaled Manhattan
+    // distance before averaging
+    static double ScaledAbsoluteDeviation(const INT32* pValues, const float* pMean, const float* pSpread, float minSpread, DWORD c)
+    {
+        double sum = 0.0;
+        for (DWORD i = 0; i < N; i++)
+        {
+            float spread = (pSpread[i] > minSpread) ? pSpread[i] : minSpread;
+            double term = fabs(pValues[i] - pMean[i]) / spread;
+            sum += (i < c) ? term : 0.0;
+        }
+        return sum;
+    }
+
+    // Sum of squared z-scores, the Mahalanobis distance before averaging
+    static double SquaredZ(const INT32* pValues, const float* pMean, const float* pSpread, float minSpread, DWORD c)
+    {
+        double sum = 0.0;
+        for (DWORD i = 0; i < N; i++)
+        {
+            float spread = (pSpread[i] > minSpread) ? pSpread[i] : minSpread;
+            double z = (i < c) ? (pValues[i] - pMean[i]) / spread : 0.0;
+            sum += z * z;
+        }
+        return sum;
+    }
+};
+
+// Generic versions for passwords longer than the largest bucket
+inline double ScaledAbsoluteDeviationGeneric(const INT32* pValues, const float* pMean, const float* pSpread, float minSpread, DWORD c)
+{
+    double sum = 0.0;
+    for (DWORD i = 0; i < c; i++)
+    {
+        float spread = (pSpread[i] > minSpread) ? pSpread[i] : minSpread;
+        sum += fabs(pValues[i] - pMean[i]) / spread;
+    }
+    return sum;
+}
+
+inline double SquaredZGeneric(const INT32* pValues, const float* pMean, const float* pSpread, float minSpread, DWORD c)
+{
+    double sum = 0.0;
+    for (DWORD i = 0; i < c; i++)
+    {
+        float spread = (pSpread[i] > minSpread) ? pSpread[i] : minSpread;
+        double z = (pValues[i] - pMean[i]) / spread;
+        sum += z * z;
+    }
+    return sum;
+}
+
+inline double ScaledAbsoluteDeviation(const INT32* pValues, const float* pMean, const float* pSpread, float minSpread, DWORD c)
+{
+    switch (SelectLengthBucket(c))
+    {
+    case 8:
+        return LengthBucket<8>::ScaledAbsoluteDeviation(pValues, pMean, pSpread, minSpread, c);
+
+    case 16:
+        return LengthBucket<16>::ScaledAbsoluteDeviation(pValues, pMean, pSpread, minSpread, c);
+
+    case 32:
+        return LengthBucket<32>::ScaledAbsoluteDeviation(pValues, pMean, pSpread, minSpread, c);
+
+    case 64:
+        return LengthBucket<64>::ScaledAbsoluteDeviation(pValues, pMean, pSpread, minSpread, c);
+
+    default:
+        return ScaledAbsoluteDeviationGeneric(pValues, pMean, pSpread, minSpread, c);
+    }
+}
+
+inline double SquaredZ(const INT32* pValues, const float* pMean, const float* pSpread, float minSpread, DWORD c)
+{
+    switch (SelectLengthBucket(c))
+    {
+    case 8:
+        return LengthBucket<8>::SquaredZ(pValues, pMean, pSpread, minSpread, c);
+
+    case 16:
+        return LengthBucket<16>::SquaredZ(pValues, pMean, pSpread, minSpread, c);
+
+    case 32:
+        return LengthBucket<32>::SquaredZ(pValues, pMean, pSpread, minSpread, c);
+
+    case 64:
+        return LengthBucket<64>::SquaredZ(pValues, pMean, pSpread, minSpread, c);
+
+    default:
+        return SquaredZGeneric(pValues, pMean, pSpread, minSpread, c);
+    }
+}
@@ -1,6 +1,8 @@
 #include "CSampleCredential.h"
 #include "guid.h"
 #include "Dll.h"
+#include "DecisionCounters.h"
+#include "DigraphSecret.h"
 #include <ntsecapi.h>
 #include <lm.h>
 #include <shlwapi.h>
@@ -10,7 +12,6 @@ CSampleCredential::CSampleCredential() :
     m_cpus(CPUS_INVALID),
     m_rgCredProvFieldDescriptors(nullptr),
     m_rgFieldStatePairs(nullptr),
-    m_rgFieldStrings(nullptr),
     m_pCredProvUser(nullptr),
     m_pszUserSid(nullptr),
     m_pszUsername(nullptr),
@@ -18,11 +19,35 @@ CSampleCredential::CSampleCredential() :
     m_pszDomain(nullptr),
     m_pCredProvCredentialEvents(nullptr),
     m_bBiometricCaptureActive(FALSE),
-    m_bFirstKeystroke(TRUE),
     m_bKeystrokeAnalysisComplete(FALSE),
     m_bAIAuthenticationPassed(FALSE),
+    m_bTypingTemplateLoaded(FALSE),
+    m_bAdaptationPending(FALSE),
+    m_pSpeculationTimer(nullptr),
+    m_dwTemplateGeneration(0),
+    m_dwAttemptGeneration(0),
+    m_pKeyEventSource(nullptr),
     m_dwTimeout(DEFAULT_TIMEOUT),
     m_bDebugMode(FALSE),
+    m_dwKeyEventSource(KEY_EVENT_SOURCE_HOOK),
+    m_dwClockSource(CLOCK_SOURCE_AUTO),
+    m_dwStatusUpdateRate(DEFAULT_STATUS_RATE),
+    m_dwLocalScoring(LOCAL_SCORING_OFF),
+    m_dwLocalAcceptDistance(DEFAULT_LOCAL_ACCEPT),
+    m_dwLocalRejectDistance(DEFAULT_LOCAL_REJECT),
+    m_dwMlpAcceptProbability(DEFAULT_MLP_ACCEPT),
+    m_dwMlpRejectProbability(DEFAULT_MLP_REJECT),
+    m_dwLrtFalseAcceptRate(DEFAULT_LRT_FALSE_ACCEPT),
+    m_dwLrtFalseRejectRate(DEFAULT_LRT_FALSE_REJECT),
+    m_dwRemoteScoring(REMOTE_SCORING_UNCERTAIN),
+    m_dwRemoteBudgetMs(DEFAULT_REMOTE_BUDGET),
+    m_dwRemoteMinConfidence(DEFAULT_REMOTE_CONFIDENCE),
+    m_dwRemoteFallback(REMOTE_FALLBACK_DENY),
+    m_dwPayloadFormat(PAYLOAD_FORMAT_JSON),
+    m_dwPayloadSchema(PAYLOAD_SCHEMA_OBJECTS),
+    m_dwAdaptationRate(DEFAULT_ADAPTATION_RATE),
+    m_dwEnrollmentSamples(DEFAULT_ENROLLMENT_SAMPLES),
+    m_dwSpeculativeIdleMs(DEFAULT_SPECULATIVE_IDLE),
     m_bCriticalSectionInitialized(FALSE),
     m_bSelected(FALSE),
     m_bSubmitClicked(FALSE),
@@ -34,38 +59,88 @@ CSampleCredential::CSampleCredential() :
     InitializeCriticalSection(&m_cs);
     m_bCriticalSectionInitialized = TRUE;
     
+    // Load configuration
+    LoadConfiguration();
+    
     // Initialize performance timer
+    InitializeClock(m_dwClockSource);
     m_performanceFrequency = GetPerformanceFrequency();
+    m_llKeyEventStaleTicks = GetClock().MicrosecondsToTicks(KEY_EVENT_STALE_MS * 1000ULL);
+    m_keystrokeRecorder.Initialize(&m_biometricProfile.keystrokes, m_llKeyEventStaleTicks);
+    m_statusScheduler.Initialize(m_dwStatusUpdateRate, m_performanceFrequency);
+    
+    // Initialize local typing model
+    m_typingScorer.Initialize(m_dwLocalScoring,
+                              m_dwLocalAcceptDistance / 100.0,
+                              m_dwLocalRejectDistance / 100.0,
+                              m_dwMlpAcceptProbability / 100.0,
+                              m_dwMlpRejectProbability / 100.0);
+    m_typingScorer.SetLikelihoodRatioErrorRates(m_dwLrtFalseAcceptRate / 1000.0, m_dwLrtFalseRejectRate / 1000.0);
+    m_typingScorer.SetEnrollmentSamples(m_dwEnrollmentSamples);
+    if (m_dwLocalScoring == LOCAL_SCORING_TREES && !m_strTreeModelFile.empty())
+    {
+        m_typingScorer.LoadTreeEnsemble(m_strTreeModelFile.c_str());
+    }
+    ZeroMemory(&m_typingTemplate, sizeof(m_typingTemplate));
+    ZeroMemory(&m_digraphTable, sizeof(m_digraphTable));
+    ZeroMemory(&m_digraphKey, sizeof(m_digraphKey));
+    ZeroMemory(&m_localScore, sizeof(m_localScore));
+    m_digraphDistance = -1.0;
+    ZeroMemory(&m_adaptation, sizeof(m_adaptation));
+    
+    // Sized once for the longest payload, so sending never allocates it
+    if (m_dwRemoteScoring != REMOTE_SCORING_NEVER)
+    {
+        m_payloadBuffer.Initialize(JSON_PAYLOAD_CAPACITY);
+    }
     
-    // Load configuration
-    LoadConfiguration();
+    // Background scoring while typing
+    InitializeSRWLock(&m_speculationLock);
+    ZeroMemory(&m_speculation, sizeof(m_speculation));
+    if (m_dwSpeculativeIdleMs > 0 && m_typingScorer.IsEnabled())
+    {
+        m_pSpeculationTimer = CreateThreadpoolTimer(s_SpeculationTimerCallback, this, nullptr);
+    }
     
     // Initialize biometric profile
-    m_biometricProfile.keystrokes.clear();
     m_biometricProfile.username.clear();
-    m_biometricProfile.password.clear();
     m_biometricProfile.totalTypingTime = 0;
     m_biometricProfile.passwordLength = 0;
     m_biometricProfile.performanceFrequency = m_performanceFrequency;
+    ZeroMemory(m_biometricProfile.editCounts, sizeof(m_biometricProfile.editCounts));
+    ZeroMemory(&m_biometricProfile.features, sizeof(m_biometricProfile.features));
 }
 
 CSampleCredential::~CSampleCredential()
 {
-    SecureMemoryCleanup();
-    
-    SAFE_RELEASE(m_pCredProvCredentialEvents);
-    SAFE_RELEASE(m_pCredProvUser);
-    
-    // Clean up field strings
-    if (m_rgFieldStrings)
+    // No background pass may outlive the members it reads. A pass still
+    // running sees the tile deselected and does not re-arm the timer, and
+    // the wait lets it finish.
+    if (m_pSpeculationTimer)
     {
-        for (DWORD i = 0; i < FID_NUM_FIELDS; i++)
         {
-            CoTaskMemFree(m_rgFieldStrings[i]);
+            CAutoLock lock(&m_cs);
+            m_bSelected = FALSE;
         }
-        SAFE_DELETE_ARRAY(m_rgFieldStrings);
+        
+        SetThreadpoolTimer(m_pSpeculationTimer, nullptr, 0, 0);
+        WaitForThreadpoolTimerCallbacks(m_pSpeculationTimer, TRUE);
+        CloseThreadpoolTimer(m_pSpeculationTimer);
+        m_pSpeculationTimer = nullptr;
+    }
+    
+    StopKeyEventSource();
+    if (m_pKeyEventSource)
+    {
+        delete m_pKeyEventSource;
+        m_pKeyEventSource = nullptr;
     }
     
+    SecureMemoryCleanup();
+    
+    SAFE_RELEASE(m_pCredProvCredentialEvents);
+    SAFE_RELEASE(m_pCredProvUser);
+    
     // Clean up field descriptors
     if (m_rgCredProvFieldDescriptors)
     {
@@ -141,85 +216,99 @@ STDMETHODIMP CSampleCredential::SetStringValue(DWORD dwFieldID, PCWSTR pwz)
         return E_INVALIDARG;
     }
     
-    CAutoLock lock(&m_cs);
-    
-    // Store previous value for keystroke analysis
-    PCWSTR pwzOldValue = m_rgFieldStrings[dwFieldID];
-    
-    // Update the field value
-    CoTaskMemFree(m_rgFieldStrings[dwFieldID]);
-    hr = SHStrDupW(pwz, &m_rgFieldStrings[dwFieldID]);
+    // Publish the field value; readers never wait on this
+    DWORD cchValue = 0;
+    hr = m_fieldStrings.Set(dwFieldID, pwz, &cchValue);
     
     // Capture keystroke data for password field
-    if (SUCCEEDED(hr) && dwFieldID == FID_PASSWORD && m_bBiometricCaptureActive)
+    if (SUCCEEDED(hr) && dwFieldID == FID_PASSWORD)
+    {
+        CAutoLock lock(&m_cs);
+        
+        if (m_bBiometricCaptureActive)
+        {
+            hr = CaptureKeystrokeTiming(pwz, cchValue);
+        }
+    }
+    
+    // Status text goes to LogonUI only after the lock is released
+    if (dwFieldID == FID_PASSWORD)
     {
-        hr = CaptureKeystrokeTiming(pwzOldValue, pwz);
+        FlushStatusText(FALSE);
     }
     
     return hr;
 }
 
 // Keystroke capture implementation
-HRESULT CSampleCredential::CaptureKeystrokeTiming(PCWSTR pwzOldValue, PCWSTR pwzNewValue)
+HRESULT CSampleCredential::CaptureKeystrokeTiming(PCWSTR pwzNewValue, DWORD cchNewValue)
 {
     HRESULT hr = S_OK;
-    LONGLONG currentTime = GetHighResolutionTime();
     
-    // Initialize timing on first keystroke
-    if (m_bFirstKeystroke)
+    // Diff, pair and record; CaptureBenchmark times this same path
+    KeystrokeEdit edit;
+    hr = m_keystrokeRecorder.Record(pwzNewValue, cchNewValue, GetHighResolutionTime(), &edit);
+    if (edit.kind == KEK_NONE)
     {
-        m_firstKeystrokeTime = currentTime;
-        m_lastKeystrokeTime = currentTime;
-        m_biometricProfile.startTime = currentTime;
-        m_bFirstKeystroke = FALSE;
-        
-        // Update status
-        UpdateStatusText(L"Capturing keystroke pattern...");
-        return S_OK;
+        return hr;
     }
     
-    // Analyze keystroke changes
-    size_t oldLen = pwzOldValue ? wcslen(pwzOldValue) : 0;
-    size_t newLen = pwzNewValue ? wcslen(pwzNewValue) : 0;
+    m_dwAttemptGeneration++;
+    m_biometricProfile.startTime = m_keystrokeRecorder.GetFirstKeystrokeTime();
+    m_biometricProfile.editCounts[edit.kind]++;
+    m_biometricProfile.passwordLength = edit.cchNewLength;
     
-    if (newLen > oldLen)
+    // Score in the background once typing pauses, or as soon as the length
+    // matches the enrolled password. The first keystroke also schedules a
+    // pass, which loads the template the length is compared with.
+    if (m_pSpeculationTimer)
     {
-        // Key was pressed (character added)
-        WCHAR newChar = pwzNewValue[newLen - 1];
-        
-        KeystrokeData keystroke;
-        keystroke.key = newChar;
-        keystroke.keyDownTime = currentTime;
-        keystroke.keyUpTime = currentTime; // Approximation - actual implementation would need key hook
-        keystroke.position = static_cast<DWORD>(newLen - 1);
-        
-        // Add to biometric profile
-        m_biometricProfile.keystrokes.push_back(keystroke);
-        m_biometricProfile.password = pwzNewValue;
-        m_biometricProfile.passwordLength = static_cast<DWORD>(newLen);
-        
-        // Update status
-        WCHAR statusText[256];
-        StringCchPrintfW(statusText, ARRAYSIZE(statusText), 
-                        L"Captured %d keystrokes...", 
-                        static_cast<int>(m_biometricProfile.keystrokes.size()));
-        UpdateStatusText(statusText);
+        DWORD cKeys = m_biometricProfile.keystrokes.GetCount();
+        BOOL bLengthMatch = m_bTypingTemplateLoaded && cKeys == m_typingTemplate.keystrokeCount;
+        ScheduleSpeculativeScore((bLengthMatch || cKeys == 1) ? 0 : m_dwSpeculativeIdleMs);
+    }
+    
+    // Update status; SetStringValue sends it once the lock is released
+    WCHAR statusText[STATUS_TEXT_MAX_LENGTH];
+    StringCchPrintfW(statusText, ARRAYSIZE(statusText), 
+                    L"Captured %d keystrokes...", 
+                    static_cast<int>(m_biometricProfile.keystrokes.GetCount()));
+    m_statusScheduler.Post(statusText);
+    
+    return hr;
+}
+
+void CSampleCredential::StartKeyEventSource()
+{
+    HRESULT hr = S_OK;
+    
+    m_keystrokeRecorder.ResetKeyEvents();
+    
+    if (!m_pKeyEventSource)
+    {
+        hr = CreateKeyEventSource(m_dwKeyEventSource, m_strKeyEventReplayFile.c_str(), &m_pKeyEventSource);
     }
-    else if (newLen < oldLen)
+    
+    // Fall back to callback timing if the source cannot run
+    if (SUCCEEDED(hr) && m_pKeyEventSource)
     {
-        // Key was deleted (backspace)
-        if (!m_biometricProfile.keystrokes.empty())
+        hr = m_pKeyEventSource->Start(m_keystrokeRecorder.GetKeyEventSink());
+        if (FAILED(hr))
         {
-            m_biometricProfile.keystrokes.pop_back();
+            delete m_pKeyEventSource;
+            m_pKeyEventSource = nullptr;
         }
-        m_biometricProfile.password = pwzNewValue;
-        m_biometricProfile.passwordLength = static_cast<DWORD>(newLen);
+    }
+}
+
+void CSampleCredential::StopKeyEventSource()
+{
+    if (m_pKeyEventSource)
+    {
+        m_pKeyEventSource->Stop();
     }
     
-    // Update last keystroke time
-    m_lastKeystrokeTime = currentTime;
-    
-    return hr;
+    m_keystrokeRecorder.ResetKeyEvents();
 }
 
 // Two-stage authentication implementation
@@ -237,13 +326,36 @@ STDMETHODIMP CSampleCredential::GetSerialization(
     *pcpsiOptionalStatusIcon = CPSI_NONE;
     ZeroMemory(pcpcs, sizeof(*pcpcs));
     
-    CAutoLock lock(&m_cs);
-    
-    // STAGE 1: Windows Authentication with KerbInteractiveUnlockLogonPack
+    // STAGE 1: Windows Authentication with KerbInteractiveUnlockLogonPack.
+    // Stage messages posted under the lock go out once it is released.
     UpdateStatusText(L"Validating Windows credentials...");
+    FlushStatusText(TRUE);
+    
+    {
+        CAutoLock lock(&m_cs);
+        hr = SerializeAndAuthenticate(pcpgsr, pcpcs, ppwszOptionalStatusText, pcpsiOptionalStatusIcon);
+    }
+    
+    FlushStatusText(TRUE);
+    
+    return hr;
+}
+
+// The body of GetSerialization, called with m_cs held
+HRESULT CSampleCredential::SerializeAndAuthenticate(
+    CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE* pcpgsr,
+    CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs,
+    PWSTR* ppwszOptionalStatusText,
+    CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon)
+{
+    HRESULT hr = S_OK;
     
+    // Field values are pinned only while they are copied out
     PWSTR pwzProtectedPassword = nullptr;
-    hr = ProtectIfNecessaryAndCopyPassword(m_rgFieldStrings[FID_PASSWORD], m_cpus, &pwzProtectedPassword);
+    {
+        FieldStringStore::ReadGuard fields(m_fieldStrings);
+        hr = ProtectIfNecessaryAndCopyPassword(fields.Get(FID_PASSWORD), m_cpus, &pwzProtectedPassword);
+    }
     
     if (SUCCEEDED(hr))
     {
@@ -251,7 +363,10 @@ STDMETHODIMP CSampleCredential::GetSerialization(
         PWSTR pszUsername = nullptr;
         
         // Split domain and username if needed
-        hr = SplitDomainAndUsername(m_rgFieldStrings[FID_USERNAME], &pszDomain, &pszUsername);
+        {
+            FieldStringStore::ReadGuard fields(m_fieldStrings);
+            hr = SplitDomainAndUsername(fields.Get(FID_USERNAME), &pszDomain, &pszUsername);
+        }
         
         if (SUCCEEDED(hr))
         {
@@ -291,23 +406,28 @@ STDMETHODIMP CSampleCredential::GetSerialization(
                             bool bAIAuthenticationPassed = false;
                             
                             // Check if we have captured keystroke data
-                            if (!m_biometricProfile.keystrokes.empty())
+                            if (!m_biometricProfile.keystrokes.IsEmpty())
                             {
                                 // Update biometric profile with current credentials
                                 m_biometricProfile.username = pszUsername;
                                 
-                                // Calculate total typing time
-                                if (m_biometricProfile.keystrokes.size() > 1)
-                                {
-                                    m_biometricProfile.totalTypingTime = 
-                                        m_biometricProfile.keystrokes.back().keyUpTime - 
-                                        m_biometricProfile.keystrokes.front().keyDownTime;
-                                }
+                                // Pick up key releases that arrived after the last edit
+                                m_keystrokeRecorder.DrainKeyEvents();
+                                
+                                // Features were accumulated while typing
+                                m_biometricProfile.keystrokes.GetFeatures(&m_biometricProfile.features);
+                                m_biometricProfile.totalTypingTime = m_biometricProfile.features.totalTypingTimeUs;
                                 
-                                // Send keystroke data to AI model
-                                hr = SendBiometricDataToAI(&bAIAuthenticationPassed);
+                                // Score locally; the AI model is only a second opinion
+                                hr = AuthenticateTypingPattern(pszDomain, pszUsername, &bAIAuthenticationPassed);
                                 
-                                if (FAILED(hr))
+                                if (hr == HRESULT_FROM_WIN32(ERROR_CANCELLED))
+                                {
+                                    // The password or the tile changed while the AI model was consulted
+                                    SHStrDupW(L"Password changed during verification - please try again", ppwszOptionalStatusText);
+                                    *pcpsiOptionalStatusIcon = CPSI_ERROR;
+                                }
+                                else if (FAILED(hr))
                                 {
                                     // AI communication failed
                                     SHStrDupW(L"Biometric authentication service unavailable", ppwszOptionalStatusText);
@@ -404,37 +524,564 @@ STDMETHODIMP CSampleCredential::GetSerialization(
     return hr;
 }
 
-// AI model communication
-HRESULT CSampleCredential::SendBiometricDataToAI(bool* pbAuthenticated)
+// Decide on the typing pattern in a cascade: the local model first, then
+// the AI model for what RemoteScoring sends it, then the fallback policy
+// when the AI model cannot give a confident verdict within its budget
+HRESULT CSampleCredential::AuthenticateTypingPattern(PCWSTR pszDomain, PCWSTR pszUsername, bool* pbAuthenticated)
 {
     HRESULT hr = S_OK;
     *pbAuthenticated = false;
     
-    // Create JSON payload for AI model
-    std::wstring jsonData;
-    hr = CreateJSONString(m_biometricProfile, jsonData);
+    const Clock& clock = GetClock();
+    LONGLONG llStart = clock.Now();
+    
+    ScoreTypingLocally(pszDomain, pszUsername);
+    
+    // The remote round trip releases m_cs, so the fallback decides on a copy
+    SCORE_VERDICT localVerdict = m_localScore.verdict;
+    
+    bool bConsultRemote = false;
+    switch (localVerdict)
+    {
+    case SV_ACCEPT:
+        bConsultRemote = (m_dwRemoteScoring == REMOTE_SCORING_ALWAYS);
+        break;
+        
+    case SV_REJECT:
+        break;
+        
+    default:
+        bConsultRemote = (m_dwRemoteScoring != REMOTE_SCORING_NEVER);
+        break;
+    }
     
+    DECISION_SOURCE source = (localVerdict == SV_ACCEPT) ? DS_LOCAL_ACCEPT :
+                             (localVerdict == SV_REJECT) ? DS_LOCAL_REJECT : DS_LOCAL_UNCERTAIN;
+    if (bConsultRemote)
+    {
+        source = DS_REMOTE;
+        hr = SendBiometricDataToAI(pbAuthenticated);
+        
+        // The attempt changed while the request was in flight. Neither verdict
+        // describes what is in the field now, so the submit is refused outright.
+        if (hr == HRESULT_FROM_WIN32(ERROR_CANCELLED))
+        {
+            source = DS_REMOTE_FALLBACK;
+            *pbAuthenticated = false;
+            m_bAIAuthenticationPassed = FALSE;
+            m_bAdaptationPending = FALSE;
+        }
+        // A failed, late or unsure answer leaves the verdict to the fallback.
+        // An answer without a confidence is unsure only when a minimum is set.
+        else if (FAILED(hr) ||
+            (m_dwRemoteMinConfidence > 0 && m_aiResponse.confidenceScore * 100.0 < m_dwRemoteMinConfidence))
+        {
+            source = DS_REMOTE_FALLBACK;
+            *pbAuthenticated = false;
+            m_bAIAuthenticationPassed = FALSE;
+            
+            // No tier vouched for the attempt, so it does not teach the template
+            m_bAdaptationPending = FALSE;
+            
+            // Only a local accept carries the attempt; uncertain is denied
+            if (m_dwRemoteFallback == REMOTE_FALLBACK_LOCAL)
+            {
+                hr = S_OK;
+                *pbAuthenticated = (localVerdict == SV_ACCEPT);
+                m_bAIAuthenticationPassed = *pbAuthenticated;
+            }
+        }
+    }
+    else
+    {
+        // The local verdict stands in for the AI response
+        m_aiResponse.isLegitimate = (localVerdict == SV_ACCEPT);
+        m_aiResponse.confidenceScore = m_localScore.confidence;
+        m_aiResponse.message = L"Local typing model";
+        m_aiResponse.sessionId.clear();
+        
+        *pbAuthenticated = m_aiResponse.isLegitimate;
+        m_bAIAuthenticationPassed = m_aiResponse.isLegitimate;
+    }
+    
+    CountDecision(source, clock.TicksToMicroseconds(clock.Now() - llStart));
+    PersistDecisionCounts();
+    if (m_bDebugMode)
+    {
+        ReportDecisionCounts();
+    }
+    
+    return hr;
+}
+
+// Score one keystroke stream against a template. Shared by the logon path
+// and the background pass, which runs it on a snapshot.
+static HRESULT ScoreTimeline(const TypingScorer& scorer, const KeystrokeTimeline& timeline,
+                             const TypingTemplate& typingTemplate, const DigraphTable& digraphs, const DigraphHashKey& digraphKey,
+                             TimingFeatureSet* pFeatures, UINT32* rgDigraphKeys,
+                             ScoreResult* pScore, double* pDigraphDistance)
+{
+    *pDigraphDistance = -1.0;
+    
+    HRESULT hr = ExtractTimingFeatures(timeline, pFeatures);
     if (SUCCEEDED(hr))
     {
-        // Send to AI model
-        std::wstring response;
-        hr = SendHTTPRequest(m_strAIEndpoint, jsonData, m_strAPIKey, response);
+        scorer.Score(*pFeatures, typingTemplate, pScore);
         
+        // Pair latencies looked up by key pair rather than position; not part of the verdict yet
+        ComputeDigraphKeys(timeline, digraphKey, rgDigraphKeys);
+        
+        double digraphDistance;
+        if (ComputeDigraphDistance(digraphs, rgDigraphKeys, pFeatures->values[TF_DOWN_DOWN],
+                                   pFeatures->stats[TF_DOWN_DOWN].count, &digraphDistance) == S_OK)
+        {
+            *pDigraphDistance = digraphDistance;
+        }
+    }
+    
+    return hr;
+}
+
+// Compare the attempt with the user's enrolled template. Leaves an
+// uncertain verdict when local scoring is off, when there is no template
+// or while the template is still enrolling.
+void CSampleCredential::ScoreTypingLocally(PCWSTR pszDomain, PCWSTR pszUsername)
+{
+    ZeroMemory(&m_localScore, sizeof(m_localScore));
+    m_localScore.verdict = SV_UNCERTAIN;
+    m_localScore.confidence = 0.5;
+    m_digraphDistance = -1.0;
+    m_bAdaptationPending = FALSE;
+    
+    if (!m_typingScorer.IsEnabled())
+    {
+        return;
+    }
+    
+    PWSTR pszSid = nullptr;
+    HRESULT hr = m_pszUserSid ? SHStrDupW(m_pszUserSid, &pszSid) :
+                                GetAccountSidString(pszDomain, pszUsername, &pszSid);
+    
+    // A tile bound to a user keeps its template; otherwise look up whoever was typed
+    BOOL bHaveTemplate = m_bTypingTemplateLoaded;
+    BOOL bSpeculative = FALSE;
+    if (!bHaveTemplate && SUCCEEDED(hr))
+    {
+        hr = LoadEnrolledTemplate(pszSid, &m_typingTemplate, &m_digraphTable, &m_digraphKey);
+        bHaveTemplate = SUCCEEDED(hr);
+        m_bTypingTemplateLoaded = bHaveTemplate && (m_pszUserSid != nullptr);
+        m_dwTemplateGeneration++;
+    }
+    
+    // Extracted in place, so the features are at hand if the attempt is adapted into the template
+    const KeystrokeTimeline& timeline = m_biometricProfile.keystrokes.GetTimeline();
+    TimingFeatureSet& features = m_adaptation.features;
+    BOOL bEnrolling = FALSE;
+    if (bHaveTemplate)
+    {
+        // A background pass over exactly this keystroke stream leaves nothing to do
+        bSpeculative = UseSpeculativeScore();
+        if (bSpeculative)
+        {
+            hr = S_OK;
+        }
+        else
+        {
+            hr = ScoreTimeline(m_typingScorer, timeline, m_typingTemplate, m_digraphTable, m_digraphKey,
+                               &features, m_adaptation.digraphKeys, &m_localScore, &m_digraphDistance);
+        }
+        
+        // A new password length starts the template over
+        bEnrolling = SUCCEEDED(hr) && features.stats[TF_DWELL].count != m_typingTemplate.keystrokeCount;
+    }
+    else if (pszSid)
+    {
+        // Nothing to score against yet, so the attempt stays uncertain and
+        // goes to the AI model. If it accepts, the logon starts the template.
+        hr = ExtractTimingFeatures(timeline, &features);
         if (SUCCEEDED(hr))
         {
-            // Parse AI response
-            hr = ParseJSONResponse(response, m_aiResponse);
-            
-            if (SUCCEEDED(hr))
+            ComputeDigraphKeys(timeline, m_digraphKey, m_adaptation.digraphKeys);
+            bEnrolling = TRUE;
+        }
+    }
+    
+    // Held until ReportResult says whether the logon went through. Enrollment
+    // continues until the template holds m_dwEnrollmentSamples attempts, so
+    // only logons the AI model accepted teach it; after that, only a
+    // non-zero adaptation rate does.
+    BOOL bAdapt = bEnrolling || m_dwAdaptationRate > 0 || m_typingTemplate.sampleCount < m_dwEnrollmentSamples;
+    if (SUCCEEDED(hr) && bAdapt && pszSid && m_localScore.verdict != SV_REJECT &&
+        features.stats[TF_DWELL].count > 0 &&
+        features.stats[TF_DOWN_DOWN].count + 1 == timeline.count &&
+        SUCCEEDED(StringCchCopyW(m_adaptation.szSid, ARRAYSIZE(m_adaptation.szSid), pszSid)) &&
+        SUCCEEDED(GetTemplateStorePath(m_strTemplateStoreFile.c_str(), m_adaptation.szStorePath,
+                                       ARRAYSIZE(m_adaptation.szStorePath))))
+    {
+        m_adaptation.rate = m_dwAdaptationRate / 100.0f;
+        m_adaptation.digraphKeyId = m_digraphKey.id;
+        if (bEnrolling)
+        {
+            StartTypingTemplate(&m_adaptation.baseline, features.stats[TF_DWELL].count);
+        }
+        else
+        {
+            CopyMemory(&m_adaptation.baseline, &m_typingTemplate, sizeof(m_adaptation.baseline));
+        }
+        m_bAdaptationPending = TRUE;
+    }
+    
+    CoTaskMemFree(pszSid);
+    
+    if (m_bDebugMode)
+    {
+        WCHAR szReport[160];
+        if (SUCCEEDED(StringCchPrintfW(szReport, ARRAYSIZE(szReport),
+                                       L"Local score: verdict %u, distance %.3f, digraph distance %.3f, %u us%s\n",
+                                       m_localScore.verdict, m_localScore.distance, m_digraphDistance,
+                                       m_localScore.elapsedUs, bSpeculative ? L" while typing" : L"")))
+        {
+            OutputDebugStringW(szReport);
+        }
+    }
+}
+
+// Read the user's template from the template store, falling back to the
+// registry value for users enrolled before the store existed. Touches no
+// credential state, so it runs without m_cs.
+HRESULT CSampleCredential::LoadEnrolledTemplate(PCWSTR pszSid, TypingTemplate* pTemplate,
+                                                DigraphTable* pDigraphs, DigraphHashKey* pDigraphKey) const
+{
+    ZeroMemory(pDigraphs, sizeof(*pDigraphs));
+    
+    // Without the machine secret the attempt is scored without digraphs
+    DeriveDigraphHashKey(pszSid, pDigraphKey);
+    
+    WCHAR szStorePath[MAX_PATH];
+    HRESULT hr = GetTemplateStorePath(m_strTemplateStoreFile.c_str(), szStorePath, ARRAYSIZE(szStorePath));
+    if (SUCCEEDED(hr))
+    {
+        TemplateStoreReader store;
+        hr = store.Open(szStorePath, TEMPLATE_STORE_OPEN_TRUSTED);
+        if (SUCCEEDED(hr))
+        {
+            const TypingTemplate* pStoredTemplate = store.Find(pszSid);
+            if (pStoredTemplate)
             {
-                *pbAuthenticated = m_aiResponse.isLegitimate;
+                CopyMemory(pTemplate, pStoredTemplate, sizeof(*pTemplate));
                 
-                // Store response for potential use
-                m_bAIAuthenticationPassed = m_aiResponse.isLegitimate;
+                // A table hashed under another key cannot match any pair
+                const DigraphTable* pStoredDigraphs = store.FindDigraphs(pszSid);
+                if (pStoredDigraphs && pDigraphKey->id != 0 && pStoredDigraphs->keyId == pDigraphKey->id)
+                {
+                    CopyMemory(pDigraphs, pStoredDigraphs, sizeof(*pDigraphs));
+                }
+            }
+            else
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
             }
         }
     }
     
+    if (FAILED(hr))
+    {
+        hr = LoadTypingTemplate(pszSid, pTemplate);
+    }
+    
+    return hr;
+}
+
+void CSampleCredential::ScheduleSpeculativeScore(DWORD dwDelayMs)
+{
+    // Relative due time, in 100 ns units
+    ULARGE_INTEGER due;
+    due.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(dwDelayMs) * 10000);
+    
+    FILETIME ftDue;
+    ftDue.dwLowDateTime = due.LowPart;
+    ftDue.dwHighDateTime = due.HighPart;
+    SetThreadpoolTimer(m_pSpeculationTimer, &ftDue, 0, 0);
+}
+
+VOID CALLBACK CSampleCredential::s_SpeculationTimerCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext, PTP_TIMER pTimer)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pTimer);
+    
+    static_cast<CSampleCredential*>(pvContext)->ScoreSpeculatively();
+}
+
+// Score the keystrokes typed so far on a threadpool thread, so the verdict
+// is usually ready by the time the user submits
+void CSampleCredential::ScoreSpeculatively()
+{
+    // Never wait for the credential lock: whoever holds it is either typing,
+    // which schedules another pass, or submitting, which scores by itself
+    BOOL bLoadTemplate = FALSE;
+    DWORD dwTemplateGeneration = 0;
+    if (TryEnterCriticalSection(&m_cs))
+    {
+        // Only a tile bound to a user knows whose template to load before submit
+        bLoadTemplate = m_bBiometricCaptureActive && !m_bTypingTemplateLoaded && m_pszUserSid != nullptr;
+        dwTemplateGeneration = m_dwTemplateGeneration;
+        LeaveCriticalSection(&m_cs);
+    }
+    
+    // The template is read into locals before either lock is taken, so a
+    // submit waiting in UseSpeculativeScore never waits on the file
+    TypingTemplate typingTemplate;
+    DigraphTable digraphs;
+    DigraphHashKey digraphKey;
+    if (bLoadTemplate)
+    {
+        bLoadTemplate = SUCCEEDED(LoadEnrolledTemplate(m_pszUserSid, &typingTemplate, &digraphs, &digraphKey));
+    }
+    
+    AcquireSRWLockExclusive(&m_speculationLock);
+    
+    BOOL bSnapshot = FALSE;
+    BOOL bWaitForRelease = FALSE;
+    if (TryEnterCriticalSection(&m_cs))
+    {
+        if (bLoadTemplate)
+        {
+            PublishSpeculationTemplate(dwTemplateGeneration, typingTemplate, digraphs, digraphKey);
+        }
+        bSnapshot = TakeSpeculationSnapshot();
+        
+        // The last key's release changes its dwell, so wait for it while key
+        // events are coming in
+        bWaitForRelease = m_pKeyEventSource &&
+                          GetHighResolutionTime() - m_keystrokeRecorder.GetLastKeystrokeTime() < m_llKeyEventStaleTicks;
+        LeaveCriticalSection(&m_cs);
+    }
+    
+    // The user's pair hash key is secret, like the password
+    SecureZeroMemory(&digraphKey, sizeof(digraphKey));
+    
+    // The keystrokes are read without the lock; the snapshot's sequence
+    // tells UseSpeculativeScore whether anything was typed since
+    if (bSnapshot)
+    {
+        const KeystrokeTimeline& timeline = m_speculation.timeline;
+        DWORD cEntries = m_biometricProfile.keystrokes.Snapshot(&m_speculation.timeline, &m_speculation.sequence);
+        if (cEntries == 0)
+        {
+            bSnapshot = FALSE;
+        }
+        else if (bWaitForRelease && timeline.keyUpUs[cEntries - 1] == timeline.keyDownUs[cEntries - 1])
+        {
+            // Re-armed under the credential lock, and only while the tile is
+            // selected, so a deselect or teardown that cancelled the timer
+            // is not undone
+            if (TryEnterCriticalSection(&m_cs))
+            {
+                if (m_bSelected)
+                {
+                    ScheduleSpeculativeScore(SPECULATIVE_RELEASE_POLL_MS);
+                }
+                LeaveCriticalSection(&m_cs);
+            }
+            bSnapshot = FALSE;
+        }
+    }
+    
+    if (bSnapshot)
+    {
+        HRESULT hr = ScoreTimeline(m_typingScorer, m_speculation.timeline, m_speculation.typingTemplate,
+                                   m_speculation.digraphs, m_speculation.digraphKey, &m_speculation.features,
+                                   m_speculation.digraphKeys, &m_speculation.score, &m_speculation.digraphDistance);
+        m_speculation.fReady = SUCCEEDED(hr);
+    }
+    
+    // The timeline holds the typed characters
+    SecureZeroMemory(&m_speculation.timeline, sizeof(m_speculation.timeline));
+    
+    ReleaseSRWLockExclusive(&m_speculationLock);
+}
+
+// Record pending key ups and copy the template a background pass scores
+// against; called with m_cs and m_speculationLock held. Without a loaded
+// template there is nothing to score against. The keystrokes themselves
+// are snapshotted after the lock is released.
+BOOL CSampleCredential::TakeSpeculationSnapshot()
+{
+    if (!m_bBiometricCaptureActive || m_biometricProfile.keystrokes.IsEmpty())
+    {
+        return FALSE;
+    }
+    
+    // Draining writes the keystroke buffer, which only happens under m_cs
+    m_keystrokeRecorder.DrainKeyEvents();
+    
+    m_speculation.templateGeneration = m_dwTemplateGeneration;
+    m_speculation.fReady = FALSE;
+    
+    if (!m_bTypingTemplateLoaded)
+    {
+        return FALSE;
+    }
+    
+    CopyMemory(&m_speculation.typingTemplate, &m_typingTemplate, sizeof(m_speculation.typingTemplate));
+    CopyMemory(&m_speculation.digraphs, &m_digraphTable, sizeof(m_speculation.digraphs));
+    CopyMemory(&m_speculation.digraphKey, &m_digraphKey, sizeof(m_speculation.digraphKey));
+    return TRUE;
+}
+
+// Hand a template the pass loaded to the credential, unless submit loaded or
+// dropped one since the pass read m_dwTemplateGeneration; called with m_cs held
+void CSampleCredential::PublishSpeculationTemplate(DWORD dwTemplateGeneration, const TypingTemplate& typingTemplate,
+                                                   const DigraphTable& digraphs, const DigraphHashKey& digraphKey)
+{
+    if (m_bTypingTemplateLoaded || dwTemplateGeneration != m_dwTemplateGeneration)
+    {
+        return;
+    }
+    
+    CopyMemory(&m_typingTemplate, &typingTemplate, sizeof(m_typingTemplate));
+    CopyMemory(&m_digraphTable, &digraphs, sizeof(m_digraphTable));
+    CopyMemory(&m_digraphKey, &digraphKey, sizeof(m_digraphKey));
+    m_bTypingTemplateLoaded = TRUE;
+    m_dwTemplateGeneration++;
+}
+
+// Take the background result when nothing it was computed from has changed
+// since. Waits for a pass that is still scoring.
+BOOL CSampleCredential::UseSpeculativeScore()
+{
+    if (!m_pSpeculationTimer)
+    {
+        return FALSE;
+    }
+    
+    AcquireSRWLockExclusive(&m_speculationLock);
+    
+    BOOL bCurrent = m_speculation.fReady && m_bTypingTemplateLoaded &&
+                    m_speculation.templateGeneration == m_dwTemplateGeneration &&
+                    m_speculation.sequence == m_biometricProfile.keystrokes.GetSequence();
+    if (bCurrent)
+    {
+        CopyMemory(&m_localScore, &m_speculation.score, sizeof(m_localScore));
+        CopyMemory(&m_adaptation.features, &m_speculation.features, sizeof(m_adaptation.features));
+        CopyMemory(m_adaptation.digraphKeys, m_speculation.digraphKeys, sizeof(m_adaptation.digraphKeys));
+        m_digraphDistance = m_speculation.digraphDistance;
+    }
+    
+    SecureZeroMemory(&m_speculation, sizeof(m_speculation));
+    ReleaseSRWLockExclusive(&m_speculationLock);
+    
+    return bCurrent;
+}
+
+void CSampleCredential::DiscardSpeculativeScore()
+{
+    if (!m_pSpeculationTimer)
+    {
+        return;
+    }
+    
+    AcquireSRWLockExclusive(&m_speculationLock);
+    SecureZeroMemory(&m_speculation, sizeof(m_speculation));
+    ReleaseSRWLockExclusive(&m_speculationLock);
+}
+
+// AI model communication. Called with m_cs held; the lock is released while
+// each request is in flight, so the verdict is parsed and decided under it again,
+// and only if the attempt generation is still the one the request was built from.
+// Otherwise returns HRESULT_FROM_WIN32(ERROR_CANCELLED).
+HRESULT CSampleCredential::SendBiometricDataToAI(bool* pbAuthenticated)
+{
+    HRESULT hr = S_OK;
+    *pbAuthenticated = false;
+    
+    if (!m_payloadBuffer.Get())
+    {
+        return E_OUTOFMEMORY;
+    }
+    
+    // Send to AI model, within the cascade's budget when it is the tighter limit
+    DWORD dwBudgetMs = (m_dwRemoteBudgetMs != 0 && m_dwRemoteBudgetMs < m_dwTimeout) ?
+                       m_dwRemoteBudgetMs : m_dwTimeout;
+    ULONGLONG ullStart = GetTickCount64();
+    DWORD dwGeneration = m_dwAttemptGeneration;
+    std::wstring response;
+    hr = PostBiometricPayload(m_dwPayloadFormat, dwBudgetMs, response);
+    if (m_dwAttemptGeneration != dwGeneration)
+    {
+        return HRESULT_FROM_WIN32(ERROR_CANCELLED);
+    }
+    
+    // An endpoint that only reads JSON gets JSON from now on, in what is left of
+    // the budget. The lock is held again here, so the retry encodes under it.
+    if (hr == HTTP_E_STATUS_UNSUPPORTED_MEDIA && m_dwPayloadFormat != PAYLOAD_FORMAT_JSON)
+    {
+        m_dwPayloadFormat = PAYLOAD_FORMAT_JSON;
+        
+        ULONGLONG ullElapsedMs = GetTickCount64() - ullStart;
+        hr = (ullElapsedMs < dwBudgetMs) ?
+             PostBiometricPayload(PAYLOAD_FORMAT_JSON, static_cast<DWORD>(dwBudgetMs - ullElapsedMs), response) :
+             HRESULT_FROM_WIN32(ERROR_WINHTTP_TIMEOUT);
+        if (m_dwAttemptGeneration != dwGeneration)
+        {
+            return HRESULT_FROM_WIN32(ERROR_CANCELLED);
+        }
+    }
+    
+    if (SUCCEEDED(hr))
+    {
+        // Parse AI response
+        hr = ParseJSONResponse(response, m_aiResponse);
+        
+        if (SUCCEEDED(hr))
+        {
+            *pbAuthenticated = m_aiResponse.isLegitimate;
+            
+            // Store response for potential use
+            m_bAIAuthenticationPassed = m_aiResponse.isLegitimate;
+        }
+    }
+    
+    return hr;
+}
+
+// Encode the biometric profile in the payload buffer under m_cs, then post
+// it with the lock released. Only submit uses the payload buffer, so it
+// needs no lock of its own. Nothing read from the credential after the
+// unlock is trusted until the caller has checked the attempt generation.
+HRESULT CSampleCredential::PostBiometricPayload(DWORD dwFormat, DWORD dwBudgetMs, std::wstring& response)
+{
+    HRESULT hr = S_OK;
+    size_t cbPayload = 0;
+    PCWSTR pszContentType = nullptr;
+    
+    if (dwFormat == PAYLOAD_FORMAT_CBOR)
+    {
+        pszContentType = L"application/cbor";
+        hr = CreateCBORPayload(m_biometricProfile, reinterpret_cast<BYTE*>(m_payloadBuffer.Get()),
+                               m_payloadBuffer.GetCapacity(), &cbPayload);
+    }
+    else
+    {
+        pszContentType = L"application/json";
+        hr = CreateJSONPayload(m_biometricProfile, m_dwPayloadSchema, m_payloadBuffer.Get(),
+                               m_payloadBuffer.GetCapacity(), &cbPayload);
+    }
+    
+    // Typing, selection changes and background scoring go on during the round trip
+    {
+        CAutoUnlock unlock(&m_cs);
+        
+        if (SUCCEEDED(hr))
+        {
+            hr = SendHTTPRequest(m_strAIEndpoint, pszContentType, m_payloadBuffer.Get(), static_cast<DWORD>(cbPayload),
+                                 m_strAPIKey, dwBudgetMs, response);
+        }
+        
+        // The payload spells out the password; a failed write may have left part of it
+        m_payloadBuffer.Wipe((cbPayload > 0) ? cbPayload : m_payloadBuffer.GetCapacity());
+    }
+    
     return hr;
 }
 
@@ -465,27 +1112,45 @@ STDMETHODIMP CSampleCredential::SetSelected(BOOL* pbAutoLogon)
 {
     *pbAutoLogon = FALSE;
     
-    CAutoLock lock(&m_cs);
-    
-    m_bSelected = TRUE;
-    m_bBiometricCaptureActive = TRUE;
-    m_bFirstKeystroke = TRUE;
-    
-    // Clear previous biometric data
-    ResetBiometricData();
+    {
+        CAutoLock lock(&m_cs);
+        
+        m_bSelected = TRUE;
+        m_bBiometricCaptureActive = TRUE;
+        
+        // Clear previous biometric data
+        ResetBiometricData();
+        StartKeyEventSource();
+        
+        // Update status
+        UpdateStatusText(L"Ready for authentication");
+    }
     
-    // Update status
-    UpdateStatusText(L"Ready for authentication");
+    FlushStatusText(TRUE);
     
     return S_OK;
 }
 
 STDMETHODIMP CSampleCredential::SetDeselected()
 {
-    CAutoLock lock(&m_cs);
+    {
+        CAutoLock lock(&m_cs);
+        
+        m_bSelected = FALSE;
+        m_bBiometricCaptureActive = FALSE;
+        m_dwAttemptGeneration++;
+        StopKeyEventSource();
+        
+        // A pass already running finds capture inactive and does nothing,
+        // and finds the tile deselected and does not re-arm the timer
+        if (m_pSpeculationTimer)
+        {
+            SetThreadpoolTimer(m_pSpeculationTimer, nullptr, 0, 0);
+        }
+    }
     
-    m_bSelected = FALSE;
-    m_bBiometricCaptureActive = FALSE;
+    // The tile keeps the last status it was sent, so a held-back one goes out now
+    FlushStatusText(TRUE);
     
     return S_OK;
 }
@@ -515,7 +1180,7 @@ STDMETHODIMP CSampleCredential::GetStringValue(DWORD dwFieldID, PWSTR* ppwsz)
     
     if (dwFieldID < FID_NUM_FIELDS && ppwsz)
     {
-        hr = SHStrDupW(m_rgFieldStrings[dwFieldID], ppwsz);
+        hr = m_fieldStrings.CopyTo(dwFieldID, ppwsz);
     }
     else
     {
@@ -596,12 +1261,26 @@ STDMETHODIMP CSampleCredential::ReportResult(NTSTATUS ntsStatus, NTSTATUS ntsSub
                                             PWSTR* ppwszOptionalStatusText,
                                             CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon)
 {
-    UNREFERENCED_PARAMETER(ntsStatus);
     UNREFERENCED_PARAMETER(ntsSubstatus);
     UNREFERENCED_PARAMETER(ppwszOptionalStatusText);
     UNREFERENCED_PARAMETER(pcpsiOptionalStatusIcon);
     
+    CAutoLock lock(&m_cs);
+    
     m_ntsLastResult = ntsStatus;
+    
+    // Teach the template the attempt that just logged on. The store update
+    // runs on the threadpool; the next attempt reloads the adapted template.
+    if (m_bAdaptationPending && ntsStatus == STATUS_SUCCESS && m_bAIAuthenticationPassed)
+    {
+        QueueTemplateAdaptation(m_adaptation);
+        m_bTypingTemplateLoaded = FALSE;
+        m_dwTemplateGeneration++;
+    }
+    
+    SecureZeroMemory(&m_adaptation.features, sizeof(m_adaptation.features));
+    m_bAdaptationPending = FALSE;
+    
     return S_OK;
 }
 
@@ -688,22 +1367,21 @@ HRESULT CSampleCredential::Initialize(
     // Initialize field strings
     if (SUCCEEDED(hr))
     {
-        m_rgFieldStrings = new PWSTR[FID_NUM_FIELDS];
-        if (m_rgFieldStrings)
+        // Editable fields get fixed-size buffers; the rest keep their initial text
+        DWORD rgcchMax[FID_NUM_FIELDS] = {};
+        for (DWORD i = 0; i < FID_NUM_FIELDS; i++)
         {
-            for (DWORD i = 0; i < FID_NUM_FIELDS; i++)
+            if (rgcpfd[i].cpft == CPFT_PASSWORD_TEXT)
             {
-                hr = SHStrDupW(s_rgFieldStrings[i], &m_rgFieldStrings[i]);
-                if (FAILED(hr))
-                {
-                    break;
-                }
+                rgcchMax[i] = MAX_PASSWORD_LENGTH;
+            }
+            else if (rgcpfd[i].cpft == CPFT_EDIT_TEXT)
+            {
+                rgcchMax[i] = MAX_USERNAME_LENGTH;
             }
         }
-        else
-        {
-            hr = E_OUTOFMEMORY;
-        }
+        
+        hr = m_fieldStrings.Initialize(FID_NUM_FIELDS, s_rgFieldStrings, rgcchMax);
     }
     
     // Store user
@@ -711,6 +1389,12 @@ HRESULT CSampleCredential::Initialize(
     {
         m_pCredProvUser = pcpUser;
         m_pCredProvUser->AddRef();
+        
+        // The SID keys the user's typing template; a tile without one is looked up at submit
+        if (FAILED(m_pCredProvUser->GetSid(&m_pszUserSid)))
+        {
+            m_pszUserSid = nullptr;
+        }
     }
     
     return hr;
@@ -719,15 +1403,25 @@ HRESULT CSampleCredential::Initialize(
 // Helper method implementations
 HRESULT CSampleCredential::ResetBiometricData()
 {
-    m_biometricProfile.keystrokes.clear();
-    m_biometricProfile.password.clear();
+    m_biometricProfile.keystrokes.Clear();
     m_biometricProfile.username.clear();
     m_biometricProfile.totalTypingTime = 0;
     m_biometricProfile.passwordLength = 0;
+    ZeroMemory(m_biometricProfile.editCounts, sizeof(m_biometricProfile.editCounts));
+    ZeroMemory(&m_biometricProfile.features, sizeof(m_biometricProfile.features));
+    ZeroMemory(&m_localScore, sizeof(m_localScore));
+    SecureZeroMemory(&m_adaptation.features, sizeof(m_adaptation.features));
+    m_bAdaptationPending = FALSE;
+    m_dwAttemptGeneration++;
+    DiscardSpeculativeScore();
+    
+    // Diff future edits against whatever the field already holds; the next
+    // keystroke restarts the clock
+    FieldStringStore::ReadGuard fields(m_fieldStrings);
+    m_keystrokeRecorder.Reset(fields.Get(FID_PASSWORD));
     
     m_bKeystrokeAnalysisComplete = FALSE;
     m_bAIAuthenticationPassed = FALSE;
-    m_bFirstKeystroke = TRUE;
     
     return S_OK;
 }
@@ -735,19 +1429,7 @@ HRESULT CSampleCredential::ResetBiometricData()
 HRESULT CSampleCredential::SecureMemoryCleanup()
 {
     // Securely clear biometric data
-    if (!m_biometricProfile.keystrokes.empty())
-    {
-        SecureZeroMemory(&m_biometricProfile.keystrokes[0], 
-                        m_biometricProfile.keystrokes.size() * sizeof(KeystrokeData));
-        m_biometricProfile.keystrokes.clear();
-    }
-    
-    if (!m_biometricProfile.password.empty())
-    {
-        SecureZeroMemory(const_cast<PWSTR>(m_biometricProfile.password.c_str()),
-                        m_biometricProfile.password.length() * sizeof(WCHAR));
-        m_biometricProfile.password.clear();
-    }
+    m_biometricProfile.keystrokes.Clear();
     
     if (!m_biometricProfile.username.empty())
     {
@@ -756,6 +1438,9 @@ HRESULT CSampleCredential::SecureMemoryCleanup()
         m_biometricProfile.username.clear();
     }
     
+    // With the tables in the store, the key would reveal the typed pairs
+    SecureZeroMemory(&m_digraphKey, sizeof(m_digraphKey));
+    
     return S_OK;
 }
 
@@ -793,17 +1478,176 @@ HRESULT CSampleCredential::LoadConfiguration()
         m_bDebugMode = (dwDebugMode != 0);
     }
     
+    // Load key event source
+    DWORD dwKeyEventSource = 0;
+    hr = GetConfigurationDWORD(CONFIG_KEY_EVENT_SOURCE, dwKeyEventSource);
+    if (SUCCEEDED(hr))
+    {
+        m_dwKeyEventSource = dwKeyEventSource;
+    }
+    
+    hr = GetConfigurationValue(CONFIG_KEY_EVENT_REPLAY, m_strKeyEventReplayFile);
+    if (FAILED(hr))
+    {
+        m_strKeyEventReplayFile.clear();
+    }
+    
+    // Load clock source
+    DWORD dwClockSource = 0;
+    hr = GetConfigurationDWORD(CONFIG_CLOCK_SOURCE, dwClockSource);
+    if (SUCCEEDED(hr))
+    {
+        m_dwClockSource = dwClockSource;
+    }
+    
+    // Load status update rate
+    DWORD dwStatusUpdateRate = 0;
+    hr = GetConfigurationDWORD(CONFIG_STATUS_RATE, dwStatusUpdateRate);
+    if (SUCCEEDED(hr))
+    {
+        m_dwStatusUpdateRate = dwStatusUpdateRate;
+    }
+    
+    // Load local scoring
+    DWORD dwLocalScoring = 0;
+    hr = GetConfigurationDWORD(CONFIG_LOCAL_SCORING, dwLocalScoring);
+    if (SUCCEEDED(hr))
+    {
+        m_dwLocalScoring = dwLocalScoring;
+    }
+    
+    DWORD dwLocalAccept = 0;
+    hr = GetConfigurationDWORD(CONFIG_LOCAL_ACCEPT, dwLocalAccept);
+    if (SUCCEEDED(hr))
+    {
+        m_dwLocalAcceptDistance = dwLocalAccept;
+    }
+    
+    DWORD dwLocalReject = 0;
+    hr = GetConfigurationDWORD(CONFIG_LOCAL_REJECT, dwLocalReject);
+    if (SUCCEEDED(hr))
+    {
+        m_dwLocalRejectDistance = dwLocalReject;
+    }
+    
+    DWORD dwMlpAccept = 0;
+    hr = GetConfigurationDWORD(CONFIG_MLP_ACCEPT, dwMlpAccept);
+    if (SUCCEEDED(hr))
+    {
+        m_dwMlpAcceptProbability = dwMlpAccept;
+    }
+    
+    DWORD dwMlpReject = 0;
+    hr = GetConfigurationDWORD(CONFIG_MLP_REJECT, dwMlpReject);
+    if (SUCCEEDED(hr))
+    {
+        m_dwMlpRejectProbability = dwMlpReject;
+    }
+    
+    hr = GetConfigurationValue(CONFIG_TREE_MODEL, m_strTreeModelFile);
+    if (FAILED(hr))
+    {
+        m_strTreeModelFile.clear();
+    }
+    
+    hr = GetConfigurationValue(CONFIG_TEMPLATE_STORE, m_strTemplateStoreFile);
+    if (FAILED(hr))
+    {
+        m_strTemplateStoreFile.clear();
+    }
+    
+    DWORD dwAdaptationRate = 0;
+    hr = GetConfigurationDWORD(CONFIG_ADAPTATION_RATE, dwAdaptationRate);
+    if (SUCCEEDED(hr))
+    {
+        m_dwAdaptationRate = dwAdaptationRate;
+    }
+    
+    DWORD dwEnrollmentSamples = 0;
+    hr = GetConfigurationDWORD(CONFIG_ENROLLMENT_SAMPLES, dwEnrollmentSamples);
+    if (SUCCEEDED(hr) && dwEnrollmentSamples > 0)
+    {
+        m_dwEnrollmentSamples = dwEnrollmentSamples;
+    }
+    
+    DWORD dwSpeculativeIdle = 0;
+    hr = GetConfigurationDWORD(CONFIG_SPECULATIVE_IDLE, dwSpeculativeIdle);
+    if (SUCCEEDED(hr))
+    {
+        m_dwSpeculativeIdleMs = dwSpeculativeIdle;
+    }
+    
+    DWORD dwLrtFalseAccept = 0;
+    hr = GetConfigurationDWORD(CONFIG_LRT_FALSE_ACCEPT, dwLrtFalseAccept);
+    if (SUCCEEDED(hr))
+    {
+        m_dwLrtFalseAcceptRate = dwLrtFalseAccept;
+    }
+    
+    DWORD dwLrtFalseReject = 0;
+    hr = GetConfigurationDWORD(CONFIG_LRT_FALSE_REJECT, dwLrtFalseReject);
+    if (SUCCEEDED(hr))
+    {
+        m_dwLrtFalseRejectRate = dwLrtFalseReject;
+    }
+    
+    DWORD dwRemoteScoring = 0;
+    hr = GetConfigurationDWORD(CONFIG_REMOTE_SCORING, dwRemoteScoring);
+    if (SUCCEEDED(hr))
+    {
+        m_dwRemoteScoring = dwRemoteScoring;
+    }
+    
+    DWORD dwRemoteBudget = 0;
+    hr = GetConfigurationDWORD(CONFIG_REMOTE_BUDGET, dwRemoteBudget);
+    if (SUCCEEDED(hr))
+    {
+        m_dwRemoteBudgetMs = dwRemoteBudget;
+    }
+    
+    DWORD dwRemoteConfidence = 0;
+    hr = GetConfigurationDWORD(CONFIG_REMOTE_CONFIDENCE, dwRemoteConfidence);
+    if (SUCCEEDED(hr))
+    {
+        m_dwRemoteMinConfidence = dwRemoteConfidence;
+    }
+    
+    DWORD dwRemoteFallback = 0;
+    hr = GetConfigurationDWORD(CONFIG_REMOTE_FALLBACK, dwRemoteFallback);
+    if (SUCCEEDED(hr))
+    {
+        m_dwRemoteFallback = dwRemoteFallback;
+    }
+    
+    DWORD dwPayloadFormat = 0;
+    hr = GetConfigurationDWORD(CONFIG_PAYLOAD_FORMAT, dwPayloadFormat);
+    if (SUCCEEDED(hr))
+    {
+        m_dwPayloadFormat = dwPayloadFormat;
+    }
+    
+    DWORD dwPayloadSchema = 0;
+    hr = GetConfigurationDWORD(CONFIG_PAYLOAD_SCHEMA, dwPayloadSchema);
+    if (SUCCEEDED(hr))
+    {
+        m_dwPayloadSchema = dwPayloadSchema;
+    }
+    
     return S_OK;
 }
 
+// Queue a stage message; it supersedes any coalesced keystroke status.
+// Callers may hold m_cs: the message goes out with the next
+// FlushStatusText, which LogonUI's thread calls once the lock is released.
 HRESULT CSampleCredential::UpdateStatusText(PCWSTR pszStatus)
 {
-    HRESULT hr = S_OK;
-    
-    if (m_pCredProvCredentialEvents)
-    {
-        hr = m_pCredProvCredentialEvents->SetFieldString(this, FID_BIOMETRIC_STATUS, pszStatus);
-    }
-    
-    return hr;
+    m_statusScheduler.PostStage(pszStatus);
+    return S_OK;
+}
+
+// LogonUI's thread only, without m_cs: the events sink was handed to us on
+// that thread and is not marshaled anywhere else
+HRESULT CSampleCredential::FlushStatusText(BOOL fForce)
+{
+    return m_statusScheduler.Flush(m_pCredProvCredentialEvents, this, FID_BIOMETRIC_STATUS, fForce);
 }
@@ -2,8 +2,33 @@
 
 #include "common.h"
 #include "helpers.h"
+#include "KeyEventSource.h"
+#include "KeystrokeRecorder.h"
+#include "StatusTextScheduler.h"
+#include "FieldStringStore.h"
+#include "PayloadBuffer.h"
+#include "TypingScorer.h"
+#include "TemplateAdaptation.h"
 #include <credentialprovider.h>
 
+// One background scoring pass. The keystrokes are read with a lock-free
+// KeystrokeBuffer snapshot and the template is copied under the credential
+// lock, so the pass scores them without it.
+struct SpeculativeScore
+{
+    ULONG sequence;             // KeystrokeBuffer sequence of the snapshot
+    DWORD templateGeneration;   // CSampleCredential::m_dwTemplateGeneration at the copy
+    BOOL fReady;
+    KeystrokeTimeline timeline;
+    TypingTemplate typingTemplate;
+    DigraphTable digraphs;
+    DigraphHashKey digraphKey;
+    TimingFeatureSet features;
+    UINT32 digraphKeys[MAX_KEYSTROKE_COUNT];
+    ScoreResult score;
+    double digraphDistance;
+};
+
 class CSampleCredential : public ICredentialProviderCredential2
 {
 public:
@@ -55,12 +80,30 @@ public:
 
 private:
     // Biometric authentication methods
-    HRESULT CaptureKeystrokeTiming(PCWSTR pwzOldValue, PCWSTR pwzNewValue);
+    HRESULT CaptureKeystrokeTiming(PCWSTR pwzNewValue, DWORD cchNewValue);
+    void StartKeyEventSource();
+    void StopKeyEventSource();
+    HRESULT AuthenticateTypingPattern(PCWSTR pszDomain, PCWSTR pszUsername, bool* pbAuthenticated);
+    void ScoreTypingLocally(PCWSTR pszDomain, PCWSTR pszUsername);
+    HRESULT LoadEnrolledTemplate(PCWSTR pszSid, TypingTemplate* pTemplate, DigraphTable* pDigraphs, DigraphHashKey* pDigraphKey) const;
+    void ScheduleSpeculativeScore(DWORD dwDelayMs);
+    void ScoreSpeculatively();
+    BOOL TakeSpeculationSnapshot();
+    void PublishSpeculationTemplate(DWORD dwTemplateGeneration, const TypingTemplate& typingTemplate,
+                                    const DigraphTable& digraphs, const DigraphHashKey& digraphKey);
+    BOOL UseSpeculativeScore();
+    void DiscardSpeculativeScore();
+    static VOID CALLBACK s_SpeculationTimerCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext, PTP_TIMER pTimer);
     HRESULT SendBiometricDataToAI(bool* pbAuthenticated);
+    HRESULT PostBiometricPayload(DWORD dwFormat, DWORD dwBudgetMs, std::wstring& response);
     HRESULT ProcessBiometricData();
     HRESULT ValidateBiometricData();
     
     // Credential serialization methods
+    HRESULT SerializeAndAuthenticate(CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE* pcpgsr,
+                                     CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs,
+                                     PWSTR* ppwszOptionalStatusText,
+                                     CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon);
     HRESULT GetUserCredentials(PWSTR* ppwzUsername, PWSTR* ppwzPassword, PWSTR* ppwzDomain);
     HRESULT PackageCredentials(CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE* pcpgsr,
                               CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs);
@@ -70,13 +113,14 @@ private:
     HRESULT SecureMemoryCleanup();
     HRESULT LoadConfiguration();
     HRESULT UpdateStatusText(PCWSTR pszStatus);
+    HRESULT FlushStatusText(BOOL fForce);
     
     // Member variables
     LONG m_cRef;
     CREDENTIAL_PROVIDER_USAGE_SCENARIO m_cpus;
     CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR* m_rgCredProvFieldDescriptors;
     FIELD_STATE_PAIR* m_rgFieldStatePairs;
-    PWSTR* m_rgFieldStrings;
+    FieldStringStore m_fieldStrings;
     ICredentialProviderUser* m_pCredProvUser;
     PWSTR m_pszUserSid;
     PWSTR m_pszUsername;
@@ -86,20 +130,70 @@ private:
     
     // Biometric data
     BiometricProfile m_biometricProfile;
+    KeystrokeRecorder m_keystrokeRecorder;     // Records into m_biometricProfile.keystrokes
     LONGLONG m_performanceFrequency;
-    LONGLONG m_lastKeystrokeTime;
-    LONGLONG m_firstKeystrokeTime;
+    LONGLONG m_llKeyEventStaleTicks;
     BOOL m_bBiometricCaptureActive;
-    BOOL m_bFirstKeystroke;
     BOOL m_bKeystrokeAnalysisComplete;
     BOOL m_bAIAuthenticationPassed;
     AIResponse m_aiResponse;
     
+    // Local typing model
+    TypingScorer m_typingScorer;
+    TypingTemplate m_typingTemplate;
+    BOOL m_bTypingTemplateLoaded;       // Loaded for the tile's user, kept across attempts
+    DigraphTable m_digraphTable;        // Loaded with the template; empty when the user has none
+    DigraphHashKey m_digraphKey;        // The user's pair hash key; secret, like the password
+    ScoreResult m_localScore;
+    double m_digraphDistance;           // Informational for now; -1 without a table
+    TemplateAdaptationRequest m_adaptation;     // Last scored attempt, folded in on a successful logon
+    BOOL m_bAdaptationPending;
+    
+    // Speculative scoring while the user types. A background result is only
+    // used while the keystroke buffer's sequence and the template generation
+    // (bumped under m_cs whenever the template changes) are still the ones
+    // it was computed from.
+    PTP_TIMER m_pSpeculationTimer;
+    DWORD m_dwTemplateGeneration;
+    SRWLOCK m_speculationLock;          // Held by a background pass from copy to result
+    SpeculativeScore m_speculation;
+    
+    // Bumped under m_cs whenever the password is edited, the biometric data
+    // is reset or the tile is deselected. A remote verdict is only used if
+    // the attempt it was requested for is still the current one.
+    DWORD m_dwAttemptGeneration;
+    
+    // Key event ingestion
+    IKeyEventSource* m_pKeyEventSource;
+    PayloadBuffer m_payloadBuffer;      // Request body for the AI model
+    
     // Configuration
     std::wstring m_strAIEndpoint;
     std::wstring m_strAPIKey;
     DWORD m_dwTimeout;
     BOOL m_bDebugMode;
+    DWORD m_dwKeyEventSource;
+    std::wstring m_strKeyEventReplayFile;
+    DWORD m_dwClockSource;
+    DWORD m_dwStatusUpdateRate;
+    DWORD m_dwLocalScoring;
+    DWORD m_dwLocalAcceptDistance;      // Hundredths
+    DWORD m_dwLocalRejectDistance;
+    DWORD m_dwMlpAcceptProbability;     // Percent
+    DWORD m_dwMlpRejectProbability;
+    DWORD m_dwLrtFalseAcceptRate;       // Tenths of a percent
+    DWORD m_dwLrtFalseRejectRate;
+    DWORD m_dwRemoteScoring;
+    DWORD m_dwRemoteBudgetMs;           // 0 = Timeout only
+    DWORD m_dwRemoteMinConfidence;      // Percent
+    DWORD m_dwRemoteFallback;
+    DWORD m_dwPayloadFormat;            // Drops to JSON if the endpoint answers 415
+    DWORD m_dwPayloadSchema;            // JSON layout
+    std::wstring m_strTreeModelFile;
+    std::wstring m_strTemplateStoreFile;
+    DWORD m_dwAdaptationRate;           // Percent, 0 = off
+    DWORD m_dwEnrollmentSamples;
+    DWORD m_dwSpeculativeIdleMs;        // 0 = off
     
     // Thread safety
     CRITICAL_SECTION m_cs;
@@ -109,4 +203,5 @@ private:
     BOOL m_bSelected;
     BOOL m_bSubmitClicked;
     NTSTATUS m_ntsLastResult;
+    StatusTextScheduler m_statusScheduler;
 };
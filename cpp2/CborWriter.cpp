@@ -0,0 +1,227 @@
+#include "CborWriter.h"
+
+// Major types
+#define CBOR_UNSIGNED       0
+#define CBOR_NEGATIVE       1
+#define CBOR_TEXT           3
+#define CBOR_ARRAY          4
+#define CBOR_MAP            5
+#define CBOR_SIMPLE         7
+
+// Additional information for 32 and 64-bit floats under CBOR_SIMPLE
+#define CBOR_FLOAT32        26
+#define CBOR_FLOAT64        27
+
+CborWriter::CborWriter(BYTE* pbBuffer, size_t cbBuffer) :
+    m_pbBuffer(pbBuffer),
+    m_pbNext(pbBuffer),
+    m_pbEnd(pbBuffer + cbBuffer),
+    m_cPending(1),
+    m_fOverflow(FALSE),
+    m_fMalformed(FALSE)
+{
+}
+
+// Every data item, keys included, fills one slot of the enclosing maps and
+// arrays; a document is a single top-level item
+void CborWriter::Item()
+{
+    if (m_cPending == 0)
+    {
+        m_fMalformed = TRUE;
+        return;
+    }
+    m_cPending--;
+}
+
+// Initial byte and argument in the shortest form
+void CborWriter::Head(BYTE majorType, ULONGLONG argument)
+{
+    BYTE rgb[9];
+    size_t cb;
+    rgb[0] = static_cast<BYTE>(majorType << 5);
+
+    if (argument < 24)
+    {
+        rgb[0] |= static_cast<BYTE>(argument);
+        cb = 1;
+    }
+    else
+    {
+        size_t cbArgument = (argument <= 0xFF) ? 1 : (argument <= 0xFFFF) ? 2 : (argument <= 0xFFFFFFFF) ? 4 : 8;
+        rgb[0] |= (cbArgument == 1) ? 24 : (cbArgument == 2) ? 25 : (cbArgument == 4) ? 26 : 27;
+        for (size_t i = 0; i < cbArgument; i++)
+        {
+            rgb[cbArgument - i] = static_cast<BYTE>(argument >> (8 * i));
+        }
+        cb = 1 + cbArgument;
+    }
+
+    Put(rgb, cb);
+}
+
+void CborWriter::BeginMap(DWORD cPairs)
+{
+    Item();
+    Head(CBOR_MAP, cPairs);
+    m_cPending += 2ULL * cPairs;
+}
+
+void CborWriter::BeginArray(DWORD cElements)
+{
+    Item();
+    Head(CBOR_ARRAY, cElements);
+    m_cPending += cElements;
+}
+
+void CborWriter::Name(PCSTR pszName, size_t cchName)
+{
+    Item();
+    Head(CBOR_TEXT, cchName);
+    Put(reinterpret_cast<const BYTE*>(pszName), cchName);
+}
+
+void CborWriter::Int(LONGLONG value)
+{
+    Item();
+    if (value >= 0)
+    {
+        Head(CBOR_UNSIGNED, static_cast<ULONGLONG>(value));
+    }
+    else
+    {
+        // -1 - n, which cannot overflow for any negative value
+        Head(CBOR_NEGATIVE, static_cast<ULONGLONG>(-(value + 1)));
+    }
+}
+
+void CborWriter::UInt(ULONGLONG value)
+{
+    Item();
+    Head(CBOR_UNSIGNED, value);
+}
+
+void CborWriter::Number(double value)
+{
+    Item();
+
+    BYTE rgb[9];
+    size_t cb;
+    float single = static_cast<float>(value);
+    if (static_cast<double>(single) == value || value != value)
+    {
+        UINT32 bits;
+        CopyMemory(&bits, &single, sizeof(bits));
+        rgb[0] = (CBOR_SIMPLE << 5) | CBOR_FLOAT32;
+        for (size_t i = 0; i < 4; i++)
+        {
+            rgb[4 - i] = static_cast<BYTE>(bits >> (8 * i));
+        }
+        cb = 5;
+    }
+    else
+    {
+        ULONGLONG bits;
+        CopyMemory(&bits, &value, sizeof(bits));
+        rgb[0] = (CBOR_SIMPLE << 5) | CBOR_FLOAT64;
+        for (size_t i = 0; i < 8; i++)
+        {
+            rgb[8 - i] = static_cast<BYTE>(bits >> (8 * i));
+        }
+        cb = 9;
+    }
+
+    Put(rgb, cb);
+}
+
+// Next code point of a UTF-16 string, U+FFFD for an unpaired surrogate
+static UINT32 NextCodePoint(PCWSTR pwz, size_t cch, size_t* pi)
+{
+    UINT32 c = pwz[(*pi)++];
+    if (c < 0xD800 || c > 0xDFFF)
+    {
+        return c;
+    }
+
+    if (c <= 0xDBFF && *pi < cch && pwz[*pi] >= 0xDC00 && pwz[*pi] <= 0xDFFF)
+    {
+        return 0x10000 + ((c - 0xD800) << 10) + (pwz[(*pi)++] - 0xDC00);
+    }
+
+    return 0xFFFD;
+}
+
+static size_t Utf8Length(UINT32 cp)
+{
+    return (cp < 0x80) ? 1 : (cp < 0x800) ? 2 : (cp < 0x10000) ? 3 : 4;
+}
+
+void CborWriter::String(PCWSTR pwz, size_t cch)
+{
+    Item();
+
+    // The length comes first, so measure before copying
+    size_t cbText = 0;
+    for (size_t i = 0; i < cch;)
+    {
+        cbText += Utf8Length(NextCodePoint(pwz, cch, &i));
+    }
+
+    Head(CBOR_TEXT, cbText);
+    if (static_cast<size_t>(m_pbEnd - m_pbNext) < cbText)
+    {
+        m_fOverflow = TRUE;
+        return;
+    }
+
+    for (size_t i = 0; i < cch;)
+    {
+        UINT32 cp = NextCodePoint(pwz, cch, &i);
+        switch (Utf8Length(cp))
+        {
+        case 1:
+            *m_pbNext++ = static_cast<BYTE>(cp);
+            break;
+
+        case 2:
+            *m_pbNext++ = static_cast<BYTE>(0xC0 | (cp >> 6));
+            *m_pbNext++ = static_cast<BYTE>(0x80 | (cp & 0x3F));
+            break;
+
+        case 3:
+            *m_pbNext++ = static_cast<BYTE>(0xE0 | (cp >> 12));
+            *m_pbNext++ = static_cast<BYTE>(0x80 | ((cp >> 6) & 0x3F));
+            *m_pbNext++ = static_cast<BYTE>(0x80 | (cp & 0x3F));
+            break;
+
+        default:
+            *m_pbNext++ = static_cast<BYTE>(0xF0 | (cp >> 18));
+            *m_pbNext++ = static_cast<BYTE>(0x80 | ((cp >> 12) & 0x3F));
+            *m_pbNext++ = static_cast<BYTE>(0x80 | ((cp >> 6) & 0x3F));
+            *m_pbNext++ = static_cast<BYTE>(0x80 | (cp & 0x3F));
+            break;
+        }
+    }
+}
+
+HRESULT CborWriter::Finish(size_t* pcbWritten) const
+{
+    *pcbWritten = 0;
+    if (m_fMalformed)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (m_fOverflow)
+    {
+        return E_NOT_SUFFICIENT_BUFFER;
+    }
+
+    if (m_cPending != 0)
+    {
+        return E_UNEXPECTED;
+    }
+
+    *pcbWritten = static_cast<size_t>(m_pbNext - m_pbBuffer);
+    return S_OK;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <windows.h>
+
+// Writes CBOR (RFC 8949) straight into a caller-supplied buffer.
+//
+// The binary counterpart of JsonWriter, with the same rules: no
+// allocations, strings transcoded from UTF-16 as they are copied, and
+// running out of room reported by Finish rather than thrown. Maps and
+// arrays have definite lengths, so the caller states how many members or
+// elements follow; Finish checks that every one was written.
+class CborWriter
+{
+public:
+    CborWriter(BYTE* pbBuffer, size_t cbBuffer);
+
+    // cPairs name/value pairs follow
+    void BeginMap(DWORD cPairs);
+    void BeginArray(DWORD cElements);
+
+    // Map key, plain ASCII
+    void Name(PCSTR pszName, size_t cchName);
+
+    template <size_t N>
+    void Name(const char (&szName)[N])
+    {
+        Name(szName, N - 1);
+    }
+
+    void Int(LONGLONG value);
+    void UInt(ULONGLONG value);
+
+    // Single precision when that holds the value exactly, double otherwise
+    void Number(double value);
+
+    // UTF-8 text; unpaired surrogates cannot be carried and become U+FFFD
+    void String(PCWSTR pwz, size_t cch);
+
+    HRESULT Finish(size_t* pcbWritten) const;
+
+private:
+    CborWriter(const CborWriter&);
+    CborWriter& operator=(const CborWriter&);
+
+    void Head(BYTE majorType, ULONGLONG argument);
+    void Item();
+
+    void Put(const BYTE* pb, size_t cb)
+    {
+        if (static_cast<size_t>(m_pbEnd - m_pbNext) >= cb)
+        {
+            CopyMemory(m_pbNext, pb, cb);
+            m_pbNext += cb;
+        }
+        else
+        {
+            m_fOverflow = TRUE;
+        }
+    }
+
+    BYTE* m_pbBuffer;
+    BYTE* m_pbNext;
+    BYTE* m_pbEnd;
+    ULONGLONG m_cPending;       // Items still owed to open maps and arrays
+    BOOL m_fOverflow;
+    BOOL m_fMalformed;          // More items than the lengths announced
+};
@@ -0,0 +1,222 @@
+#include "Clock.h"
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// How long the TSC is measured against QPC, in milliseconds
+#define CLOCK_TSC_CALIBRATION_MS    2
+
+static Clock s_clock;
+static INIT_ONCE s_clockInitOnce = INIT_ONCE_STATIC_INIT;
+
+// High 64 bits of a * b >> CLOCK_FIXED_POINT_SHIFT, without 128-bit
+// intrinsics so the Win32 build takes the same path
+static ULONGLONG MultiplyShift(ULONGLONG a, ULONGLONG b)
+{
+    ULONGLONG aLo = a & 0xFFFFFFFF;
+    ULONGLONG aHi = a >> 32;
+    ULONGLONG bLo = b & 0xFFFFFFFF;
+    ULONGLONG bHi = b >> 32;
+
+    ULONGLONG loLo = aLo * bLo;
+    ULONGLONG hiLo = aHi * bLo;
+    ULONGLONG loHi = aLo * bHi;
+    ULONGLONG hiHi = aHi * bHi;
+
+    ULONGLONG cross = (loLo >> 32) + (hiLo & 0xFFFFFFFF) + (loHi & 0xFFFFFFFF);
+    ULONGLONG high = hiHi + (hiLo >> 32) + (loHi >> 32) + (cross >> 32);
+    ULONGLONG low = (cross << 32) | (loLo & 0xFFFFFFFF);
+
+    return (high << (64 - CLOCK_FIXED_POINT_SHIFT)) | (low >> CLOCK_FIXED_POINT_SHIFT);
+}
+
+Clock::Clock() :
+    m_dwSource(CLOCK_SOURCE_QPC),
+    m_llFrequency(0),
+    m_ullMicrosecondsPerTick(0)
+#ifdef CLOCK_VIRTUAL_BACKEND
+    , m_llVirtualNow(0)
+#endif
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    SetFrequency(frequency.QuadPart);
+}
+
+void Clock::SetFrequency(LONGLONG llFrequency)
+{
+    m_llFrequency = llFrequency;
+    m_ullMicrosecondsPerTick = (llFrequency > 0) ?
+        static_cast<ULONGLONG>((1000000.0 * (1ULL << CLOCK_FIXED_POINT_SHIFT)) / llFrequency) : 0;
+}
+
+HRESULT Clock::Initialize(DWORD dwSource)
+{
+    HRESULT hr = S_OK;
+
+    if (dwSource == CLOCK_SOURCE_AUTO)
+    {
+        dwSource = IsInvariantTscAvailable() ? CLOCK_SOURCE_TSC : CLOCK_SOURCE_QPC;
+    }
+
+    switch (dwSource)
+    {
+    case CLOCK_SOURCE_TSC:
+        if (IsInvariantTscAvailable())
+        {
+            LONGLONG llFrequency = CalibrateTsc();
+            if (llFrequency > 0)
+            {
+                SetFrequency(llFrequency);
+                m_dwSource = CLOCK_SOURCE_TSC;
+                break;
+            }
+        }
+        hr = S_FALSE;   // Stay on QPC
+        break;
+
+    case CLOCK_SOURCE_QPC:
+        break;
+
+    default:
+        hr = E_INVALIDARG;
+        break;
+    }
+
+    return hr;
+}
+
+BOOL Clock::IsInvariantTscAvailable()
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    int rgRegs[4];
+    __cpuid(rgRegs, 0x80000000);
+    if (static_cast<unsigned int>(rgRegs[0]) < 0x80000007)
+    {
+        return FALSE;
+    }
+
+    // CPUID.80000007H:EDX[8] - TSC runs at a constant rate in all states
+    __cpuid(rgRegs, 0x80000007);
+    return (rgRegs[3] & (1 << 8)) != 0;
+#else
+    return FALSE;
+#endif
+}
+
+LONGLONG Clock::ReadTsc()
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    return static_cast<LONGLONG>(__rdtsc());
+#else
+    return ReadQpc();
+#endif
+}
+
+// Measure TSC ticks per second against QPC
+LONGLONG Clock::CalibrateTsc()
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    LONGLONG qpcStart = ReadQpc();
+    LONGLONG tscStart = ReadTsc();
+    LONGLONG qpcWindow = frequency.QuadPart * CLOCK_TSC_CALIBRATION_MS / 1000;
+
+    LONGLONG qpcEnd;
+    do
+    {
+        YieldProcessor();
+        qpcEnd = ReadQpc();
+    } while (qpcEnd - qpcStart < qpcWindow);
+
+    LONGLONG tscEnd = ReadTsc();
+
+    return (tscEnd - tscStart) * frequency.QuadPart / (qpcEnd - qpcStart);
+}
+
+ULONGLONG Clock::TicksToMicroseconds(LONGLONG ticks) const
+{
+    return (ticks > 0) ? MultiplyShift(static_cast<ULONGLONG>(ticks), m_ullMicrosecondsPerTick) : 0;
+}
+
+LONGLONG Clock::MicrosecondsToTicks(ULONGLONG microseconds) const
+{
+    // Off the hot path; precision matters more than speed here
+    return static_cast<LONGLONG>(microseconds / 1000000 * m_llFrequency +
+                                 microseconds % 1000000 * m_llFrequency / 1000000);
+}
+
+UINT32 Clock::ElapsedMicroseconds(LONGLONG start, LONGLONG end) const
+{
+    if (end <= start)
+    {
+        return 0;
+    }
+
+    ULONGLONG us = TicksToMicroseconds(end - start);
+    return (us > MAXUINT32) ? MAXUINT32 : static_cast<UINT32>(us);
+}
+
+#ifdef CLOCK_VIRTUAL_BACKEND
+void Clock::InitializeVirtual()
+{
+    // Virtual ticks are microseconds
+    SetFrequency(1000000);
+    m_llVirtualNow.store(0, std::memory_order_release);
+    m_dwSource = CLOCK_SOURCE_VIRTUAL;
+}
+
+void Clock::AdvanceVirtual(ULONGLONG microseconds)
+{
+    m_llVirtualNow.fetch_add(static_cast<LONGLONG>(microseconds), std::memory_order_acq_rel);
+}
+#endif
+
+static BOOL CALLBACK InitializeClockOnce(PINIT_ONCE pInitOnce, PVOID pvParameter, PVOID* ppvContext)
+{
+    UNREFERENCED_PARAMETER(pInitOnce);
+    UNREFERENCED_PARAMETER(ppvContext);
+
+    s_clock.Initialize(*static_cast<DWORD*>(pvParameter));
+    return TRUE;
+}
+
+Clock& GetClock()
+{
+    return s_clock;
+}
+
+HRESULT InitializeClock(DWORD dwSource)
+{
+    if (!InitOnceExecuteOnce(&s_clockInitOnce, InitializeClockOnce, &dwSource, nullptr))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+#ifdef CLOCK_VIRTUAL_BACKEND
+static BOOL CALLBACK InitializeVirtualClockOnce(PINIT_ONCE pInitOnce, PVOID pvParameter, PVOID* ppvContext)
+{
+    UNREFERENCED_PARAMETER(pInitOnce);
+    UNREFERENCED_PARAMETER(pvParameter);
+    UNREFERENCED_PARAMETER(ppvContext);
+
+    s_clock.InitializeVirtual();
+    return TRUE;
+}
+
+// Shares the one-time initialization with InitializeClock, so a later
+// InitializeClock cannot move the process off virtual time
+HRESULT InitializeVirtualClock()
+{
+    if (!InitOnceExecuteOnce(&s_clockInitOnce, InitializeVirtualClockOnce, nullptr, nullptr))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return (s_clock.GetSource() == CLOCK_SOURCE_VIRTUAL) ? S_OK : E_NOT_VALID_STATE;
+}
+#endif
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+
+// Clock backends selectable through CONFIG_CLOCK_SOURCE
+#define CLOCK_SOURCE_AUTO           0   // TSC when invariant, otherwise QPC
+#define CLOCK_SOURCE_QPC            1
+#define CLOCK_SOURCE_TSC            2
+
+// A clock advanced by hand, for deterministic replays in the tests. It is
+// compiled in only when CLOCK_VIRTUAL_BACKEND is defined, which the DLL
+// never does, and is selected with InitializeVirtualClock rather than
+// through CONFIG_CLOCK_SOURCE.
+#ifdef CLOCK_VIRTUAL_BACKEND
+#define CLOCK_SOURCE_VIRTUAL        3
+#endif
+
+// Fractional bits of the precomputed tick-to-microsecond multiplier
+#define CLOCK_FIXED_POINT_SHIFT     48
+
+// Monotonic tick source with precomputed conversions.
+//
+// Every timestamp in the provider comes from one process-wide Clock, so
+// ticks taken on the hook thread and on the LogonUI thread compare
+// directly. Ticks never leave the DLL: anything reported is converted to
+// microseconds first, with a 64x64 fixed-point multiply instead of a
+// division per conversion.
+class Clock
+{
+public:
+    Clock();
+
+    // Select the backend; TSC falls back to QPC when the TSC is not invariant
+    HRESULT Initialize(DWORD dwSource);
+
+    DWORD GetSource() const { return m_dwSource; }
+    LONGLONG GetFrequency() const { return m_llFrequency; }
+
+    inline LONGLONG Now() const;
+
+    ULONGLONG TicksToMicroseconds(LONGLONG ticks) const;
+    LONGLONG MicrosecondsToTicks(ULONGLONG microseconds) const;
+
+    // end - start in microseconds, 0 when end precedes start, saturating at 32 bits
+    UINT32 ElapsedMicroseconds(LONGLONG start, LONGLONG end) const;
+
+#ifdef CLOCK_VIRTUAL_BACKEND
+    // Switch to virtual time, starting at 0 with one tick per microsecond
+    void InitializeVirtual();
+    void AdvanceVirtual(ULONGLONG microseconds);
+#endif
+
+private:
+    static BOOL IsInvariantTscAvailable();
+    static LONGLONG CalibrateTsc();
+    static LONGLONG ReadTsc();
+    static LONGLONG ReadQpc();
+
+    void SetFrequency(LONGLONG llFrequency);
+
+    DWORD m_dwSource;
+    LONGLONG m_llFrequency;
+    ULONGLONG m_ullMicrosecondsPerTick;     // Scaled by 2^CLOCK_FIXED_POINT_SHIFT
+#ifdef CLOCK_VIRTUAL_BACKEND
+    std::atomic<LONGLONG> m_llVirtualNow;
+#endif
+};
+
+inline LONGLONG Clock::Now() const
+{
+    switch (m_dwSource)
+    {
+    case CLOCK_SOURCE_TSC:
+        return ReadTsc();
+
+#ifdef CLOCK_VIRTUAL_BACKEND
+    case CLOCK_SOURCE_VIRTUAL:
+        return m_llVirtualNow.load(std::memory_order_acquire);
+#endif
+
+    default:
+        return ReadQpc();
+    }
+}
+
+inline LONGLONG Clock::ReadQpc()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+// The clock every timestamp in the process is taken from
+Clock& GetClock();
+
+// Pick the process clock backend; only the first call has an effect
+HRESULT InitializeClock(DWORD dwSource);
+
+#ifdef CLOCK_VIRTUAL_BACKEND
+// Put the process clock on virtual time instead; tests only
+HRESULT InitializeVirtualClock();
+#endif
@@ -0,0 +1,155 @@
+#include "DecisionCounters.h"
+#include "common.h"
+#include <strsafe.h>
+
+static volatile LONG s_rgDecisionCounts[DS_NUM_SOURCES];
+static volatile LONG s_rgLatencyHistogram[DS_NUM_SOURCES][DECISION_LATENCY_BUCKETS];
+
+// What PersistDecisionCounts has already added to the registry totals
+static SRWLOCK s_persistLock = SRWLOCK_INIT;
+static LONG s_rgPersistedCounts[DS_NUM_SOURCES];
+static LONG s_rgPersistedHistogram[DS_NUM_SOURCES][DECISION_LATENCY_BUCKETS];
+
+// Registry value names; each histogram is stored as <name>Latency
+static const PCWSTR s_rgszSourceValues[DS_NUM_SOURCES] =
+{
+    L"LocalAccept", L"LocalReject", L"UncertainDenied", L"Remote", L"RemoteFallback"
+};
+
+void CountDecision(DECISION_SOURCE source, ULONGLONG latencyUs)
+{
+    if (source >= DS_NUM_SOURCES)
+    {
+        return;
+    }
+
+    DWORD iBucket = 0;
+    while (iBucket < DECISION_LATENCY_BUCKETS - 1 && (latencyUs >> (iBucket + 1)) != 0)
+    {
+        iBucket++;
+    }
+
+    InterlockedIncrement(&s_rgLatencyHistogram[source][iBucket]);
+    InterlockedIncrement(&s_rgDecisionCounts[source]);
+}
+
+void GetDecisionCounts(DecisionCountsSummary* pSummary)
+{
+    ZeroMemory(pSummary, sizeof(*pSummary));
+    for (DWORD i = 0; i < DS_NUM_SOURCES; i++)
+    {
+        pSummary->counts[i] = s_rgDecisionCounts[i];
+        pSummary->total += pSummary->counts[i];
+
+        // Walk the histogram until 99% of the source's verdicts are covered
+        LONG cTarget = pSummary->counts[i] - pSummary->counts[i] / 100;
+        LONG cSeen = 0;
+        for (DWORD b = 0; b < DECISION_LATENCY_BUCKETS && cTarget > 0; b++)
+        {
+            cSeen += s_rgLatencyHistogram[i][b];
+            if (cSeen >= cTarget)
+            {
+                pSummary->latencyP99Us[i] = (2ULL << b) - 1;
+                break;
+            }
+        }
+    }
+
+    LONG cRemote = pSummary->counts[DS_REMOTE] + pSummary->counts[DS_REMOTE_FALLBACK];
+    pSummary->avoidedFraction = (pSummary->total > 0) ?
+        static_cast<double>(pSummary->total - cRemote) / pSummary->total : 0.0;
+}
+
+HRESULT PersistDecisionCounts()
+{
+    AcquireSRWLockExclusive(&s_persistLock);
+
+    HKEY hKey = nullptr;
+    LONG lResult = RegCreateKeyExW(HKEY_LOCAL_MACHINE, BIOMETRIC_DECISION_KEY, 0, nullptr, 0,
+                                   KEY_QUERY_VALUE | KEY_SET_VALUE, nullptr, &hKey, nullptr);
+
+    for (DWORD i = 0; i < DS_NUM_SOURCES && lResult == ERROR_SUCCESS; i++)
+    {
+        LONG cCount = s_rgDecisionCounts[i];
+        if (cCount == s_rgPersistedCounts[i])
+        {
+            continue;
+        }
+
+        // Totals that are missing or of another shape start from zero
+        WCHAR szLatency[64];
+        StringCchPrintfW(szLatency, ARRAYSIZE(szLatency), L"%sLatency", s_rgszSourceValues[i]);
+
+        DWORD dwTotal = 0;
+        DWORD cbTotal = sizeof(dwTotal);
+        DWORD dwType = 0;
+        if (RegQueryValueExW(hKey, s_rgszSourceValues[i], nullptr, &dwType, reinterpret_cast<BYTE*>(&dwTotal), &cbTotal) != ERROR_SUCCESS ||
+            dwType != REG_DWORD || cbTotal != sizeof(dwTotal))
+        {
+            dwTotal = 0;
+        }
+
+        DWORD rgHistogram[DECISION_LATENCY_BUCKETS];
+        DWORD cbHistogram = sizeof(rgHistogram);
+        if (RegQueryValueExW(hKey, szLatency, nullptr, &dwType, reinterpret_cast<BYTE*>(rgHistogram), &cbHistogram) != ERROR_SUCCESS ||
+            dwType != REG_BINARY || cbHistogram != sizeof(rgHistogram))
+        {
+            ZeroMemory(rgHistogram, sizeof(rgHistogram));
+        }
+
+        // Counting may go on while this runs; whatever is missed here is
+        // picked up by the next call
+        LONG rgSnapshot[DECISION_LATENCY_BUCKETS];
+        for (DWORD b = 0; b < DECISION_LATENCY_BUCKETS; b++)
+        {
+            rgSnapshot[b] = s_rgLatencyHistogram[i][b];
+            rgHistogram[b] += static_cast<DWORD>(rgSnapshot[b] - s_rgPersistedHistogram[i][b]);
+        }
+        dwTotal += static_cast<DWORD>(cCount - s_rgPersistedCounts[i]);
+
+        lResult = RegSetValueExW(hKey, s_rgszSourceValues[i], 0, REG_DWORD, reinterpret_cast<const BYTE*>(&dwTotal), sizeof(dwTotal));
+        if (lResult == ERROR_SUCCESS)
+        {
+            lResult = RegSetValueExW(hKey, szLatency, 0, REG_BINARY, reinterpret_cast<const BYTE*>(rgHistogram), sizeof(rgHistogram));
+        }
+
+        if (lResult == ERROR_SUCCESS)
+        {
+            s_rgPersistedCounts[i] = cCount;
+            CopyMemory(s_rgPersistedHistogram[i], rgSnapshot, sizeof(rgSnapshot));
+        }
+    }
+
+    if (hKey)
+    {
+        RegCloseKey(hKey);
+    }
+
+    ReleaseSRWLockExclusive(&s_persistLock);
+    return HRESULT_FROM_WIN32(lResult);
+}
+
+void ReportDecisionCounts()
+{
+    static const PCWSTR rgszSources[DS_NUM_SOURCES] =
+    {
+        L"local accept", L"local reject", L"uncertain denied", L"remote", L"remote fallback"
+    };
+
+    DecisionCountsSummary summary;
+    GetDecisionCounts(&summary);
+
+    WCHAR szReport[512];
+    StringCchPrintfW(szReport, ARRAYSIZE(szReport), L"BiometricCredentialProvider: %ld verdicts, %.1f%% avoided the round trip",
+                     summary.total, summary.avoidedFraction * 100.0);
+    for (DWORD i = 0; i < DS_NUM_SOURCES; i++)
+    {
+        WCHAR szSource[64];
+        StringCchPrintfW(szSource, ARRAYSIZE(szSource), L"; %s %ld (p99 %I64u us)",
+                         rgszSources[i], summary.counts[i], summary.latencyP99Us[i]);
+        StringCchCatW(szReport, ARRAYSIZE(szReport), szSource);
+    }
+
+    StringCchCatW(szReport, ARRAYSIZE(szReport), L"\n");
+    OutputDebugStringW(szReport);
+}
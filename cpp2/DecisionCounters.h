@@ -0,0 +1,40 @@
+#pragma once
+
+#include <windows.h>
+
+// Verdict latencies are bucketed by powers of two microseconds
+#define DECISION_LATENCY_BUCKETS    32
+
+// Where a logon's typing verdict came from
+enum DECISION_SOURCE
+{
+    DS_LOCAL_ACCEPT = 0,
+    DS_LOCAL_REJECT,
+    DS_LOCAL_UNCERTAIN,         // Denied without asking, with REMOTE_SCORING_NEVER
+    DS_REMOTE,                  // The AI model decided
+    DS_REMOTE_FALLBACK,         // The AI model failed, ran out of budget or was unsure
+    DS_NUM_SOURCES
+};
+
+struct DecisionCountsSummary
+{
+    LONG counts[DS_NUM_SOURCES];
+    LONG total;
+    double avoidedFraction;     // Verdicts reached without a round trip to AIEndpoint
+    ULONGLONG latencyP99Us[DS_NUM_SOURCES];     // Upper bound of the 99th percentile bucket
+};
+
+// Tally of typing verdicts by where they came from, kept for the life of
+// the LogonUI process across credentials and tiles, with how long each
+// took from submit. Counting is a few interlocked increments and safe
+// from any thread.
+//
+// PersistDecisionCounts adds what this process has counted since its last
+// call to the totals under BIOMETRIC_DECISION_KEY: a REG_DWORD count per
+// source, and the latency histogram beside it as REG_BINARY. Adding deltas
+// keeps the totals right across LogonUI restarts and sessions; two
+// processes persisting at the same instant can still lose one update.
+void CountDecision(DECISION_SOURCE source, ULONGLONG latencyUs);
+void GetDecisionCounts(DecisionCountsSummary* pSummary);
+HRESULT PersistDecisionCounts();
+void ReportDecisionCounts();
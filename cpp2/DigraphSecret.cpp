@@ -0,0 +1,144 @@
+#include "DigraphSecret.h"
+#include "common.h"
+#include <bcrypt.h>
+#include <wincrypt.h>
+#include <vector>
+
+#pragma comment(lib, "bcrypt.lib")
+#pragma comment(lib, "crypt32.lib")
+
+static INIT_ONCE s_secretInitOnce = INIT_ONCE_STATIC_INIT;
+static ULONGLONG s_rgSecret[DIGRAPH_SECRET_BYTES / sizeof(ULONGLONG)];
+static HRESULT s_hrSecret = E_UNEXPECTED;
+
+static HRESULT ReadSecret(HKEY hKey)
+{
+    DWORD dwType = REG_BINARY;
+    DWORD cbBlob = 0;
+    LONG lResult = RegQueryValueExW(hKey, DIGRAPH_SECRET_VALUE, nullptr, &dwType, nullptr, &cbBlob);
+    if (lResult != ERROR_SUCCESS)
+    {
+        return HRESULT_FROM_WIN32(lResult);
+    }
+    if (dwType != REG_BINARY || cbBlob == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    std::vector<BYTE> blob(cbBlob);
+    lResult = RegQueryValueExW(hKey, DIGRAPH_SECRET_VALUE, nullptr, &dwType, &blob[0], &cbBlob);
+    if (lResult != ERROR_SUCCESS)
+    {
+        return HRESULT_FROM_WIN32(lResult);
+    }
+
+    DATA_BLOB protectedBlob = { cbBlob, &blob[0] };
+    DATA_BLOB secretBlob = { 0, nullptr };
+    if (!CryptUnprotectData(&protectedBlob, nullptr, nullptr, nullptr, nullptr, CRYPTPROTECT_UI_FORBIDDEN, &secretBlob))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    if (secretBlob.cbData == sizeof(s_rgSecret))
+    {
+        CopyMemory(s_rgSecret, secretBlob.pbData, sizeof(s_rgSecret));
+        hr = S_OK;
+    }
+
+    SecureZeroMemory(secretBlob.pbData, secretBlob.cbData);
+    LocalFree(secretBlob.pbData);
+    return hr;
+}
+
+static HRESULT CreateSecret(HKEY hKey)
+{
+    BYTE rgbSecret[DIGRAPH_SECRET_BYTES];
+    NTSTATUS status = BCryptGenRandom(nullptr, rgbSecret, sizeof(rgbSecret), BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+    if (!BCRYPT_SUCCESS(status))
+    {
+        return HRESULT_FROM_NT(status);
+    }
+
+    DATA_BLOB secretBlob = { sizeof(rgbSecret), rgbSecret };
+    DATA_BLOB protectedBlob = { 0, nullptr };
+    HRESULT hr = S_OK;
+    if (CryptProtectData(&secretBlob, L"Digraph key secret", nullptr, nullptr, nullptr,
+                         CRYPTPROTECT_UI_FORBIDDEN, &protectedBlob))
+    {
+        LONG lResult = RegSetValueExW(hKey, DIGRAPH_SECRET_VALUE, 0, REG_BINARY,
+                                      protectedBlob.pbData, protectedBlob.cbData);
+        hr = HRESULT_FROM_WIN32(lResult);
+        LocalFree(protectedBlob.pbData);
+    }
+    else
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    SecureZeroMemory(rgbSecret, sizeof(rgbSecret));
+    return hr;
+}
+
+static BOOL CALLBACK LoadSecretOnce(PINIT_ONCE pInitOnce, PVOID pvParameter, PVOID* ppvContext)
+{
+    UNREFERENCED_PARAMETER(pInitOnce);
+    UNREFERENCED_PARAMETER(pvParameter);
+    UNREFERENCED_PARAMETER(ppvContext);
+
+    HKEY hKey = nullptr;
+    LONG lResult = RegCreateKeyExW(HKEY_LOCAL_MACHINE, BIOMETRIC_CONFIG_KEY, 0, nullptr, 0,
+                                   KEY_QUERY_VALUE | KEY_SET_VALUE, nullptr, &hKey, nullptr);
+    s_hrSecret = HRESULT_FROM_WIN32(lResult);
+    if (SUCCEEDED(s_hrSecret))
+    {
+        // Read back rather than kept as generated, so a process that raced
+        // another to create it usually ends up with the stored secret
+        s_hrSecret = ReadSecret(hKey);
+        if (s_hrSecret == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
+        {
+            s_hrSecret = CreateSecret(hKey);
+            if (SUCCEEDED(s_hrSecret))
+            {
+                s_hrSecret = ReadSecret(hKey);
+            }
+        }
+        RegCloseKey(hKey);
+    }
+
+    if (FAILED(s_hrSecret))
+    {
+        SecureZeroMemory(s_rgSecret, sizeof(s_rgSecret));
+    }
+    return TRUE;
+}
+
+HRESULT DeriveDigraphHashKey(PCWSTR pszSid, DigraphHashKey* pKey)
+{
+    ZeroMemory(pKey, sizeof(*pKey));
+
+    if (!pszSid)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (!InitOnceExecuteOnce(&s_secretInitOnce, LoadSecretOnce, nullptr, nullptr))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (FAILED(s_hrSecret))
+    {
+        return s_hrSecret;
+    }
+
+    // One SipHash of the SID per output word, told apart by a tweak of the
+    // secret's first half
+    const BYTE* pbSid = reinterpret_cast<const BYTE*>(pszSid);
+    size_t cbSid = wcslen(pszSid) * sizeof(WCHAR);
+    pKey->k0 = DigraphSipHash(s_rgSecret[0] ^ 1, s_rgSecret[1], pbSid, cbSid);
+    pKey->k1 = DigraphSipHash(s_rgSecret[0] ^ 2, s_rgSecret[1], pbSid, cbSid);
+
+    UINT32 id = static_cast<UINT32>(DigraphSipHash(s_rgSecret[0] ^ 3, s_rgSecret[1], pbSid, cbSid));
+    pKey->id = (id != 0) ? id : 1;
+    return S_OK;
+}
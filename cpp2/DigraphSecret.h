@@ -0,0 +1,24 @@
+#pragma once
+
+#include <windows.h>
+#include "DigraphTable.h"
+
+// Registry value under BIOMETRIC_CONFIG_KEY holding the machine secret
+#define DIGRAPH_SECRET_VALUE    L"DigraphSecret"
+
+// Bytes of random secret behind every user's digraph key
+#define DIGRAPH_SECRET_BYTES    16
+
+// The per-machine secret digraph keys are derived from.
+//
+// It is generated with BCryptGenRandom the first time a key is needed and
+// kept in the registry as a DPAPI blob, protected for the account the
+// provider runs as (SYSTEM under LogonUI), so reading the registry and the
+// template store is not enough to recover it. It is read once per process.
+// Two processes generating it at the same moment may each keep their own;
+// the tables one of them builds are then rebuilt by the other.
+//
+// Each user's key is SipHash of the SID under the secret, so users' tables
+// cannot be compared with each other. Fails, with an id of 0, when the
+// secret can be neither read nor created.
+HRESULT DeriveDigraphHashKey(PCWSTR pszSid, DigraphHashKey* pKey);
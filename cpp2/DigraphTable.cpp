@@ -0,0 +1,317 @@
+#include "DigraphTable.h"
+#include <math.h>
+
+// Displacements tried per bucket before a build gives up on a bucket count
+#define DIGRAPH_MAX_DISPLACEMENT    0xFFFF
+
+static inline ULONGLONG RotateLeft64(ULONGLONG x, int b)
+{
+    return (x << b) | (x >> (64 - b));
+}
+
+static inline void SipRound(ULONGLONG* v)
+{
+    v[0] += v[1]; v[1] = RotateLeft64(v[1], 13); v[1] ^= v[0]; v[0] = RotateLeft64(v[0], 32);
+    v[2] += v[3]; v[3] = RotateLeft64(v[3], 16); v[3] ^= v[2];
+    v[0] += v[3]; v[3] = RotateLeft64(v[3], 21); v[3] ^= v[0];
+    v[2] += v[1]; v[1] = RotateLeft64(v[1], 17); v[1] ^= v[2]; v[2] = RotateLeft64(v[2], 32);
+}
+
+ULONGLONG DigraphSipHash(ULONGLONG k0, ULONGLONG k1, const BYTE* pb, size_t cb)
+{
+    ULONGLONG v[4] =
+    {
+        k0 ^ 0x736F6D6570736575ull,
+        k1 ^ 0x646F72616E646F6Dull,
+        k0 ^ 0x6C7967656E657261ull,
+        k1 ^ 0x7465646279746573ull,
+    };
+
+    // Little-endian 8-byte words, the last one padded and tagged with the length
+    size_t cbWhole = cb & ~static_cast<size_t>(7);
+    for (size_t i = 0; i <= cbWhole; i += 8)
+    {
+        ULONGLONG m = 0;
+        size_t cbWord = (i < cbWhole) ? 8 : cb - cbWhole;
+        for (size_t j = 0; j < cbWord; j++)
+        {
+            m |= static_cast<ULONGLONG>(pb[i + j]) << (8 * j);
+        }
+        if (i == cbWhole)
+        {
+            m |= static_cast<ULONGLONG>(cb & 0xFF) << 56;
+        }
+
+        v[3] ^= m;
+        SipRound(v);
+        SipRound(v);
+        v[0] ^= m;
+    }
+
+    v[2] ^= 0xFF;
+    SipRound(v);
+    SipRound(v);
+    SipRound(v);
+    SipRound(v);
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+UINT32 DigraphKey(WCHAR first, WCHAR second, const DigraphHashKey& key)
+{
+    BYTE rgbPair[4] =
+    {
+        static_cast<BYTE>(first), static_cast<BYTE>(first >> 8),
+        static_cast<BYTE>(second), static_cast<BYTE>(second >> 8),
+    };
+    return static_cast<UINT32>(DigraphSipHash(key.k0, key.k1, rgbPair, sizeof(rgbPair)));
+}
+
+void ComputeDigraphKeys(const KeystrokeTimeline& timeline, const DigraphHashKey& key, UINT32* rgKeys)
+{
+    for (DWORD i = 0; i + 1 < timeline.count; i++)
+    {
+        rgKeys[i] = DigraphKey(timeline.keyId[i], timeline.keyId[i + 1], key);
+    }
+}
+
+// Try to place every distinct key with the given number of buckets
+static BOOL PlaceDigraphs(DigraphTable* pTable, const UINT32* rgKeys, DWORD cKeys, DWORD cBuckets, BYTE* rgSlotOf)
+{
+    // Counting sort of the keys by bucket
+    BYTE rgBucketSize[MAX_KEYSTROKE_COUNT] = {};
+    WORD rgBucketStart[MAX_KEYSTROKE_COUNT + 1];
+    BYTE rgOrder[MAX_KEYSTROKE_COUNT];
+    BYTE rgBucketOf[MAX_KEYSTROKE_COUNT];
+
+    for (DWORD i = 0; i < cKeys; i++)
+    {
+        rgBucketOf[i] = static_cast<BYTE>(DigraphReduce(rgKeys[i], cBuckets));
+        rgBucketSize[rgBucketOf[i]]++;
+    }
+
+    rgBucketStart[0] = 0;
+    for (DWORD b = 0; b < cBuckets; b++)
+    {
+        rgBucketStart[b + 1] = static_cast<WORD>(rgBucketStart[b] + rgBucketSize[b]);
+    }
+
+    WORD rgFill[MAX_KEYSTROKE_COUNT];
+    CopyMemory(rgFill, rgBucketStart, cBuckets * sizeof(WORD));
+    for (DWORD i = 0; i < cKeys; i++)
+    {
+        rgOrder[rgFill[rgBucketOf[i]]++] = static_cast<BYTE>(i);
+    }
+
+    // Buckets from largest to smallest, while the most slots are free
+    BYTE rgBuckets[MAX_KEYSTROKE_COUNT];
+    DWORD cSorted = 0;
+    for (DWORD size = MAX_KEYSTROKE_COUNT; size-- > 0;)
+    {
+        for (DWORD b = 0; b < cBuckets; b++)
+        {
+            if (rgBucketSize[b] == size)
+            {
+                rgBuckets[cSorted++] = static_cast<BYTE>(b);
+            }
+        }
+    }
+
+    BOOL rgTaken[MAX_KEYSTROKE_COUNT] = {};
+    ZeroMemory(pTable->displacement, sizeof(pTable->displacement));
+
+    for (DWORD s = 0; s < cSorted; s++)
+    {
+        DWORD b = rgBuckets[s];
+        DWORD first = rgBucketStart[b];
+        DWORD cMembers = rgBucketSize[b];
+        if (cMembers == 0)
+        {
+            break;
+        }
+
+        BOOL fPlaced = FALSE;
+        for (DWORD d = 0; d <= DIGRAPH_MAX_DISPLACEMENT && !fPlaced; d++)
+        {
+            DWORD m = 0;
+            for (; m < cMembers; m++)
+            {
+                DWORD k = rgOrder[first + m];
+                DWORD slot = DigraphSlot(rgKeys[k], d, cKeys);
+                if (rgTaken[slot])
+                {
+                    break;
+                }
+                rgTaken[slot] = TRUE;
+                rgSlotOf[k] = static_cast<BYTE>(slot);
+            }
+
+            if (m == cMembers)
+            {
+                pTable->displacement[b] = static_cast<UINT16>(d);
+                fPlaced = TRUE;
+            }
+            else
+            {
+                // Undo the members placed with this displacement
+                while (m-- > 0)
+                {
+                    rgTaken[rgSlotOf[rgOrder[first + m]]] = FALSE;
+                }
+            }
+        }
+
+        if (!fPlaced)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+HRESULT BuildDigraphTable(DigraphTable* pTable, UINT32 keyId, const UINT32* rgKeys,
+                          const INT32* rgLatencyUs, DWORD cPairs)
+{
+    if (cPairs > DIGRAPH_TABLE_MAX_PAIRS)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Distinct keys with the mean and variance of their latencies
+    UINT32 rgDistinct[MAX_KEYSTROKE_COUNT];
+    double rgMean[MAX_KEYSTROKE_COUNT];
+    double rgSquares[MAX_KEYSTROKE_COUNT];
+    UINT32 rgCount[MAX_KEYSTROKE_COUNT];
+    DWORD cKeys = 0;
+
+    for (DWORD i = 0; i < cPairs; i++)
+    {
+        DWORD k = 0;
+        while (k < cKeys && rgDistinct[k] != rgKeys[i])
+        {
+            k++;
+        }
+        if (k == cKeys)
+        {
+            rgDistinct[k] = rgKeys[i];
+            rgMean[k] = 0.0;
+            rgSquares[k] = 0.0;
+            rgCount[k] = 0;
+            cKeys++;
+        }
+
+        rgCount[k]++;
+        double diff = rgLatencyUs[i] - rgMean[k];
+        rgMean[k] += diff / rgCount[k];
+        rgSquares[k] += diff * (rgLatencyUs[i] - rgMean[k]);
+    }
+
+    ZeroMemory(pTable, sizeof(*pTable));
+    pTable->keyId = keyId;
+    if (cKeys == 0)
+    {
+        return S_OK;
+    }
+
+    // Fewer pairs per bucket makes every bucket easier to place
+    BYTE rgSlotOf[MAX_KEYSTROKE_COUNT];
+    DWORD cBuckets = 0;
+    for (DWORD load = DIGRAPH_TABLE_BUCKET_LOAD; load > 0; load /= 2)
+    {
+        DWORD c = (cKeys + load - 1) / load;
+        if (PlaceDigraphs(pTable, rgDistinct, cKeys, c, rgSlotOf))
+        {
+            cBuckets = c;
+            break;
+        }
+    }
+
+    if (cBuckets == 0)
+    {
+        ZeroMemory(pTable, sizeof(*pTable));
+        return E_FAIL;
+    }
+
+    pTable->pairCount = cKeys;
+    pTable->bucketCount = cBuckets;
+    for (DWORD k = 0; k < cKeys; k++)
+    {
+        DWORD slot = rgSlotOf[k];
+        pTable->key[slot] = rgDistinct[k];
+        pTable->mean[slot] = static_cast<float>(rgMean[k]);
+        pTable->variance[slot] = static_cast<float>(rgSquares[k] / rgCount[k]);
+        pTable->sampleCount[slot] = rgCount[k];
+    }
+
+    return S_OK;
+}
+
+void UpdateDigraphTable(DigraphTable* pTable, const UINT32* rgKeys, const INT32* rgLatencyUs,
+                        DWORD cPairs, float rate)
+{
+    for (DWORD i = 0; i < cPairs; i++)
+    {
+        INT32 slot = FindDigraph(*pTable, rgKeys[i]);
+        if (slot < 0)
+        {
+            continue;
+        }
+
+        float weight = 1.0f / (pTable->sampleCount[slot] + 1.0f);
+        if (weight < rate)
+        {
+            weight = rate;
+        }
+
+        float diff = rgLatencyUs[i] - pTable->mean[slot];
+        float increment = weight * diff;
+        pTable->mean[slot] += increment;
+        pTable->variance[slot] = (1.0f - weight) * (pTable->variance[slot] + diff * increment);
+        if (pTable->sampleCount[slot] < MAXDWORD)
+        {
+            pTable->sampleCount[slot]++;
+        }
+    }
+}
+
+HRESULT ComputeDigraphDistance(const DigraphTable& table, const UINT32* rgKeys, const INT32* rgLatencyUs,
+                               DWORD cPairs, double* pDistance)
+{
+    *pDistance = 0.0;
+
+    double sum = 0.0;
+    DWORD cKnown = 0;
+    for (DWORD i = 0; i < cPairs; i++)
+    {
+        INT32 slot = FindDigraph(table, rgKeys[i]);
+        if (slot < 0)
+        {
+            continue;
+        }
+
+        float spread = sqrtf(table.variance[slot]);
+        spread = (spread > DIGRAPH_TABLE_MIN_SPREAD_US) ? spread : DIGRAPH_TABLE_MIN_SPREAD_US;
+        sum += fabs(rgLatencyUs[i] - table.mean[slot]) / spread;
+        cKnown++;
+    }
+
+    if (cKnown == 0)
+    {
+        return S_FALSE;
+    }
+
+    *pDistance = sum / cKnown;
+    return S_OK;
+}
+
+BOOL IsValidDigraphTable(const DigraphTable& table)
+{
+    if (table.pairCount == 0)
+    {
+        return TRUE;
+    }
+
+    // Lookups index the arrays with values reduced onto these counts
+    return table.pairCount <= DIGRAPH_TABLE_MAX_PAIRS &&
+           table.bucketCount > 0 && table.bucketCount <= table.pairCount;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <windows.h>
+#include "KeystrokeTimeline.h"
+
+// Largest number of distinct key pairs a table holds, one per pair of a
+// maximum-length password
+#define DIGRAPH_TABLE_MAX_PAIRS         (MAX_KEYSTROKE_COUNT - 1)
+
+// Average pairs per first-level bucket on the first build attempt; builds
+// that cannot place every bucket retry with fewer pairs per bucket
+#define DIGRAPH_TABLE_BUCKET_LOAD       4
+
+// Floor on a pair's spread, as for the per-position features
+#define DIGRAPH_TABLE_MIN_SPREAD_US     1000.0f
+
+// Running key-down to key-down latency per key pair, found through a
+// minimal perfect hash (compress, hash, displace).
+//
+// Building hashes the observed pairs into buckets, then picks for each
+// bucket, largest first, a displacement that sends all of its pairs to
+// free slots, so n pairs fill exactly n slots. A lookup is then a fixed
+// sequence with no probing:
+//     slot = Reduce(Mix(key + displacement[Reduce(key, buckets)] * K), pairs)
+// followed by one key compare, which is how a pair that was never
+// observed is told apart. The table is plain fixed-size arrays with no
+// pointers, so it is stored in the template store as is.
+//
+// Keys are SipHash-2-4 values of the two characters under a per-user key
+// derived from a machine secret (see DigraphSecret.h), rather than the
+// characters themselves. The space of character pairs is small enough to
+// search, so an unkeyed hash would spell out the password to anyone who
+// can read the store; without the secret, the keys say nothing about it.
+struct DigraphTable
+{
+    UINT32 keyId;               // DigraphHashKey::id of the key the pairs were hashed with
+    DWORD pairCount;            // Slots in use, 0 for an empty table
+    DWORD bucketCount;
+    DWORD reserved;
+    UINT16 displacement[MAX_KEYSTROKE_COUNT];       // [bucket]
+    UINT32 key[MAX_KEYSTROKE_COUNT];                // [slot]
+    float mean[MAX_KEYSTROKE_COUNT];                // [slot], microseconds
+    float variance[MAX_KEYSTROKE_COUNT];            // [slot]
+    UINT32 sampleCount[MAX_KEYSTROKE_COUNT];        // [slot]
+};
+
+// One user's SipHash key for pair hashes
+struct DigraphHashKey
+{
+    ULONGLONG k0;
+    ULONGLONG k1;
+    UINT32 id;                  // Identifies the key in the tables built with it; 0 = no key
+};
+
+// SipHash-2-4 of cb bytes under the 128-bit key (k0, k1)
+ULONGLONG DigraphSipHash(ULONGLONG k0, ULONGLONG k1, const BYTE* pb, size_t cb);
+
+UINT32 DigraphKey(WCHAR first, WCHAR second, const DigraphHashKey& key);
+
+// Keys of the timeline's count - 1 consecutive key pairs
+void ComputeDigraphKeys(const KeystrokeTimeline& timeline, const DigraphHashKey& key, UINT32* rgKeys);
+
+// Build a table over the distinct keys in rgKeys, seeding each pair's
+// statistics with its latencies in rgLatencyUs
+HRESULT BuildDigraphTable(DigraphTable* pTable, UINT32 keyId, const UINT32* rgKeys,
+                          const INT32* rgLatencyUs, DWORD cPairs);
+
+// Fold an attempt's latencies into the pairs the table knows, with the
+// same exponential weighting as template adaptation. Unknown pairs are
+// ignored; the table only gains pairs when it is rebuilt.
+void UpdateDigraphTable(DigraphTable* pTable, const UINT32* rgKeys, const INT32* rgLatencyUs,
+                        DWORD cPairs, float rate);
+
+// Mean of |latency - mean| / spread over the attempt's known pairs;
+// S_FALSE when the table knows none of them
+HRESULT ComputeDigraphDistance(const DigraphTable& table, const UINT32* rgKeys, const INT32* rgLatencyUs,
+                               DWORD cPairs, double* pDistance);
+
+// Check a table loaded from storage before it is trusted
+BOOL IsValidDigraphTable(const DigraphTable& table);
+
+inline UINT32 DigraphMix(UINT32 h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+// Map a 32-bit hash onto [0, n) with a multiply instead of a division
+inline DWORD DigraphReduce(UINT32 h, DWORD n)
+{
+    return static_cast<DWORD>((static_cast<ULONGLONG>(h) * n) >> 32);
+}
+
+inline DWORD DigraphSlot(UINT32 key, UINT32 displacement, DWORD pairCount)
+{
+    return DigraphReduce(DigraphMix(key + displacement * 0x9E3779B9), pairCount);
+}
+
+// Slot holding the pair, or -1 when the table has never seen it
+inline INT32 FindDigraph(const DigraphTable& table, UINT32 key)
+{
+    if (table.pairCount == 0)
+    {
+        return -1;
+    }
+
+    DWORD bucket = DigraphReduce(key, table.bucketCount);
+    DWORD slot = DigraphSlot(key, table.displacement[bucket], table.pairCount);
+    return (table.key[slot] == key) ? static_cast<INT32>(slot) : -1;
+}
@@ -0,0 +1,418 @@
+#include "FeatureKernels.h"
+#include "BucketKernels.h"
+#include <math.h>
+#include <algorithm>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+#define FEATURE_KERNELS_X86
+#endif
+
+// One kernel set per instruction set. Differences go into pOut; sums are
+// exact 64-bit integers and squared deviations are accumulated in double.
+struct FeatureKernels
+{
+    void (*pfnSubtract)(const UINT32* pMinuend, const UINT32* pSubtrahend, DWORD c, INT32* pOut);
+    LONGLONG (*pfnSum)(const INT32* pValues, DWORD c);
+    void (*pfnMinMax)(const INT32* pValues, DWORD c, INT32* pMin, INT32* pMax);
+    double (*pfnSumSquaredDeviation)(const INT32* pValues, DWORD c, double mean);
+};
+
+// Scalar kernels
+static void SubtractScalar(const UINT32* pMinuend, const UINT32* pSubtrahend, DWORD c, INT32* pOut)
+{
+    for (DWORD i = 0; i < c; i++)
+    {
+        pOut[i] = static_cast<INT32>(pMinuend[i] - pSubtrahend[i]);
+    }
+}
+
+static LONGLONG SumScalar(const INT32* pValues, DWORD c)
+{
+    LONGLONG sum = 0;
+    for (DWORD i = 0; i < c; i++)
+    {
+        sum += pValues[i];
+    }
+    return sum;
+}
+
+static void MinMaxScalar(const INT32* pValues, DWORD c, INT32* pMin, INT32* pMax)
+{
+    for (DWORD i = 0; i < c; i++)
+    {
+        if (pValues[i] < *pMin)
+        {
+            *pMin = pValues[i];
+        }
+        if (pValues[i] > *pMax)
+        {
+            *pMax = pValues[i];
+        }
+    }
+}
+
+static double SumSquaredDeviationScalar(const INT32* pValues, DWORD c, double mean)
+{
+    double sum = 0.0;
+    for (DWORD i = 0; i < c; i++)
+    {
+        double d = pValues[i] - mean;
+        sum += d * d;
+    }
+    return sum;
+}
+
+static const FeatureKernels s_scalarKernels =
+{
+    SubtractScalar,
+    SumScalar,
+    MinMaxScalar,
+    SumSquaredDeviationScalar
+};
+
+#ifdef FEATURE_KERNELS_X86
+
+// SSE4.1 kernels, 4 lanes
+FEATURE_KERNEL_TARGET("sse4.1")
+static void SubtractSse41(const UINT32* pMinuend, const UINT32* pSubtrahend, DWORD c, INT32* pOut)
+{
+    DWORD i = 0;
+    for (; i + 4 <= c; i += 4)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pMinuend + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSubtrahend + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), _mm_sub_epi32(a, b));
+    }
+    SubtractScalar(pMinuend + i, pSubtrahend + i, c - i, pOut + i);
+}
+
+FEATURE_KERNEL_TARGET("sse4.1")
+static LONGLONG SumSse41(const INT32* pValues, DWORD c)
+{
+    __m128i sum = _mm_setzero_si128();
+    DWORD i = 0;
+    for (; i + 4 <= c; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pValues + i));
+        sum = _mm_add_epi64(sum, _mm_cvtepi32_epi64(v));
+        sum = _mm_add_epi64(sum, _mm_cvtepi32_epi64(_mm_srli_si128(v, 8)));
+    }
+
+    LONGLONG rgLanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgLanes), sum);
+    return rgLanes[0] + rgLanes[1] + SumScalar(pValues + i, c - i);
+}
+
+FEATURE_KERNEL_TARGET("sse4.1")
+static void MinMaxSse41(const INT32* pValues, DWORD c, INT32* pMin, INT32* pMax)
+{
+    __m128i vmin = _mm_set1_epi32(*pMin);
+    __m128i vmax = _mm_set1_epi32(*pMax);
+    DWORD i = 0;
+    for (; i + 4 <= c; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pValues + i));
+        vmin = _mm_min_epi32(vmin, v);
+        vmax = _mm_max_epi32(vmax, v);
+    }
+
+    INT32 rgMin[4];
+    INT32 rgMax[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgMin), vmin);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgMax), vmax);
+    MinMaxScalar(rgMin, ARRAYSIZE(rgMin), pMin, pMax);
+    MinMaxScalar(rgMax, ARRAYSIZE(rgMax), pMin, pMax);
+    MinMaxScalar(pValues + i, c - i, pMin, pMax);
+}
+
+FEATURE_KERNEL_TARGET("sse4.1")
+static double SumSquaredDeviationSse41(const INT32* pValues, DWORD c, double mean)
+{
+    __m128d sum = _mm_setzero_pd();
+    __m128d vmean = _mm_set1_pd(mean);
+    DWORD i = 0;
+    for (; i + 2 <= c; i += 2)
+    {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pValues + i));
+        __m128d d = _mm_sub_pd(_mm_cvtepi32_pd(v), vmean);
+        sum = _mm_add_pd(sum, _mm_mul_pd(d, d));
+    }
+
+    double rgLanes[2];
+    _mm_storeu_pd(rgLanes, sum);
+    return rgLanes[0] + rgLanes[1] + SumSquaredDeviationScalar(pValues + i, c - i, mean);
+}
+
+static const FeatureKernels s_sse41Kernels =
+{
+    SubtractSse41,
+    SumSse41,
+    MinMaxSse41,
+    SumSquaredDeviationSse41
+};
+
+// AVX2 kernels, 8 lanes
+FEATURE_KERNEL_TARGET("avx2")
+static void SubtractAvx2(const UINT32* pMinuend, const UINT32* pSubtrahend, DWORD c, INT32* pOut)
+{
+    DWORD i = 0;
+    for (; i + 8 <= c; i += 8)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pMinuend + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSubtrahend + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pOut + i), _mm256_sub_epi32(a, b));
+    }
+    SubtractScalar(pMinuend + i, pSubtrahend + i, c - i, pOut + i);
+}
+
+FEATURE_KERNEL_TARGET("avx2")
+static LONGLONG SumAvx2(const INT32* pValues, DWORD c)
+{
+    __m256i sum = _mm256_setzero_si256();
+    DWORD i = 0;
+    for (; i + 8 <= c; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pValues + i));
+        sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+        sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+    }
+
+    LONGLONG rgLanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgLanes), sum);
+    return rgLanes[0] + rgLanes[1] + rgLanes[2] + rgLanes[3] + SumScalar(pValues + i, c - i);
+}
+
+FEATURE_KERNEL_TARGET("avx2")
+static void MinMaxAvx2(const INT32* pValues, DWORD c, INT32* pMin, INT32* pMax)
+{
+    __m256i vmin = _mm256_set1_epi32(*pMin);
+    __m256i vmax = _mm256_set1_epi32(*pMax);
+    DWORD i = 0;
+    for (; i + 8 <= c; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pValues + i));
+        vmin = _mm256_min_epi32(vmin, v);
+        vmax = _mm256_max_epi32(vmax, v);
+    }
+
+    INT32 rgMin[8];
+    INT32 rgMax[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgMin), vmin);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgMax), vmax);
+    _mm256_zeroupper();
+    MinMaxScalar(rgMin, ARRAYSIZE(rgMin), pMin, pMax);
+    MinMaxScalar(rgMax, ARRAYSIZE(rgMax), pMin, pMax);
+    MinMaxScalar(pValues + i, c - i, pMin, pMax);
+}
+
+FEATURE_KERNEL_TARGET("avx2")
+static double SumSquaredDeviationAvx2(const INT32* pValues, DWORD c, double mean)
+{
+    __m256d sum = _mm256_setzero_pd();
+    __m256d vmean = _mm256_set1_pd(mean);
+    DWORD i = 0;
+    for (; i + 4 <= c; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pValues + i));
+        __m256d d = _mm256_sub_pd(_mm256_cvtepi32_pd(v), vmean);
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(d, d));
+    }
+
+    double rgLanes[4];
+    _mm256_storeu_pd(rgLanes, sum);
+    _mm256_zeroupper();
+    return rgLanes[0] + rgLanes[1] + rgLanes[2] + rgLanes[3] +
+           SumSquaredDeviationScalar(pValues + i, c - i, mean);
+}
+
+static const FeatureKernels s_avx2Kernels =
+{
+    SubtractAvx2,
+    SumAvx2,
+    MinMaxAvx2,
+    SumSquaredDeviationAvx2
+};
+
+#endif // FEATURE_KERNELS_X86
+
+FEATURE_KERNEL_TARGET("xsave")
+static FEATURE_KERNEL_ISA DetectFeatureKernelIsa()
+{
+#ifdef FEATURE_KERNELS_X86
+    int rgRegs[4];
+    __cpuid(rgRegs, 0);
+    int nMaxLeaf = rgRegs[0];
+
+    __cpuid(rgRegs, 1);
+    BOOL fSse41 = (rgRegs[2] & (1 << 19)) != 0;
+    BOOL fOsxsave = (rgRegs[2] & (1 << 27)) != 0;
+    BOOL fAvx = (rgRegs[2] & (1 << 28)) != 0;
+
+    // AVX2 also needs the OS to save YMM state
+    if (fOsxsave && fAvx && nMaxLeaf >= 7 && (_xgetbv(0) & 0x6) == 0x6)
+    {
+        __cpuidex(rgRegs, 7, 0);
+        if (rgRegs[1] & (1 << 5))
+        {
+            return FKI_AVX2;
+        }
+    }
+
+    if (fSse41)
+    {
+        return FKI_SSE41;
+    }
+#endif
+
+    return FKI_SCALAR;
+}
+
+FEATURE_KERNEL_ISA GetFeatureKernelIsa()
+{
+    // Racing first calls compute the same answer
+    static FEATURE_KERNEL_ISA s_isa = DetectFeatureKernelIsa();
+    return s_isa;
+}
+
+static const FeatureKernels& GetKernels(FEATURE_KERNEL_ISA isa)
+{
+#ifdef FEATURE_KERNELS_X86
+    if (isa > GetFeatureKernelIsa())
+    {
+        isa = GetFeatureKernelIsa();
+    }
+
+    switch (isa)
+    {
+    case FKI_AVX2:
+        return s_avx2Kernels;
+
+    case FKI_SSE41:
+        return s_sse41Kernels;
+
+    default:
+        break;
+    }
+#else
+    UNREFERENCED_PARAMETER(isa);
+#endif
+
+    return s_scalarKernels;
+}
+
+// Fixed-length kernels for short passwords. Subtract fills the whole
+// bucket, which stays inside the timeline lanes. Past 16 keys the unrolled
+// masked loops lose to the dispatched AVX2 kernels, so only the two
+// smallest buckets are used here.
+template <DWORD N>
+struct BucketFeatureKernels
+{
+    static const FeatureKernels s_kernels;
+};
+
+template <DWORD N>
+const FeatureKernels BucketFeatureKernels<N>::s_kernels =
+{
+    LengthBucket<N>::Subtract,
+    LengthBucket<N>::Sum,
+    LengthBucket<N>::MinMax,
+    LengthBucket<N>::SumSquaredDeviation
+};
+
+static_assert(16 + 1 <= MAX_KEYSTROKE_COUNT, "the length buckets must fit in the timeline lanes");
+
+static const FeatureKernels* GetBucketKernels(DWORD c)
+{
+    switch (SelectLengthBucket(c))
+    {
+    case 8:
+        return &BucketFeatureKernels<8>::s_kernels;
+
+    case 16:
+        return &BucketFeatureKernels<16>::s_kernels;
+
+    default:
+        return NULL;
+    }
+}
+
+static void ComputeStats(const FeatureKernels& kernels, const INT32* pValues, DWORD c, TimingFeatureStats* pStats)
+{
+    ZeroMemory(pStats, sizeof(*pStats));
+    pStats->count = c;
+    if (c == 0)
+    {
+        return;
+    }
+
+    pStats->mean = static_cast<double>(kernels.pfnSum(pValues, c)) / c;
+    if (c > 1)
+    {
+        pStats->stdDev = sqrt(kernels.pfnSumSquaredDeviation(pValues, c, pStats->mean) / (c - 1));
+    }
+
+    pStats->min = pValues[0];
+    pStats->max = pValues[0];
+    kernels.pfnMinMax(pValues, c, &pStats->min, &pStats->max);
+
+    // Percentiles by selection on a copy, no full sort needed
+    INT32 rgWork[MAX_KEYSTROKE_COUNT];
+    CopyMemory(rgWork, pValues, c * sizeof(INT32));
+
+    DWORD iP50 = (c - 1) * 50 / 100;
+    DWORD iP90 = (c - 1) * 90 / 100;
+    std::nth_element(rgWork, rgWork + iP50, rgWork + c);
+    pStats->p50 = rgWork[iP50];
+    std::nth_element(rgWork + iP50, rgWork + iP90, rgWork + c);
+    pStats->p90 = rgWork[iP90];
+}
+
+static void ExtractWithKernels(const FeatureKernels& kernels, const KeystrokeTimeline& timeline, TimingFeatureSet* pFeatures)
+{
+    DWORD cKeys = timeline.count;
+    DWORD cPairs = (cKeys > 0) ? cKeys - 1 : 0;
+
+    kernels.pfnSubtract(timeline.keyUpUs, timeline.keyDownUs, cKeys, pFeatures->values[TF_DWELL]);
+    kernels.pfnSubtract(timeline.keyDownUs + 1, timeline.keyDownUs, cPairs, pFeatures->values[TF_DOWN_DOWN]);
+    kernels.pfnSubtract(timeline.keyDownUs + 1, timeline.keyUpUs, cPairs, pFeatures->values[TF_UP_DOWN]);
+    kernels.pfnSubtract(timeline.keyUpUs + 1, timeline.keyDownUs, cPairs, pFeatures->values[TF_DOWN_UP]);
+
+    // The scoring buckets read each vector up to its own bucket size
+    ZeroFillLengthBucket(pFeatures->values[TF_DWELL], cKeys);
+    for (DWORD f = TF_DOWN_DOWN; f < TF_NUM_FEATURES; f++)
+    {
+        ZeroFillLengthBucket(pFeatures->values[f], cPairs);
+    }
+
+    ComputeStats(kernels, pFeatures->values[TF_DWELL], cKeys, &pFeatures->stats[TF_DWELL]);
+    for (DWORD f = TF_DOWN_DOWN; f < TF_NUM_FEATURES; f++)
+    {
+        ComputeStats(kernels, pFeatures->values[f], cPairs, &pFeatures->stats[f]);
+    }
+}
+
+HRESULT ExtractTimingFeaturesWith(FEATURE_KERNEL_ISA isa, const KeystrokeTimeline& timeline, TimingFeatureSet* pFeatures)
+{
+    if (!pFeatures || timeline.count > MAX_KEYSTROKE_COUNT)
+    {
+        return E_INVALIDARG;
+    }
+
+    ExtractWithKernels(GetKernels(isa), timeline, pFeatures);
+    return S_OK;
+}
+
+HRESULT ExtractTimingFeatures(const KeystrokeTimeline& timeline, TimingFeatureSet* pFeatures)
+{
+    if (!pFeatures || timeline.count > MAX_KEYSTROKE_COUNT)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Short passwords take the length-specialized kernels; longer input
+    // falls back to the widest instruction set the CPU supports
+    const FeatureKernels* pKernels = GetBucketKernels(timeline.count);
+    ExtractWithKernels(pKernels ? *pKernels : GetKernels(GetFeatureKernelIsa()), timeline, pFeatures);
+    return S_OK;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <windows.h>
+#include "KeystrokeTimeline.h"
+
+// Timing features derived from a keystroke timeline. Each is a vector over
+// keystrokes (dwell) or over neighbouring keystroke pairs (the rest), and
+// is named by the two key edges it spans; TypingFeatures uses the same
+// names. "Digraph" means a pair of keys (DigraphTable.h), not a time.
+enum TIMING_FEATURE
+{
+    TF_DWELL = 0,       // up[i] - down[i]
+    TF_DOWN_DOWN,       // down[i+1] - down[i]
+    TF_UP_DOWN,         // down[i+1] - up[i]; negative on rollover
+    TF_DOWN_UP,         // up[i+1] - down[i], the whole pair
+    TF_NUM_FEATURES
+};
+
+// Instruction set the feature kernels run on
+enum FEATURE_KERNEL_ISA
+{
+    FKI_SCALAR = 0,
+    FKI_SSE41,
+    FKI_AVX2
+};
+
+struct TimingFeatureStats
+{
+    DWORD count;
+    double mean;            // Microseconds
+    double stdDev;
+    INT32 min;
+    INT32 max;
+    INT32 p50;
+    INT32 p90;
+};
+
+struct TimingFeatureSet
+{
+    alignas(32) INT32 values[TF_NUM_FEATURES][MAX_KEYSTROKE_COUNT];
+    TimingFeatureStats stats[TF_NUM_FEATURES];
+};
+
+// Compute every feature vector and its moments and percentiles. Passwords
+// up to 16 keys use kernels specialized for their length bucket; longer
+// input uses the fastest kernel the CPU supports. Every vector is zero past
+// its count up to its length bucket (SelectLengthBucket in BucketKernels.h),
+// which the scoring kernels read.
+HRESULT ExtractTimingFeatures(const KeystrokeTimeline& timeline, TimingFeatureSet* pFeatures);
+
+// Same, on an explicit instruction set; falls back to scalar when the CPU
+// lacks it. Used to check the vector kernels against the scalar ones.
+HRESULT ExtractTimingFeaturesWith(FEATURE_KERNEL_ISA isa, const KeystrokeTimeline& timeline, TimingFeatureSet* pFeatures);
+
+FEATURE_KERNEL_ISA GetFeatureKernelIsa();
+
+// MSVC compiles any intrinsic in any function. GCC and Clang only compile
+// one in a function built for its instruction set, so each vector kernel
+// names its own and the rest of the module keeps the baseline target.
+#if defined(__GNUC__) || defined(__clang__)
+#define FEATURE_KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FEATURE_KERNEL_TARGET(isa)
+#endif
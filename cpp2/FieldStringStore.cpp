@@ -0,0 +1,290 @@
+#include "FieldStringStore.h"
+#include <strsafe.h>
+
+// Bytes one version of a field with room for cchMax characters occupies
+SIZE_T FieldStringStore::VersionSize(DWORD cchMax)
+{
+    SIZE_T cb = FIELD_OFFSET(FieldString, sz) + (cchMax + 1) * sizeof(WCHAR);
+    return (cb + sizeof(ULONGLONG) - 1) & ~(sizeof(ULONGLONG) - 1);
+}
+
+FieldStringStore::FieldStringStore() :
+    m_rgFields(nullptr),
+    m_cFields(0),
+    m_pbBuffers(nullptr),
+    m_cbBuffers(0),
+    m_fLocked(FALSE),
+    m_ullEpoch(1)
+{
+    for (DWORD i = 0; i < FIELD_STRING_READER_SLOTS; i++)
+    {
+        m_rgReaderEpochs[i].store(0, std::memory_order_relaxed);
+    }
+
+    InitializeSRWLock(&m_writeLock);
+}
+
+FieldStringStore::~FieldStringStore()
+{
+    // No readers can outlive the owner, so everything goes now
+    if (m_pbBuffers)
+    {
+        SecureZeroMemory(m_pbBuffers, m_cbBuffers);
+        if (m_fLocked)
+        {
+            VirtualUnlock(m_pbBuffers, m_cbBuffers);
+        }
+        VirtualFree(m_pbBuffers, 0, MEM_RELEASE);
+    }
+
+    delete[] m_rgFields;
+}
+
+HRESULT FieldStringStore::Initialize(DWORD cFields, const PCWSTR* rgpszInitial, const DWORD* rgcchMax)
+{
+    if (m_rgFields)
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    HRESULT hr = S_OK;
+    DWORD rgcchInitial[32];
+    if (cFields > ARRAYSIZE(rgcchInitial))
+    {
+        return E_INVALIDARG;
+    }
+
+    // Size every field up front
+    SIZE_T cbTotal = 0;
+    for (DWORD i = 0; i < cFields; i++)
+    {
+        size_t cch = 0;
+        hr = StringCchLengthW(rgpszInitial[i], STRSAFE_MAX_CCH, &cch);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        DWORD cchMax = (rgcchMax && rgcchMax[i] > 0) ? rgcchMax[i] : static_cast<DWORD>(cch);
+        if (cch > cchMax)
+        {
+            return E_NOT_SUFFICIENT_BUFFER;
+        }
+
+        rgcchInitial[i] = static_cast<DWORD>(cch);
+        cbTotal += FIELD_STRING_VERSIONS * VersionSize(cchMax);
+    }
+
+    m_rgFields = new Field[cFields];
+    if (!m_rgFields)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // Fresh pages are zeroed; lock them so field values never reach the pagefile
+    m_pbBuffers = static_cast<BYTE*>(VirtualAlloc(nullptr, cbTotal, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+    if (!m_pbBuffers)
+    {
+        delete[] m_rgFields;
+        m_rgFields = nullptr;
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    m_cbBuffers = cbTotal;
+    m_fLocked = VirtualLock(m_pbBuffers, m_cbBuffers);
+
+    BYTE* pbNext = m_pbBuffers;
+    for (DWORD i = 0; i < cFields; i++)
+    {
+        Field& field = m_rgFields[i];
+        field.cchMax = (rgcchMax && rgcchMax[i] > 0) ? rgcchMax[i] : rgcchInitial[i];
+
+        for (DWORD v = 0; v < FIELD_STRING_VERSIONS; v++)
+        {
+            field.rgpVersions[v] = reinterpret_cast<FieldString*>(pbNext);
+            pbNext += VersionSize(field.cchMax);
+        }
+
+        WriteString(field.rgpVersions[0], rgpszInitial[i], rgcchInitial[i]);
+        field.rgpVersions[0]->state = FSS_CURRENT;
+        field.pCurrent.store(field.rgpVersions[0], std::memory_order_release);
+    }
+
+    m_cFields = cFields;
+
+    return hr;
+}
+
+void FieldStringStore::WriteString(FieldString* pString, PCWSTR pwz, DWORD cch)
+{
+    pString->retireEpoch = 0;
+    pString->cch = cch;
+    CopyMemory(pString->sz, pwz, cch * sizeof(WCHAR));
+    pString->sz[cch] = L'\0';
+}
+
+HRESULT FieldStringStore::Set(DWORD dwFieldID, PCWSTR pwz, DWORD* pcchValue)
+{
+    if (dwFieldID >= m_cFields)
+    {
+        return E_INVALIDARG;
+    }
+
+    Field& field = m_rgFields[dwFieldID];
+
+    size_t cch = 0;
+    HRESULT hr = StringCchLengthW(pwz, field.cchMax + 1, &cch);
+    if (FAILED(hr))
+    {
+        return E_NOT_SUFFICIENT_BUFFER;
+    }
+
+    AcquireSRWLockExclusive(&m_writeLock);
+
+    FieldString* pString = FindFreeVersion(field);
+    WriteString(pString, pwz, static_cast<DWORD>(cch));
+    pString->state = FSS_CURRENT;
+
+    FieldString* pOld = field.pCurrent.exchange(pString, std::memory_order_seq_cst);
+
+    // Readers that might still hold pOld started in this epoch or earlier
+    pOld->retireEpoch = m_ullEpoch.fetch_add(1, std::memory_order_seq_cst);
+    pOld->state = FSS_RETIRED;
+
+    Reclaim();
+
+    ReleaseSRWLockExclusive(&m_writeLock);
+
+    if (pcchValue)
+    {
+        *pcchValue = static_cast<DWORD>(cch);
+    }
+
+    return S_OK;
+}
+
+// Called with m_writeLock held
+FieldStringStore::FieldString* FieldStringStore::FindFreeVersion(Field& field)
+{
+    for (;;)
+    {
+        for (DWORD v = 0; v < FIELD_STRING_VERSIONS; v++)
+        {
+            if (field.rgpVersions[v]->state == FSS_FREE)
+            {
+                return field.rgpVersions[v];
+            }
+        }
+
+        // Every spare is pinned by a reader; let it run and leave
+        SwitchToThread();
+        Reclaim();
+    }
+}
+
+// Wipe and free every retired version no active reader can still see.
+// Called with m_writeLock held.
+void FieldStringStore::Reclaim()
+{
+    ULONGLONG ullOldestReader = MAXULONGLONG;
+    for (DWORD i = 0; i < FIELD_STRING_READER_SLOTS; i++)
+    {
+        ULONGLONG ullEpoch = m_rgReaderEpochs[i].load(std::memory_order_seq_cst);
+        if (ullEpoch != 0 && ullEpoch < ullOldestReader)
+        {
+            ullOldestReader = ullEpoch;
+        }
+    }
+
+    for (DWORD i = 0; i < m_cFields; i++)
+    {
+        for (DWORD v = 0; v < FIELD_STRING_VERSIONS; v++)
+        {
+            FieldString* pString = m_rgFields[i].rgpVersions[v];
+            if (pString->state == FSS_RETIRED && pString->retireEpoch < ullOldestReader)
+            {
+                // Field values include the password
+                SecureZeroMemory(pString->sz, (pString->cch + 1) * sizeof(WCHAR));
+                pString->cch = 0;
+                pString->state = FSS_FREE;
+            }
+        }
+    }
+}
+
+DWORD FieldStringStore::EnterRead() const
+{
+    DWORD iSlot = GetCurrentThreadId() % FIELD_STRING_READER_SLOTS;
+
+    for (;;)
+    {
+        for (DWORD i = 0; i < FIELD_STRING_READER_SLOTS; i++)
+        {
+            ULONGLONG ullFree = 0;
+            ULONGLONG ullEpoch = m_ullEpoch.load(std::memory_order_seq_cst);
+            if (m_rgReaderEpochs[iSlot].compare_exchange_strong(ullFree, ullEpoch, std::memory_order_seq_cst))
+            {
+                return iSlot;
+            }
+            iSlot = (iSlot + 1) % FIELD_STRING_READER_SLOTS;
+        }
+
+        SwitchToThread();
+    }
+}
+
+void FieldStringStore::LeaveRead(DWORD iSlot) const
+{
+    m_rgReaderEpochs[iSlot].store(0, std::memory_order_release);
+}
+
+// The only place a field value leaves the locked buffers, because
+// GetStringValue must return CoTaskMemAlloc memory
+HRESULT FieldStringStore::CopyTo(DWORD dwFieldID, PWSTR* ppwsz) const
+{
+    if (dwFieldID >= m_cFields || !ppwsz)
+    {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = S_OK;
+    *ppwsz = nullptr;
+
+    DWORD iSlot = EnterRead();
+
+    const FieldString* pString = m_rgFields[dwFieldID].pCurrent.load(std::memory_order_seq_cst);
+    DWORD cb = (pString->cch + 1) * sizeof(WCHAR);
+    *ppwsz = static_cast<PWSTR>(CoTaskMemAlloc(cb));
+    if (*ppwsz)
+    {
+        CopyMemory(*ppwsz, pString->sz, cb);
+    }
+    else
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+    LeaveRead(iSlot);
+
+    return hr;
+}
+
+FieldStringStore::ReadGuard::ReadGuard(const FieldStringStore& store) :
+    m_store(store),
+    m_iSlot(store.EnterRead())
+{
+}
+
+FieldStringStore::ReadGuard::~ReadGuard()
+{
+    m_store.LeaveRead(m_iSlot);
+}
+
+PCWSTR FieldStringStore::ReadGuard::Get(DWORD dwFieldID) const
+{
+    if (dwFieldID >= m_store.m_cFields)
+    {
+        return nullptr;
+    }
+
+    return m_store.m_rgFields[dwFieldID].pCurrent.load(std::memory_order_seq_cst)->sz;
+}
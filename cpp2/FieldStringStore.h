@@ -0,0 +1,105 @@
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+
+// Concurrent readers the store can pin at once; more simply wait for a slot
+#define FIELD_STRING_READER_SLOTS   16
+
+// Buffers per field: the current value plus replaced values that readers
+// may still be looking at
+#define FIELD_STRING_VERSIONS       4
+
+// Credential field values with lock-free reads.
+//
+// Every field owns a few fixed-capacity buffers carved out of one locked,
+// never-paged allocation made at Initialize(). A writer copies the new
+// value straight into a spare buffer of that field and publishes it with
+// a single atomic exchange, so a reader always sees either the old or the
+// new string, never a torn one, and typing never touches the heap.
+// Replaced buffers are retired rather than reused: every reader announces
+// the epoch it started in, and a retired buffer is wiped and handed back
+// only once no reader from its epoch or earlier is still active. Writers
+// are serialized among themselves; readers never wait on writers. Read
+// sections are expected to be short, since a writer that finds every
+// buffer of a field pinned waits for a reader to leave.
+class FieldStringStore
+{
+public:
+    FieldStringStore();
+    ~FieldStringStore();
+
+    // rgcchMax gives each field's longest value in characters; 0 sizes the
+    // field to its initial value
+    HRESULT Initialize(DWORD cFields, const PCWSTR* rgpszInitial, const DWORD* rgcchMax);
+
+    // Writer side; pcchValue, if given, receives the length of the new value
+    HRESULT Set(DWORD dwFieldID, PCWSTR pwz, DWORD* pcchValue);
+
+    // Reader side: a CoTaskMemAlloc copy the caller owns
+    HRESULT CopyTo(DWORD dwFieldID, PWSTR* ppwsz) const;
+
+    // Pins the current strings for the lifetime of the guard so callers
+    // can use them in place without copying
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const FieldStringStore& store);
+        ~ReadGuard();
+
+        PCWSTR Get(DWORD dwFieldID) const;
+
+    private:
+        ReadGuard(const ReadGuard&);
+        ReadGuard& operator=(const ReadGuard&);
+
+        const FieldStringStore& m_store;
+        DWORD m_iSlot;
+    };
+
+private:
+    enum FIELD_STRING_STATE
+    {
+        FSS_FREE = 0,
+        FSS_CURRENT,
+        FSS_RETIRED
+    };
+
+    struct FieldString
+    {
+        ULONGLONG retireEpoch;
+        DWORD cch;
+        DWORD state;        // FIELD_STRING_STATE, guarded by m_writeLock
+        WCHAR sz[ANYSIZE_ARRAY];
+    };
+
+    struct Field
+    {
+        std::atomic<FieldString*> pCurrent;
+        DWORD cchMax;
+        FieldString* rgpVersions[FIELD_STRING_VERSIONS];
+    };
+
+    FieldStringStore(const FieldStringStore&);
+    FieldStringStore& operator=(const FieldStringStore&);
+
+    static SIZE_T VersionSize(DWORD cchMax);
+    static void WriteString(FieldString* pString, PCWSTR pwz, DWORD cch);
+
+    DWORD EnterRead() const;
+    void LeaveRead(DWORD iSlot) const;
+    FieldString* FindFreeVersion(Field& field);
+    void Reclaim();
+
+    Field* m_rgFields;
+    DWORD m_cFields;
+
+    BYTE* m_pbBuffers;          // One locked allocation backing every version
+    SIZE_T m_cbBuffers;
+    BOOL m_fLocked;
+
+    mutable std::atomic<ULONGLONG> m_rgReaderEpochs[FIELD_STRING_READER_SLOTS];  // 0 when the slot is free
+    std::atomic<ULONGLONG> m_ullEpoch;
+
+    SRWLOCK m_writeLock;
+};
@@ -0,0 +1,162 @@
+"""Quantize the typing verifier MLP and emit it as a C++ header.
+
+Reads the float model exported by training (mlp-model.json by default) and
+writes MlpWeights.h with int8 weights, int32 biases and fixed-point
+requantization constants as constexpr arrays, so the DLL parses and
+allocates nothing at load. build.bat runs this before msbuild; the
+generated header is checked in for builds without Python.
+
+Model format:
+    {
+        "input_count": 16,
+        "input_max": 8.0,               # |input| range covered by int8
+        "layers": [
+            {"weights": [[...], ...],   # [outputs][inputs]
+             "bias": [...],
+             "activation": "relu",      # or "linear" for the output layer
+             "output_max": 8.0},        # activation range, hidden layers only
+            ...
+        ]
+    }
+
+The last layer must have a single linear output, the logit.
+"""
+
+import json
+import os
+import sys
+
+INT8_MAX = 127
+LANE_WIDTH = 16     # Inputs are padded to whole 16-byte vectors
+
+
+def pad(n):
+    return (n + LANE_WIDTH - 1) // LANE_WIDTH * LANE_WIDTH
+
+
+def quantize_multiplier(real):
+    """Return (multiplier, shift) with real ~= multiplier / 2**shift and
+    multiplier in [2**30, 2**31)."""
+    if real <= 0.0:
+        raise ValueError("requantization scale must be positive")
+    shift = 0
+    while real * (1 << shift) < (1 << 30):
+        shift += 1
+    while real * (1 << shift) >= (1 << 31):
+        shift -= 1
+    multiplier = int(round(real * (1 << shift)))
+    if multiplier == 1 << 31:
+        multiplier //= 2
+        shift -= 1
+    if shift <= 0 or shift > 62:
+        raise ValueError("requantization scale out of range: %g" % real)
+    return multiplier, shift
+
+
+def quantize(model):
+    input_count = model["input_count"]
+    in_scale = model["input_max"] / INT8_MAX
+    input_scale = in_scale
+    layers = []
+    width = input_count
+
+    for index, layer in enumerate(model["layers"]):
+        weights = layer["weights"]
+        bias = layer["bias"]
+        last = index == len(model["layers"]) - 1
+        if any(len(row) != width for row in weights) or len(bias) != len(weights):
+            raise ValueError("layer %d does not match its input width %d" % (index, width))
+        if last and (len(weights) != 1 or layer["activation"] != "linear"):
+            raise ValueError("the output layer must be one linear unit")
+        if not last and layer["activation"] != "relu":
+            raise ValueError("hidden layers must use relu")
+
+        w_max = max(abs(w) for row in weights for w in row) or 1.0
+        w_scale = w_max / INT8_MAX
+        acc_scale = w_scale * in_scale
+        stride = pad(width)
+
+        q_weights = []
+        for row in weights:
+            q_row = [max(-INT8_MAX, min(INT8_MAX, int(round(w / w_scale)))) for w in row]
+            q_weights.append(q_row + [0] * (stride - width))
+        q_bias = [int(round(b / acc_scale)) for b in bias]
+
+        entry = {
+            "weights": q_weights,
+            "bias": q_bias,
+            "inputs": stride,
+            "outputs": len(weights),
+            "relu": not last,
+        }
+        if last:
+            entry["multiplier"], entry["shift"] = 0, 0
+            entry["output_scale"] = acc_scale
+        else:
+            out_scale = layer["output_max"] / INT8_MAX
+            entry["multiplier"], entry["shift"] = quantize_multiplier(acc_scale / out_scale)
+            in_scale = out_scale
+        layers.append(entry)
+        width = len(weights)
+
+    return input_count, input_scale, layers
+
+
+def format_array(ctype, name, values, per_line=16):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append("    " + ", ".join(str(v) for v in values[i:i + per_line]) + ",")
+    return "static constexpr %s %s[%d] =\n{\n%s\n};\n" % (ctype, name, len(values), "\n".join(lines))
+
+
+def emit(source_name, input_count, input_scale, layers):
+    out = []
+    out.append("// Generated by GenerateMlpWeights.py from %s. Do not edit.\n\n" % source_name)
+    out.append("#pragma once\n\n")
+    out.append("#include \"MlpScorer.h\"\n\n")
+    out.append("#define MLP_INPUT_COUNT             %d\n" % input_count)
+    out.append("#define MLP_INPUT_STRIDE            %d\n" % pad(input_count))
+    out.append("#define MLP_MAX_WIDTH               %d\n\n" % max([pad(input_count)] +
+                                                               [pad(l["outputs"]) for l in layers]))
+    out.append("static constexpr float s_mlpInputScale = %.9ef;\n" % input_scale)
+    out.append("static constexpr float s_mlpOutputScale = %.9ef;\n\n" % layers[-1]["output_scale"])
+
+    for i, layer in enumerate(layers):
+        flat = [w for row in layer["weights"] for w in row]
+        out.append(format_array("INT8", "s_rgMlpWeights%d" % i, flat, layer["inputs"]))
+        out.append("\n")
+        out.append(format_array("INT32", "s_rgMlpBias%d" % i, layer["bias"], 8))
+        out.append("\n")
+
+    out.append("static constexpr MlpLayer s_rgMlpLayers[] =\n{\n")
+    for i, layer in enumerate(layers):
+        out.append("    { s_rgMlpWeights%d, s_rgMlpBias%d, %d, %d, %d, %d, %s },\n" % (
+            i, i, layer["inputs"], layer["outputs"], layer["multiplier"], layer["shift"],
+            "TRUE" if layer["relu"] else "FALSE"))
+    out.append("};\n")
+    return "".join(out)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    source = sys.argv[1] if len(sys.argv) > 1 else os.path.join(here, "mlp-model.json")
+    target = sys.argv[2] if len(sys.argv) > 2 else os.path.join(here, "MlpWeights.h")
+
+    with open(source) as f:
+        model = json.load(f)
+
+    text = emit(os.path.basename(source), *quantize(model))
+
+    # Leave the header alone when nothing changed, so msbuild does not rebuild
+    if os.path.exists(target):
+        with open(target, newline="") as f:
+            if f.read() == text.replace("\n", "\r\n"):
+                return 0
+
+    with open(target, "w", newline="\r\n") as f:
+        f.write(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,212 @@
+#include "JsonWriter.h"
+#include <charconv>
+#include <math.h>
+
+JsonWriter::JsonWriter(char* pchBuffer, size_t cchBuffer) :
+    m_pchBuffer(pchBuffer),
+    m_pchNext(pchBuffer),
+    m_pchEnd(pchBuffer + cchBuffer),
+    m_dwDepth(0),
+    m_dwHasMembers(0),
+    m_fAfterName(FALSE),
+    m_fOverflow(FALSE)
+{
+}
+
+// Comma before every value but the first at its depth, and none between
+// a member name and its value
+void JsonWriter::BeginValue()
+{
+    if (m_fAfterName)
+    {
+        m_fAfterName = FALSE;
+        return;
+    }
+
+    DWORD dwBit = 1u << m_dwDepth;
+    if (m_dwHasMembers & dwBit)
+    {
+        Put(',');
+    }
+    m_dwHasMembers |= dwBit;
+}
+
+void JsonWriter::Open(char ch)
+{
+    BeginValue();
+    Put(ch);
+
+    if (m_dwDepth + 1 >= JSON_WRITER_MAX_DEPTH)
+    {
+        m_fOverflow = TRUE;
+        return;
+    }
+
+    m_dwDepth++;
+    m_dwHasMembers &= ~(1u << m_dwDepth);
+}
+
+void JsonWriter::Close(char ch)
+{
+    if (m_dwDepth == 0)
+    {
+        m_fOverflow = TRUE;
+        return;
+    }
+
+    m_dwDepth--;
+    Put(ch);
+}
+
+void JsonWriter::BeginObject()
+{
+    Open('{');
+}
+
+void JsonWriter::EndObject()
+{
+    Close('}');
+}
+
+void JsonWriter::BeginArray()
+{
+    Open('[');
+}
+
+void JsonWriter::EndArray()
+{
+    Close(']');
+}
+
+void JsonWriter::Name(PCSTR pszName, size_t cchName)
+{
+    BeginValue();
+    Put('"');
+    Put(pszName, cchName);
+    Put("\":", 2);
+    m_fAfterName = TRUE;
+}
+
+void JsonWriter::Int(LONGLONG value)
+{
+    BeginValue();
+    std::to_chars_result result = std::to_chars(m_pchNext, m_pchEnd, value);
+    if (result.ec == std::errc())
+    {
+        m_pchNext = result.ptr;
+    }
+    else
+    {
+        m_fOverflow = TRUE;
+    }
+}
+
+void JsonWriter::UInt(ULONGLONG value)
+{
+    BeginValue();
+    std::to_chars_result result = std::to_chars(m_pchNext, m_pchEnd, value);
+    if (result.ec == std::errc())
+    {
+        m_pchNext = result.ptr;
+    }
+    else
+    {
+        m_fOverflow = TRUE;
+    }
+}
+
+void JsonWriter::Number(double value)
+{
+    BeginValue();
+    if (!isfinite(value))
+    {
+        Put("null", 4);
+        return;
+    }
+
+    std::to_chars_result result = std::to_chars(m_pchNext, m_pchEnd, value);
+    if (result.ec == std::errc())
+    {
+        m_pchNext = result.ptr;
+    }
+    else
+    {
+        m_fOverflow = TRUE;
+    }
+}
+
+// \uXXXX for a code unit JSON requires escaped or UTF-8 cannot carry
+void JsonWriter::PutEscaped(UINT32 codeUnit)
+{
+    static const char s_rgchHex[] = "0123456789abcdef";
+    char rgch[6] = { '\\', 'u',
+                     s_rgchHex[(codeUnit >> 12) & 0xF], s_rgchHex[(codeUnit >> 8) & 0xF],
+                     s_rgchHex[(codeUnit >> 4) & 0xF], s_rgchHex[codeUnit & 0xF] };
+    Put(rgch, sizeof(rgch));
+}
+
+void JsonWriter::String(PCWSTR pwz, size_t cch)
+{
+    BeginValue();
+    Put('"');
+
+    for (size_t i = 0; i < cch; i++)
+    {
+        UINT32 c = pwz[i];
+        if (c == L'"' || c == L'\\')
+        {
+            char rgch[2] = { '\\', static_cast<char>(c) };
+            Put(rgch, sizeof(rgch));
+        }
+        else if (c < 0x20)
+        {
+            PutEscaped(c);
+        }
+        else if (c < 0x80)
+        {
+            Put(static_cast<char>(c));
+        }
+        else if (c < 0x800)
+        {
+            char rgch[2] = { static_cast<char>(0xC0 | (c >> 6)), static_cast<char>(0x80 | (c & 0x3F)) };
+            Put(rgch, sizeof(rgch));
+        }
+        else if (c >= 0xD800 && c <= 0xDBFF && i + 1 < cch && pwz[i + 1] >= 0xDC00 && pwz[i + 1] <= 0xDFFF)
+        {
+            UINT32 cp = 0x10000 + ((c - 0xD800) << 10) + (pwz[++i] - 0xDC00);
+            char rgch[4] = { static_cast<char>(0xF0 | (cp >> 18)), static_cast<char>(0x80 | ((cp >> 12) & 0x3F)),
+                             static_cast<char>(0x80 | ((cp >> 6) & 0x3F)), static_cast<char>(0x80 | (cp & 0x3F)) };
+            Put(rgch, sizeof(rgch));
+        }
+        else if (c >= 0xD800 && c <= 0xDFFF)
+        {
+            // A lone surrogate, e.g. one keystroke of a character typed as two
+            PutEscaped(c);
+        }
+        else
+        {
+            char rgch[3] = { static_cast<char>(0xE0 | (c >> 12)), static_cast<char>(0x80 | ((c >> 6) & 0x3F)),
+                             static_cast<char>(0x80 | (c & 0x3F)) };
+            Put(rgch, sizeof(rgch));
+        }
+    }
+
+    Put('"');
+}
+
+HRESULT JsonWriter::Finish(size_t* pcchWritten) const
+{
+    *pcchWritten = 0;
+    if (m_fOverflow)
+    {
+        return E_NOT_SUFFICIENT_BUFFER;
+    }
+
+    if (m_dwDepth != 0 || m_fAfterName)
+    {
+        return E_UNEXPECTED;
+    }
+
+    *pcchWritten = static_cast<size_t>(m_pchNext - m_pchBuffer);
+    return S_OK;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <windows.h>
+
+// Deepest nesting of objects and arrays a writer tracks
+#define JSON_WRITER_MAX_DEPTH       32
+
+// Writes compact UTF-8 JSON straight into a caller-supplied buffer.
+//
+// Numbers are formatted with std::to_chars and strings are transcoded from
+// UTF-16 as they are copied, so building a document makes no allocations
+// and no intermediate strings. Commas between members and elements are
+// inserted automatically. Running out of room does not throw: the writer
+// stops writing and Finish reports E_NOT_SUFFICIENT_BUFFER.
+class JsonWriter
+{
+public:
+    JsonWriter(char* pchBuffer, size_t cchBuffer);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    // Member name, plain ASCII with nothing to escape; the next value
+    // written is the member's value
+    void Name(PCSTR pszName, size_t cchName);
+
+    template <size_t N>
+    void Name(const char (&szName)[N])
+    {
+        Name(szName, N - 1);
+    }
+
+    void Int(LONGLONG value);
+    void UInt(ULONGLONG value);
+
+    // Shortest form that reads back as the same double; null when the
+    // value is not finite, which JSON cannot represent
+    void Number(double value);
+
+    void String(PCWSTR pwz, size_t cch);
+
+    // Bytes written, excluding any terminator; fails if anything was cut
+    // off or an object or array is still open
+    HRESULT Finish(size_t* pcchWritten) const;
+
+private:
+    JsonWriter(const JsonWriter&);
+    JsonWriter& operator=(const JsonWriter&);
+
+    void BeginValue();
+    void Open(char ch);
+    void Close(char ch);
+    void PutEscaped(UINT32 codeUnit);
+
+    void Put(char ch)
+    {
+        if (m_pchNext < m_pchEnd)
+        {
+            *m_pchNext++ = ch;
+        }
+        else
+        {
+            m_fOverflow = TRUE;
+        }
+    }
+
+    void Put(PCSTR pch, size_t cch)
+    {
+        if (static_cast<size_t>(m_pchEnd - m_pchNext) >= cch)
+        {
+            CopyMemory(m_pchNext, pch, cch);
+            m_pchNext += cch;
+        }
+        else
+        {
+            m_fOverflow = TRUE;
+        }
+    }
+
+    char* m_pchBuffer;
+    char* m_pchNext;
+    char* m_pchEnd;
+    DWORD m_dwDepth;
+    DWORD m_dwHasMembers;       // Bit per depth, set once a value is written there
+    BOOL m_fAfterName;
+    BOOL m_fOverflow;
+};
@@ -0,0 +1,173 @@
+#include "KeyEventPairer.h"
+
+// Keys that produce a character in the password field. Modifiers, editing
+// and navigation keys never become keystrokes, so they are not paired.
+static BOOL IsCharacterKey(DWORD vk)
+{
+    return (vk == VK_SPACE) ||
+           (vk >= '0' && vk <= '9') ||
+           (vk >= 'A' && vk <= 'Z') ||
+           (vk >= VK_NUMPAD0 && vk <= VK_DIVIDE) ||
+           (vk >= VK_OEM_1 && vk <= VK_OEM_3) ||
+           (vk >= VK_OEM_4 && vk <= VK_OEM_8) ||
+           (vk == VK_OEM_102);
+}
+
+// KeyEventQueue implementation
+KeyEventQueue::KeyEventQueue() :
+    m_dwHead(0),
+    m_dwTail(0),
+    m_cDropped(0)
+{
+    ZeroMemory(m_rgEvents, sizeof(m_rgEvents));
+}
+
+void KeyEventQueue::OnKeyEvent(const KeyEvent& keyEvent)
+{
+    DWORD dwTail = m_dwTail.load(std::memory_order_relaxed);
+    DWORD dwHead = m_dwHead.load(std::memory_order_acquire);
+
+    if (dwTail - dwHead >= KEY_EVENT_QUEUE_SIZE)
+    {
+        m_cDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    m_rgEvents[dwTail & (KEY_EVENT_QUEUE_SIZE - 1)] = keyEvent;
+    m_dwTail.store(dwTail + 1, std::memory_order_release);
+}
+
+bool KeyEventQueue::TryPop(KeyEvent* pKeyEvent)
+{
+    DWORD dwHead = m_dwHead.load(std::memory_order_relaxed);
+    DWORD dwTail = m_dwTail.load(std::memory_order_acquire);
+
+    if (dwHead == dwTail)
+    {
+        return false;
+    }
+
+    *pKeyEvent = m_rgEvents[dwHead & (KEY_EVENT_QUEUE_SIZE - 1)];
+    m_dwHead.store(dwHead + 1, std::memory_order_release);
+    return true;
+}
+
+void KeyEventQueue::Discard()
+{
+    m_dwHead.store(m_dwTail.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+// KeyEventPairer implementation
+KeyEventPairer::KeyEventPairer()
+{
+    Reset();
+}
+
+void KeyEventPairer::Reset()
+{
+    ZeroMemory(m_rgKeys, sizeof(m_rgKeys));
+    ZeroMemory(m_rgUnclaimed, sizeof(m_rgUnclaimed));
+    m_iFirstUnclaimed = 0;
+    m_cUnclaimed = 0;
+}
+
+void KeyEventPairer::DiscardUnclaimed()
+{
+    while (m_cUnclaimed > 0)
+    {
+        PendingKey& key = m_rgKeys[m_rgUnclaimed[m_iFirstUnclaimed]];
+        if (key.state == PKS_DOWN || key.state == PKS_RELEASED)
+        {
+            key.state = (key.state == PKS_DOWN) ? PKS_CLAIMED : PKS_IDLE;
+            key.downTime = 0;
+        }
+        m_iFirstUnclaimed = (m_iFirstUnclaimed + 1) % c_cMaxUnclaimed;
+        m_cUnclaimed--;
+    }
+}
+
+BOOL KeyEventPairer::Ingest(const KeyEvent& keyEvent, LONGLONG* pllDownTime, LONGLONG* pllUpTime)
+{
+    BYTE vk = static_cast<BYTE>(keyEvent.virtualKey);
+    PendingKey& key = m_rgKeys[vk];
+
+    if (!IsCharacterKey(vk))
+    {
+        return FALSE;
+    }
+
+    if (keyEvent.flags & KEY_EVENT_FLAG_UP)
+    {
+        if (key.state == PKS_CLAIMED)
+        {
+            key.state = PKS_IDLE;
+
+            // A discarded key down leaves nothing to complete
+            if (key.downTime != 0)
+            {
+                *pllDownTime = key.downTime;
+                *pllUpTime = keyEvent.timestamp;
+                return TRUE;
+            }
+        }
+        else if (key.state == PKS_DOWN)
+        {
+            key.state = PKS_RELEASED;
+            key.upTime = keyEvent.timestamp;
+        }
+
+        return FALSE;
+    }
+
+    // Auto-repeat while the key is held is not a new keystroke
+    if (key.state == PKS_DOWN || key.state == PKS_CLAIMED)
+    {
+        return FALSE;
+    }
+
+    // Make room by forgetting the oldest unclaimed key down
+    if (m_cUnclaimed == c_cMaxUnclaimed)
+    {
+        PendingKey& oldest = m_rgKeys[m_rgUnclaimed[m_iFirstUnclaimed]];
+        oldest.state = PKS_IDLE;
+        m_iFirstUnclaimed = (m_iFirstUnclaimed + 1) % c_cMaxUnclaimed;
+        m_cUnclaimed--;
+    }
+
+    key.state = PKS_DOWN;
+    key.downTime = keyEvent.timestamp;
+    key.upTime = 0;
+    m_rgUnclaimed[(m_iFirstUnclaimed + m_cUnclaimed) % c_cMaxUnclaimed] = vk;
+    m_cUnclaimed++;
+
+    return FALSE;
+}
+
+BOOL KeyEventPairer::ClaimKeyDown(LONGLONG llNow, LONGLONG llStaleTicks, LONGLONG* pllDownTime, LONGLONG* pllUpTime)
+{
+    while (m_cUnclaimed > 0)
+    {
+        PendingKey& key = m_rgKeys[m_rgUnclaimed[m_iFirstUnclaimed]];
+        m_iFirstUnclaimed = (m_iFirstUnclaimed + 1) % c_cMaxUnclaimed;
+        m_cUnclaimed--;
+
+        if (key.state != PKS_DOWN && key.state != PKS_RELEASED)
+        {
+            continue;
+        }
+
+        if (llNow - key.downTime > llStaleTicks)
+        {
+            key.state = (key.state == PKS_DOWN) ? PKS_CLAIMED : PKS_IDLE;
+            key.downTime = 0;
+            continue;
+        }
+
+        *pllDownTime = key.downTime;
+        *pllUpTime = (key.state == PKS_RELEASED) ? key.upTime : 0;
+        key.state = (key.state == PKS_RELEASED) ? PKS_IDLE : PKS_CLAIMED;
+        return TRUE;
+    }
+
+    return FALSE;
+}
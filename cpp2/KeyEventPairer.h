@@ -0,0 +1,97 @@
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+
+// Capacity of the hook-to-credential event queue (power of two)
+#define KEY_EVENT_QUEUE_SIZE        256
+
+// Unclaimed key downs older than this are not attributed to a keystroke
+#define KEY_EVENT_STALE_MS          1000
+
+// Key event flags
+#define KEY_EVENT_FLAG_UP           0x0001
+
+// Raw key transition as seen by a key event source
+struct KeyEvent
+{
+    LONGLONG timestamp;     // GetClock() ticks
+    WORD virtualKey;        // VK_* code
+    WORD flags;             // KEY_EVENT_FLAG_* values
+};
+
+// Receives raw key events from a source
+class IKeyEventSink
+{
+public:
+    virtual ~IKeyEventSink() {}
+    virtual void OnKeyEvent(const KeyEvent& keyEvent) = 0;
+};
+
+// Bounded single-producer/single-consumer queue between a key event
+// source thread and the credential. Pushing never blocks or allocates;
+// when the credential falls behind, new events are dropped and counted.
+class KeyEventQueue : public IKeyEventSink
+{
+public:
+    KeyEventQueue();
+
+    // Producer side
+    void OnKeyEvent(const KeyEvent& keyEvent);
+
+    // Consumer side
+    bool TryPop(KeyEvent* pKeyEvent);
+    void Discard();
+
+    LONG GetDroppedCount() const { return m_cDropped.load(std::memory_order_relaxed); }
+
+private:
+    KeyEvent m_rgEvents[KEY_EVENT_QUEUE_SIZE];
+    std::atomic<DWORD> m_dwHead;        // Next slot to read, owned by the consumer
+    std::atomic<DWORD> m_dwTail;        // Next slot to write, owned by the producer
+    std::atomic<LONG> m_cDropped;
+};
+
+// Pairs key downs with key ups and hands key downs to the keystrokes that
+// SetStringValue observes. Character key downs wait in arrival order until
+// a typed character claims one; the matching key up then completes that
+// keystroke. Everything is table driven and O(1) per event.
+class KeyEventPairer
+{
+public:
+    KeyEventPairer();
+
+    void Reset();
+    void DiscardUnclaimed();
+
+    // Feed one raw event. Returns TRUE when a key up completes a claimed
+    // keystroke, with the key down and key up ticks of that keystroke.
+    BOOL Ingest(const KeyEvent& keyEvent, LONGLONG* pllDownTime, LONGLONG* pllUpTime);
+
+    // Attribute the oldest pending character key down to a new keystroke.
+    // *pllUpTime is 0 while the key is still held.
+    BOOL ClaimKeyDown(LONGLONG llNow, LONGLONG llStaleTicks, LONGLONG* pllDownTime, LONGLONG* pllUpTime);
+
+private:
+    enum PENDING_KEY_STATE
+    {
+        PKS_IDLE = 0,
+        PKS_DOWN,           // Pressed, not yet attributed to a keystroke
+        PKS_RELEASED,       // Pressed and released, not yet attributed
+        PKS_CLAIMED         // Attributed to a keystroke, waiting for key up
+    };
+
+    struct PendingKey
+    {
+        LONGLONG downTime;
+        LONGLONG upTime;
+        BYTE state;
+    };
+
+    static const DWORD c_cMaxUnclaimed = 16;
+
+    PendingKey m_rgKeys[256];
+    BYTE m_rgUnclaimed[c_cMaxUnclaimed];    // Virtual keys in press order
+    DWORD m_iFirstUnclaimed;
+    DWORD m_cUnclaimed;
+};
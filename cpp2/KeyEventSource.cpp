@@ -0,0 +1,419 @@
+#include "KeyEventSource.h"
+#include "Dll.h"
+#include "Clock.h"
+#include <stdlib.h>
+
+// KeyboardHookSource implementation
+std::atomic<KeyboardHookSource*> KeyboardHookSource::s_pActive(nullptr);
+
+// Whichever of Start() and the hook thread moves the state off
+// HOOK_START_PENDING first decides whether the start counts
+enum HOOK_START_STATE
+{
+    HOOK_START_PENDING = 0,
+    HOOK_START_DONE,
+    HOOK_START_ABANDONED
+};
+
+struct KeyboardHookSource::HookStart
+{
+    std::atomic<LONG> cRef;
+    std::atomic<LONG> state;
+    HANDLE hReady;
+    HRESULT hr;
+};
+
+KeyboardHookSource::KeyboardHookSource() :
+    m_pSink(nullptr),
+    m_hThread(nullptr),
+    m_dwThreadId(0)
+{
+}
+
+KeyboardHookSource::~KeyboardHookSource()
+{
+    Stop();
+}
+
+HRESULT KeyboardHookSource::Start(IKeyEventSink* pSink)
+{
+    if (!pSink)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_hThread)
+    {
+        return S_OK;
+    }
+
+    // Only one hook may feed the process at a time
+    KeyboardHookSource* pExpected = nullptr;
+    if (!s_pActive.compare_exchange_strong(pExpected, this))
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    HRESULT hr = S_OK;
+    m_pSink = pSink;
+
+    HookStart* pStart = new HookStart();
+    pStart->cRef = 1;
+    pStart->state = HOOK_START_PENDING;
+    pStart->hr = S_OK;
+    pStart->hReady = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+    if (pStart->hReady)
+    {
+        pStart->cRef++;
+        m_hThread = CreateThread(nullptr, 0, s_HookThreadProc, pStart, 0, &m_dwThreadId);
+        if (m_hThread)
+        {
+            WaitForSingleObject(pStart->hReady, KEY_EVENT_HOOK_START_TIMEOUT_MS);
+            if (pStart->state.exchange(HOOK_START_ABANDONED) == HOOK_START_PENDING)
+            {
+                // The thread unhooks and exits on its own once it gets going
+                CloseHandle(m_hThread);
+                m_hThread = nullptr;
+                m_dwThreadId = 0;
+                hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+            }
+            else
+            {
+                hr = pStart->hr;
+            }
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            pStart->cRef--;
+        }
+    }
+    else
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    ReleaseHookStart(pStart);
+
+    if (FAILED(hr))
+    {
+        Stop();
+    }
+
+    return hr;
+}
+
+void KeyboardHookSource::Stop()
+{
+    if (m_hThread)
+    {
+        PostThreadMessageW(m_dwThreadId, WM_QUIT, 0, 0);
+        WaitForSingleObject(m_hThread, INFINITE);
+        CloseHandle(m_hThread);
+        m_hThread = nullptr;
+        m_dwThreadId = 0;
+    }
+
+    KeyboardHookSource* pExpected = this;
+    s_pActive.compare_exchange_strong(pExpected, nullptr);
+    m_pSink = nullptr;
+}
+
+void KeyboardHookSource::ReleaseHookStart(HookStart* pStart)
+{
+    if (--pStart->cRef == 0)
+    {
+        if (pStart->hReady)
+        {
+            CloseHandle(pStart->hReady);
+        }
+        delete pStart;
+    }
+}
+
+DWORD WINAPI KeyboardHookSource::s_HookThreadProc(LPVOID pvParam)
+{
+    HookStart* pStart = static_cast<HookStart*>(pvParam);
+    MSG msg;
+
+    // Create the message queue before Stop() can post WM_QUIT to it
+    PeekMessageW(&msg, nullptr, WM_USER, WM_USER, PM_NOREMOVE);
+
+    HHOOK hHook = SetWindowsHookExW(WH_KEYBOARD_LL, s_LowLevelKeyboardProc, g_hInst, 0);
+    pStart->hr = hHook ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+
+    // Start() has already given up; no hook callback has run yet, since
+    // they are only delivered while this thread pumps messages
+    BOOL fAbandoned = (pStart->state.exchange(HOOK_START_DONE) == HOOK_START_ABANDONED);
+    SetEvent(pStart->hReady);
+    ReleaseHookStart(pStart);
+
+    if (hHook && fAbandoned)
+    {
+        UnhookWindowsHookEx(hHook);
+    }
+    else if (hHook)
+    {
+        while (GetMessageW(&msg, nullptr, 0, 0) > 0)
+        {
+            TranslateMessage(&msg);
+            DispatchMessageW(&msg);
+        }
+
+        UnhookWindowsHookEx(hHook);
+    }
+
+    return 0;
+}
+
+LRESULT CALLBACK KeyboardHookSource::s_LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam)
+{
+    if (nCode == HC_ACTION)
+    {
+        KeyboardHookSource* pSource = s_pActive.load(std::memory_order_acquire);
+        if (pSource && pSource->m_pSink)
+        {
+            const KBDLLHOOKSTRUCT* pkbhs = reinterpret_cast<const KBDLLHOOKSTRUCT*>(lParam);
+
+            KeyEvent keyEvent;
+            keyEvent.timestamp = GetClock().Now();
+            keyEvent.virtualKey = static_cast<WORD>(pkbhs->vkCode);
+            keyEvent.flags = (pkbhs->flags & LLKHF_UP) ? KEY_EVENT_FLAG_UP : 0;
+
+            pSource->m_pSink->OnKeyEvent(keyEvent);
+        }
+    }
+
+    return CallNextHookEx(nullptr, nCode, wParam, lParam);
+}
+
+#ifdef KEY_EVENT_REPLAY_SOURCE
+
+// ReplayKeyEventSource implementation
+ReplayKeyEventSource::ReplayKeyEventSource() :
+    m_rgEvents(nullptr),
+    m_cEvents(0),
+    m_pSink(nullptr),
+    m_hThread(nullptr),
+    m_hStop(nullptr)
+{
+}
+
+ReplayKeyEventSource::~ReplayKeyEventSource()
+{
+    Stop();
+    delete[] m_rgEvents;
+}
+
+HRESULT ReplayKeyEventSource::Load(PCWSTR pszPath)
+{
+    HRESULT hr = S_OK;
+
+    HANDLE hFile = CreateFileW(pszPath, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER cbFile;
+    if (!GetFileSizeEx(hFile, &cbFile) || cbFile.QuadPart > MAXDWORD - 1)
+    {
+        CloseHandle(hFile);
+        return E_INVALIDARG;
+    }
+
+    DWORD cbText = static_cast<DWORD>(cbFile.QuadPart);
+    char* pszText = new char[cbText + 1];
+    DWORD cbRead = 0;
+
+    if (!ReadFile(hFile, pszText, cbText, &cbRead, nullptr))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    CloseHandle(hFile);
+
+    if (SUCCEEDED(hr))
+    {
+        pszText[cbRead] = '\0';
+
+        // Every event needs at least "D 0 0\n"
+        DWORD cMax = cbRead / 6 + 1;
+        delete[] m_rgEvents;
+        m_rgEvents = new ReplayEvent[cMax];
+        m_cEvents = 0;
+
+        char* pszLine = pszText;
+        while (*pszLine && m_cEvents < cMax)
+        {
+            char* pszNext = pszLine;
+            while (*pszNext && *pszNext != '\n')
+            {
+                pszNext++;
+            }
+            if (*pszNext)
+            {
+                *pszNext++ = '\0';
+            }
+
+            char chKind = *pszLine;
+            if (chKind == 'D' || chKind == 'U')
+            {
+                char* pszEnd = nullptr;
+                unsigned long vk = strtoul(pszLine + 1, &pszEnd, 0);
+                unsigned long long offsetUs = strtoull(pszEnd, nullptr, 10);
+
+                ReplayEvent& replayEvent = m_rgEvents[m_cEvents++];
+                replayEvent.offsetUs = offsetUs;
+                replayEvent.virtualKey = static_cast<WORD>(vk);
+                replayEvent.flags = (chKind == 'U') ? KEY_EVENT_FLAG_UP : 0;
+            }
+
+            pszLine = pszNext;
+        }
+
+        if (m_cEvents == 0)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+
+    SecureZeroMemory(pszText, cbText + 1);
+    delete[] pszText;
+
+    return hr;
+}
+
+HRESULT ReplayKeyEventSource::Start(IKeyEventSink* pSink)
+{
+    if (!pSink || m_cEvents == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    Stop();
+
+    m_pSink = pSink;
+    m_hStop = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (!m_hStop)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_hThread = CreateThread(nullptr, 0, s_ReplayThreadProc, this, 0, nullptr);
+    if (!m_hThread)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(m_hStop);
+        m_hStop = nullptr;
+        return hr;
+    }
+
+    return S_OK;
+}
+
+void ReplayKeyEventSource::Stop()
+{
+    if (m_hThread)
+    {
+        SetEvent(m_hStop);
+        WaitForSingleObject(m_hThread, INFINITE);
+        CloseHandle(m_hThread);
+        m_hThread = nullptr;
+    }
+
+    if (m_hStop)
+    {
+        CloseHandle(m_hStop);
+        m_hStop = nullptr;
+    }
+
+    m_pSink = nullptr;
+}
+
+DWORD WINAPI ReplayKeyEventSource::s_ReplayThreadProc(LPVOID pvParam)
+{
+    static_cast<ReplayKeyEventSource*>(pvParam)->Replay();
+    return 0;
+}
+
+void ReplayKeyEventSource::Replay()
+{
+    const Clock& clock = GetClock();
+    LONGLONG start = clock.Now();
+
+    for (DWORD i = 0; i < m_cEvents; i++)
+    {
+        const ReplayEvent& replayEvent = m_rgEvents[i];
+        LONGLONG due = start + clock.MicrosecondsToTicks(replayEvent.offsetUs);
+
+        // Sleep until the event is due, waking early if asked to stop
+        LONGLONG now = clock.Now();
+        if (now < due)
+        {
+            DWORD dwWaitMs = static_cast<DWORD>(clock.TicksToMicroseconds(due - now) / 1000);
+            if (WaitForSingleObject(m_hStop, dwWaitMs) == WAIT_OBJECT_0)
+            {
+                return;
+            }
+        }
+        else if (WaitForSingleObject(m_hStop, 0) == WAIT_OBJECT_0)
+        {
+            return;
+        }
+
+        // Deliver the recorded time so pairing sees the trace exactly
+        KeyEvent keyEvent;
+        keyEvent.timestamp = due;
+        keyEvent.virtualKey = replayEvent.virtualKey;
+        keyEvent.flags = replayEvent.flags;
+        m_pSink->OnKeyEvent(keyEvent);
+    }
+}
+
+#endif // KEY_EVENT_REPLAY_SOURCE
+
+// Factory
+HRESULT CreateKeyEventSource(DWORD dwKind, PCWSTR pszReplayPath, IKeyEventSource** ppSource)
+{
+    HRESULT hr = S_OK;
+    *ppSource = nullptr;
+
+#ifndef KEY_EVENT_REPLAY_SOURCE
+    UNREFERENCED_PARAMETER(pszReplayPath);
+#endif
+
+    switch (dwKind)
+    {
+    case KEY_EVENT_SOURCE_NONE:
+        break;
+
+    case KEY_EVENT_SOURCE_HOOK:
+        *ppSource = new KeyboardHookSource();
+        break;
+
+#ifdef KEY_EVENT_REPLAY_SOURCE
+    case KEY_EVENT_SOURCE_REPLAY:
+        {
+            ReplayKeyEventSource* pReplay = new ReplayKeyEventSource();
+            hr = pReplay->Load(pszReplayPath);
+            if (SUCCEEDED(hr))
+            {
+                *ppSource = pReplay;
+            }
+            else
+            {
+                delete pReplay;
+            }
+        }
+        break;
+#endif
+
+    default:
+        hr = E_INVALIDARG;
+        break;
+    }
+
+    return hr;
+}
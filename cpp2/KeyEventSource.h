@@ -0,0 +1,93 @@
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+#include "KeyEventPairer.h"
+
+// Key event sources selectable through CONFIG_KEY_EVENT_SOURCE. The replay
+// source is compiled in only when KEY_EVENT_REPLAY_SOURCE is defined, which
+// test builds do and the shipped DLL does not; without it a configured
+// replay source fails to create and typing falls back to callback timing.
+#define KEY_EVENT_SOURCE_NONE       0
+#define KEY_EVENT_SOURCE_HOOK       1
+#ifdef KEY_EVENT_REPLAY_SOURCE
+#define KEY_EVENT_SOURCE_REPLAY     2
+#endif
+
+// Longest Start() waits for the hook thread to install its hook. It runs
+// under the credential lock, so a slow start gives up and the credential
+// times keystrokes from the edit callbacks instead.
+#define KEY_EVENT_HOOK_START_TIMEOUT_MS     250
+
+// Produces raw key events on its own thread until stopped
+class IKeyEventSource
+{
+public:
+    virtual ~IKeyEventSource() {}
+    virtual HRESULT Start(IKeyEventSink* pSink) = 0;
+    virtual void Stop() = 0;
+};
+
+// Key events from a low-level keyboard hook running on its own thread
+class KeyboardHookSource : public IKeyEventSource
+{
+public:
+    KeyboardHookSource();
+    ~KeyboardHookSource();
+
+    HRESULT Start(IKeyEventSink* pSink);
+    void Stop();
+
+private:
+    // Shared by Start() and the hook thread, so a thread that starts too
+    // late can still report to it and clean up after itself
+    struct HookStart;
+
+    static DWORD WINAPI s_HookThreadProc(LPVOID pvParam);
+    static LRESULT CALLBACK s_LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam);
+    static void ReleaseHookStart(HookStart* pStart);
+
+    static std::atomic<KeyboardHookSource*> s_pActive;
+
+    IKeyEventSink* m_pSink;
+    HANDLE m_hThread;
+    DWORD m_dwThreadId;
+};
+
+#ifdef KEY_EVENT_REPLAY_SOURCE
+
+// Key events replayed from a recorded trace. Each line of the file is
+//     D|U <virtual key> <microseconds since start of trace>
+// and events are delivered on a worker thread at the recorded pace.
+class ReplayKeyEventSource : public IKeyEventSource
+{
+public:
+    ReplayKeyEventSource();
+    ~ReplayKeyEventSource();
+
+    HRESULT Load(PCWSTR pszPath);
+    HRESULT Start(IKeyEventSink* pSink);
+    void Stop();
+
+private:
+    struct ReplayEvent
+    {
+        ULONGLONG offsetUs;
+        WORD virtualKey;
+        WORD flags;
+    };
+
+    static DWORD WINAPI s_ReplayThreadProc(LPVOID pvParam);
+    void Replay();
+
+    ReplayEvent* m_rgEvents;
+    DWORD m_cEvents;
+    IKeyEventSink* m_pSink;
+    HANDLE m_hThread;
+    HANDLE m_hStop;
+};
+
+#endif // KEY_EVENT_REPLAY_SOURCE
+
+// Create the key event source named by configuration, or nullptr for none
+HRESULT CreateKeyEventSource(DWORD dwKind, PCWSTR pszReplayPath, IKeyEventSource** ppSource);
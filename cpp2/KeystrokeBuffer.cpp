@@ -0,0 +1,227 @@
+#include "KeystrokeBuffer.h"
+
+KeystrokeBuffer::KeystrokeBuffer() :
+    m_cEntries(0),
+    m_ulSequence(0)
+{
+    ZeroMemory(&m_timeline, sizeof(m_timeline));
+}
+
+KeystrokeBuffer::~KeystrokeBuffer()
+{
+    SecureZeroMemory(&m_timeline, sizeof(m_timeline));
+}
+
+void KeystrokeBuffer::BeginWrite()
+{
+    // Odd sequence tells readers a write is in flight
+    m_ulSequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void KeystrokeBuffer::EndWrite()
+{
+    m_timeline.count = m_cEntries.load(std::memory_order_relaxed);
+    m_ulSequence.fetch_add(1, std::memory_order_release);
+}
+
+HRESULT KeystrokeBuffer::Append(WCHAR key, UINT32 keyDownUs, UINT32 keyUpUs, DWORD dwPosition, BYTE flags)
+{
+    DWORD cEntries = GetCount();
+    if (cEntries >= MAX_KEYSTROKE_COUNT || dwPosition >= MAX_KEYSTROKE_COUNT)
+    {
+        return E_NOT_SUFFICIENT_BUFFER;
+    }
+
+    m_features.AddKeystroke(keyDownUs, keyUpUs);
+    if (cEntries > 0)
+    {
+        m_features.AddPair(m_timeline.keyDownUs[cEntries - 1], m_timeline.keyUpUs[cEntries - 1], keyDownUs);
+    }
+
+    BeginWrite();
+    m_timeline.keyDownUs[cEntries] = keyDownUs;
+    m_timeline.keyUpUs[cEntries] = keyUpUs;
+    m_timeline.keyId[cEntries] = key;
+    m_timeline.position[cEntries] = static_cast<BYTE>(dwPosition);
+    m_timeline.flags[cEntries] = flags;
+    m_cEntries.store(cEntries + 1, std::memory_order_relaxed);
+    EndWrite();
+
+    return S_OK;
+}
+
+void KeystrokeBuffer::RemoveLast()
+{
+    DWORD cEntries = GetCount();
+    if (cEntries == 0)
+    {
+        return;
+    }
+
+    RemoveFeatures(cEntries - 1, cEntries - 2, cEntries > 1, cEntries);
+
+    BeginWrite();
+    WipeKeystrokeTimeline(&m_timeline, cEntries - 1, 1);
+    m_cEntries.store(cEntries - 1, std::memory_order_relaxed);
+    EndWrite();
+}
+
+// Drop the keystrokes behind the characters in [dwPosition, dwPosition + cchRemoved)
+// and close the gap in the positions of everything after them
+void KeystrokeBuffer::RemovePositions(DWORD dwPosition, DWORD cchRemoved)
+{
+    DWORD cEntries = GetCount();
+    DWORD cKept = 0;
+
+    BeginWrite();
+
+    for (DWORD i = 0; i < cEntries; i++)
+    {
+        DWORD dwKeyPosition = m_timeline.position[i];
+        if (dwKeyPosition >= dwPosition && dwKeyPosition < dwPosition + cchRemoved)
+        {
+            // Everything before i is already compacted into [0, cKept)
+            RemoveFeatures(i, cKept - 1, cKept > 0, cEntries);
+            continue;
+        }
+
+        if (dwKeyPosition >= dwPosition + cchRemoved)
+        {
+            dwKeyPosition -= cchRemoved;
+        }
+
+        m_timeline.keyDownUs[cKept] = m_timeline.keyDownUs[i];
+        m_timeline.keyUpUs[cKept] = m_timeline.keyUpUs[i];
+        m_timeline.keyId[cKept] = m_timeline.keyId[i];
+        m_timeline.position[cKept] = static_cast<BYTE>(dwKeyPosition);
+        m_timeline.flags[cKept] = m_timeline.flags[i];
+        cKept++;
+    }
+
+    if (cKept < cEntries)
+    {
+        WipeKeystrokeTimeline(&m_timeline, cKept, cEntries - cKept);
+    }
+    m_cEntries.store(cKept, std::memory_order_relaxed);
+
+    EndWrite();
+}
+
+// Make room for cchInserted characters typed at dwFromPosition
+void KeystrokeBuffer::ShiftPositions(DWORD dwFromPosition, DWORD cchInserted)
+{
+    DWORD cEntries = GetCount();
+
+    BeginWrite();
+
+    for (DWORD i = 0; i < cEntries; i++)
+    {
+        if (m_timeline.position[i] >= dwFromPosition)
+        {
+            m_timeline.position[i] = static_cast<BYTE>(m_timeline.position[i] + cchInserted);
+        }
+    }
+
+    EndWrite();
+}
+
+// Complete a keystroke that was recorded while its key was still held.
+// Such keystrokes carry keyUpUs == keyDownUs until the key up arrives.
+void KeystrokeBuffer::SetKeyUp(UINT32 keyDownUs, UINT32 keyUpUs)
+{
+    DWORD cEntries = GetCount();
+
+    for (DWORD i = cEntries; i > 0; i--)
+    {
+        if (m_timeline.keyDownUs[i - 1] == keyDownUs && m_timeline.keyUpUs[i - 1] == keyDownUs)
+        {
+            m_features.UpdateKeyUp(keyDownUs, keyDownUs, keyUpUs,
+                                   (i < cEntries) ? &m_timeline.keyDownUs[i] : nullptr);
+
+            BeginWrite();
+            m_timeline.keyUpUs[i - 1] = keyUpUs;
+            EndWrite();
+            return;
+        }
+    }
+}
+
+void KeystrokeBuffer::Clear()
+{
+    m_features.Reset();
+
+    BeginWrite();
+    WipeKeystrokeTimeline(&m_timeline, 0, GetCount());
+    m_cEntries.store(0, std::memory_order_relaxed);
+    EndWrite();
+}
+
+// Take keystroke dwIndex out of the features. Its neighbours become
+// adjacent: dwPrevIndex (when fHasPrev) and dwIndex + 1 (when present).
+void KeystrokeBuffer::RemoveFeatures(DWORD dwIndex, DWORD dwPrevIndex, BOOL fHasPrev, DWORD cEntries)
+{
+    const UINT32* rgDown = m_timeline.keyDownUs;
+    const UINT32* rgUp = m_timeline.keyUpUs;
+    BOOL fHasNext = (dwIndex + 1 < cEntries);
+
+    m_features.RemoveKeystroke(rgDown[dwIndex], rgUp[dwIndex]);
+
+    if (fHasPrev)
+    {
+        m_features.RemovePair(rgDown[dwPrevIndex], rgUp[dwPrevIndex], rgDown[dwIndex]);
+    }
+
+    if (fHasNext)
+    {
+        m_features.RemovePair(rgDown[dwIndex], rgUp[dwIndex], rgDown[dwIndex + 1]);
+    }
+
+    if (fHasPrev && fHasNext)
+    {
+        m_features.AddPair(rgDown[dwPrevIndex], rgUp[dwPrevIndex], rgDown[dwIndex + 1]);
+    }
+}
+
+void KeystrokeBuffer::GetFeatures(TypingFeatures* pFeatures) const
+{
+    DWORD cEntries = GetCount();
+    LONGLONG totalTypingTimeUs = 0;
+
+    if (cEntries > 0)
+    {
+        totalTypingTimeUs = static_cast<LONGLONG>(m_timeline.keyUpUs[cEntries - 1]) - m_timeline.keyDownUs[0];
+        if (totalTypingTimeUs < 0)
+        {
+            totalTypingTimeUs = 0;
+        }
+    }
+
+    m_features.GetFeatures(totalTypingTimeUs, pFeatures);
+}
+
+DWORD KeystrokeBuffer::Snapshot(KeystrokeTimeline* pTimeline, ULONG* pulSequence) const
+{
+    for (;;)
+    {
+        ULONG ulBefore = m_ulSequence.load(std::memory_order_acquire);
+        if (ulBefore & 1)
+        {
+            YieldProcessor();
+            continue;
+        }
+
+        DWORD cEntries = m_cEntries.load(std::memory_order_relaxed);
+        CopyKeystrokeTimeline(pTimeline, m_timeline, cEntries);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_ulSequence.load(std::memory_order_relaxed) == ulBefore)
+        {
+            if (pulSequence)
+            {
+                *pulSequence = ulBefore;
+            }
+            return cEntries;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+#include "KeystrokeTimeline.h"
+#include "TypingFeatures.h"
+
+// Fixed-capacity keystroke store embedded in the credential.
+//
+// Exactly one thread writes (the LogonUI callback thread, under the
+// credential lock). Every mutation is bracketed by a sequence counter that
+// is odd while the write is in progress, so any other thread can take a
+// consistent Snapshot() without the credential lock: it copies the lanes
+// and retries if the counter moved underneath it. Nothing here allocates,
+// and entries that fall off the end are wiped immediately. Typing features
+// are kept up to date with every mutation, so they are ready at submit.
+class KeystrokeBuffer
+{
+public:
+    KeystrokeBuffer();
+    ~KeystrokeBuffer();
+
+    // Writer side
+    HRESULT Append(WCHAR key, UINT32 keyDownUs, UINT32 keyUpUs, DWORD dwPosition, BYTE flags);
+    void RemoveLast();
+    void RemovePositions(DWORD dwPosition, DWORD cchRemoved);
+    void ShiftPositions(DWORD dwFromPosition, DWORD cchInserted);
+    void SetKeyUp(UINT32 keyDownUs, UINT32 keyUpUs);
+    void Clear();
+
+    DWORD GetCount() const { return m_cEntries.load(std::memory_order_relaxed); }
+    bool IsEmpty() const { return GetCount() == 0; }
+    const KeystrokeTimeline& GetTimeline() const { return m_timeline; }
+    void GetFeatures(TypingFeatures* pFeatures) const;
+
+    // Reader side, safe from any thread
+    DWORD Snapshot(KeystrokeTimeline* pTimeline, ULONG* pulSequence) const;
+    ULONG GetSequence() const { return m_ulSequence.load(std::memory_order_acquire); }
+
+private:
+    KeystrokeBuffer(const KeystrokeBuffer&);
+    KeystrokeBuffer& operator=(const KeystrokeBuffer&);
+
+    void BeginWrite();
+    void EndWrite();
+
+    void RemoveFeatures(DWORD dwIndex, DWORD dwPrevIndex, BOOL fHasPrev, DWORD cEntries);
+
+    KeystrokeTimeline m_timeline;
+    TypingFeatureAccumulator m_features;
+    std::atomic<DWORD> m_cEntries;
+    std::atomic<ULONG> m_ulSequence;
+};
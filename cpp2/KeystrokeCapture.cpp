@@ -0,0 +1,128 @@
+#include "KeystrokeCapture.h"
+
+KeystrokeEditTracker::KeystrokeEditTracker() :
+    m_cchValue(0)
+{
+    m_rgchValue[0] = L'\0';
+}
+
+KeystrokeEditTracker::~KeystrokeEditTracker()
+{
+    SecureZeroMemory(m_rgchValue, sizeof(m_rgchValue));
+}
+
+HRESULT KeystrokeEditTracker::Reset(PCWSTR pwzInitialValue)
+{
+    SecureZeroMemory(m_rgchValue, sizeof(m_rgchValue));
+    m_cchValue = 0;
+
+    if (pwzInitialValue)
+    {
+        size_t cch = wcsnlen(pwzInitialValue, KEYSTROKE_CAPTURE_MAX_LENGTH + 1);
+        if (cch > KEYSTROKE_CAPTURE_MAX_LENGTH)
+        {
+            return E_NOT_SUFFICIENT_BUFFER;
+        }
+
+        CopyMemory(m_rgchValue, pwzInitialValue, cch * sizeof(WCHAR));
+        m_rgchValue[cch] = L'\0';
+        m_cchValue = static_cast<DWORD>(cch);
+    }
+
+    return S_OK;
+}
+
+HRESULT KeystrokeEditTracker::Update(PCWSTR pwzNewValue, DWORD cchNewValue, KeystrokeEdit* pEdit)
+{
+    if (!pEdit)
+    {
+        return E_INVALIDARG;
+    }
+
+    ZeroMemory(pEdit, sizeof(*pEdit));
+    pEdit->kind = KEK_NONE;
+
+    PCWSTR pwzNew = pwzNewValue ? pwzNewValue : L"";
+    size_t cchNew = pwzNewValue ? cchNewValue : 0;
+    if (cchNew > KEYSTROKE_CAPTURE_MAX_LENGTH)
+    {
+        return E_NOT_SUFFICIENT_BUFFER;
+    }
+
+    size_t cchOld = m_cchValue;
+    size_t cchPrefix = 0;
+    size_t cchSuffix = 0;
+
+    // Fast paths: one character typed or erased at the end of the field.
+    // The whole prefix is compared; a field ending in a repeated character
+    // ("abcc" -> "aXbcc") would otherwise pass for an edit at the end.
+    if (cchNew == cchOld + 1 && wmemcmp(m_rgchValue, pwzNew, cchOld) == 0)
+    {
+        cchPrefix = cchOld;
+    }
+    else if (cchNew + 1 == cchOld && wmemcmp(m_rgchValue, pwzNew, cchNew) == 0)
+    {
+        cchPrefix = cchNew;
+    }
+    else
+    {
+        // General case: strip the common prefix and suffix, what is left in
+        // between is the edited span
+        size_t cchMin = (cchOld < cchNew) ? cchOld : cchNew;
+        while (cchPrefix < cchMin && m_rgchValue[cchPrefix] == pwzNew[cchPrefix])
+        {
+            cchPrefix++;
+        }
+
+        while (cchSuffix < cchMin - cchPrefix &&
+               m_rgchValue[cchOld - 1 - cchSuffix] == pwzNew[cchNew - 1 - cchSuffix])
+        {
+            cchSuffix++;
+        }
+    }
+
+    DWORD cchRemoved = static_cast<DWORD>(cchOld - cchPrefix - cchSuffix);
+    DWORD cchInserted = static_cast<DWORD>(cchNew - cchPrefix - cchSuffix);
+
+    pEdit->position = static_cast<DWORD>(cchPrefix);
+    pEdit->cchRemoved = cchRemoved;
+    pEdit->cchInserted = cchInserted;
+    pEdit->pwzInserted = pwzNew + cchPrefix;
+    pEdit->cchNewLength = static_cast<DWORD>(cchNew);
+
+    if (cchRemoved == 0 && cchInserted == 0)
+    {
+        pEdit->kind = KEK_NONE;
+        return S_OK;
+    }
+    else if (cchInserted == 0)
+    {
+        pEdit->kind = KEK_DELETE;
+    }
+    else if (cchRemoved == 0)
+    {
+        pEdit->kind = (cchInserted == 1) ? KEK_INSERT : KEK_PASTE;
+    }
+    else
+    {
+        pEdit->kind = KEK_REPLACE;
+    }
+
+    // Only the edited span of the mirror has to change
+    if (cchRemoved != cchInserted && cchSuffix > 0)
+    {
+        MoveMemory(m_rgchValue + cchPrefix + cchInserted,
+                   m_rgchValue + cchPrefix + cchRemoved,
+                   cchSuffix * sizeof(WCHAR));
+    }
+    CopyMemory(m_rgchValue + cchPrefix, pwzNew + cchPrefix, cchInserted * sizeof(WCHAR));
+
+    if (cchNew < cchOld)
+    {
+        SecureZeroMemory(m_rgchValue + cchNew, (cchOld - cchNew) * sizeof(WCHAR));
+    }
+    m_rgchValue[cchNew] = L'\0';
+    m_cchValue = static_cast<DWORD>(cchNew);
+
+    return S_OK;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <windows.h>
+
+// Largest field value the edit tracker mirrors (matches MAX_PASSWORD_LENGTH)
+#define KEYSTROKE_CAPTURE_MAX_LENGTH    256
+
+// Kind of edit observed between two successive values of a field
+enum KEYSTROKE_EDIT_KIND
+{
+    KEK_NONE = 0,       // Value unchanged
+    KEK_INSERT,         // One character typed
+    KEK_DELETE,         // Characters removed (backspace, delete, cut)
+    KEK_REPLACE,        // Selection overwritten by new text
+    KEK_PASTE,          // Several characters inserted at once
+    KEK_NUM_KINDS
+};
+
+// Minimal edit turning the previous field value into the new one
+struct KeystrokeEdit
+{
+    KEYSTROKE_EDIT_KIND kind;
+    DWORD position;            // First character position touched by the edit
+    DWORD cchRemoved;          // Characters removed at position
+    DWORD cchInserted;         // Characters inserted at position
+    PCWSTR pwzInserted;        // Inserted text, points into the new value
+    DWORD cchNewLength;        // Field length after the edit
+};
+
+// Mirrors the last value seen by SetStringValue and diffs each new value
+// against it. The caller passes the new length, which SetStringValue has
+// already measured. Typing and backspacing at the end of the field are
+// recognized from the length and a compare of the unchanged prefix;
+// anything else falls back to a prefix/suffix scan. The mirror lives in a
+// fixed buffer and is wiped on reset.
+class KeystrokeEditTracker
+{
+public:
+    KeystrokeEditTracker();
+    ~KeystrokeEditTracker();
+
+    HRESULT Update(PCWSTR pwzNewValue, DWORD cchNewValue, KeystrokeEdit* pEdit);
+    HRESULT Reset(PCWSTR pwzInitialValue);
+
+    DWORD GetLength() const { return m_cchValue; }
+
+private:
+    KeystrokeEditTracker(const KeystrokeEditTracker&);
+    KeystrokeEditTracker& operator=(const KeystrokeEditTracker&);
+
+    WCHAR m_rgchValue[KEYSTROKE_CAPTURE_MAX_LENGTH + 1];
+    DWORD m_cchValue;
+};
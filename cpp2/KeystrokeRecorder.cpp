@@ -0,0 +1,158 @@
+#include "KeystrokeRecorder.h"
+#include "Clock.h"
+
+KeystrokeRecorder::KeystrokeRecorder() :
+    m_pKeystrokes(nullptr),
+    m_llStaleTicks(0),
+    m_llFirstKeystrokeTime(0),
+    m_llLastKeystrokeTime(0),
+    m_bFirstKeystroke(TRUE)
+{
+}
+
+void KeystrokeRecorder::Initialize(KeystrokeBuffer* pKeystrokes, LONGLONG llStaleTicks)
+{
+    m_pKeystrokes = pKeystrokes;
+    m_llStaleTicks = llStaleTicks;
+}
+
+HRESULT KeystrokeRecorder::Reset(PCWSTR pwzValue)
+{
+    m_bFirstKeystroke = TRUE;
+    m_llFirstKeystrokeTime = 0;
+    m_llLastKeystrokeTime = 0;
+    return m_editTracker.Reset(pwzValue);
+}
+
+void KeystrokeRecorder::ResetKeyEvents()
+{
+    m_keyEventQueue.Discard();
+    m_keyEventPairer.Reset();
+}
+
+HRESULT KeystrokeRecorder::Record(PCWSTR pwzNewValue, DWORD cchNewValue, LONGLONG llNow, KeystrokeEdit* pEdit)
+{
+    // Work out what changed since the last value
+    DWORD cchOldLength = m_editTracker.GetLength();
+    HRESULT hr = m_editTracker.Update(pwzNewValue, cchNewValue, pEdit);
+    if (FAILED(hr))
+    {
+        pEdit->kind = KEK_NONE;
+        return hr;
+    }
+
+    if (pEdit->kind == KEK_NONE)
+    {
+        return S_OK;
+    }
+
+    LONGLONG keyDownTime = llNow;
+    LONGLONG keyUpTime = llNow;
+
+    // A typed character takes its timing from the key event behind it;
+    // without one, the time of this callback stands in for both edges
+    DrainKeyEvents();
+    if (pEdit->cchInserted == 1 && pEdit->kind != KEK_PASTE)
+    {
+        LONGLONG claimedUpTime = 0;
+        if (m_keyEventPairer.ClaimKeyDown(llNow, m_llStaleTicks, &keyDownTime, &claimedUpTime))
+        {
+            keyUpTime = claimedUpTime ? claimedUpTime : keyDownTime;
+        }
+    }
+    else
+    {
+        m_keyEventPairer.DiscardUnclaimed();
+    }
+
+    if (m_bFirstKeystroke)
+    {
+        m_llFirstKeystrokeTime = keyDownTime;
+        m_bFirstKeystroke = FALSE;
+    }
+
+    // Apply the edit to the keystroke stream
+    if (pEdit->cchRemoved > 0)
+    {
+        RemoveKeystrokes(pEdit->position, pEdit->cchRemoved, cchOldLength);
+    }
+
+    if (pEdit->cchInserted > 0)
+    {
+        hr = InsertKeystrokes(*pEdit, keyDownTime, keyUpTime);
+    }
+
+    m_llLastKeystrokeTime = keyDownTime;
+    return hr;
+}
+
+// Pair up the key transitions queued by the key event source. A key up
+// that completes an already recorded keystroke fills in its release time.
+void KeystrokeRecorder::DrainKeyEvents()
+{
+    KeyEvent keyEvent;
+    LONGLONG keyDownTime = 0;
+    LONGLONG keyUpTime = 0;
+
+    while (m_keyEventQueue.TryPop(&keyEvent))
+    {
+        if (m_keyEventPairer.Ingest(keyEvent, &keyDownTime, &keyUpTime) && !m_bFirstKeystroke)
+        {
+            m_pKeystrokes->SetKeyUp(
+                GetClock().ElapsedMicroseconds(m_llFirstKeystrokeTime, keyDownTime),
+                GetClock().ElapsedMicroseconds(m_llFirstKeystrokeTime, keyUpTime));
+        }
+    }
+}
+
+// Drop the keystrokes that produced the characters in [dwPosition, dwPosition + cchRemoved)
+void KeystrokeRecorder::RemoveKeystrokes(DWORD dwPosition, DWORD cchRemoved, DWORD cchOldLength)
+{
+    KeystrokeBuffer& keystrokes = *m_pKeystrokes;
+    const KeystrokeTimeline& timeline = keystrokes.GetTimeline();
+
+    // Backspace over the most recent keystroke is the common case
+    if (cchRemoved == 1 && !keystrokes.IsEmpty() &&
+        timeline.position[keystrokes.GetCount() - 1] == dwPosition &&
+        dwPosition + 1 == cchOldLength)
+    {
+        keystrokes.RemoveLast();
+    }
+    else
+    {
+        keystrokes.RemovePositions(dwPosition, cchRemoved);
+    }
+}
+
+// Record one keystroke per inserted character
+HRESULT KeystrokeRecorder::InsertKeystrokes(const KeystrokeEdit& edit, LONGLONG keyDownTime, LONGLONG keyUpTime)
+{
+    HRESULT hr = S_OK;
+
+    // Characters typed in the middle of the field push the tail along
+    if (edit.position + edit.cchInserted < edit.cchNewLength)
+    {
+        m_pKeystrokes->ShiftPositions(edit.position, edit.cchInserted);
+    }
+
+    BYTE flags = 0;
+    if (edit.kind == KEK_PASTE)
+    {
+        flags = KEYSTROKE_FLAG_PASTED;
+    }
+    else if (edit.kind == KEK_REPLACE)
+    {
+        flags = (edit.cchInserted > 1) ? (KEYSTROKE_FLAG_REPLACED | KEYSTROKE_FLAG_PASTED) : KEYSTROKE_FLAG_REPLACED;
+    }
+
+    // A key still held is recorded with key up == key down until its release arrives
+    UINT32 keyDownUs = GetClock().ElapsedMicroseconds(m_llFirstKeystrokeTime, keyDownTime);
+    UINT32 keyUpUs = GetClock().ElapsedMicroseconds(m_llFirstKeystrokeTime, keyUpTime);
+
+    for (DWORD i = 0; i < edit.cchInserted && SUCCEEDED(hr); i++)
+    {
+        hr = m_pKeystrokes->Append(edit.pwzInserted[i], keyDownUs, keyUpUs, edit.position + i, flags);
+    }
+
+    return hr;
+}
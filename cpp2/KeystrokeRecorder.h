@@ -0,0 +1,57 @@
+#pragma once
+
+#include <windows.h>
+#include "KeystrokeCapture.h"
+#include "KeystrokeBuffer.h"
+#include "KeyEventPairer.h"
+
+// The capture path behind SetStringValue: diffs each new field value
+// against the last one, pairs the key events queued by the key event
+// source with the characters typed, and applies the edit to a keystroke
+// buffer the caller owns. Keystroke times are microseconds since the
+// first keystroke after Reset().
+//
+// Everything but the queue runs on one thread under the caller's lock;
+// the key event source feeds the queue from its own thread. Nothing here
+// allocates, which CaptureBenchmark checks.
+class KeystrokeRecorder
+{
+public:
+    KeystrokeRecorder();
+
+    void Initialize(KeystrokeBuffer* pKeystrokes, LONGLONG llStaleTicks);
+
+    // Diff future edits against pwzValue and restart the clock at the next
+    // keystroke. The keystroke buffer is the caller's to clear.
+    HRESULT Reset(PCWSTR pwzValue);
+
+    // Forget queued and pending key events, for a source being started or stopped
+    void ResetKeyEvents();
+
+    // Apply the field's new value; pEdit->kind is KEK_NONE when nothing changed
+    HRESULT Record(PCWSTR pwzNewValue, DWORD cchNewValue, LONGLONG llNow, KeystrokeEdit* pEdit);
+
+    // Fill in release times from key ups queued since the last edit
+    void DrainKeyEvents();
+
+    IKeyEventSink* GetKeyEventSink() { return &m_keyEventQueue; }
+    LONG GetDroppedKeyEventCount() const { return m_keyEventQueue.GetDroppedCount(); }
+    LONGLONG GetFirstKeystrokeTime() const { return m_llFirstKeystrokeTime; }
+    LONGLONG GetLastKeystrokeTime() const { return m_llLastKeystrokeTime; }
+
+private:
+    KeystrokeRecorder(const KeystrokeRecorder&);
+    KeystrokeRecorder& operator=(const KeystrokeRecorder&);
+
+    void RemoveKeystrokes(DWORD dwPosition, DWORD cchRemoved, DWORD cchOldLength);
+    HRESULT InsertKeystrokes(const KeystrokeEdit& edit, LONGLONG keyDownTime, LONGLONG keyUpTime);
+
+    KeystrokeBuffer* m_pKeystrokes;
+    KeystrokeEditTracker m_editTracker;
+    KeyEventQueue m_keyEventQueue;
+    KeyEventPairer m_keyEventPairer;
+    LONGLONG m_llStaleTicks;
+    LONGLONG m_llFirstKeystrokeTime;
+    LONGLONG m_llLastKeystrokeTime;
+    BOOL m_bFirstKeystroke;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <windows.h>
+#include "KeystrokeCapture.h"
+
+// One keystroke per password character, so the timeline never needs to grow
+#define MAX_KEYSTROKE_COUNT     KEYSTROKE_CAPTURE_MAX_LENGTH
+
+// Keystroke flags
+#define KEYSTROKE_FLAG_PASTED       0x01    // Character arrived as part of a paste
+#define KEYSTROKE_FLAG_REPLACED     0x02    // Character overwrote a selection
+
+// Compact structure-of-arrays keystroke timeline.
+//
+// Keystrokes are kept in the order they were typed. Times are microsecond
+// offsets from the first keystroke of the attempt, which fit in 32 bits for
+// any realistic logon and keep each timing lane contiguous and 32-byte
+// aligned for vector loads. Entry i of every lane describes keystroke i;
+// lanes are only meaningful up to count.
+struct KeystrokeTimeline
+{
+    alignas(32) UINT32 keyDownUs[MAX_KEYSTROKE_COUNT];   // Key pressed, us since first keystroke
+    alignas(32) UINT32 keyUpUs[MAX_KEYSTROKE_COUNT];     // Key released, us since first keystroke
+    alignas(32) WCHAR keyId[MAX_KEYSTROKE_COUNT];        // Character produced
+    BYTE position[MAX_KEYSTROKE_COUNT];                  // Position in the password string
+    BYTE flags[MAX_KEYSTROKE_COUNT];                     // KEYSTROKE_FLAG_* values
+    DWORD count;
+};
+
+// Bytes one keystroke occupies across all lanes
+#define KEYSTROKE_TIMELINE_ENTRY_SIZE \
+    (2 * sizeof(UINT32) + sizeof(WCHAR) + 2 * sizeof(BYTE))
+
+// Copy the first cEntries keystrokes of every lane
+inline void CopyKeystrokeTimeline(KeystrokeTimeline* pDest, const KeystrokeTimeline& src, DWORD cEntries)
+{
+    CopyMemory(pDest->keyDownUs, src.keyDownUs, cEntries * sizeof(UINT32));
+    CopyMemory(pDest->keyUpUs, src.keyUpUs, cEntries * sizeof(UINT32));
+    CopyMemory(pDest->keyId, src.keyId, cEntries * sizeof(WCHAR));
+    CopyMemory(pDest->position, src.position, cEntries * sizeof(BYTE));
+    CopyMemory(pDest->flags, src.flags, cEntries * sizeof(BYTE));
+    pDest->count = cEntries;
+}
+
+// Wipe keystrokes [dwFirst, dwFirst + cEntries) in every lane
+inline void WipeKeystrokeTimeline(KeystrokeTimeline* pTimeline, DWORD dwFirst, DWORD cEntries)
+{
+    SecureZeroMemory(pTimeline->keyDownUs + dwFirst, cEntries * sizeof(UINT32));
+    SecureZeroMemory(pTimeline->keyUpUs + dwFirst, cEntries * sizeof(UINT32));
+    SecureZeroMemory(pTimeline->keyId + dwFirst, cEntries * sizeof(WCHAR));
+    SecureZeroMemory(pTimeline->position + dwFirst, cEntries * sizeof(BYTE));
+    SecureZeroMemory(pTimeline->flags + dwFirst, cEntries * sizeof(BYTE));
+}
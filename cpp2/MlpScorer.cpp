@@ -0,0 +1,175 @@
+#include "MlpScorer.h"
+#include "TypingScorer.h"
+#include "MlpWeights.h"
+#include <math.h>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <immintrin.h>
+#define MLP_SCORER_X86
+#endif
+
+static_assert(MLP_INPUT_COUNT == MLP_FEATURE_INPUTS, "MlpWeights.h was generated for a different input layout");
+static_assert(MLP_INPUT_STRIDE % 16 == 0 && MLP_MAX_WIDTH % 16 == 0, "MLP layers must be padded to 16 inputs");
+
+// int8 dot products over a multiple of 16 elements, accumulated in int32
+static INT32 DotScalar(const INT8* pWeights, const INT8* pInputs, DWORD c)
+{
+    INT32 sum = 0;
+    for (DWORD i = 0; i < c; i++)
+    {
+        sum += static_cast<INT32>(pWeights[i]) * pInputs[i];
+    }
+    return sum;
+}
+
+#ifdef MLP_SCORER_X86
+
+FEATURE_KERNEL_TARGET("sse4.1")
+static INT32 DotSse41(const INT8* pWeights, const INT8* pInputs, DWORD c)
+{
+    __m128i sum = _mm_setzero_si128();
+    for (DWORD i = 0; i < c; i += 8)
+    {
+        __m128i w = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pWeights + i)));
+        __m128i x = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pInputs + i)));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(w, x));
+    }
+
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+FEATURE_KERNEL_TARGET("avx2")
+static INT32 DotAvx2(const INT8* pWeights, const INT8* pInputs, DWORD c)
+{
+    __m256i sum = _mm256_setzero_si256();
+    for (DWORD i = 0; i < c; i += 16)
+    {
+        __m256i w = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pWeights + i)));
+        __m256i x = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pInputs + i)));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(w, x));
+    }
+
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    _mm256_zeroupper();
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(half);
+}
+
+#endif // MLP_SCORER_X86
+
+typedef INT32 (*PFN_MLP_DOT)(const INT8* pWeights, const INT8* pInputs, DWORD c);
+
+static PFN_MLP_DOT GetDotKernel()
+{
+#ifdef MLP_SCORER_X86
+    switch (GetFeatureKernelIsa())
+    {
+    case FKI_AVX2:
+        return DotAvx2;
+
+    case FKI_SSE41:
+        return DotSse41;
+
+    default:
+        break;
+    }
+#endif
+
+    return DotScalar;
+}
+
+static INT8 SaturateInt8(LONGLONG value, LONGLONG minimum)
+{
+    return static_cast<INT8>((value < minimum) ? minimum : (value > 127) ? 127 : value);
+}
+
+void BuildMlpInputs(const TimingFeatureSet& features, const TypingTemplate& typingTemplate,
+                    float rgInputs[MLP_FEATURE_INPUTS])
+{
+    for (DWORD f = 0; f < TF_NUM_FEATURES; f++)
+    {
+        const INT32* pValues = features.values[f];
+        const float* pMean = typingTemplate.mean[f];
+        const float* pMad = typingTemplate.meanAbsDeviation[f];
+        const float* pStdDev = typingTemplate.stdDev[f];
+        DWORD c = features.stats[f].count;
+
+        double manhattan = 0.0;
+        double sumSquaredZ = 0.0;
+        double maxAbsZ = 0.0;
+        double shift = 0.0;
+        double spread = 0.0;
+
+        for (DWORD i = 0; i < c; i++)
+        {
+            double mad = (pMad[i] > TYPING_TEMPLATE_MIN_SPREAD_US) ? pMad[i] : TYPING_TEMPLATE_MIN_SPREAD_US;
+            double sd = (pStdDev[i] > TYPING_TEMPLATE_MIN_SPREAD_US) ? pStdDev[i] : TYPING_TEMPLATE_MIN_SPREAD_US;
+            double delta = pValues[i] - pMean[i];
+            double z = fabs(delta) / sd;
+
+            manhattan += fabs(delta) / mad;
+            sumSquaredZ += z * z;
+            maxAbsZ = (z > maxAbsZ) ? z : maxAbsZ;
+            shift += delta;
+            spread += sd;
+        }
+
+        float* pInputs = rgInputs + f * MI_PER_FEATURE;
+        pInputs[MI_MANHATTAN] = (c > 0) ? static_cast<float>(manhattan / c) : 0.0f;
+        pInputs[MI_RMS_Z] = (c > 0) ? static_cast<float>(sqrt(sumSquaredZ / c)) : 0.0f;
+        pInputs[MI_MAX_Z] = static_cast<float>(maxAbsZ);
+        pInputs[MI_TEMPO] = (spread > 0.0) ? static_cast<float>(shift / spread) : 0.0f;
+    }
+}
+
+HRESULT EvaluateTypingMlp(const TimingFeatureSet& features, const TypingTemplate& typingTemplate,
+                          double* pProbability)
+{
+    if (!pProbability)
+    {
+        return E_INVALIDARG;
+    }
+
+    static const PFN_MLP_DOT s_pfnDot = GetDotKernel();
+
+    float rgInputs[MLP_FEATURE_INPUTS];
+    BuildMlpInputs(features, typingTemplate, rgInputs);
+
+    // Two ping-pong activation buffers; padding lanes stay zero
+    alignas(32) INT8 rgActivations[2][MLP_MAX_WIDTH] = {};
+    for (DWORD i = 0; i < MLP_FEATURE_INPUTS; i++)
+    {
+        float q = rgInputs[i] / s_mlpInputScale;
+        rgActivations[0][i] = SaturateInt8(static_cast<LONGLONG>(q + ((q < 0.0f) ? -0.5f : 0.5f)), -127);
+    }
+
+    double logit = 0.0;
+    for (DWORD l = 0; l < ARRAYSIZE(s_rgMlpLayers); l++)
+    {
+        const MlpLayer& layer = s_rgMlpLayers[l];
+        const INT8* pIn = rgActivations[l & 1];
+        INT8* pOut = rgActivations[(l + 1) & 1];
+        ZeroMemory(pOut, MLP_MAX_WIDTH);
+
+        for (DWORD o = 0; o < layer.cOutputs; o++)
+        {
+            INT32 acc = s_pfnDot(layer.pWeights + o * layer.cInputs, pIn, layer.cInputs) + layer.pBias[o];
+
+            if (layer.fRelu)
+            {
+                LONGLONG scaled = (static_cast<LONGLONG>(acc) * layer.multiplier +
+                                   (1LL << (layer.shift - 1))) >> layer.shift;
+                pOut[o] = SaturateInt8(scaled, 0);
+            }
+            else
+            {
+                logit = acc * static_cast<double>(s_mlpOutputScale);
+            }
+        }
+    }
+
+    *pProbability = 1.0 / (1.0 + exp(-logit));
+    return S_OK;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <windows.h>
+#include "FeatureKernels.h"
+
+struct TypingTemplate;
+
+// What the verifier network sees about each timing feature: how far the
+// attempt is from the user's template, not the raw timings, so one network
+// serves every user
+enum MLP_INPUT
+{
+    MI_MANHATTAN = 0,       // Mean |x - mean| / mean absolute deviation
+    MI_RMS_Z,               // Root mean square z-score
+    MI_MAX_Z,               // Largest |z-score|
+    MI_TEMPO,               // Signed shift of the attempt's mean, in template spreads
+    MI_PER_FEATURE
+};
+
+#define MLP_FEATURE_INPUTS          (TF_NUM_FEATURES * MI_PER_FEATURE)
+
+// One quantized layer. Weights are int8, row-major [outputs][inputs] with
+// inputs padded to a multiple of 16; accumulators are int32. Hidden layers
+// requantize to int8 with a fixed-point multiplier and apply ReLU.
+struct MlpLayer
+{
+    const INT8* pWeights;
+    const INT32* pBias;
+    DWORD cInputs;
+    DWORD cOutputs;
+    INT32 multiplier;       // Q31 multiplier of acc -> next activation
+    INT32 shift;
+    BOOL fRelu;
+};
+
+void BuildMlpInputs(const TimingFeatureSet& features, const TypingTemplate& typingTemplate,
+                    float rgInputs[MLP_FEATURE_INPUTS]);
+
+// Probability that the attempt was typed by the template's owner, from the
+// network baked into MlpWeights.h
+HRESULT EvaluateTypingMlp(const TimingFeatureSet& features, const TypingTemplate& typingTemplate,
+                          double* pProbability);
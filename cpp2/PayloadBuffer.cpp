@@ -0,0 +1,47 @@
+#include "PayloadBuffer.h"
+
+PayloadBuffer::PayloadBuffer() :
+    m_pchBuffer(nullptr),
+    m_cbBuffer(0),
+    m_fLocked(FALSE)
+{
+}
+
+PayloadBuffer::~PayloadBuffer()
+{
+    if (m_pchBuffer)
+    {
+        SecureZeroMemory(m_pchBuffer, m_cbBuffer);
+        if (m_fLocked)
+        {
+            VirtualUnlock(m_pchBuffer, m_cbBuffer);
+        }
+        VirtualFree(m_pchBuffer, 0, MEM_RELEASE);
+    }
+}
+
+HRESULT PayloadBuffer::Initialize(size_t cbCapacity)
+{
+    if (m_pchBuffer)
+    {
+        return E_NOT_VALID_STATE;
+    }
+
+    m_pchBuffer = static_cast<char*>(VirtualAlloc(nullptr, cbCapacity, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+    if (!m_pchBuffer)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_cbBuffer = cbCapacity;
+    m_fLocked = VirtualLock(m_pchBuffer, m_cbBuffer);
+    return S_OK;
+}
+
+void PayloadBuffer::Wipe(size_t cbUsed)
+{
+    if (m_pchBuffer)
+    {
+        SecureZeroMemory(m_pchBuffer, (cbUsed < m_cbBuffer) ? cbUsed : m_cbBuffer);
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <windows.h>
+
+// Reusable buffer that request payloads are built in.
+//
+// Payloads carry the typed characters, so the buffer is allocated once,
+// locked so it never reaches the pagefile, and wiped after every request,
+// the same way FieldStringStore keeps field values.
+class PayloadBuffer
+{
+public:
+    PayloadBuffer();
+    ~PayloadBuffer();
+
+    HRESULT Initialize(size_t cbCapacity);
+
+    char* Get() const { return m_pchBuffer; }
+    size_t GetCapacity() const { return m_cbBuffer; }
+
+    // Clear the first cbUsed bytes once a payload has been sent
+    void Wipe(size_t cbUsed);
+
+private:
+    PayloadBuffer(const PayloadBuffer&);
+    PayloadBuffer& operator=(const PayloadBuffer&);
+
+    char* m_pchBuffer;
+    size_t m_cbBuffer;
+    BOOL m_fLocked;
+};
@@ -0,0 +1,71 @@
+#include "StatusTextScheduler.h"
+#include "Clock.h"
+#include <strsafe.h>
+
+StatusTextScheduler::StatusTextScheduler() :
+    m_fPending(FALSE),
+    m_fUrgent(FALSE),
+    m_llLastSent(0),
+    m_llMinInterval(0)
+{
+    InitializeSRWLock(&m_lock);
+    m_szPending[0] = L'\0';
+}
+
+void StatusTextScheduler::Initialize(DWORD dwMaxUpdatesPerSecond, LONGLONG llFrequency)
+{
+    AcquireSRWLockExclusive(&m_lock);
+    m_llMinInterval = (dwMaxUpdatesPerSecond > 0) ? llFrequency / dwMaxUpdatesPerSecond : 0;
+    ReleaseSRWLockExclusive(&m_lock);
+}
+
+void StatusTextScheduler::Post(PCWSTR pszStatus)
+{
+    AcquireSRWLockExclusive(&m_lock);
+    StringCchCopyW(m_szPending, ARRAYSIZE(m_szPending), pszStatus);
+    m_fPending = TRUE;
+    ReleaseSRWLockExclusive(&m_lock);
+}
+
+// A stage message supersedes pending keystroke status and skips the cap
+void StatusTextScheduler::PostStage(PCWSTR pszStatus)
+{
+    AcquireSRWLockExclusive(&m_lock);
+    StringCchCopyW(m_szPending, ARRAYSIZE(m_szPending), pszStatus);
+    m_fPending = TRUE;
+    m_fUrgent = TRUE;
+    ReleaseSRWLockExclusive(&m_lock);
+}
+
+HRESULT StatusTextScheduler::Flush(ICredentialProviderCredentialEvents* pEvents,
+                                   ICredentialProviderCredential* pCredential,
+                                   DWORD dwFieldID,
+                                   BOOL fForce)
+{
+    WCHAR szStatus[STATUS_TEXT_MAX_LENGTH];
+    LONGLONG now = GetClock().Now();
+
+    AcquireSRWLockExclusive(&m_lock);
+
+    if (!m_fPending || (!fForce && !m_fUrgent && now - m_llLastSent < m_llMinInterval))
+    {
+        ReleaseSRWLockExclusive(&m_lock);
+        return S_FALSE;
+    }
+
+    CopyMemory(szStatus, m_szPending, sizeof(szStatus));
+    m_fPending = FALSE;
+    m_fUrgent = FALSE;
+    m_llLastSent = now;
+
+    ReleaseSRWLockExclusive(&m_lock);
+
+    // The COM call happens with no lock held
+    HRESULT hr = S_OK;
+    if (pEvents)
+    {
+        hr = pEvents->SetFieldString(pCredential, dwFieldID, szStatus);
+    }
+
+    return hr;
+}
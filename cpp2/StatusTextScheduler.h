@@ -0,0 +1,41 @@
+#pragma once
+
+#include <windows.h>
+#include <credentialprovider.h>
+
+// Longest status line the scheduler holds, including the terminator
+#define STATUS_TEXT_MAX_LENGTH      128
+
+// Coalesces status field updates so typing never waits on LogonUI.
+//
+// Post() only records the latest text (last write wins) and is cheap enough
+// to call under the credential lock. Flush() is called on the LogonUI
+// thread once the lock has been released and forwards the pending text to
+// SetFieldString, at most once per update interval. A text that arrives
+// inside the interval stays pending and goes out with the next Flush() that
+// is due, or immediately when the caller forces it. PostStage() is for
+// messages that must not wait: they supersede pending keystroke status and
+// go out with the next Flush(), whatever the interval.
+class StatusTextScheduler
+{
+public:
+    StatusTextScheduler();
+
+    // 0 updates per second removes the cap; llFrequency is GetClock() ticks per second
+    void Initialize(DWORD dwMaxUpdatesPerSecond, LONGLONG llFrequency);
+
+    void Post(PCWSTR pszStatus);
+    void PostStage(PCWSTR pszStatus);
+    HRESULT Flush(ICredentialProviderCredentialEvents* pEvents,
+                  ICredentialProviderCredential* pCredential,
+                  DWORD dwFieldID,
+                  BOOL fForce);
+
+private:
+    SRWLOCK m_lock;
+    WCHAR m_szPending[STATUS_TEXT_MAX_LENGTH];
+    BOOL m_fPending;
+    BOOL m_fUrgent;                 // Pending text is a stage message
+    LONGLONG m_llLastSent;
+    LONGLONG m_llMinInterval;
+};
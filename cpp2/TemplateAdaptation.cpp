@@ -0,0 +1,157 @@
+#include "TemplateAdaptation.h"
+#include "Dll.h"
+#include <math.h>
+
+// Serializes load-modify-commit cycles on the store within the process
+static SRWLOCK s_storeWriteLock = SRWLOCK_INIT;
+
+HRESULT AdaptTypingTemplate(TypingTemplate* pTemplate, const TimingFeatureSet& features, float rate)
+{
+    // Checked like IsValidTypingTemplate, except that a started template has no samples yet
+    DWORD cKeys = pTemplate->keystrokeCount;
+    if (pTemplate->magic != TYPING_TEMPLATE_MAGIC || pTemplate->version != TYPING_TEMPLATE_VERSION ||
+        cKeys == 0 || cKeys > MAX_KEYSTROKE_COUNT || features.stats[TF_DWELL].count != cKeys ||
+        !(rate >= 0.0f && rate <= 1.0f))
+    {
+        return E_INVALIDARG;
+    }
+
+    float weight = 1.0f / (pTemplate->sampleCount + 1.0f);
+    if (weight < rate)
+    {
+        weight = rate;
+    }
+    float decay = 1.0f - weight;
+
+    for (DWORD f = 0; f < TF_NUM_FEATURES; f++)
+    {
+        DWORD c = (f == TF_DWELL) ? cKeys : cKeys - 1;
+        const INT32* pValues = features.values[f];
+        float* pMean = pTemplate->mean[f];
+        float* pMeanAbsDeviation = pTemplate->meanAbsDeviation[f];
+        float* pStdDev = pTemplate->stdDev[f];
+
+        for (DWORD i = 0; i < c; i++)
+        {
+            float diff = pValues[i] - pMean[i];
+            float increment = weight * diff;
+            pMean[i] += increment;
+            pStdDev[i] = sqrtf(decay * (pStdDev[i] * pStdDev[i] + diff * increment));
+            pMeanAbsDeviation[i] = decay * pMeanAbsDeviation[i] + weight * fabsf(diff);
+        }
+    }
+
+    if (pTemplate->sampleCount < MAXDWORD)
+    {
+        pTemplate->sampleCount++;
+    }
+
+    return S_OK;
+}
+
+void StartTypingTemplate(TypingTemplate* pTemplate, DWORD cKeys)
+{
+    ZeroMemory(pTemplate, sizeof(*pTemplate));
+    pTemplate->magic = TYPING_TEMPLATE_MAGIC;
+    pTemplate->version = TYPING_TEMPLATE_VERSION;
+    pTemplate->keystrokeCount = cKeys;
+}
+
+static HRESULT ApplyTemplateAdaptation(TemplateAdaptationRequest* pRequest)
+{
+    AcquireSRWLockExclusive(&s_storeWriteLock);
+
+    BOOL fRebuildDigraphs = FALSE;
+    DigraphTable digraphs;
+    TemplateStoreWriter writer;
+    HRESULT hr = writer.Load(pRequest->szStorePath);
+    if (SUCCEEDED(hr))
+    {
+        // Start from the latest stored version, which may include adaptations
+        // made since the attempt was scored. An enrollment starts from the
+        // empty template it carries, replacing any entry for another length.
+        const TypingTemplate* pStored = writer.Find(pRequest->szSid);
+        if (pStored && pStored->keystrokeCount == pRequest->baseline.keystrokeCount)
+        {
+            CopyMemory(&pRequest->baseline, pStored, sizeof(pRequest->baseline));
+        }
+        else
+        {
+            fRebuildDigraphs = TRUE;
+        }
+
+        hr = AdaptTypingTemplate(&pRequest->baseline, pRequest->features, pRequest->rate);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = writer.Put(pRequest->szSid, pRequest->baseline);
+    }
+
+    // A table for another password or another key is started over. Without
+    // a key the pairs were never hashed, and the stored table is kept.
+    BOOL fHaveDigraphs = (pRequest->digraphKeyId != 0);
+    if (SUCCEEDED(hr) && fHaveDigraphs)
+    {
+        const DigraphTable* pStored = writer.FindDigraphs(pRequest->szSid);
+        const INT32* pLatencies = pRequest->features.values[TF_DOWN_DOWN];
+        DWORD cPairs = pRequest->features.stats[TF_DOWN_DOWN].count;
+
+        if (!fRebuildDigraphs && pStored && pStored->pairCount > 0 && pStored->keyId == pRequest->digraphKeyId)
+        {
+            CopyMemory(&digraphs, pStored, sizeof(digraphs));
+            UpdateDigraphTable(&digraphs, pRequest->digraphKeys, pLatencies, cPairs, pRequest->rate);
+        }
+        else
+        {
+            hr = BuildDigraphTable(&digraphs, pRequest->digraphKeyId, pRequest->digraphKeys,
+                                   pLatencies, cPairs);
+        }
+    }
+
+    if (SUCCEEDED(hr) && fHaveDigraphs)
+    {
+        hr = writer.PutDigraphs(pRequest->szSid, digraphs);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = writer.Commit();
+    }
+
+    ReleaseSRWLockExclusive(&s_storeWriteLock);
+
+    SecureZeroMemory(&digraphs, sizeof(digraphs));
+    return hr;
+}
+
+static VOID CALLBACK s_AdaptTemplateCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+
+    TemplateAdaptationRequest* pRequest = static_cast<TemplateAdaptationRequest*>(pvContext);
+    ApplyTemplateAdaptation(pRequest);
+
+    SecureZeroMemory(pRequest, sizeof(*pRequest));
+    delete pRequest;
+    DllRelease();
+}
+
+HRESULT QueueTemplateAdaptation(const TemplateAdaptationRequest& request)
+{
+    TemplateAdaptationRequest* pRequest = new TemplateAdaptationRequest;
+    CopyMemory(pRequest, &request, sizeof(*pRequest));
+
+    // Keeps the DLL loaded until the callback is done with it
+    DllAddRef();
+    if (!TrySubmitThreadpoolCallback(s_AdaptTemplateCallback, pRequest, nullptr))
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        SecureZeroMemory(pRequest, sizeof(*pRequest));
+        delete pRequest;
+        DllRelease();
+        return hr;
+    }
+
+    return S_OK;
+}
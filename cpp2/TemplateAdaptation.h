@@ -0,0 +1,38 @@
+#pragma once
+
+#include <windows.h>
+#include "TypingScorer.h"
+#include "TemplateStore.h"
+
+// Fold one accepted attempt into a template with exponentially weighted
+// means, variances and mean absolute deviations. The newest attempt gets
+// weight rate, or 1 / (samples + 1) while that is larger, so a young
+// template averages its first attempts equally before it starts to
+// forget. Constant work per keystroke position, whatever the history.
+// The attempt must have the template's keystroke count. A template from
+// StartTypingTemplate takes its first attempt as is. A rate of 0 keeps
+// averaging equally.
+HRESULT AdaptTypingTemplate(TypingTemplate* pTemplate, const TimingFeatureSet& features, float rate);
+
+// An empty template for a password of cKeys keystrokes, to be enrolled
+// through AdaptTypingTemplate
+void StartTypingTemplate(TypingTemplate* pTemplate, DWORD cKeys);
+
+// An attempt waiting for its logon result before it is folded in
+struct TemplateAdaptationRequest
+{
+    WCHAR szStorePath[MAX_PATH];
+    WCHAR szSid[TEMPLATE_STORE_SID_CHARS];
+    float rate;
+    TypingTemplate baseline;        // Scored against; used when the store has no entry
+    TimingFeatureSet features;
+    UINT32 digraphKeyId;                        // DigraphHashKey::id, 0 = leave the table alone
+    UINT32 digraphKeys[MAX_KEYSTROKE_COUNT];    // Per TF_DOWN_DOWN value
+};
+
+// Adapt the user's stored template on a threadpool thread and write it
+// back through TemplateStoreWriter. The user's digraph table is updated
+// along with it, or built from this attempt when there is none yet. The request is copied, so the caller
+// may reuse it at once. Updates from this process are applied one at a
+// time.
+HRESULT QueueTemplateAdaptation(const TemplateAdaptationRequest& request);
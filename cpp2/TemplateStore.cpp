@@ -0,0 +1,584 @@
+#include "TemplateStore.h"
+#include <shlwapi.h>
+#include <sddl.h>
+#include <aclapi.h>
+#include <strsafe.h>
+
+// Store directory owner and ACL: SYSTEM and administrators only, inherited
+// by the store and its temporary files
+#define TEMPLATE_STORE_DIRECTORY_SDDL   L"O:BAD:P(A;OICI;FA;;;SY)(A;OICI;FA;;;BA)"
+
+// Rights that let a holder change the store or the directory it lives in
+#define TEMPLATE_STORE_WRITE_ACCESS     (FILE_WRITE_DATA | FILE_APPEND_DATA | FILE_WRITE_EA | \
+                                         FILE_WRITE_ATTRIBUTES | FILE_DELETE_CHILD | DELETE | \
+                                         WRITE_DAC | WRITE_OWNER | GENERIC_WRITE | GENERIC_ALL)
+
+// Attempts at replacing the store while another process has it open
+// without FILE_SHARE_DELETE
+#define TEMPLATE_STORE_RENAME_ATTEMPTS  5
+#define TEMPLATE_STORE_RENAME_DELAY_MS  20
+
+static BOOL IsTrustedSid(PSID pSid)
+{
+    return pSid && (IsWellKnownSid(pSid, WinLocalSystemSid) || IsWellKnownSid(pSid, WinBuiltinAdministratorsSid));
+}
+
+// Owned by SYSTEM or administrators, and nobody else is granted a right to
+// change it. Reading is fine, so the installer may grant it to services.
+static BOOL IsTrustedSecurity(PSID pOwner, PACL pDacl)
+{
+    if (!IsTrustedSid(pOwner) || !pDacl)
+    {
+        return FALSE;
+    }
+
+    for (DWORD i = 0; i < pDacl->AceCount; i++)
+    {
+        ACE_HEADER* pAce = nullptr;
+        if (!GetAce(pDacl, i, reinterpret_cast<void**>(&pAce)))
+        {
+            return FALSE;
+        }
+
+        if (pAce->AceType == ACCESS_DENIED_ACE_TYPE)
+        {
+            continue;
+        }
+
+        // Object and callback ACEs are not expected here, so they are not trusted either
+        if (pAce->AceType != ACCESS_ALLOWED_ACE_TYPE)
+        {
+            return FALSE;
+        }
+
+        ACCESS_ALLOWED_ACE* pAllowed = reinterpret_cast<ACCESS_ALLOWED_ACE*>(pAce);
+        if ((pAllowed->Mask & TEMPLATE_STORE_WRITE_ACCESS) != 0 && !IsTrustedSid(&pAllowed->SidStart))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static HRESULT CheckTrustedHandle(HANDLE hObject)
+{
+    PSID pOwner = nullptr;
+    PACL pDacl = nullptr;
+    PSECURITY_DESCRIPTOR pSD = nullptr;
+    DWORD dwError = GetSecurityInfo(hObject, SE_FILE_OBJECT, OWNER_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION,
+                                    &pOwner, nullptr, &pDacl, nullptr, &pSD);
+    if (dwError != ERROR_SUCCESS)
+    {
+        return HRESULT_FROM_WIN32(dwError);
+    }
+
+    HRESULT hr = IsTrustedSecurity(pOwner, pDacl) ? S_OK : HRESULT_FROM_WIN32(ERROR_INVALID_OWNER);
+    LocalFree(pSD);
+    return hr;
+}
+
+TemplateStoreReader::TemplateStoreReader() :
+    m_pHeader(nullptr),
+    m_pbEntries(nullptr)
+{
+}
+
+TemplateStoreReader::~TemplateStoreReader()
+{
+    Close();
+}
+
+HRESULT TemplateStoreReader::Open(PCWSTR pszPath, DWORD dwFlags)
+{
+    Close();
+
+    // Share delete, so the writer can rename a new store over this one
+    HANDLE hFile = CreateFileW(pszPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // Checked on the handle that is mapped, so the file cannot be swapped in between
+    HRESULT hr = (dwFlags & TEMPLATE_STORE_OPEN_ANY_OWNER) ? S_OK : CheckTrustedHandle(hFile);
+    LARGE_INTEGER cbFile;
+    if (SUCCEEDED(hr) && !GetFileSizeEx(hFile, &cbFile))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if (SUCCEEDED(hr) &&
+             (cbFile.QuadPart < static_cast<LONGLONG>(sizeof(TemplateStoreHeader)) ||
+              cbFile.QuadPart > static_cast<LONGLONG>(sizeof(TemplateStoreHeader) +
+                                                      TEMPLATE_STORE_MAX_ENTRIES * sizeof(TemplateStoreEntry))))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    // The view keeps the section and file alive once both handles are closed
+    void* pView = nullptr;
+    if (SUCCEEDED(hr))
+    {
+        HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (hMapping)
+        {
+            pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+            if (!pView)
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+            }
+            CloseHandle(hMapping);
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+    CloseHandle(hFile);
+
+    if (SUCCEEDED(hr))
+    {
+        const TemplateStoreHeader* pHeader = static_cast<const TemplateStoreHeader*>(pView);
+        size_t cbEntry = (pHeader->version == TEMPLATE_STORE_VERSION_1) ? TEMPLATE_STORE_ENTRY_SIZE_V1 :
+                                                                          sizeof(TemplateStoreEntry);
+        if (pHeader->magic != TEMPLATE_STORE_MAGIC ||
+            pHeader->version < TEMPLATE_STORE_VERSION_1 || pHeader->version > TEMPLATE_STORE_VERSION ||
+            pHeader->entrySize != cbEntry ||
+            pHeader->entryCount > TEMPLATE_STORE_MAX_ENTRIES ||
+            cbFile.QuadPart != static_cast<LONGLONG>(sizeof(TemplateStoreHeader) + pHeader->entryCount * cbEntry))
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+        else
+        {
+            m_pHeader = pHeader;
+            m_pbEntries = reinterpret_cast<const BYTE*>(pHeader + 1);
+        }
+    }
+
+    if (FAILED(hr) && pView)
+    {
+        UnmapViewOfFile(pView);
+    }
+
+    return hr;
+}
+
+void TemplateStoreReader::Close()
+{
+    if (m_pHeader)
+    {
+        UnmapViewOfFile(m_pHeader);
+        m_pHeader = nullptr;
+        m_pbEntries = nullptr;
+    }
+}
+
+const TemplateStoreEntry* TemplateStoreReader::FindEntry(PCWSTR pszSid) const
+{
+    if (!m_pHeader || !pszSid)
+    {
+        return nullptr;
+    }
+
+    DWORD lo = 0;
+    DWORD hi = m_pHeader->entryCount;
+    while (lo < hi)
+    {
+        DWORD mid = lo + (hi - lo) / 2;
+        if (wcsncmp(GetEntry(mid)->szSid, pszSid, TEMPLATE_STORE_SID_CHARS) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    if (lo < m_pHeader->entryCount && wcsncmp(GetEntry(lo)->szSid, pszSid, TEMPLATE_STORE_SID_CHARS) == 0)
+    {
+        return GetEntry(lo);
+    }
+
+    return nullptr;
+}
+
+const TypingTemplate* TemplateStoreReader::Find(PCWSTR pszSid) const
+{
+    const TemplateStoreEntry* pEntry = FindEntry(pszSid);
+    if (pEntry && IsValidTypingTemplate(pEntry->typingTemplate))
+    {
+        return &pEntry->typingTemplate;
+    }
+
+    return nullptr;
+}
+
+const DigraphTable* TemplateStoreReader::FindDigraphs(PCWSTR pszSid) const
+{
+    const TemplateStoreEntry* pEntry = HasDigraphs() ? FindEntry(pszSid) : nullptr;
+    if (pEntry && pEntry->digraphs.pairCount > 0 && IsValidDigraphTable(pEntry->digraphs))
+    {
+        return &pEntry->digraphs;
+    }
+
+    return nullptr;
+}
+
+TemplateStoreWriter::TemplateStoreWriter()
+{
+    m_szPath[0] = L'\0';
+}
+
+TemplateStoreWriter::~TemplateStoreWriter()
+{
+    Clear();
+}
+
+void TemplateStoreWriter::Clear()
+{
+    if (!m_entries.empty())
+    {
+        SecureZeroMemory(&m_entries[0], m_entries.size() * sizeof(TemplateStoreEntry));
+        m_entries.clear();
+    }
+}
+
+HRESULT TemplateStoreWriter::Load(PCWSTR pszPath)
+{
+    Clear();
+
+    HRESULT hr = StringCchCopyW(m_szPath, ARRAYSIZE(m_szPath), pszPath);
+    if (FAILED(hr))
+    {
+        m_szPath[0] = L'\0';
+        return hr;
+    }
+
+    // A store planted by someone else is not carried over; Commit replaces it
+    TemplateStoreReader reader;
+    hr = reader.Open(m_szPath, TEMPLATE_STORE_OPEN_TRUSTED);
+    if (hr == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) || hr == HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND) ||
+        hr == HRESULT_FROM_WIN32(ERROR_INVALID_OWNER))
+    {
+        return S_OK;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Copy entry by entry; version 1 entries are shorter, and they and
+        // version 2 entries get empty digraph tables
+        m_entries.resize(reader.GetEntryCount());
+        for (DWORD i = 0; i < reader.GetEntryCount(); i++)
+        {
+            ZeroMemory(&m_entries[i], sizeof(TemplateStoreEntry));
+            CopyMemory(&m_entries[i], reader.GetEntry(i), reader.m_pHeader->entrySize);
+            if (!reader.HasDigraphs())
+            {
+                ZeroMemory(&m_entries[i].digraphs, sizeof(m_entries[i].digraphs));
+            }
+        }
+    }
+
+    return hr;
+}
+
+size_t TemplateStoreWriter::LowerBound(PCWSTR pszSid) const
+{
+    size_t lo = 0;
+    size_t hi = m_entries.size();
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (wcsncmp(m_entries[mid].szSid, pszSid, TEMPLATE_STORE_SID_CHARS) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+const TypingTemplate* TemplateStoreWriter::Find(PCWSTR pszSid) const
+{
+    if (!pszSid)
+    {
+        return nullptr;
+    }
+
+    size_t i = LowerBound(pszSid);
+    if (i == m_entries.size() || wcsncmp(m_entries[i].szSid, pszSid, TEMPLATE_STORE_SID_CHARS) != 0)
+    {
+        return nullptr;
+    }
+
+    return &m_entries[i].typingTemplate;
+}
+
+const DigraphTable* TemplateStoreWriter::FindDigraphs(PCWSTR pszSid) const
+{
+    if (!pszSid)
+    {
+        return nullptr;
+    }
+
+    size_t i = LowerBound(pszSid);
+    if (i == m_entries.size() || wcsncmp(m_entries[i].szSid, pszSid, TEMPLATE_STORE_SID_CHARS) != 0)
+    {
+        return nullptr;
+    }
+
+    return &m_entries[i].digraphs;
+}
+
+HRESULT TemplateStoreWriter::Put(PCWSTR pszSid, const TypingTemplate& typingTemplate)
+{
+    size_t cchSid = 0;
+    HRESULT hr = pszSid ? StringCchLengthW(pszSid, TEMPLATE_STORE_SID_CHARS, &cchSid) : E_INVALIDARG;
+    if (FAILED(hr) || cchSid == 0 || !IsValidTypingTemplate(typingTemplate))
+    {
+        return E_INVALIDARG;
+    }
+
+    size_t i = LowerBound(pszSid);
+    if (i == m_entries.size() || wcsncmp(m_entries[i].szSid, pszSid, TEMPLATE_STORE_SID_CHARS) != 0)
+    {
+        if (m_entries.size() >= TEMPLATE_STORE_MAX_ENTRIES)
+        {
+            return HRESULT_FROM_WIN32(ERROR_DISK_FULL);
+        }
+
+        TemplateStoreEntry entry;
+        ZeroMemory(&entry, sizeof(entry));
+        StringCchCopyW(entry.szSid, ARRAYSIZE(entry.szSid), pszSid);
+        m_entries.insert(m_entries.begin() + i, entry);
+    }
+
+    CopyMemory(&m_entries[i].typingTemplate, &typingTemplate, sizeof(typingTemplate));
+    return S_OK;
+}
+
+HRESULT TemplateStoreWriter::PutDigraphs(PCWSTR pszSid, const DigraphTable& digraphs)
+{
+    if (!pszSid || !IsValidDigraphTable(digraphs))
+    {
+        return E_INVALIDARG;
+    }
+
+    size_t i = LowerBound(pszSid);
+    if (i == m_entries.size() || wcsncmp(m_entries[i].szSid, pszSid, TEMPLATE_STORE_SID_CHARS) != 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    CopyMemory(&m_entries[i].digraphs, &digraphs, sizeof(digraphs));
+    return S_OK;
+}
+
+HRESULT TemplateStoreWriter::Remove(PCWSTR pszSid)
+{
+    if (!pszSid)
+    {
+        return E_INVALIDARG;
+    }
+
+    size_t i = LowerBound(pszSid);
+    if (i == m_entries.size() || wcsncmp(m_entries[i].szSid, pszSid, TEMPLATE_STORE_SID_CHARS) != 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    SecureZeroMemory(&m_entries[i], sizeof(TemplateStoreEntry));
+    m_entries.erase(m_entries.begin() + i);
+    return S_OK;
+}
+
+// %ProgramData% lets any user create directories, so an existing one may
+// have been made by a user with an owner and ACL of their choosing. Unless
+// only SYSTEM and administrators can change it, take it over with the
+// store's owner and ACL. Junctions are refused rather than followed.
+static HRESULT SecureStoreDirectory(PCWSTR pszDirectory, PSECURITY_DESCRIPTOR pSD)
+{
+    HANDLE hDirectory = CreateFileW(pszDirectory, READ_CONTROL | WRITE_DAC | WRITE_OWNER,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                    FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, nullptr);
+    if (hDirectory == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = S_OK;
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!GetFileInformationByHandle(hDirectory, &info))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if ((info.dwFileAttributes & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_REPARSE_POINT)) != FILE_ATTRIBUTE_DIRECTORY)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_OWNER);
+    }
+    else if (CheckTrustedHandle(hDirectory) != S_OK)
+    {
+        PSID pOwner = nullptr;
+        PACL pDacl = nullptr;
+        BOOL fDefaulted = FALSE;
+        BOOL fPresent = FALSE;
+        if (!GetSecurityDescriptorOwner(pSD, &pOwner, &fDefaulted) ||
+            !GetSecurityDescriptorDacl(pSD, &fPresent, &pDacl, &fDefaulted))
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+        else
+        {
+            // Files already inside keep their owner and ACL; the reader
+            // refuses them, and Commit writes a new file of its own
+            DWORD dwError = SetSecurityInfo(hDirectory, SE_FILE_OBJECT,
+                                            OWNER_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION |
+                                            PROTECTED_DACL_SECURITY_INFORMATION,
+                                            pOwner, nullptr, pDacl, nullptr);
+            hr = HRESULT_FROM_WIN32(dwError);
+        }
+    }
+    CloseHandle(hDirectory);
+
+    return hr;
+}
+
+static HRESULT CreateStoreDirectory(PCWSTR pszStorePath)
+{
+    WCHAR szDirectory[MAX_PATH];
+    HRESULT hr = StringCchCopyW(szDirectory, ARRAYSIZE(szDirectory), pszStorePath);
+    if (FAILED(hr) || !PathRemoveFileSpecW(szDirectory))
+    {
+        return E_INVALIDARG;
+    }
+
+    PSECURITY_DESCRIPTOR pSD = nullptr;
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(TEMPLATE_STORE_DIRECTORY_SDDL,
+                                                              SDDL_REVISION_1, &pSD, nullptr))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), pSD, FALSE };
+    if (!CreateDirectoryW(szDirectory, &sa))
+    {
+        DWORD dwError = GetLastError();
+        hr = (dwError == ERROR_ALREADY_EXISTS) ? SecureStoreDirectory(szDirectory, pSD) : HRESULT_FROM_WIN32(dwError);
+    }
+    LocalFree(pSD);
+
+    return hr;
+}
+
+static HRESULT WriteAll(HANDLE hFile, const void* pv, size_t cb)
+{
+    const BYTE* pb = static_cast<const BYTE*>(pv);
+    while (cb > 0)
+    {
+        DWORD cbChunk = (cb > 0x10000000) ? 0x10000000 : static_cast<DWORD>(cb);
+        DWORD cbWritten = 0;
+        if (!WriteFile(hFile, pb, cbChunk, &cbWritten, nullptr))
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+        pb += cbWritten;
+        cb -= cbWritten;
+    }
+    return S_OK;
+}
+
+HRESULT TemplateStoreWriter::Commit()
+{
+    if (!m_szPath[0])
+    {
+        return E_UNEXPECTED;
+    }
+
+    WCHAR szTemp[MAX_PATH];
+    HRESULT hr = StringCchPrintfW(szTemp, ARRAYSIZE(szTemp), L"%s.new", m_szPath);
+    if (SUCCEEDED(hr))
+    {
+        hr = CreateStoreDirectory(m_szPath);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // A leftover temporary file is not reused, since it would keep its
+    // owner and ACL through the rename
+    DeleteFileW(szTemp);
+    HANDLE hFile = CreateFileW(szTemp, GENERIC_WRITE, 0, nullptr,
+                               CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    TemplateStoreHeader header;
+    header.magic = TEMPLATE_STORE_MAGIC;
+    header.version = TEMPLATE_STORE_VERSION;
+    header.entryCount = static_cast<DWORD>(m_entries.size());
+    header.entrySize = sizeof(TemplateStoreEntry);
+
+    hr = WriteAll(hFile, &header, sizeof(header));
+    if (SUCCEEDED(hr) && !m_entries.empty())
+    {
+        hr = WriteAll(hFile, &m_entries[0], m_entries.size() * sizeof(TemplateStoreEntry));
+    }
+
+    // On disk before the rename makes it visible
+    if (SUCCEEDED(hr) && !FlushFileBuffers(hFile))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    CloseHandle(hFile);
+
+    if (SUCCEEDED(hr))
+    {
+        for (DWORD dwAttempt = 1; ; dwAttempt++)
+        {
+            if (MoveFileExW(szTemp, m_szPath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+            {
+                hr = S_OK;
+                break;
+            }
+
+            DWORD dwError = GetLastError();
+            hr = HRESULT_FROM_WIN32(dwError);
+            if ((dwError != ERROR_ACCESS_DENIED && dwError != ERROR_SHARING_VIOLATION) ||
+                dwAttempt == TEMPLATE_STORE_RENAME_ATTEMPTS)
+            {
+                break;
+            }
+            Sleep(TEMPLATE_STORE_RENAME_DELAY_MS);
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        DeleteFileW(szTemp);
+    }
+
+    return hr;
+}
+
+HRESULT GetTemplateStorePath(PCWSTR pszConfigured, PWSTR pszPath, DWORD cchPath)
+{
+    PCWSTR pszSource = (pszConfigured && pszConfigured[0]) ? pszConfigured : TEMPLATE_STORE_DEFAULT_PATH;
+
+    DWORD cchExpanded = ExpandEnvironmentStringsW(pszSource, pszPath, cchPath);
+    if (cchExpanded == 0)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return (cchExpanded <= cchPath) ? S_OK : HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include "TypingScorer.h"
+#include "DigraphTable.h"
+
+// Identifies a template store file
+#define TEMPLATE_STORE_MAGIC        0x53505954      // 'TYPS'
+#define TEMPLATE_STORE_VERSION      3
+
+// Version 1 entries end before the digraph table; readers still accept them
+#define TEMPLATE_STORE_VERSION_1    1
+
+// Version 2 tables hold pairs hashed without a secret. Their entries are
+// laid out as in version 3 and still load, with the tables left out.
+#define TEMPLATE_STORE_VERSION_2    2
+
+// Room for any string SID, terminator included
+#define TEMPLATE_STORE_SID_CHARS    192
+
+// Upper bound on users in one store, so a corrupt header cannot describe
+// a mapping larger than the file
+#define TEMPLATE_STORE_MAX_ENTRIES  4096
+
+// Default store under %ProgramData%
+#define TEMPLATE_STORE_DEFAULT_PATH L"%ProgramData%\\BiometricCredentialProvider\\templates.dat"
+
+// TemplateStoreReader::Open flags. Without TEMPLATE_STORE_OPEN_ANY_OWNER a
+// store owned or writable by anyone but SYSTEM and administrators is
+// refused with ERROR_INVALID_OWNER: it could hold templates trained on
+// someone else's typing.
+#define TEMPLATE_STORE_OPEN_TRUSTED     0x0
+#define TEMPLATE_STORE_OPEN_ANY_OWNER   0x1     // Offline tools reading a copy
+
+// File layout: one header, then entryCount entries sorted by SID with
+// ordinal comparison. Every field is fixed size, so the mapped file is
+// used as is.
+struct TemplateStoreHeader
+{
+    DWORD magic;
+    DWORD version;
+    DWORD entryCount;
+    DWORD entrySize;            // sizeof(TemplateStoreEntry), checked on open
+};
+
+struct TemplateStoreEntry
+{
+    WCHAR szSid[TEMPLATE_STORE_SID_CHARS];
+    TypingTemplate typingTemplate;
+    DigraphTable digraphs;      // Version 2 and later; used from version 3
+};
+
+#define TEMPLATE_STORE_ENTRY_SIZE_V1    offsetof(TemplateStoreEntry, digraphs)
+
+// Read-only view of the template store for scoring.
+//
+// The file is mapped once on Open and searched in place: a lookup is a
+// binary search over the entries, with no parsing and no allocation. The
+// writer never modifies a store file, it renames a new one over it, so an
+// open view stays consistent for as long as it is held.
+class TemplateStoreReader
+{
+public:
+    TemplateStoreReader();
+    ~TemplateStoreReader();
+
+    HRESULT Open(PCWSTR pszPath, DWORD dwFlags);
+    void Close();
+
+    BOOL IsOpen() const { return m_pHeader != nullptr; }
+    DWORD GetEntryCount() const { return m_pHeader ? m_pHeader->entryCount : 0; }
+
+    // Entry i in SID order, for offline tools. The digraph table is only
+    // present when HasDigraphs.
+    const TemplateStoreEntry* GetEntry(DWORD i) const
+    {
+        return reinterpret_cast<const TemplateStoreEntry*>(m_pbEntries + static_cast<size_t>(i) * m_pHeader->entrySize);
+    }
+
+    BOOL HasDigraphs() const { return m_pHeader && m_pHeader->version >= TEMPLATE_STORE_VERSION; }
+
+    // Template enrolled for the SID, pointing into the view; nullptr when
+    // the user has none. Valid until Close.
+    const TypingTemplate* Find(PCWSTR pszSid) const;
+
+    // Digraph table for the SID, pointing into the view; nullptr when the
+    // user has none or the store predates them. Valid until Close.
+    const DigraphTable* FindDigraphs(PCWSTR pszSid) const;
+
+private:
+    friend class TemplateStoreWriter;
+
+    const TemplateStoreEntry* FindEntry(PCWSTR pszSid) const;
+
+    TemplateStoreReader(const TemplateStoreReader&);
+    TemplateStoreReader& operator=(const TemplateStoreReader&);
+
+    const TemplateStoreHeader* m_pHeader;
+    const BYTE* m_pbEntries;
+};
+
+// Builds a new version of the template store.
+//
+// Load copies the current entries into memory, upgrading version 1 and 2
+// entries with empty digraph tables, Put and Remove edit that copy, and
+// Commit writes it to a temporary file next to the store and renames it
+// over the store in one step. Readers see either the old file
+// or the new one, never a partial write. Writers do not lock each other
+// out, so concurrent updates must be serialized by the caller.
+class TemplateStoreWriter
+{
+public:
+    TemplateStoreWriter();
+    ~TemplateStoreWriter();
+
+    // A missing store loads as empty, and so does one that is not trusted,
+    // so Commit replaces it
+    HRESULT Load(PCWSTR pszPath);
+
+    // Entry as loaded or last put; nullptr when the SID has none
+    const TypingTemplate* Find(PCWSTR pszSid) const;
+    const DigraphTable* FindDigraphs(PCWSTR pszSid) const;
+
+    // Replaces the template and keeps the user's digraph table
+    HRESULT Put(PCWSTR pszSid, const TypingTemplate& typingTemplate);
+
+    // The SID must already have a template
+    HRESULT PutDigraphs(PCWSTR pszSid, const DigraphTable& digraphs);
+    HRESULT Remove(PCWSTR pszSid);
+
+    // Creates the store directory for SYSTEM and administrators only. An
+    // existing directory anyone else owns or may write is taken over first.
+    HRESULT Commit();
+
+private:
+    TemplateStoreWriter(const TemplateStoreWriter&);
+    TemplateStoreWriter& operator=(const TemplateStoreWriter&);
+
+    size_t LowerBound(PCWSTR pszSid) const;
+    void Clear();
+
+    WCHAR m_szPath[MAX_PATH];
+    std::vector<TemplateStoreEntry> m_entries;
+};
+
+// Expand CONFIG_TEMPLATE_STORE, or the default path when it is empty
+HRESULT GetTemplateStorePath(PCWSTR pszConfigured, PWSTR pszPath, DWORD cchPath);
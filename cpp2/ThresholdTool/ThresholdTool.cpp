@@ -0,0 +1,369 @@
+// ThresholdTool: false accept / false reject curves for the local typing
+// model, computed over archived logon attempts.
+//
+//     ThresholdTool <template store> <session archive> [options]
+//
+//     -method <n>     LocalScoring method to evaluate (default 1)
+//     -trees <file>   Tree model for method 4
+//     -threads <n>    Scoring threads, 0 = one per logical processor (default)
+//     -max <d>        Largest threshold in the curve (default 5, or 1 for
+//                     methods 3, 4 and 5)
+//     -steps <n>      Thresholds in the curve (default 500)
+//     -out <file>     Write the curve there instead of to stdout
+//
+// The session archive has one attempt per line: the SID of the user who
+// typed it, then one <key down us>,<key up us> pair per keystroke, in
+// typing order. Lines starting with # are ignored. Every attempt is scored
+// against every template of the same password length; pairs with the
+// attempt's own SID are genuine, all others impostors. The curve is CSV
+// with one row per threshold: threshold,far,frr.
+
+#include "BatchScorer.h"
+#include "TemplateStore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <strsafe.h>
+#include <wchar.h>
+#include <vector>
+
+// Attempts scored per ScoreBatch call; bounds the feature and distance buffers
+#define ATTEMPTS_PER_BATCH      4096
+
+#define MAX_SESSION_LINE        8192
+
+struct ThresholdOptions
+{
+    PCWSTR pszStorePath;
+    PCWSTR pszArchivePath;
+    PCWSTR pszTreeModelPath;
+    PCWSTR pszOutputPath;
+    DWORD dwMethod;
+    DWORD cThreads;
+    double maxThreshold;
+    DWORD cSteps;
+};
+
+// Accumulated genuine and impostor distances, bucketed by the lowest
+// threshold that accepts them. The last bucket is above every threshold.
+struct ErrorHistogram
+{
+    std::vector<ULONGLONG> genuine;
+    std::vector<ULONGLONG> impostor;
+    ULONGLONG cGenuine;
+    ULONGLONG cImpostor;
+};
+
+static void PrintUsage()
+{
+    fwprintf(stderr, L"Usage: ThresholdTool <template store> <session archive> [-method n] [-trees file]\n"
+                     L"                     [-threads n] [-max d] [-steps n] [-out file]\n");
+}
+
+static BOOL ParseOptions(int argc, wchar_t** argv, ThresholdOptions* pOptions)
+{
+    ZeroMemory(pOptions, sizeof(*pOptions));
+    pOptions->dwMethod = LOCAL_SCORING_MANHATTAN;
+    pOptions->cSteps = 500;
+
+    if (argc < 3)
+    {
+        return FALSE;
+    }
+    pOptions->pszStorePath = argv[1];
+    pOptions->pszArchivePath = argv[2];
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            return FALSE;
+        }
+
+        PCWSTR pszValue = argv[i + 1];
+        if (wcscmp(argv[i], L"-method") == 0)
+        {
+            pOptions->dwMethod = wcstoul(pszValue, nullptr, 10);
+        }
+        else if (wcscmp(argv[i], L"-trees") == 0)
+        {
+            pOptions->pszTreeModelPath = pszValue;
+        }
+        else if (wcscmp(argv[i], L"-threads") == 0)
+        {
+            pOptions->cThreads = wcstoul(pszValue, nullptr, 10);
+        }
+        else if (wcscmp(argv[i], L"-max") == 0)
+        {
+            pOptions->maxThreshold = wcstod(pszValue, nullptr);
+        }
+        else if (wcscmp(argv[i], L"-steps") == 0)
+        {
+            pOptions->cSteps = wcstoul(pszValue, nullptr, 10);
+        }
+        else if (wcscmp(argv[i], L"-out") == 0)
+        {
+            pOptions->pszOutputPath = pszValue;
+        }
+        else
+        {
+            return FALSE;
+        }
+        i++;
+    }
+
+    if (pOptions->dwMethod == LOCAL_SCORING_OFF || pOptions->dwMethod > LOCAL_SCORING_LIKELIHOOD_RATIO ||
+        pOptions->cSteps == 0 || pOptions->maxThreshold < 0.0)
+    {
+        return FALSE;
+    }
+
+    if (pOptions->maxThreshold == 0.0)
+    {
+        pOptions->maxThreshold = IsProbabilityScoring(pOptions->dwMethod) ? 1.0 : 5.0;
+    }
+
+    return TRUE;
+}
+
+// "<sid> <down>,<up> <down>,<up> ..." into the attempt's owner and timeline.
+// Returns FALSE for blank lines, comments and malformed attempts.
+static BOOL ParseSession(PWSTR pszLine, PWSTR pszSid, DWORD cchSid, KeystrokeTimeline* pTimeline)
+{
+    PWSTR pszContext = nullptr;
+    PWSTR pszToken = wcstok_s(pszLine, L" \t\r\n", &pszContext);
+    if (!pszToken || pszToken[0] == L'#' || FAILED(StringCchCopyW(pszSid, cchSid, pszToken)))
+    {
+        return FALSE;
+    }
+
+    pTimeline->count = 0;
+    while ((pszToken = wcstok_s(nullptr, L" \t\r\n", &pszContext)) != nullptr)
+    {
+        if (pTimeline->count >= MAX_KEYSTROKE_COUNT)
+        {
+            return FALSE;
+        }
+
+        PWSTR pszEnd = nullptr;
+        ULONG keyDownUs = wcstoul(pszToken, &pszEnd, 10);
+        if (*pszEnd != L',')
+        {
+            return FALSE;
+        }
+        ULONG keyUpUs = wcstoul(pszEnd + 1, &pszEnd, 10);
+        if (*pszEnd != L'\0' || keyUpUs < keyDownUs)
+        {
+            return FALSE;
+        }
+
+        pTimeline->keyDownUs[pTimeline->count] = keyDownUs;
+        pTimeline->keyUpUs[pTimeline->count] = keyUpUs;
+        pTimeline->count++;
+    }
+
+    return pTimeline->count > 0;
+}
+
+static void AccumulateBatch(const float* rgDistances, const TypingTemplate* const* rgpOwners, DWORD cAttempts,
+                            const TypingTemplate* const* rgpTemplates, DWORD cTemplates,
+                            const ThresholdOptions& options, ErrorHistogram* pHistogram)
+{
+    double stepsPerUnit = options.cSteps / options.maxThreshold;
+
+    for (DWORD a = 0; a < cAttempts; a++)
+    {
+        const float* rgRow = rgDistances + static_cast<SIZE_T>(a) * cTemplates;
+        for (DWORD t = 0; t < cTemplates; t++)
+        {
+            float distance = rgRow[t];
+            if (distance == BATCH_DISTANCE_NOT_COMPARABLE)
+            {
+                continue;
+            }
+
+            // Bucket i is accepted by threshold i * max / steps and above
+            double scaled = distance * stepsPerUnit;
+            DWORD iBucket = (scaled <= 0.0) ? 0 :
+                            (scaled >= options.cSteps) ? options.cSteps + (scaled > options.cSteps) :
+                            static_cast<DWORD>(ceil(scaled));
+
+            if (rgpTemplates[t] == rgpOwners[a])
+            {
+                pHistogram->genuine[iBucket]++;
+                pHistogram->cGenuine++;
+            }
+            else
+            {
+                pHistogram->impostor[iBucket]++;
+                pHistogram->cImpostor++;
+            }
+        }
+    }
+}
+
+static void WriteCurve(FILE* pFile, const ErrorHistogram& histogram, const ThresholdOptions& options)
+{
+    fwprintf(pFile, L"threshold,far,frr\n");
+
+    ULONGLONG cGenuineAccepted = 0;
+    ULONGLONG cImpostorAccepted = 0;
+    double bestGap = 2.0;
+    double eer = 0.0;
+    double eerThreshold = 0.0;
+
+    for (DWORD i = 0; i <= options.cSteps; i++)
+    {
+        cGenuineAccepted += histogram.genuine[i];
+        cImpostorAccepted += histogram.impostor[i];
+
+        double threshold = options.maxThreshold * i / options.cSteps;
+        double far = histogram.cImpostor ? static_cast<double>(cImpostorAccepted) / histogram.cImpostor : 0.0;
+        double frr = histogram.cGenuine ? 1.0 - static_cast<double>(cGenuineAccepted) / histogram.cGenuine : 0.0;
+        fwprintf(pFile, L"%.6f,%.8f,%.8f\n", threshold, far, frr);
+
+        double gap = fabs(far - frr);
+        if (gap < bestGap)
+        {
+            bestGap = gap;
+            eer = (far + frr) / 2.0;
+            eerThreshold = threshold;
+        }
+    }
+
+    fwprintf(stderr, L"%llu genuine and %llu impostor comparisons\n", histogram.cGenuine, histogram.cImpostor);
+    fwprintf(stderr, L"Equal error rate %.4f%% at threshold %.6f\n", eer * 100.0, eerThreshold);
+}
+
+int __cdecl wmain(int argc, wchar_t** argv)
+{
+    ThresholdOptions options;
+    if (!ParseOptions(argc, argv, &options))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    // Only distances are used, so the accept and reject bands do not matter
+    TypingScorer scorer;
+    scorer.Initialize(options.dwMethod, 0.0, 0.0, 1.0, 0.0);
+    if (options.dwMethod == LOCAL_SCORING_TREES)
+    {
+        HRESULT hr = options.pszTreeModelPath ? scorer.LoadTreeEnsemble(options.pszTreeModelPath) : E_INVALIDARG;
+        if (FAILED(hr))
+        {
+            fwprintf(stderr, L"Cannot load the tree model (0x%08lx)\n", hr);
+            return 1;
+        }
+    }
+
+    // Usually a copy taken off the machine, owned by whoever copied it
+    TemplateStoreReader store;
+    HRESULT hr = store.Open(options.pszStorePath, TEMPLATE_STORE_OPEN_ANY_OWNER);
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"Cannot open template store %s (0x%08lx)\n", options.pszStorePath, hr);
+        return 1;
+    }
+
+    std::vector<const TypingTemplate*> templates;
+    for (DWORD i = 0; i < store.GetEntryCount(); i++)
+    {
+        const TypingTemplate& typingTemplate = store.GetEntry(i)->typingTemplate;
+        if (IsValidTypingTemplate(typingTemplate))
+        {
+            templates.push_back(&typingTemplate);
+        }
+    }
+
+    if (templates.empty())
+    {
+        fwprintf(stderr, L"No valid templates in %s\n", options.pszStorePath);
+        return 1;
+    }
+
+    FILE* pArchive = nullptr;
+    if (_wfopen_s(&pArchive, options.pszArchivePath, L"r") != 0)
+    {
+        fwprintf(stderr, L"Cannot open session archive %s\n", options.pszArchivePath);
+        return 1;
+    }
+
+    FILE* pOutput = stdout;
+    if (options.pszOutputPath && _wfopen_s(&pOutput, options.pszOutputPath, L"w") != 0)
+    {
+        fwprintf(stderr, L"Cannot create %s\n", options.pszOutputPath);
+        fclose(pArchive);
+        return 1;
+    }
+
+    DWORD cTemplates = static_cast<DWORD>(templates.size());
+    std::vector<TimingFeatureSet> attempts(ATTEMPTS_PER_BATCH);
+    std::vector<const TypingTemplate*> owners(ATTEMPTS_PER_BATCH);
+    std::vector<float> distances(static_cast<SIZE_T>(ATTEMPTS_PER_BATCH) * cTemplates);
+
+    ErrorHistogram histogram;
+    histogram.genuine.assign(options.cSteps + 2, 0);
+    histogram.impostor.assign(options.cSteps + 2, 0);
+    histogram.cGenuine = 0;
+    histogram.cImpostor = 0;
+
+    static WCHAR s_szLine[MAX_SESSION_LINE];
+    static KeystrokeTimeline s_timeline;
+    WCHAR szSid[TEMPLATE_STORE_SID_CHARS];
+    ULONGLONG cSessions = 0;
+    ULONGLONG cSkipped = 0;
+    ULONGLONG ullStart = GetTickCount64();
+    DWORD cPending = 0;
+    BOOL fEnd = FALSE;
+
+    while (!fEnd)
+    {
+        fEnd = (fgetws(s_szLine, ARRAYSIZE(s_szLine), pArchive) == nullptr);
+        if (!fEnd)
+        {
+            if (!ParseSession(s_szLine, szSid, ARRAYSIZE(szSid), &s_timeline) ||
+                FAILED(ExtractTimingFeatures(s_timeline, &attempts[cPending])))
+            {
+                cSkipped += (s_szLine[0] != L'#' && s_szLine[0] != L'\n');
+                continue;
+            }
+
+            // Attempts by users without a template only count as impostors
+            owners[cPending] = store.Find(szSid);
+            cPending++;
+            cSessions++;
+        }
+
+        if (cPending == ATTEMPTS_PER_BATCH || (fEnd && cPending > 0))
+        {
+            hr = ScoreBatch(scorer, &attempts[0], cPending, &templates[0], cTemplates,
+                            &distances[0], options.cThreads);
+            if (FAILED(hr))
+            {
+                fwprintf(stderr, L"Scoring failed (0x%08lx)\n", hr);
+                break;
+            }
+
+            AccumulateBatch(&distances[0], &owners[0], cPending, &templates[0], cTemplates, options, &histogram);
+            cPending = 0;
+        }
+    }
+
+    fclose(pArchive);
+
+    if (SUCCEEDED(hr))
+    {
+        double seconds = (GetTickCount64() - ullStart) / 1000.0;
+        fwprintf(stderr, L"%llu attempts against %lu templates in %.1f s, %llu lines skipped\n",
+                 cSessions, cTemplates, seconds, cSkipped);
+        WriteCurve(pOutput, histogram, options);
+    }
+
+    if (pOutput != stdout)
+    {
+        fclose(pOutput);
+    }
+
+    return SUCCEEDED(hr) ? 0 : 1;
+}
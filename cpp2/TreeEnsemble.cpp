@@ -0,0 +1,336 @@
+#include "TreeEnsemble.h"
+#include <stdlib.h>
+
+TreeEnsemble::TreeEnsemble() :
+    m_pbBlock(nullptr),
+    m_rgFeature(nullptr),
+    m_rgThreshold(nullptr),
+    m_rgLeaf(nullptr),
+    m_cTrees(0),
+    m_dwDepth(0),
+    m_cFeatures(0),
+    m_baseScore(0.0f)
+{
+}
+
+TreeEnsemble::~TreeEnsemble()
+{
+    Unload();
+}
+
+void TreeEnsemble::Unload()
+{
+    delete[] m_pbBlock;
+    m_pbBlock = nullptr;
+    m_rgFeature = nullptr;
+    m_rgThreshold = nullptr;
+    m_rgLeaf = nullptr;
+    m_cTrees = 0;
+    m_dwDepth = 0;
+    m_cFeatures = 0;
+    m_baseScore = 0.0f;
+}
+
+// Depth of the subtree at iNode, or more than TREE_ENSEMBLE_MAX_DEPTH when
+// it is too deep or refers to nodes that do not exist
+DWORD TreeEnsemble::MeasureDepth(const RawNode* rgNodes, DWORD cNodes, INT32 iNode, DWORD dwDepth)
+{
+    if (dwDepth > TREE_ENSEMBLE_MAX_DEPTH || iNode < 0 || static_cast<DWORD>(iNode) >= cNodes)
+    {
+        return TREE_ENSEMBLE_MAX_DEPTH + 1;
+    }
+
+    const RawNode& node = rgNodes[iNode];
+    if (node.feature == -1)
+    {
+        return dwDepth;
+    }
+    if (node.feature < 0)
+    {
+        return TREE_ENSEMBLE_MAX_DEPTH + 1;
+    }
+
+    DWORD dwLeft = MeasureDepth(rgNodes, cNodes, node.left, dwDepth + 1);
+    DWORD dwRight = MeasureDepth(rgNodes, cNodes, node.right, dwDepth + 1);
+    return (dwLeft > dwRight) ? dwLeft : dwRight;
+}
+
+void TreeEnsemble::Flatten(DWORD iTree, const RawNode* rgNodes, INT32 iNode, DWORD iSlot, DWORD dwDepth)
+{
+    const DWORD cInternal = (1u << m_dwDepth) - 1;
+    const RawNode& node = rgNodes[iNode];
+
+    if (dwDepth == m_dwDepth)
+    {
+        m_rgLeaf[iTree * (cInternal + 1) + (iSlot - cInternal)] = node.value;
+        return;
+    }
+
+    DWORD iFlat = iTree * cInternal + iSlot;
+    if (node.feature == -1)
+    {
+        // Early leaf: both sides lead to the same value
+        m_rgFeature[iFlat] = 0;
+        m_rgThreshold[iFlat] = 0.0f;
+        Flatten(iTree, rgNodes, iNode, 2 * iSlot + 1, dwDepth + 1);
+        Flatten(iTree, rgNodes, iNode, 2 * iSlot + 2, dwDepth + 1);
+    }
+    else
+    {
+        m_rgFeature[iFlat] = static_cast<UINT16>(node.feature);
+        m_rgThreshold[iFlat] = node.value;
+        Flatten(iTree, rgNodes, node.left, 2 * iSlot + 1, dwDepth + 1);
+        Flatten(iTree, rgNodes, node.right, 2 * iSlot + 2, dwDepth + 1);
+    }
+}
+
+// Advance to the next line, terminating the current one
+static char* NextLine(char* pszLine)
+{
+    while (*pszLine && *pszLine != '\n')
+    {
+        pszLine++;
+    }
+    if (*pszLine)
+    {
+        *pszLine++ = '\0';
+    }
+    return pszLine;
+}
+
+HRESULT TreeEnsemble::Parse(char* pszText)
+{
+    // First pass: count trees and the nodes listed for each
+    DWORD cTrees = 0;
+    DWORD cNodes = 0;
+    for (const char* psz = pszText; *psz; )
+    {
+        if (*psz == 'T')
+        {
+            cTrees++;
+        }
+        else if ((*psz == 'N' || *psz == 'L') && cTrees > 0)
+        {
+            cNodes++;
+        }
+        while (*psz && *psz != '\n')
+        {
+            psz++;
+        }
+        if (*psz)
+        {
+            psz++;
+        }
+    }
+
+    if (cTrees == 0 || cNodes == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    DWORD* rgFirst = new DWORD[cTrees + 1];
+    RawNode* rgNodes = new RawNode[cNodes];
+    ZeroMemory(rgFirst, (cTrees + 1) * sizeof(DWORD));
+    for (DWORD i = 0; i < cNodes; i++)
+    {
+        rgNodes[i].feature = -2;    // Not listed yet
+    }
+
+    // Second pass: node counts per tree, then the nodes themselves
+    HRESULT hr = S_OK;
+    LONG iTree = -1;
+    for (char* pszLine = pszText; *pszLine; )
+    {
+        char* pszNext = NextLine(pszLine);
+        if (*pszLine == 'T')
+        {
+            iTree++;
+        }
+        else if ((*pszLine == 'N' || *pszLine == 'L') && iTree >= 0)
+        {
+            rgFirst[iTree + 1]++;
+        }
+        pszLine = pszNext;
+    }
+    for (DWORD i = 0; i < cTrees; i++)
+    {
+        rgFirst[i + 1] += rgFirst[i];
+    }
+
+    iTree = -1;
+    BOOL fHeader = FALSE;
+    for (char* pszLine = pszText; *pszLine && SUCCEEDED(hr); pszLine += strlen(pszLine) + 1)
+    {
+        char chKind = *pszLine;
+        char* pszEnd = nullptr;
+
+        if (chKind == 'E')
+        {
+            m_cFeatures = strtoul(pszLine + 1, &pszEnd, 10);
+            m_baseScore = static_cast<float>(strtod(pszEnd, nullptr));
+            fHeader = (m_cFeatures > 0 && m_cFeatures <= 0xFFFF);
+        }
+        else if (chKind == 'T')
+        {
+            iTree++;
+        }
+        else if ((chKind == 'N' || chKind == 'L') && iTree >= 0)
+        {
+            DWORD cTreeNodes = rgFirst[iTree + 1] - rgFirst[iTree];
+            DWORD iNode = strtoul(pszLine + 1, &pszEnd, 10);
+            if (iNode >= cTreeNodes || rgNodes[rgFirst[iTree] + iNode].feature != -2)
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                break;
+            }
+
+            RawNode& node = rgNodes[rgFirst[iTree] + iNode];
+            if (chKind == 'L')
+            {
+                node.feature = -1;
+                node.value = static_cast<float>(strtod(pszEnd, nullptr));
+                node.left = node.right = -1;
+            }
+            else
+            {
+                unsigned long feature = strtoul(pszEnd, &pszEnd, 10);
+                node.value = static_cast<float>(strtod(pszEnd, &pszEnd));
+                node.left = strtol(pszEnd, &pszEnd, 10);
+                node.right = strtol(pszEnd, nullptr, 10);
+                node.feature = (fHeader && feature < m_cFeatures) ? static_cast<INT32>(feature) : -3;
+            }
+        }
+    }
+
+    // Every tree must be complete, acyclic and shallow enough
+    DWORD dwDepth = 0;
+    for (DWORD i = 0; i < cTrees && SUCCEEDED(hr); i++)
+    {
+        DWORD dwTreeDepth = MeasureDepth(rgNodes + rgFirst[i], rgFirst[i + 1] - rgFirst[i], 0, 0);
+        if (!fHeader || dwTreeDepth > TREE_ENSEMBLE_MAX_DEPTH)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+        dwDepth = (dwTreeDepth > dwDepth) ? dwTreeDepth : dwDepth;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        const DWORD cInternal = (1u << dwDepth) - 1;
+        const DWORD cLeaves = cInternal + 1;
+        SIZE_T cbFeatures = static_cast<SIZE_T>(cTrees) * cInternal * sizeof(UINT16);
+        SIZE_T cbThresholds = static_cast<SIZE_T>(cTrees) * cInternal * sizeof(float);
+        SIZE_T cbLeaves = static_cast<SIZE_T>(cTrees) * cLeaves * sizeof(float);
+
+        // Float arrays first so they stay aligned
+        m_pbBlock = new BYTE[cbThresholds + cbLeaves + cbFeatures];
+        m_rgThreshold = reinterpret_cast<float*>(m_pbBlock);
+        m_rgLeaf = reinterpret_cast<float*>(m_pbBlock + cbThresholds);
+        m_rgFeature = reinterpret_cast<UINT16*>(m_pbBlock + cbThresholds + cbLeaves);
+        m_dwDepth = dwDepth;
+        m_cTrees = cTrees;
+
+        for (DWORD i = 0; i < cTrees; i++)
+        {
+            Flatten(i, rgNodes + rgFirst[i], 0, 0, 0);
+        }
+    }
+
+    delete[] rgNodes;
+    delete[] rgFirst;
+
+    return hr;
+}
+
+HRESULT TreeEnsemble::Load(PCWSTR pszPath)
+{
+    Unload();
+
+    HANDLE hFile = CreateFileW(pszPath, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER cbFile;
+    if (!GetFileSizeEx(hFile, &cbFile) || cbFile.QuadPart > MAXDWORD - 1)
+    {
+        CloseHandle(hFile);
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = S_OK;
+    DWORD cbText = static_cast<DWORD>(cbFile.QuadPart);
+    char* pszText = new char[cbText + 1];
+    DWORD cbRead = 0;
+
+    if (!ReadFile(hFile, pszText, cbText, &cbRead, nullptr))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    CloseHandle(hFile);
+
+    if (SUCCEEDED(hr))
+    {
+        pszText[cbRead] = '\0';
+        hr = Parse(pszText);
+    }
+
+    delete[] pszText;
+
+    if (FAILED(hr))
+    {
+        Unload();
+    }
+
+    return hr;
+}
+
+float TreeEnsemble::Evaluate(const float* pFeatures) const
+{
+    const DWORD cInternal = (1u << m_dwDepth) - 1;
+    const DWORD cLeaves = cInternal + 1;
+    const UINT16* rgFeature = m_rgFeature;
+    const float* rgThreshold = m_rgThreshold;
+
+    float sum = m_baseScore;
+    DWORD t = 0;
+
+    // Four independent walks per iteration
+    for (; t + 4 <= m_cTrees; t += 4)
+    {
+        DWORD b0 = t * cInternal;
+        DWORD b1 = b0 + cInternal;
+        DWORD b2 = b1 + cInternal;
+        DWORD b3 = b2 + cInternal;
+        DWORD i0 = 0;
+        DWORD i1 = 0;
+        DWORD i2 = 0;
+        DWORD i3 = 0;
+
+        for (DWORD d = 0; d < m_dwDepth; d++)
+        {
+            i0 = 2 * i0 + 1 + (pFeatures[rgFeature[b0 + i0]] > rgThreshold[b0 + i0]);
+            i1 = 2 * i1 + 1 + (pFeatures[rgFeature[b1 + i1]] > rgThreshold[b1 + i1]);
+            i2 = 2 * i2 + 1 + (pFeatures[rgFeature[b2 + i2]] > rgThreshold[b2 + i2]);
+            i3 = 2 * i3 + 1 + (pFeatures[rgFeature[b3 + i3]] > rgThreshold[b3 + i3]);
+        }
+
+        const float* pLeaves = m_rgLeaf + t * cLeaves - cInternal;
+        sum += pLeaves[i0] + pLeaves[cLeaves + i1] + pLeaves[2 * cLeaves + i2] + pLeaves[3 * cLeaves + i3];
+    }
+
+    for (; t < m_cTrees; t++)
+    {
+        DWORD b = t * cInternal;
+        DWORD i = 0;
+        for (DWORD d = 0; d < m_dwDepth; d++)
+        {
+            i = 2 * i + 1 + (pFeatures[rgFeature[b + i]] > rgThreshold[b + i]);
+        }
+        sum += m_rgLeaf[t * cLeaves + i - cInternal];
+    }
+
+    return sum;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <windows.h>
+
+// Deepest tree an ensemble may contain
+#define TREE_ENSEMBLE_MAX_DEPTH     10
+
+// Largest number of nodes one tree may list in the model file
+#define TREE_ENSEMBLE_MAX_NODES     ((1 << (TREE_ENSEMBLE_MAX_DEPTH + 1)) - 1)
+
+// Gradient-boosted tree ensemble evaluated without branches.
+//
+// Every tree is padded to a complete binary tree of the ensemble's depth
+// and stored breadth first, so node i's children are 2i+1 and 2i+2 and
+// a lookup is depth steps of idx = 2 * idx + 1 + (x[feature] > threshold).
+// A leaf above the full depth becomes a split that always goes left, with
+// its value copied to every leaf below it. Split features, thresholds and
+// leaf values are separate arrays in one allocation, and four trees are
+// walked at once so their loads overlap.
+//
+// Model files are text, one record per line:
+//     E <feature count> <base score>      once, first
+//     T                                   starts a tree; its root is node 0
+//     N <node> <feature> <threshold> <left> <right>
+//     L <node> <value>
+// A sample goes right when its feature is greater than the threshold.
+class TreeEnsemble
+{
+public:
+    TreeEnsemble();
+    ~TreeEnsemble();
+
+    HRESULT Load(PCWSTR pszPath);
+    void Unload();
+
+    BOOL IsLoaded() const { return m_cTrees != 0; }
+    DWORD GetFeatureCount() const { return m_cFeatures; }
+    DWORD GetTreeCount() const { return m_cTrees; }
+
+    // Sum of the leaves the sample reaches plus the base score (a logit)
+    float Evaluate(const float* pFeatures) const;
+
+private:
+    TreeEnsemble(const TreeEnsemble&);
+    TreeEnsemble& operator=(const TreeEnsemble&);
+
+    struct RawNode
+    {
+        INT32 feature;      // -1 for a leaf
+        float value;        // Threshold, or leaf value
+        INT32 left;
+        INT32 right;
+    };
+
+    static DWORD MeasureDepth(const RawNode* rgNodes, DWORD cNodes, INT32 iNode, DWORD dwDepth);
+    void Flatten(DWORD iTree, const RawNode* rgNodes, INT32 iNode, DWORD iSlot, DWORD dwDepth);
+    HRESULT Parse(char* pszText);
+
+    BYTE* m_pbBlock;            // Owns the three arrays below
+    UINT16* m_rgFeature;        // [tree][internal node]
+    float* m_rgThreshold;       // [tree][internal node]
+    float* m_rgLeaf;            // [tree][leaf]
+    DWORD m_cTrees;
+    DWORD m_dwDepth;
+    DWORD m_cFeatures;
+    float m_baseScore;
+};
@@ -0,0 +1,123 @@
+#include "TypingFeatures.h"
+#include <math.h>
+
+// RunningStats implementation
+void RunningStats::Reset()
+{
+    count = 0;
+    mean = 0.0;
+    m2 = 0.0;
+}
+
+void RunningStats::Add(double x)
+{
+    count++;
+    double delta = x - mean;
+    mean += delta / count;
+    m2 += delta * (x - mean);
+}
+
+void RunningStats::Remove(double x)
+{
+    if (count <= 1)
+    {
+        Reset();
+        return;
+    }
+
+    double oldMean = mean;
+    count--;
+    mean = (oldMean * (count + 1) - x) / count;
+    m2 -= (x - mean) * (x - oldMean);
+
+    // A single value has no spread; dropping the rounding residue here
+    // keeps it from carrying into every value added later
+    if (count == 1)
+    {
+        m2 = 0.0;
+    }
+}
+
+double RunningStats::GetVariance() const
+{
+    // Removal can leave a tiny negative rounding residue
+    return (count > 1 && m2 > 0.0) ? m2 / (count - 1) : 0.0;
+}
+
+// TypingFeatureAccumulator implementation
+TypingFeatureAccumulator::TypingFeatureAccumulator()
+{
+    Reset();
+}
+
+void TypingFeatureAccumulator::Reset()
+{
+    m_dwell.Reset();
+    m_upDown.Reset();
+    m_downDown.Reset();
+    m_cPauses = 0;
+    m_cTyped = 0;
+    m_cRemoved = 0;
+}
+
+void TypingFeatureAccumulator::AddKeystroke(UINT32 keyDownUs, UINT32 keyUpUs)
+{
+    m_dwell.Add(static_cast<double>(keyUpUs) - keyDownUs);
+    m_cTyped++;
+}
+
+void TypingFeatureAccumulator::RemoveKeystroke(UINT32 keyDownUs, UINT32 keyUpUs)
+{
+    m_dwell.Remove(static_cast<double>(keyUpUs) - keyDownUs);
+    m_cRemoved++;
+}
+
+void TypingFeatureAccumulator::AddPair(UINT32 prevDownUs, UINT32 prevUpUs, UINT32 nextDownUs)
+{
+    double downDownUs = static_cast<double>(nextDownUs) - prevDownUs;
+
+    m_upDown.Add(static_cast<double>(nextDownUs) - prevUpUs);
+    m_downDown.Add(downDownUs);
+    if (downDownUs > TYPING_PAUSE_THRESHOLD_US)
+    {
+        m_cPauses++;
+    }
+}
+
+void TypingFeatureAccumulator::RemovePair(UINT32 prevDownUs, UINT32 prevUpUs, UINT32 nextDownUs)
+{
+    double downDownUs = static_cast<double>(nextDownUs) - prevDownUs;
+
+    m_upDown.Remove(static_cast<double>(nextDownUs) - prevUpUs);
+    m_downDown.Remove(downDownUs);
+    if (downDownUs > TYPING_PAUSE_THRESHOLD_US && m_cPauses > 0)
+    {
+        m_cPauses--;
+    }
+}
+
+void TypingFeatureAccumulator::UpdateKeyUp(UINT32 keyDownUs, UINT32 oldUpUs, UINT32 newUpUs, const UINT32* pNextDownUs)
+{
+    m_dwell.Remove(static_cast<double>(oldUpUs) - keyDownUs);
+    m_dwell.Add(static_cast<double>(newUpUs) - keyDownUs);
+
+    if (pNextDownUs)
+    {
+        m_upDown.Remove(static_cast<double>(*pNextDownUs) - oldUpUs);
+        m_upDown.Add(static_cast<double>(*pNextDownUs) - newUpUs);
+    }
+}
+
+void TypingFeatureAccumulator::GetFeatures(LONGLONG totalTypingTimeUs, TypingFeatures* pFeatures) const
+{
+    pFeatures->keystrokeCount = m_dwell.count;
+    pFeatures->dwellMeanUs = m_dwell.mean;
+    pFeatures->dwellStdDevUs = sqrt(m_dwell.GetVariance());
+    pFeatures->upDownMeanUs = m_upDown.mean;
+    pFeatures->upDownStdDevUs = sqrt(m_upDown.GetVariance());
+    pFeatures->downDownMeanUs = m_downDown.mean;
+    pFeatures->downDownStdDevUs = sqrt(m_downDown.GetVariance());
+    pFeatures->pauseCount = m_cPauses;
+    pFeatures->backspaceRatio = (m_cTyped > 0) ? static_cast<double>(m_cRemoved) / m_cTyped : 0.0;
+    pFeatures->totalTypingTimeUs = totalTypingTimeUs;
+}
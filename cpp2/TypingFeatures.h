@@ -0,0 +1,69 @@
+#pragma once
+
+#include <windows.h>
+
+// Key-down to key-down gaps longer than this count as a pause
+#define TYPING_PAUSE_THRESHOLD_US   500000
+
+// Running mean and variance (Welford). Values can be taken back out
+// again, which is how corrections undo their contribution.
+struct RunningStats
+{
+    DWORD count;
+    double mean;
+    double m2;
+
+    void Reset();
+    void Add(double x);
+    void Remove(double x);
+    double GetVariance() const;
+};
+
+// Feature vector describing one password entry. Times are microseconds,
+// named by the key edges they span as TIMING_FEATURE names them.
+struct TypingFeatures
+{
+    DWORD keystrokeCount;
+    double dwellMeanUs;         // Key held down
+    double dwellStdDevUs;
+    double upDownMeanUs;        // Key up to the next key down (flight); negative on rollover
+    double upDownStdDevUs;
+    double downDownMeanUs;      // Key down to the next key down
+    double downDownStdDevUs;
+    DWORD pauseCount;           // Down-down gaps longer than TYPING_PAUSE_THRESHOLD_US
+    double backspaceRatio;      // Keystrokes removed per keystroke typed
+    LONGLONG totalTypingTimeUs; // First key down to last key up
+};
+
+// Keeps the feature vector current as keystrokes come and go, so nothing
+// has to be recomputed at submit time. Features describe the surviving
+// keystrokes in typed order: one dwell per keystroke, and one up-down and
+// one down-down time per pair of neighbouring keystrokes. Every update is
+// O(1).
+class TypingFeatureAccumulator
+{
+public:
+    TypingFeatureAccumulator();
+
+    void Reset();
+
+    void AddKeystroke(UINT32 keyDownUs, UINT32 keyUpUs);
+    void RemoveKeystroke(UINT32 keyDownUs, UINT32 keyUpUs);
+
+    // Neighbouring keystrokes (earlier one first)
+    void AddPair(UINT32 prevDownUs, UINT32 prevUpUs, UINT32 nextDownUs);
+    void RemovePair(UINT32 prevDownUs, UINT32 prevUpUs, UINT32 nextDownUs);
+
+    // A held key was released; pNextDownUs is null for the last keystroke
+    void UpdateKeyUp(UINT32 keyDownUs, UINT32 oldUpUs, UINT32 newUpUs, const UINT32* pNextDownUs);
+
+    void GetFeatures(LONGLONG totalTypingTimeUs, TypingFeatures* pFeatures) const;
+
+private:
+    RunningStats m_dwell;
+    RunningStats m_upDown;
+    RunningStats m_downDown;
+    DWORD m_cPauses;
+    DWORD m_cTyped;             // Every keystroke ever added since Reset()
+    DWORD m_cRemoved;           // Every keystroke taken back out since Reset()
+};
@@ -0,0 +1,316 @@
+#include "TypingScorer.h"
+#include "Clock.h"
+#include "BucketKernels.h"
+#include <math.h>
+
+TypingScorer::TypingScorer() :
+    m_dwMethod(LOCAL_SCORING_OFF),
+    m_acceptDistance(0.0),
+    m_rejectDistance(0.0),
+    m_acceptProbability(1.0),
+    m_rejectProbability(0.0),
+    m_dwEnrollmentSamples(1)
+{
+    SetLikelihoodRatioErrorRates(LRT_DEFAULT_FALSE_ACCEPT, LRT_DEFAULT_FALSE_REJECT);
+}
+
+void TypingScorer::Initialize(DWORD dwMethod, double acceptDistance, double rejectDistance,
+                              double acceptProbability, double rejectProbability)
+{
+    m_dwMethod = (dwMethod <= LOCAL_SCORING_LIKELIHOOD_RATIO) ? dwMethod : LOCAL_SCORING_OFF;
+    m_acceptDistance = acceptDistance;
+    m_acceptProbability = acceptProbability;
+
+    // An inverted band would accept and reject the same attempt
+    m_rejectDistance = (rejectDistance > acceptDistance) ? rejectDistance : acceptDistance;
+    m_rejectProbability = (rejectProbability < acceptProbability) ? rejectProbability : acceptProbability;
+}
+
+HRESULT TypingScorer::LoadTreeEnsemble(PCWSTR pszPath)
+{
+    HRESULT hr = m_treeEnsemble.Load(pszPath);
+    if (SUCCEEDED(hr) && m_treeEnsemble.GetFeatureCount() != MLP_FEATURE_INPUTS)
+    {
+        m_treeEnsemble.Unload();
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    return hr;
+}
+
+static double Logistic(double x)
+{
+    return 1.0 / (1.0 + exp(-x));
+}
+
+HRESULT TypingScorer::SetLikelihoodRatioErrorRates(double falseAcceptRate, double falseRejectRate)
+{
+    if (!(falseAcceptRate > 0.0 && falseAcceptRate < 0.5 && falseRejectRate > 0.0 && falseRejectRate < 0.5))
+    {
+        return E_INVALIDARG;
+    }
+
+    // Wald's bounds: accept the owner once the likelihood ratio reaches
+    // (1 - FRR) / FAR, reject once it falls to FRR / (1 - FAR)
+    m_lrtAcceptBound = log((1.0 - falseRejectRate) / falseAcceptRate);
+    m_lrtRejectBound = log(falseRejectRate / (1.0 - falseAcceptRate));
+
+    // Computed like the distances they are compared with, so a test that
+    // stopped at a bound is banded on the same side of it
+    m_lrtAcceptDistance = 1.0 - Logistic(m_lrtAcceptBound);
+    m_lrtRejectDistance = 1.0 - Logistic(m_lrtRejectBound);
+    return S_OK;
+}
+
+// Keystrokes are taken in typing order, and the test stops at the first
+// one where the evidence crosses a bound, except that it goes on past the
+// accept bound until LRT_MIN_ACCEPT_KEYSTROKES have been seen. An attempt
+// that runs out of keystrokes in between stays uncertain. This runs over
+// the whole attempt once it has the enrolled length, at submit or in a
+// background pass, not as each key is typed, so stopping early saves
+// scoring work rather than keystrokes. Each keystroke adds its dwell and
+// the key-down to key-down latency leading into it; the other two features
+// are sums and differences of these, and counting them too would treat
+// the same evidence as independent. Each feature adds
+//     log p(x | owner) - log p(x | impostor) = ln k - z^2 (1 - 1/k^2) / 2
+// for z-score z against the template and k = LRT_IMPOSTOR_SPREAD.
+double TypingScorer::LogLikelihoodRatio(const TimingFeatureSet& features, const TypingTemplate& typingTemplate) const
+{
+    const double logSpreadRatio = log(LRT_IMPOSTOR_SPREAD);
+    const double zWeight = 0.5 * (1.0 - 1.0 / (LRT_IMPOSTOR_SPREAD * LRT_IMPOSTOR_SPREAD));
+
+    static const DWORD rgFeatures[] = { TF_DWELL, TF_DOWN_DOWN };
+
+    double llr = 0.0;
+    DWORD cKeys = features.stats[TF_DWELL].count;
+    for (DWORD i = 0; i < cKeys; i++)
+    {
+        for (DWORD k = 0; k < ARRAYSIZE(rgFeatures); k++)
+        {
+            // Latencies between keystrokes start at the second keystroke
+            DWORD f = rgFeatures[k];
+            DWORD j = (f == TF_DWELL) ? i : i - 1;
+            if ((f != TF_DWELL && i == 0) || j >= features.stats[f].count)
+            {
+                continue;
+            }
+
+            float spread = typingTemplate.stdDev[f][j];
+            spread = (spread > TYPING_TEMPLATE_MIN_SPREAD_US) ? spread : TYPING_TEMPLATE_MIN_SPREAD_US;
+            double z = (features.values[f][j] - typingTemplate.mean[f][j]) / spread;
+            double evidence = logSpreadRatio - zWeight * z * z;
+            llr += (evidence > -LRT_MAX_EVIDENCE) ? evidence : -LRT_MAX_EVIDENCE;
+        }
+
+        if ((llr >= m_lrtAcceptBound && i + 1 >= LRT_MIN_ACCEPT_KEYSTROKES) || llr <= m_lrtRejectBound)
+        {
+            break;
+        }
+    }
+
+    return llr;
+}
+
+HRESULT TypingScorer::EvaluateTrees(const TimingFeatureSet& features, const TypingTemplate& typingTemplate, double* pProbability) const
+{
+    if (!m_treeEnsemble.IsLoaded())
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    float rgInputs[MLP_FEATURE_INPUTS];
+    BuildMlpInputs(features, typingTemplate, rgInputs);
+
+    *pProbability = Logistic(m_treeEnsemble.Evaluate(rgInputs));
+    return S_OK;
+}
+
+static DWORD GetFeatureCount(const TimingFeatureSet& features, DWORD dwFeature)
+{
+    return features.stats[dwFeature].count;
+}
+
+double TypingScorer::ScaledManhattanDistance(const TimingFeatureSet& features, const TypingTemplate& typingTemplate) const
+{
+    double sum = 0.0;
+    DWORD cTerms = 0;
+
+    for (DWORD f = 0; f < TF_NUM_FEATURES; f++)
+    {
+        const INT32* pValues = features.values[f];
+        const float* pMean = typingTemplate.mean[f];
+        const float* pSpread = typingTemplate.meanAbsDeviation[f];
+        DWORD c = GetFeatureCount(features, f);
+
+        sum += ScaledAbsoluteDeviation(pValues, pMean, pSpread, TYPING_TEMPLATE_MIN_SPREAD_US, c);
+        cTerms += c;
+    }
+
+    return (cTerms > 0) ? sum / cTerms : 0.0;
+}
+
+double TypingScorer::MahalanobisDistance(const TimingFeatureSet& features, const TypingTemplate& typingTemplate) const
+{
+    double sum = 0.0;
+    DWORD cTerms = 0;
+
+    for (DWORD f = 0; f < TF_NUM_FEATURES; f++)
+    {
+        const INT32* pValues = features.values[f];
+        const float* pMean = typingTemplate.mean[f];
+        const float* pSpread = typingTemplate.stdDev[f];
+        DWORD c = GetFeatureCount(features, f);
+
+        sum += SquaredZ(pValues, pMean, pSpread, TYPING_TEMPLATE_MIN_SPREAD_US, c);
+        cTerms += c;
+    }
+
+    return (cTerms > 0) ? sqrt(sum / cTerms) : 0.0;
+}
+
+// Where a score sits across the uncertain band: 0 at the reject bound, 1 at
+// the accept bound, linear in between and clamped outside. Works with the
+// bounds in either order, so distances and probabilities share it. With no
+// band at all, the verdict is all there is to go on.
+static double BandConfidence(SCORE_VERDICT verdict, double value, double rejectBound, double acceptBound)
+{
+    if (acceptBound == rejectBound)
+    {
+        return (verdict == SV_ACCEPT) ? 1.0 : 0.0;
+    }
+
+    double position = (value - rejectBound) / (acceptBound - rejectBound);
+    return (position < 0.0) ? 0.0 : (position > 1.0) ? 1.0 : position;
+}
+
+HRESULT TypingScorer::Score(const TimingFeatureSet& features, const TypingTemplate& typingTemplate, ScoreResult* pResult) const
+{
+    if (!pResult)
+    {
+        return E_INVALIDARG;
+    }
+
+    LONGLONG llStart = GetClock().Now();
+
+    pResult->verdict = SV_UNCERTAIN;
+    pResult->distance = 0.0;
+    pResult->confidence = 0.5;
+    pResult->elapsedUs = 0;
+
+    // A template still enrolling has too few attempts behind its spreads
+    if (typingTemplate.sampleCount < m_dwEnrollmentSamples)
+    {
+        return S_FALSE;
+    }
+
+    double distance = 0.0;
+    HRESULT hr = ComputeDistance(features, typingTemplate, &distance);
+    if (hr != S_OK)
+    {
+        return S_FALSE;
+    }
+
+    if (m_dwMethod == LOCAL_SCORING_LIKELIHOOD_RATIO)
+    {
+        // Evidence past the accept bound from too few keystrokes is not an accept
+        if (distance <= m_lrtAcceptDistance && features.stats[TF_DWELL].count >= LRT_MIN_ACCEPT_KEYSTROKES)
+        {
+            pResult->verdict = SV_ACCEPT;
+        }
+        else if (distance >= m_lrtRejectDistance)
+        {
+            pResult->verdict = SV_REJECT;
+        }
+
+        pResult->distance = distance;
+        pResult->confidence = BandConfidence(pResult->verdict, distance, m_lrtRejectDistance, m_lrtAcceptDistance);
+    }
+    else if (IsProbabilityScoring(m_dwMethod))
+    {
+        double probability = 1.0 - distance;
+        if (probability >= m_acceptProbability)
+        {
+            pResult->verdict = SV_ACCEPT;
+        }
+        else if (probability <= m_rejectProbability)
+        {
+            pResult->verdict = SV_REJECT;
+        }
+
+        pResult->distance = distance;
+        pResult->confidence = BandConfidence(pResult->verdict, probability, m_rejectProbability, m_acceptProbability);
+    }
+    else
+    {
+        pResult->distance = distance;
+
+        if (pResult->distance <= m_acceptDistance)
+        {
+            pResult->verdict = SV_ACCEPT;
+        }
+        else if (pResult->distance >= m_rejectDistance)
+        {
+            pResult->verdict = SV_REJECT;
+        }
+
+        pResult->confidence = BandConfidence(pResult->verdict, pResult->distance, m_rejectDistance, m_acceptDistance);
+    }
+
+    pResult->elapsedUs = GetClock().ElapsedMicroseconds(llStart, GetClock().Now());
+
+    return S_OK;
+}
+
+HRESULT TypingScorer::ComputeDistance(const TimingFeatureSet& features, const TypingTemplate& typingTemplate, double* pDistance) const
+{
+    *pDistance = 0.0;
+
+    // Features are compared position by position, so only an attempt of
+    // the enrolled length can be scored
+    DWORD cKeystrokes = features.stats[TF_DWELL].count;
+    if (!IsEnabled() || cKeystrokes == 0 || cKeystrokes != typingTemplate.keystrokeCount)
+    {
+        return S_FALSE;
+    }
+
+    switch (m_dwMethod)
+    {
+    case LOCAL_SCORING_MLP:
+    case LOCAL_SCORING_TREES:
+        {
+            double probability = 0.0;
+            HRESULT hr = (m_dwMethod == LOCAL_SCORING_MLP) ?
+                EvaluateTypingMlp(features, typingTemplate, &probability) :
+                EvaluateTrees(features, typingTemplate, &probability);
+            if (FAILED(hr))
+            {
+                return S_FALSE;
+            }
+            *pDistance = 1.0 - probability;
+        }
+        break;
+
+    case LOCAL_SCORING_MAHALANOBIS:
+        *pDistance = MahalanobisDistance(features, typingTemplate);
+        break;
+
+    case LOCAL_SCORING_LIKELIHOOD_RATIO:
+        *pDistance = 1.0 - Logistic(LogLikelihoodRatio(features, typingTemplate));
+        break;
+
+    default:
+        *pDistance = ScaledManhattanDistance(features, typingTemplate);
+        break;
+    }
+
+    return S_OK;
+}
+
+BOOL IsValidTypingTemplate(const TypingTemplate& typingTemplate)
+{
+    return typingTemplate.magic == TYPING_TEMPLATE_MAGIC &&
+           typingTemplate.version == TYPING_TEMPLATE_VERSION &&
+           typingTemplate.keystrokeCount > 0 &&
+           typingTemplate.keystrokeCount <= MAX_KEYSTROKE_COUNT &&
+           typingTemplate.sampleCount > 0;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <windows.h>
+#include "FeatureKernels.h"
+#include "MlpScorer.h"
+#include "TreeEnsemble.h"
+
+// Identifies a stored TypingTemplate blob
+#define TYPING_TEMPLATE_MAGIC       0x54505954      // 'TYPT'
+#define TYPING_TEMPLATE_VERSION     1
+
+// Distance measures selectable through CONFIG_LOCAL_SCORING
+#define LOCAL_SCORING_OFF           0
+#define LOCAL_SCORING_MANHATTAN     1   // Mean |x - mean| / mean absolute deviation
+#define LOCAL_SCORING_MAHALANOBIS   2   // Diagonal covariance, RMS of z-scores
+#define LOCAL_SCORING_MLP           3   // Quantized verifier network, see MlpScorer.h
+#define LOCAL_SCORING_TREES         4   // Boosted tree ensemble loaded from a model file
+#define LOCAL_SCORING_LIKELIHOOD_RATIO 5 // Likelihood ratio test against Wald's bounds
+
+// The likelihood ratio test takes the owner's timings as normal around the
+// template mean and an impostor's as normal around the same mean, this many
+// times wider. It is not a sequential test: it runs once over the attempt
+// at hand, when it is scored, and only stops counting early.
+// A feature at z spreads from the mean then adds ln k - z^2 (1 - 1/k^2) / 2
+// for k = LRT_IMPOSTOR_SPREAD: at k = 2, +ln 2 (0.69) at the mean, nothing
+// at |z| = 1.36 and less from there on. The model only tells typists apart
+// by how far they stray, not by where their own mean lies, so an impostor
+// who types steadily near the owner's rhythm looks like the owner. Wider
+// impostors make each near-mean feature count for more (ln k) and so
+// accept sooner; 2 keeps that to at most 1.39 per keystroke.
+#define LRT_IMPOSTOR_SPREAD         2.0
+
+// Most evidence against the owner a single feature can add, so one stray
+// keystroke cannot decide an attempt by itself. At k = 2 a feature reaches
+// it at |z| = 3.14.
+#define LRT_MAX_EVIDENCE            3.0
+
+// Fewest keystrokes the likelihood ratio test accepts on. At the default bounds, accepting
+// takes ln(0.98 / 0.005) = 5.28, which five keystrokes at the owner's means
+// reach; an accept rests on at least this many instead. Shorter passwords
+// never accept locally and go to the AI model as uncertain.
+#define LRT_MIN_ACCEPT_KEYSTROKES   8
+
+// Error rates the likelihood ratio bounds are set from until SetLikelihoodRatioErrorRates
+#define LRT_DEFAULT_FALSE_ACCEPT    0.005
+#define LRT_DEFAULT_FALSE_REJECT    0.02
+
+// Floor on a template feature's spread, so one unusually steady feature
+// cannot dominate the distance
+#define TYPING_TEMPLATE_MIN_SPREAD_US   1000.0f
+
+enum SCORE_VERDICT
+{
+    SV_UNCERTAIN = 0,
+    SV_ACCEPT,
+    SV_REJECT
+};
+
+// Enrolled typing template for one user. Every timing feature is kept per
+// keystroke position of the password it was enrolled on. The layout has no
+// pointers, so a template is stored and loaded as a single blob.
+struct TypingTemplate
+{
+    DWORD magic;
+    DWORD version;
+    DWORD keystrokeCount;       // Password length the template describes
+    DWORD sampleCount;          // Attempts folded into the template
+    float mean[TF_NUM_FEATURES][MAX_KEYSTROKE_COUNT];               // Microseconds
+    float meanAbsDeviation[TF_NUM_FEATURES][MAX_KEYSTROKE_COUNT];
+    float stdDev[TF_NUM_FEATURES][MAX_KEYSTROKE_COUNT];
+};
+
+struct ScoreResult
+{
+    SCORE_VERDICT verdict;
+    double distance;            // Scaled distance per feature, or 1 - probability for
+                                // the MLP and trees; 0 is a perfect match
+    double confidence;          // 0 at the reject bound, 1 at the accept bound, linear
+                                // across the uncertain band and clamped outside it
+    DWORD elapsedUs;            // Time spent scoring
+};
+
+// Methods whose distance is 1 - the probability that the template's owner
+// typed the attempt
+inline BOOL IsProbabilityScoring(DWORD dwMethod)
+{
+    return dwMethod == LOCAL_SCORING_MLP || dwMethod == LOCAL_SCORING_TREES || dwMethod == LOCAL_SCORING_LIKELIHOOD_RATIO;
+}
+
+// Compares an attempt's timing features against an enrolled template.
+// Distances at or below the accept distance accept, at or above the reject
+// distance reject, and anything in between is left to a second opinion.
+// The MLP and the tree ensemble are banded the same way on their
+// probability. Both read the template-relative inputs from BuildMlpInputs.
+// The likelihood ratio test decides by Wald's bounds, set from the error
+// rates it may make.
+class TypingScorer
+{
+public:
+    TypingScorer();
+
+    void Initialize(DWORD dwMethod, double acceptDistance, double rejectDistance,
+                    double acceptProbability, double rejectProbability);
+    BOOL IsEnabled() const { return m_dwMethod != LOCAL_SCORING_OFF; }
+
+    // Model for LOCAL_SCORING_TREES; without one every attempt is uncertain
+    HRESULT LoadTreeEnsemble(PCWSTR pszPath);
+
+    // Rates LOCAL_SCORING_LIKELIHOOD_RATIO accepts an impostor and rejects
+    // the owner at, each in (0, 0.5)
+    HRESULT SetLikelihoodRatioErrorRates(double falseAcceptRate, double falseRejectRate);
+
+    // Attempts a template must hold before it is scored at all; at least 1
+    void SetEnrollmentSamples(DWORD dwSamples) { m_dwEnrollmentSamples = (dwSamples > 0) ? dwSamples : 1; }
+
+    // S_FALSE with an uncertain verdict when the attempt cannot be compared
+    // with the template, e.g. because the password length differs, or the
+    // template holds fewer attempts than the enrollment needs
+    HRESULT Score(const TimingFeatureSet& features, const TypingTemplate& typingTemplate, ScoreResult* pResult) const;
+
+    // Only ScoreResult::distance, without banding or timing; S_FALSE when
+    // the attempt cannot be compared. For batch scoring.
+    HRESULT ComputeDistance(const TimingFeatureSet& features, const TypingTemplate& typingTemplate, double* pDistance) const;
+
+private:
+    double ScaledManhattanDistance(const TimingFeatureSet& features, const TypingTemplate& typingTemplate) const;
+    double MahalanobisDistance(const TimingFeatureSet& features, const TypingTemplate& typingTemplate) const;
+    HRESULT EvaluateTrees(const TimingFeatureSet& features, const TypingTemplate& typingTemplate, double* pProbability) const;
+    double LogLikelihoodRatio(const TimingFeatureSet& features, const TypingTemplate& typingTemplate) const;
+
+    DWORD m_dwMethod;
+    double m_acceptDistance;
+    double m_rejectDistance;
+    double m_acceptProbability;
+    double m_rejectProbability;
+    double m_lrtAcceptBound;            // Log likelihood ratios
+    double m_lrtRejectBound;
+    double m_lrtAcceptDistance;         // The bounds as distances
+    double m_lrtRejectDistance;
+    DWORD m_dwEnrollmentSamples;
+    TreeEnsemble m_treeEnsemble;
+};
+
+// Check a template loaded from storage before it is trusted
+BOOL IsValidTypingTemplate(const TypingTemplate& typingTemplate);
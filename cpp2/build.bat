@@ -35,6 +35,20 @@ rem Create output directories
 if not exist "%SOLUTION_DIR%\%PLATFORM%\%BUILD_CONFIG%" mkdir "%SOLUTION_DIR%\%PLATFORM%\%BUILD_CONFIG%"
 if not exist "%SOLUTION_DIR%\logs" mkdir "%SOLUTION_DIR%\logs"
 
+rem Regenerate the typing model weights when Python is available
+where python >nul 2>&1
+if %errorlevel% equ 0 (
+    echo Generating MLP weights...
+    python "%SOLUTION_DIR%GenerateMlpWeights.py"
+    if errorlevel 1 (
+        echo Error: MLP weight generation failed
+        pause
+        exit /b 1
+    )
+) else (
+    echo Python not found, using checked-in MlpWeights.h
+)
+
 echo Building solution...
 msbuild "%SOLUTION_DIR%\%PROJECT_NAME%.sln" /p:Configuration=%BUILD_CONFIG% /p:Platform=%PLATFORM% /p:PlatformToolset=v143 /m /v:minimal
 
@@ -10,6 +10,8 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include "BiometricProfile.h"
+#include "Clock.h"
 
 // Field IDs for the credential provider
 enum FIELD_ID
@@ -22,32 +24,11 @@ enum FIELD_ID
     FID_NUM_FIELDS = 5
 };
 
-// Structure for capturing keystroke data
-struct KeystrokeData
-{
-    WCHAR key;                 // The key pressed
-    LONGLONG keyDownTime;      // High precision timestamp when key was pressed
-    LONGLONG keyUpTime;        // High precision timestamp when key was released
-    DWORD position;            // Position in the password string
-};
-
-// Biometric profile structure
-struct BiometricProfile
-{
-    std::vector<KeystrokeData> keystrokes;
-    std::wstring username;
-    std::wstring password;
-    LONGLONG startTime;
-    LONGLONG totalTypingTime;
-    DWORD passwordLength;
-    LONGLONG performanceFrequency;
-};
-
 // AI Model Response structure
 struct AIResponse
 {
     bool isLegitimate;
-    double confidenceScore;
+    double confidenceScore;     // [0, 1], or -1 when the response has none
     std::wstring message;
     std::wstring sessionId;
 };
@@ -58,14 +39,69 @@ struct AIResponse
 #define CONFIG_TIMEOUT          L"Timeout"
 #define CONFIG_ENABLED          L"Enabled"
 #define CONFIG_DEBUG_MODE       L"DebugMode"
+#define CONFIG_KEY_EVENT_SOURCE L"KeyEventSource"
+#define CONFIG_KEY_EVENT_REPLAY L"KeyEventReplayFile"
+#define CONFIG_STATUS_RATE      L"StatusUpdateRate"
+#define CONFIG_CLOCK_SOURCE     L"ClockSource"
+#define CONFIG_LOCAL_SCORING    L"LocalScoring"
+#define CONFIG_LOCAL_ACCEPT     L"LocalAcceptDistance"
+#define CONFIG_LOCAL_REJECT     L"LocalRejectDistance"
+#define CONFIG_REMOTE_SCORING   L"RemoteScoring"
+#define CONFIG_REMOTE_BUDGET    L"RemoteBudgetMs"
+#define CONFIG_REMOTE_CONFIDENCE L"RemoteMinConfidence"
+#define CONFIG_REMOTE_FALLBACK  L"RemoteFallback"
+#define CONFIG_PAYLOAD_FORMAT   L"PayloadFormat"
+#define CONFIG_PAYLOAD_SCHEMA   L"PayloadSchema"
+#define CONFIG_MLP_ACCEPT       L"MlpAcceptProbability"
+#define CONFIG_MLP_REJECT       L"MlpRejectProbability"
+#define CONFIG_LRT_FALSE_ACCEPT L"LikelihoodRatioFalseAcceptRate"
+#define CONFIG_LRT_FALSE_REJECT L"LikelihoodRatioFalseRejectRate"
+#define CONFIG_TREE_MODEL       L"TreeModelFile"
+#define CONFIG_TEMPLATE_STORE   L"TemplateStoreFile"
+#define CONFIG_ADAPTATION_RATE  L"TemplateAdaptationRate"
+#define CONFIG_ENROLLMENT_SAMPLES L"EnrollmentSamples"
+#define CONFIG_SPECULATIVE_IDLE L"SpeculativeScoringIdleMs"
 
 // Registry key for configuration
 #define BIOMETRIC_CONFIG_KEY    L"SOFTWARE\\BiometricCredentialProvider"
 
+// Registry key holding enrolled typing templates, one value per user SID.
+// Read when the template store (TemplateStore.h) has no entry for the user.
+#define BIOMETRIC_TEMPLATE_KEY  BIOMETRIC_CONFIG_KEY L"\\Templates"
+
+// Registry key the verdict counts (DecisionCounters.h) are kept under,
+// across LogonUI processes and reboots. Deleting it resets them.
+#define BIOMETRIC_DECISION_KEY  BIOMETRIC_CONFIG_KEY L"\\DecisionCounts"
+
+// When the remote AI model is consulted, through CONFIG_REMOTE_SCORING
+#define REMOTE_SCORING_NEVER        0   // Local verdict only; uncertain is denied
+#define REMOTE_SCORING_UNCERTAIN    1   // Only when the local verdict is uncertain
+#define REMOTE_SCORING_ALWAYS       2   // Every attempt the local model does not reject
+
+// What decides when the AI model fails, runs out of its latency budget or
+// answers with less than CONFIG_REMOTE_CONFIDENCE, through CONFIG_REMOTE_FALLBACK
+#define REMOTE_FALLBACK_DENY        0   // Deny the attempt
+#define REMOTE_FALLBACK_LOCAL       1   // The local verdict, uncertain is denied
+
 // Default values
 #define DEFAULT_TIMEOUT         30000
 #define DEFAULT_AI_ENDPOINT     L"https://your-ai-model.com/api/authenticate"
 #define DEFAULT_API_KEY         L"your-api-key-here"
+#define DEFAULT_STATUS_RATE     20
+#define DEFAULT_LOCAL_ACCEPT    125     // Hundredths of a scaled distance unit
+#define DEFAULT_LOCAL_REJECT    250
+#define DEFAULT_MLP_ACCEPT      90      // Percent
+#define DEFAULT_MLP_REJECT      10
+#define DEFAULT_LRT_FALSE_ACCEPT 5      // Tenths of a percent
+#define DEFAULT_LRT_FALSE_REJECT 20
+#define DEFAULT_ADAPTATION_RATE 5       // Percent weight of each accepted attempt
+#define DEFAULT_ENROLLMENT_SAMPLES 5    // Remotely accepted logons before a template is scored
+#define DEFAULT_SPECULATIVE_IDLE 250    // Typing pause before a background score, 0 = off
+#define DEFAULT_REMOTE_BUDGET   0       // Milliseconds for the whole AI round trip, 0 = Timeout only
+#define DEFAULT_REMOTE_CONFIDENCE 0     // Percent
+
+// How often a background score checks whether the last key was released
+#define SPECULATIVE_RELEASE_POLL_MS 25
 
 // Helper macros
 #define SAFE_RELEASE(p) { if (p) { (p)->Release(); (p) = nullptr; } }
@@ -96,6 +132,25 @@ public:
     }
 };
 
+// Releases a critical section the caller holds once, for the lifetime of
+// the object, and takes it back on the way out
+class CAutoUnlock
+{
+private:
+    CRITICAL_SECTION* m_pcs;
+    
+public:
+    CAutoUnlock(CRITICAL_SECTION* pcs) : m_pcs(pcs)
+    {
+        LeaveCriticalSection(m_pcs);
+    }
+    
+    ~CAutoUnlock()
+    {
+        EnterCriticalSection(m_pcs);
+    }
+};
+
 // Error handling macros
 #define RETURN_IF_FAILED(hr) { if (FAILED(hr)) return hr; }
 #define BREAK_IF_FAILED(hr) { if (FAILED(hr)) break; }
@@ -114,16 +169,12 @@ inline HRESULT SecureStringCat(PWSTR pszDest, size_t cchDest, PCWSTR pszSrc)
 // High-resolution timer utilities
 inline LONGLONG GetHighResolutionTime()
 {
-    LARGE_INTEGER time;
-    QueryPerformanceCounter(&time);
-    return time.QuadPart;
+    return GetClock().Now();
 }
 
 inline LONGLONG GetPerformanceFrequency()
 {
-    LARGE_INTEGER frequency;
-    QueryPerformanceFrequency(&frequency);
-    return frequency.QuadPart;
+    return GetClock().GetFrequency();
 }
 
 // Convert performance counter to milliseconds
@@ -1,4 +1,6 @@
 #include "helpers.h"
+#include "FeatureKernels.h"
+#include "TypingScorer.h"
 #include <shlwapi.h>
 #include <wininet.h>
 #include <wincrypt.h>
@@ -76,6 +78,20 @@ HRESULT GetConfigurationValue(PCWSTR pszValueName, std::wstring& value)
     return hr;
 }
 
+HRESULT GetConfigurationDWORD(PCWSTR pszValueName, DWORD& value)
+{
+    HKEY hKey = nullptr;
+    HRESULT hr = OpenRegistryKey(HKEY_LOCAL_MACHINE, BIOMETRIC_CONFIG_KEY, KEY_READ, &hKey);
+    
+    if (SUCCEEDED(hr))
+    {
+        hr = ReadRegistryDWORD(hKey, pszValueName, value);
+        RegCloseKey(hKey);
+    }
+    
+    return hr;
+}
+
 HRESULT SetConfigurationValue(PCWSTR pszValueName, PCWSTR pszValue)
 {
     HKEY hKey = nullptr;
@@ -320,50 +336,6 @@ HRESULT KerbInteractiveUnlockLogonPack(const KERB_INTERACTIVE_UNLOCK_LOGON& kiul
     return hr;
 }
 
-// JSON utilities for AI communication
-HRESULT CreateJSONString(const BiometricProfile& profile, std::wstring& jsonOutput)
-{
-    HRESULT hr = S_OK;
-    
-    try
-    {
-        std::wstring json = L"{";
-        json += L"\"keystrokes\": [";
-        
-        for (size_t i = 0; i < profile.keystrokes.size(); ++i)
-        {
-            const KeystrokeData& keystroke = profile.keystrokes[i];
-            
-            json += L"{";
-            json += L"\"key\": \"" + std::wstring(1, keystroke.key) + L"\",";
-            json += L"\"keyDownTime\": " + std::to_wstring(keystroke.keyDownTime) + L",";
-            json += L"\"keyUpTime\": " + std::to_wstring(keystroke.keyUpTime) + L",";
-            json += L"\"position\": " + std::to_wstring(keystroke.position);
-            json += L"}";
-            
-            if (i < profile.keystrokes.size() - 1)
-            {
-                json += L",";
-            }
-        }
-        
-        json += L"],";
-        json += L"\"passwordLength\": " + std::to_wstring(profile.passwordLength) + L",";
-        json += L"\"totalTypingTime\": " + std::to_wstring(profile.totalTypingTime) + L",";
-        json += L"\"username\": \"" + profile.username + L"\",";
-        json += L"\"timestamp\": " + std::to_wstring(GetTickCount64());
-        json += L"}";
-        
-        jsonOutput = json;
-    }
-    catch (const std::exception&)
-    {
-        hr = E_FAIL;
-    }
-    
-    return hr;
-}
-
 HRESULT ParseJSONResponse(const std::wstring& jsonResponse, AIResponse& response)
 {
     HRESULT hr = S_OK;
@@ -375,11 +347,11 @@ HRESULT ParseJSONResponse(const std::wstring& jsonResponse, AIResponse& response
                                jsonResponse.find(L"\"isLegitimate\":true") != std::wstring::npos ||
                                jsonResponse.find(L"\"result\":\"legitimate\"") != std::wstring::npos);
         
-        response.confidenceScore = 0.0;
+        response.confidenceScore = -1.0;
         response.message = L"Parsed from AI response";
         response.sessionId = L"";
         
-        // Extract confidence score if present
+        // Extract confidence score if present, clamped to [0, 1]
         size_t confPos = jsonResponse.find(L"\"confidence\":");
         if (confPos != std::wstring::npos)
         {
@@ -388,7 +360,8 @@ HRESULT ParseJSONResponse(const std::wstring& jsonResponse, AIResponse& response
             if (endPos != std::wstring::npos)
             {
                 std::wstring confStr = jsonResponse.substr(startPos, endPos - startPos);
-                response.confidenceScore = _wtof(confStr.c_str());
+                double confidence = _wtof(confStr.c_str());
+                response.confidenceScore = (confidence < 0.0) ? 0.0 : (confidence > 1.0) ? 1.0 : confidence;
             }
         }
     }
@@ -400,14 +373,127 @@ HRESULT ParseJSONResponse(const std::wstring& jsonResponse, AIResponse& response
     return hr;
 }
 
+// Biometric data processing
+HRESULT CalculateKeystrokeTiming(const KeystrokeTimeline& timeline, 
+                                DWORD* pdwAverageInterval, DWORD* pdwVariance)
+{
+    if (!pdwAverageInterval || !pdwVariance)
+    {
+        return E_INVALIDARG;
+    }
+    
+    *pdwAverageInterval = 0;
+    *pdwVariance = 0;
+    
+    TimingFeatureSet features;
+    HRESULT hr = ExtractTimingFeatures(timeline, &features);
+    if (SUCCEEDED(hr))
+    {
+        // Interval between consecutive key presses, in milliseconds
+        const TimingFeatureStats& interval = features.stats[TF_DOWN_DOWN];
+        double meanMs = interval.mean / 1000.0;
+        double stdDevMs = interval.stdDev / 1000.0;
+        *pdwAverageInterval = (meanMs > 0.0) ? static_cast<DWORD>(meanMs + 0.5) : 0;
+        *pdwVariance = static_cast<DWORD>(stdDevMs * stdDevMs + 0.5);
+    }
+    
+    return hr;
+}
+
+HRESULT LoadTypingTemplate(PCWSTR pszUserSid, TypingTemplate* pTemplate)
+{
+    if (!pszUserSid || !pTemplate)
+    {
+        return E_INVALIDARG;
+    }
+    
+    DWORD cbTemplate = sizeof(*pTemplate);
+    LONG lResult = RegGetValueW(HKEY_LOCAL_MACHINE, BIOMETRIC_TEMPLATE_KEY, pszUserSid,
+                                RRF_RT_REG_BINARY, nullptr, pTemplate, &cbTemplate);
+    
+    HRESULT hr = HRESULT_FROM_WIN32(lResult);
+    if (SUCCEEDED(hr) && (cbTemplate != sizeof(*pTemplate) || !IsValidTypingTemplate(*pTemplate)))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    
+    if (FAILED(hr))
+    {
+        SecureZeroMemory(pTemplate, sizeof(*pTemplate));
+    }
+    
+    return hr;
+}
+
+HRESULT GetAccountSidString(PCWSTR pszDomain, PCWSTR pszUsername, PWSTR* ppszSid)
+{
+    *ppszSid = nullptr;
+    
+    WCHAR szAccount[MAX_USERNAME_LENGTH * 2 + 2];
+    HRESULT hr = (pszDomain && pszDomain[0]) ?
+        StringCchPrintfW(szAccount, ARRAYSIZE(szAccount), L"%s\\%s", pszDomain, pszUsername) :
+        StringCchCopyW(szAccount, ARRAYSIZE(szAccount), pszUsername);
+    
+    if (SUCCEEDED(hr))
+    {
+        BYTE rgbSid[SECURITY_MAX_SID_SIZE];
+        DWORD cbSid = sizeof(rgbSid);
+        WCHAR szReferencedDomain[DNLEN + 1];
+        DWORD cchReferencedDomain = ARRAYSIZE(szReferencedDomain);
+        SID_NAME_USE sidNameUse;
+        
+        if (LookupAccountNameW(nullptr, szAccount, rgbSid, &cbSid,
+                               szReferencedDomain, &cchReferencedDomain, &sidNameUse))
+        {
+            PWSTR pszSid = nullptr;
+            if (ConvertSidToStringSidW(rgbSid, &pszSid))
+            {
+                hr = SHStrDupW(pszSid, ppszSid);
+                LocalFree(pszSid);
+            }
+            else
+            {
+                hr = GetLastErrorAsHRESULT();
+            }
+        }
+        else
+        {
+            hr = GetLastErrorAsHRESULT();
+        }
+    }
+    
+    return hr;
+}
+
+// WinHTTP timeouts apply to each step separately, so before every step
+// they are cut to what is left of the request's budget
+static HRESULT SetRemainingTimeouts(HINTERNET hInternet, ULONGLONG ullDeadline)
+{
+    ULONGLONG ullNow = GetTickCount64();
+    if (ullNow >= ullDeadline)
+    {
+        return HRESULT_FROM_WIN32(ERROR_WINHTTP_TIMEOUT);
+    }
+    
+    ULONGLONG ullRemainingMs = ullDeadline - ullNow;
+    int nRemainingMs = (ullRemainingMs < MAXLONG) ? static_cast<int>(ullRemainingMs) : MAXLONG;
+    if (!WinHttpSetTimeouts(hInternet, nRemainingMs, nRemainingMs, nRemainingMs, nRemainingMs))
+    {
+        return GetLastErrorAsHRESULT();
+    }
+    
+    return S_OK;
+}
+
 // HTTP communication with AI model
-HRESULT SendHTTPRequest(const std::wstring& endpoint, const std::wstring& jsonData, 
-                       const std::wstring& apiKey, std::wstring& response)
+HRESULT SendHTTPRequest(const std::wstring& endpoint, PCWSTR pszContentType, const char* pchBody, DWORD cbBody,
+                       const std::wstring& apiKey, DWORD dwBudgetMs, std::wstring& response)
 {
     HRESULT hr = S_OK;
     HINTERNET hSession = nullptr;
     HINTERNET hConnect = nullptr;
     HINTERNET hRequest = nullptr;
+    ULONGLONG ullDeadline = GetTickCount64() + dwBudgetMs;
     
     try
     {
@@ -424,6 +510,12 @@ HRESULT SendHTTPRequest(const std::wstring& endpoint, const std::wstring& jsonDa
             DWORD port;
             hr = ParseURL(endpoint, protocol, host, path, port);
             
+            if (SUCCEEDED(hr))
+            {
+                // Name resolution and connecting use the session's timeouts
+                hr = SetRemainingTimeouts(hSession, ullDeadline);
+            }
+            
             if (SUCCEEDED(hr))
             {
                 hConnect = WinHttpConnect(hSession, host.c_str(), static_cast<INTERNET_PORT>(port), 0);
@@ -439,31 +531,50 @@ HRESULT SendHTTPRequest(const std::wstring& endpoint, const std::wstring& jsonDa
                     if (hRequest)
                     {
                         // Set headers
-                        std::wstring headers = L"Content-Type: application/json\r\n";
+                        std::wstring headers = L"Content-Type: ";
+                        headers += pszContentType;
+                        headers += L"\r\n";
                         if (!apiKey.empty())
                         {
                             headers += L"Authorization: Bearer " + apiKey + L"\r\n";
                         }
                         
-                        // Convert JSON to UTF-8
-                        std::string jsonUtf8 = UnicodeToUtf8(jsonData);
-                        
                         // Send request
-                        if (WinHttpSendRequest(hRequest, headers.c_str(), -1,
-                                             const_cast<char*>(jsonUtf8.c_str()), static_cast<DWORD>(jsonUtf8.length()),
-                                             static_cast<DWORD>(jsonUtf8.length()), 0))
+                        hr = SetRemainingTimeouts(hRequest, ullDeadline);
+                        if (SUCCEEDED(hr) &&
+                            WinHttpSendRequest(hRequest, headers.c_str(), -1,
+                                             const_cast<char*>(pchBody), cbBody, cbBody, 0))
                         {
-                            if (WinHttpReceiveResponse(hRequest, nullptr))
+                            hr = SetRemainingTimeouts(hRequest, ullDeadline);
+                            if (SUCCEEDED(hr) && WinHttpReceiveResponse(hRequest, nullptr))
                             {
+                                // An endpoint that cannot read the body's format says so with 415
+                                DWORD dwStatusCode = 0;
+                                DWORD cbStatusCode = sizeof(dwStatusCode);
+                                if (WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                                                        WINHTTP_HEADER_NAME_BY_INDEX, &dwStatusCode, &cbStatusCode,
+                                                        WINHTTP_NO_HEADER_INDEX) &&
+                                    dwStatusCode == HTTP_STATUS_UNSUPPORTED_MEDIA)
+                                {
+                                    hr = HTTP_E_STATUS_UNSUPPORTED_MEDIA;
+                                }
+                                
                                 // Read response
                                 DWORD dwSize = 0;
                                 std::string responseData;
                                 
-                                do
+                                while (SUCCEEDED(hr))
                                 {
                                     dwSize = 0;
+                                    hr = SetRemainingTimeouts(hRequest, ullDeadline);
+                                    if (FAILED(hr))
+                                        break;
+                                    
                                     if (!WinHttpQueryDataAvailable(hRequest, &dwSize))
+                                    {
+                                        hr = GetLastErrorAsHRESULT();
                                         break;
+                                    }
                                     
                                     if (dwSize > 0)
                                     {
@@ -476,11 +587,22 @@ HRESULT SendHTTPRequest(const std::wstring& endpoint, const std::wstring& jsonDa
                                             responseData += &buffer[0];
                                         }
                                     }
-                                } while (dwSize > 0);
+                                    
+                                    if (dwSize == 0)
+                                        break;
+                                }
                                 
                                 // Convert response to wide string
                                 response = Utf8ToUnicode(responseData);
                             }
+                            else if (SUCCEEDED(hr))
+                            {
+                                hr = GetLastErrorAsHRESULT();
+                            }
+                        }
+                        else if (SUCCEEDED(hr))
+                        {
+                            hr = GetLastErrorAsHRESULT();
                         }
                         
                         WinHttpCloseHandle(hRequest);
@@ -493,7 +615,12 @@ HRESULT SendHTTPRequest(const std::wstring& endpoint, const std::wstring& jsonDa
             WinHttpCloseHandle(hSession);
         }
         
-        if (response.empty())
+        // A partial response read before the budget ran out is not used
+        if (FAILED(hr))
+        {
+            response.clear();
+        }
+        else if (response.empty())
         {
             hr = E_FAIL;
         }
@@ -550,6 +677,27 @@ HRESULT ReadRegistryString(HKEY hKey, PCWSTR pszValueName, std::wstring& value)
     return hr;
 }
 
+HRESULT ReadRegistryDWORD(HKEY hKey, PCWSTR pszValueName, DWORD& value)
+{
+    DWORD dwType = REG_DWORD;
+    DWORD dwData = 0;
+    DWORD cbData = sizeof(dwData);
+    
+    LONG lResult = RegQueryValueExW(hKey, pszValueName, nullptr, &dwType, 
+                                   reinterpret_cast<LPBYTE>(&dwData), &cbData);
+    if (lResult == ERROR_SUCCESS && dwType != REG_DWORD)
+    {
+        lResult = ERROR_INVALID_DATATYPE;
+    }
+    
+    if (lResult == ERROR_SUCCESS)
+    {
+        value = dwData;
+    }
+    
+    return HRESULT_FROM_WIN32(lResult);
+}
+
 HRESULT WriteRegistryString(HKEY hKey, PCWSTR pszValueName, PCWSTR pszValue)
 {
     DWORD cbData = static_cast<DWORD>((wcslen(pszValue) + 1) * sizeof(WCHAR));
@@ -605,25 +753,21 @@ HRESULT ParseURL(const std::wstring& url, std::wstring& protocol, std::wstring&
 // Performance timer implementation
 PerformanceTimer::PerformanceTimer()
 {
-    QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&m_frequency));
+    m_frequency = GetClock().GetFrequency();
     m_startTime = 0;
 }
 
 void PerformanceTimer::Start()
 {
-    QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&m_startTime));
+    m_startTime = GetClock().Now();
 }
 
 DWORD PerformanceTimer::GetElapsedMilliseconds()
 {
-    LONGLONG currentTime;
-    QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&currentTime));
-    return static_cast<DWORD>((currentTime - m_startTime) * 1000 / m_frequency);
+    return static_cast<DWORD>(GetClock().TicksToMicroseconds(GetClock().Now() - m_startTime) / 1000);
 }
 
 LONGLONG PerformanceTimer::GetElapsedTicks()
 {
-    LONGLONG currentTime;
-    QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&currentTime));
-    return currentTime - m_startTime;
+    return GetClock().Now() - m_startTime;
 }
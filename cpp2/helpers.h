@@ -26,13 +26,17 @@ HRESULT KerbInteractiveUnlockLogonInit(PCWSTR pwzDomain, PCWSTR pwzUsername, PCW
                                       CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, KERB_INTERACTIVE_UNLOCK_LOGON* pkiul);
 HRESULT KerbInteractiveUnlockLogonPack(const KERB_INTERACTIVE_UNLOCK_LOGON& kiul, BYTE** ppbPackage, DWORD* pcbPackage);
 
-// JSON utilities for AI communication
-HRESULT CreateJSONString(const BiometricProfile& profile, std::wstring& jsonOutput);
+// The AI model's answer. Requests are built by CreateJSONPayload and
+// CreateCBORPayload, in BiometricProfile.h.
 HRESULT ParseJSONResponse(const std::wstring& jsonResponse, AIResponse& response);
 
-// HTTP communication with AI model
-HRESULT SendHTTPRequest(const std::wstring& endpoint, const std::wstring& jsonData, 
-                       const std::wstring& apiKey, std::wstring& response);
+// HTTP communication with AI model, posting a body of the given content
+// type. The whole exchange, from name resolution to the last byte read,
+// must finish within dwBudgetMs; otherwise it fails with
+// HRESULT_FROM_WIN32(ERROR_WINHTTP_TIMEOUT). An endpoint that does not
+// accept the content type fails with HTTP_E_STATUS_UNSUPPORTED_MEDIA.
+HRESULT SendHTTPRequest(const std::wstring& endpoint, PCWSTR pszContentType, const char* pchBody, DWORD cbBody,
+                       const std::wstring& apiKey, DWORD dwBudgetMs, std::wstring& response);
 
 // Security utilities
 HRESULT SecureStringAllocate(PCWSTR pszSource, PWSTR* ppszDest);
@@ -105,14 +109,20 @@ HRESULT IsNetworkAvailable(BOOL* pbAvailable);
 HRESULT TestEndpointConnectivity(const std::wstring& endpoint, BOOL* pbConnected);
 
 // Biometric data processing
-HRESULT ValidateKeystrokeData(const std::vector<KeystrokeData>& keystrokes, BOOL* pbValid);
-HRESULT CalculateKeystrokeTiming(const std::vector<KeystrokeData>& keystrokes, 
+HRESULT ValidateKeystrokeData(const KeystrokeTimeline& timeline, BOOL* pbValid);
+// Mean key-press interval in milliseconds and its variance in ms^2
+HRESULT CalculateKeystrokeTiming(const KeystrokeTimeline& timeline, 
                                 DWORD* pdwAverageInterval, DWORD* pdwVariance);
 
+// Enrolled typing templates, stored under BIOMETRIC_TEMPLATE_KEY by user SID
+struct TypingTemplate;
+HRESULT LoadTypingTemplate(PCWSTR pszUserSid, TypingTemplate* pTemplate);
+HRESULT GetAccountSidString(PCWSTR pszDomain, PCWSTR pszUsername, PWSTR* ppszSid);
+
 // Debug utilities
 #ifdef _DEBUG
 void DebugPrint(PCWSTR pszFormat, ...);
-void DebugPrintKeystrokeData(const std::vector<KeystrokeData>& keystrokes);
+void DebugPrintKeystrokeData(const KeystrokeTimeline& timeline);
 #else
 #define DebugPrint(...)
 #define DebugPrintKeystrokeData(...)
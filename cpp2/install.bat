@@ -83,7 +83,7 @@ powershell -Command "& {
 }"
 
 echo Configuring permissions...
-icacls "%CONFIG_DIR%" /grant "NT AUTHORITY\SYSTEM:(OI)(CI)F" /grant "BUILTIN\Administrators:(OI)(CI)F" /grant "NT AUTHORITY\LOCAL SERVICE:(OI)(CI)R" >nul
+icacls "%CONFIG_DIR%" /inheritance:r /grant "NT AUTHORITY\SYSTEM:(OI)(CI)F" /grant "BUILTIN\Administrators:(OI)(CI)F" /grant "NT AUTHORITY\LOCAL SERVICE:(OI)(CI)R" >nul
 icacls "%LOG_DIR%" /grant "NT AUTHORITY\SYSTEM:(OI)(CI)F" /grant "BUILTIN\Administrators:(OI)(CI)F" /grant "NT AUTHORITY\LOCAL SERVICE:(OI)(CI)W" >nul
 
 echo Verifying installation...
@@ -0,0 +1,217 @@
+// CreateJSONPayload and CreateCBORPayload against golden documents, in
+// both JSON schemas, and their failure modes
+
+#include "BiometricProfile.h"
+#include "TestHarness.h"
+#include <string.h>
+#include <vector>
+
+// Everything before the timestamp, which is GetTickCount64 at build time
+#define GOLDEN_SCHEMA_OBJECTS \
+    "{\"keystrokes\":[" \
+    "{\"key\":\"p\",\"keyDownTime\":0,\"keyUpTime\":95,\"position\":0,\"flags\":0}," \
+    "{\"key\":\"\\\"\",\"keyDownTime\":180000,\"keyUpTime\":180090,\"position\":1,\"flags\":0}," \
+    "{\"key\":\"\xC3\xA9\",\"keyDownTime\":180300,\"keyUpTime\":180300,\"position\":2,\"flags\":2}," \
+    "{\"key\":\"\\ud83d\",\"keyDownTime\":250000,\"keyUpTime\":250120,\"position\":3,\"flags\":1}]," \
+    GOLDEN_PROFILE_MEMBERS
+
+#define GOLDEN_SCHEMA_COLUMNAR \
+    "{\"schemaVersion\":2,\"keystrokes\":{" \
+    "\"keys\":[\"p\",\"\\\"\",\"\xC3\xA9\",\"\\ud83d\"]," \
+    "\"downDeltas\":[0,180000,300,69700]," \
+    "\"dwells\":[95,90,0,120]," \
+    "\"positions\":[0,1,2,3]," \
+    "\"flags\":[0,0,2,1]}," \
+    GOLDEN_PROFILE_MEMBERS_COLUMNAR
+
+#define GOLDEN_PROFILE_MEMBERS \
+    "\"passwordLength\":4,\"totalTypingTime\":250120," \
+    "\"edits\":{\"insert\":2,\"delete\":1,\"replace\":1,\"paste\":1}," \
+    "\"features\":{\"dwellMean\":76.25,\"dwellStdDev\":0.5,\"flightMean\":-12,\"flightStdDev\":3," \
+    "\"digraphMean\":83333.5,\"digraphStdDev\":1e+06,\"pauses\":0,\"backspaceRatio\":0.25}," \
+    "\"username\":\"CORP\\\\al\\\"x\",\"timestamp\":"
+
+// Schema 2 names the timing features by the key edges they span
+#define GOLDEN_PROFILE_MEMBERS_COLUMNAR \
+    "\"passwordLength\":4,\"totalTypingTime\":250120," \
+    "\"edits\":{\"insert\":2,\"delete\":1,\"replace\":1,\"paste\":1}," \
+    "\"features\":{\"dwellMean\":76.25,\"dwellStdDev\":0.5,\"upDownMean\":-12,\"upDownStdDev\":3," \
+    "\"downDownMean\":83333.5,\"downDownStdDev\":1e+06,\"pauses\":0,\"backspaceRatio\":0.25}," \
+    "\"username\":\"CORP\\\\al\\\"x\",\"timestamp\":"
+
+// Four keystrokes covering the awkward cases: a quote, a two-byte UTF-8
+// character, a key still held (dwell 0) and half of a surrogate pair.
+// Features are set by hand so every number has a short exact form.
+static void BuildProfile(BiometricProfile* pProfile)
+{
+    pProfile->keystrokes.Clear();
+    CHECK(SUCCEEDED(pProfile->keystrokes.Append(L'p', 0, 95, 0, 0)));
+    CHECK(SUCCEEDED(pProfile->keystrokes.Append(L'"', 180000, 180090, 1, 0)));
+    CHECK(SUCCEEDED(pProfile->keystrokes.Append(0x00E9, 180300, 180300, 2, KEYSTROKE_FLAG_REPLACED)));
+    CHECK(SUCCEEDED(pProfile->keystrokes.Append(0xD83D, 250000, 250120, 3, KEYSTROKE_FLAG_PASTED)));
+
+    pProfile->username = L"CORP\\al\"x";
+    pProfile->passwordLength = 4;
+    pProfile->totalTypingTime = 250120;
+    ZeroMemory(pProfile->editCounts, sizeof(pProfile->editCounts));
+    pProfile->editCounts[KEK_INSERT] = 2;
+    pProfile->editCounts[KEK_DELETE] = 1;
+    pProfile->editCounts[KEK_REPLACE] = 1;
+    pProfile->editCounts[KEK_PASTE] = 1;
+
+    ZeroMemory(&pProfile->features, sizeof(pProfile->features));
+    pProfile->features.dwellMeanUs = 76.25;
+    pProfile->features.dwellStdDevUs = 0.5;
+    pProfile->features.upDownMeanUs = -12.0;
+    pProfile->features.upDownStdDevUs = 3.0;
+    pProfile->features.downDownMeanUs = 83333.5;
+    pProfile->features.downDownStdDevUs = 1e6;
+    pProfile->features.pauseCount = 0;
+    pProfile->features.backspaceRatio = 0.25;
+}
+
+// The payload must be the golden bytes followed by a decimal timestamp
+// and the closing brace, and every buffer one byte short or more must fail
+static void CheckGoldenPayload(const BiometricProfile& profile, DWORD dwSchema, const char* pszGolden)
+{
+    std::vector<char> buffer(JSON_PAYLOAD_CAPACITY);
+    size_t cchPayload = 0;
+    CHECK(SUCCEEDED(CreateJSONPayload(profile, dwSchema, buffer.data(), buffer.size(), &cchPayload)));
+
+    size_t cchGolden = strlen(pszGolden);
+    std::string payload(buffer.data(), cchPayload);
+    if (payload.compare(0, cchGolden, pszGolden) != 0)
+    {
+        fprintf(stderr, "expected %s\n     got %s\n", pszGolden, payload.c_str());
+        CHECK(!"payload differs from the golden bytes");
+    }
+
+    CHECK(cchPayload > cchGolden + 1 && payload[cchPayload - 1] == '}');
+    for (size_t i = cchGolden; i + 1 < cchPayload; i++)
+    {
+        CHECK(payload[i] >= '0' && payload[i] <= '9');
+    }
+
+    for (size_t cchBuffer = 0; cchBuffer < cchPayload; cchBuffer++)
+    {
+        size_t cchWritten = 1;
+        CHECK(CreateJSONPayload(profile, dwSchema, buffer.data(), cchBuffer, &cchWritten) == E_NOT_SUFFICIENT_BUFFER);
+        CHECK(cchWritten == 0);
+    }
+}
+
+static void TestSchemaObjects()
+{
+    static BiometricProfile profile;
+    BuildProfile(&profile);
+    CheckGoldenPayload(profile, PAYLOAD_SCHEMA_OBJECTS, GOLDEN_SCHEMA_OBJECTS);
+}
+
+// Key-down deltas start from the first keystroke, and dwells are release
+// minus press
+static void TestSchemaColumnar()
+{
+    static BiometricProfile profile;
+    BuildProfile(&profile);
+    CheckGoldenPayload(profile, PAYLOAD_SCHEMA_COLUMNAR, GOLDEN_SCHEMA_COLUMNAR);
+}
+
+// A release recorded before its press (a lost key up filled in late) is
+// written as a negative dwell, not wrapped to a large unsigned value
+static void TestSchemaColumnarNegativeDwell()
+{
+    static BiometricProfile profile;
+    BuildProfile(&profile);
+    profile.keystrokes.Clear();
+    CHECK(SUCCEEDED(profile.keystrokes.Append(L'a', 1000, 900, 0, 0)));
+
+    std::vector<char> buffer(JSON_PAYLOAD_CAPACITY);
+    size_t cchPayload = 0;
+    CHECK(SUCCEEDED(CreateJSONPayload(profile, PAYLOAD_SCHEMA_COLUMNAR, buffer.data(), buffer.size(), &cchPayload)));
+    std::string payload(buffer.data(), cchPayload);
+    CHECK(payload.find("\"downDeltas\":[1000],\"dwells\":[-100]") != std::string::npos);
+}
+
+// An empty attempt still writes well-formed, empty columns
+static void TestSchemaColumnarEmpty()
+{
+    static BiometricProfile profile;
+    BuildProfile(&profile);
+    profile.keystrokes.Clear();
+
+    std::vector<char> buffer(JSON_PAYLOAD_CAPACITY);
+    size_t cchPayload = 0;
+    CHECK(SUCCEEDED(CreateJSONPayload(profile, PAYLOAD_SCHEMA_COLUMNAR, buffer.data(), buffer.size(), &cchPayload)));
+    std::string payload(buffer.data(), cchPayload);
+    CHECK(payload.find("\"keystrokes\":{\"keys\":[],\"downDeltas\":[],\"dwells\":[],\"positions\":[],\"flags\":[]}") !=
+          std::string::npos);
+}
+
+// The CBOR form opens with a seven-member map and the keystrokes as
+// positional arrays, is shorter than either JSON schema, and fails
+// cleanly in a short buffer
+static void TestCborPayload()
+{
+    static BiometricProfile profile;
+    BuildProfile(&profile);
+
+    static const BYTE rgbPrefix[] =
+    {
+        0xA7,                                                           // map(7)
+        0x6A, 'k', 'e', 'y', 's', 't', 'r', 'o', 'k', 'e', 's',         // "keystrokes"
+        0x84,                                                           // array(4)
+        0x85, 0x18, 'p', 0x00, 0x18, 95, 0x00, 0x00,                    // ['p', 0, 95, 0, 0]
+        0x85, 0x18, '"', 0x1A, 0x00, 0x02, 0xBF, 0x20,                  // ['"', 180000,
+        0x1A, 0x00, 0x02, 0xBF, 0x7A, 0x01, 0x00,                       //  180090, 1, 0]
+    };
+
+    std::vector<BYTE> buffer(JSON_PAYLOAD_CAPACITY);
+    size_t cbPayload = 0;
+    CHECK(SUCCEEDED(CreateCBORPayload(profile, buffer.data(), buffer.size(), &cbPayload)));
+    CHECK(cbPayload > sizeof(rgbPrefix) && memcmp(buffer.data(), rgbPrefix, sizeof(rgbPrefix)) == 0);
+
+    std::vector<char> json(JSON_PAYLOAD_CAPACITY);
+    size_t cchObjects = 0;
+    size_t cchColumnar = 0;
+    CHECK(SUCCEEDED(CreateJSONPayload(profile, PAYLOAD_SCHEMA_OBJECTS, json.data(), json.size(), &cchObjects)));
+    CHECK(SUCCEEDED(CreateJSONPayload(profile, PAYLOAD_SCHEMA_COLUMNAR, json.data(), json.size(), &cchColumnar)));
+    CHECK(cbPayload < cchColumnar && cchColumnar < cchObjects);
+
+    for (size_t cbBuffer = 0; cbBuffer < cbPayload; cbBuffer++)
+    {
+        size_t cbWritten = 1;
+        CHECK(CreateCBORPayload(profile, buffer.data(), cbBuffer, &cbWritten) == E_NOT_SUFFICIENT_BUFFER);
+        CHECK(cbWritten == 0);
+    }
+}
+
+// The longest profile fits the capacity the credential allocates
+static void TestCapacity()
+{
+    static BiometricProfile profile;
+    BuildProfile(&profile);
+    profile.keystrokes.Clear();
+    for (DWORD i = 0; i < MAX_KEYSTROKE_COUNT; i++)
+    {
+        CHECK(SUCCEEDED(profile.keystrokes.Append(0xD83D, 0xFFFFFFF0, 0xFFFFFFFF, i,
+                                                  KEYSTROKE_FLAG_PASTED | KEYSTROKE_FLAG_REPLACED)));
+    }
+    profile.username.assign(MAX_USERNAME_LENGTH, L'"');
+
+    std::vector<char> buffer(JSON_PAYLOAD_CAPACITY);
+    size_t cchPayload = 0;
+    CHECK(SUCCEEDED(CreateJSONPayload(profile, PAYLOAD_SCHEMA_OBJECTS, buffer.data(), buffer.size(), &cchPayload)));
+    CHECK(SUCCEEDED(CreateJSONPayload(profile, PAYLOAD_SCHEMA_COLUMNAR, buffer.data(), buffer.size(), &cchPayload)));
+    CHECK(SUCCEEDED(CreateCBORPayload(profile, reinterpret_cast<BYTE*>(buffer.data()), buffer.size(), &cchPayload)));
+}
+
+int main()
+{
+    RUN_TEST(TestSchemaObjects);
+    RUN_TEST(TestSchemaColumnar);
+    RUN_TEST(TestSchemaColumnarNegativeDwell);
+    RUN_TEST(TestSchemaColumnarEmpty);
+    RUN_TEST(TestCborPayload);
+    RUN_TEST(TestCapacity);
+    return TestResult();
+}
@@ -0,0 +1,161 @@
+// Length-bucket kernels against plain loops over the real count. Lanes
+// past the count are filled with garbage, which the buckets must mask out.
+
+#include "BucketKernels.h"
+#include "KeystrokeTimeline.h"
+#include "TestHarness.h"
+#include <float.h>
+#include <limits.h>
+#include <random>
+
+#define MIN_SPREAD      1000.0f
+
+struct KernelInputs
+{
+    INT32 values[MAX_KEYSTROKE_COUNT];
+    UINT32 minuend[MAX_KEYSTROKE_COUNT];
+    UINT32 subtrahend[MAX_KEYSTROKE_COUNT];
+    float mean[MAX_KEYSTROKE_COUNT];
+    float spread[MAX_KEYSTROKE_COUNT];
+};
+
+static void FillInputs(std::mt19937* pRandom, DWORD c, KernelInputs* pInputs)
+{
+    std::uniform_int_distribution<INT32> value(-50000, 400000);
+    std::uniform_real_distribution<float> spread(0.0f, 80000.0f);
+
+    for (DWORD i = 0; i < MAX_KEYSTROKE_COUNT; i++)
+    {
+        if (i < c)
+        {
+            pInputs->values[i] = value(*pRandom);
+            pInputs->minuend[i] = static_cast<UINT32>(value(*pRandom)) + 1000000;
+            pInputs->subtrahend[i] = static_cast<UINT32>(value(*pRandom));
+            pInputs->mean[i] = static_cast<float>(value(*pRandom));
+            pInputs->spread[i] = spread(*pRandom);    // Some below MIN_SPREAD
+        }
+        else
+        {
+            pInputs->values[i] = (i & 1) ? INT_MAX : INT_MIN;
+            pInputs->minuend[i] = 0xDEADBEEF;
+            pInputs->subtrahend[i] = 0xFEEDFACE;
+            pInputs->mean[i] = (i & 1) ? FLT_MAX : -FLT_MAX;
+            pInputs->spread[i] = 0.0f;
+        }
+    }
+}
+
+template <DWORD N>
+static void CheckBucket(const KernelInputs& inputs, DWORD c)
+{
+    INT32 rgOut[MAX_KEYSTROKE_COUNT];
+    LengthBucket<N>::Subtract(inputs.minuend, inputs.subtrahend, c, rgOut);
+    LONGLONG sum = 0;
+    INT32 minimum = inputs.values[0];
+    INT32 maximum = inputs.values[0];
+    for (DWORD i = 0; i < c; i++)
+    {
+        CHECK(rgOut[i] == static_cast<INT32>(inputs.minuend[i] - inputs.subtrahend[i]));
+        sum += inputs.values[i];
+        minimum = (inputs.values[i] < minimum) ? inputs.values[i] : minimum;
+        maximum = (inputs.values[i] > maximum) ? inputs.values[i] : maximum;
+    }
+
+    CHECK(LengthBucket<N>::Sum(inputs.values, c) == sum);
+
+    INT32 bucketMin = inputs.values[0];
+    INT32 bucketMax = inputs.values[0];
+    LengthBucket<N>::MinMax(inputs.values, c, &bucketMin, &bucketMax);
+    CHECK(bucketMin == minimum);
+    CHECK(bucketMax == maximum);
+
+    double mean = static_cast<double>(sum) / c;
+    double squaredDeviation = 0.0;
+    for (DWORD i = 0; i < c; i++)
+    {
+        squaredDeviation += (inputs.values[i] - mean) * (inputs.values[i] - mean);
+    }
+    CHECK_NEAR(LengthBucket<N>::SumSquaredDeviation(inputs.values, c, mean), squaredDeviation, 1e-9 * squaredDeviation);
+}
+
+static void TestBucketSelection()
+{
+    CHECK(SelectLengthBucket(0) == 8);
+    CHECK(SelectLengthBucket(8) == 8);
+    CHECK(SelectLengthBucket(9) == 16);
+    CHECK(SelectLengthBucket(16) == 16);
+    CHECK(SelectLengthBucket(17) == 32);
+    CHECK(SelectLengthBucket(64) == 64);
+    CHECK(SelectLengthBucket(65) == 0);
+    CHECK(SelectLengthBucket(MAX_KEYSTROKE_COUNT) == 0);
+}
+
+static void TestFeatureBucketsMatchLoops()
+{
+    std::mt19937 random(15);
+    KernelInputs* pInputs = new KernelInputs();
+
+    for (DWORD c = 1; c <= 64; c++)
+    {
+        for (DWORD iRound = 0; iRound < 8; iRound++)
+        {
+            FillInputs(&random, c, pInputs);
+            switch (SelectLengthBucket(c))
+            {
+            case 8:
+                CheckBucket<8>(*pInputs, c);
+                break;
+
+            case 16:
+                CheckBucket<16>(*pInputs, c);
+                break;
+
+            case 32:
+                CheckBucket<32>(*pInputs, c);
+                break;
+
+            default:
+                CheckBucket<64>(*pInputs, c);
+                break;
+            }
+        }
+    }
+
+    delete pInputs;
+}
+
+// The dispatching scorers against the generic loops for every password
+// length; past 64 both take the generic path
+static void TestScoringBucketsMatchGeneric()
+{
+    std::mt19937 random(16);
+    KernelInputs* pInputs = new KernelInputs();
+
+    for (DWORD c = 0; c <= MAX_KEYSTROKE_COUNT; c++)
+    {
+        for (DWORD iRound = 0; iRound < 4; iRound++)
+        {
+            FillInputs(&random, c, pInputs);
+
+            double expected = ScaledAbsoluteDeviationGeneric(pInputs->values, pInputs->mean, pInputs->spread, MIN_SPREAD, c);
+            double actual = ScaledAbsoluteDeviation(pInputs->values, pInputs->mean, pInputs->spread, MIN_SPREAD, c);
+            CHECK(isfinite(actual));
+            CHECK_NEAR(actual, expected, 1e-9 * (1.0 + expected));
+
+            expected = SquaredZGeneric(pInputs->values, pInputs->mean, pInputs->spread, MIN_SPREAD, c);
+            actual = SquaredZ(pInputs->values, pInputs->mean, pInputs->spread, MIN_SPREAD, c);
+            CHECK(isfinite(actual));
+            CHECK_NEAR(actual, expected, 1e-9 * (1.0 + expected));
+        }
+    }
+
+    delete pInputs;
+}
+
+int main()
+{
+    RUN_TEST(TestBucketSelection);
+    RUN_TEST(TestFeatureBucketsMatchLoops);
+    RUN_TEST(TestScoringBucketsMatchGeneric);
+    return TestResult();
+}
@@ -0,0 +1,411 @@
+// CaptureBenchmark: cost of the keystroke capture path, replayed off the
+// logon screen.
+//
+//     CaptureBenchmark [options]
+//
+//     -trace <file>   Replay a recorded key event trace instead of the
+//                     synthetic one (same format as KeyEventReplayFile)
+//     -speed <n>      Replay pace in percent of the recorded timing;
+//                     0 replays as fast as possible on virtual time
+//                     (default)
+//     -attempts <n>   Synthetic attempts to type (default 2000)
+//     -length <n>     Characters per synthetic attempt (default 12)
+//     -quick          Short run, used by ctest to keep the target building
+//
+// Every key event goes through the same steps the credential takes: the
+// event is queued as the key event source would queue it, and each key down
+// that produces a character is followed by the SetStringValue work under
+// the credential lock. That work is KeystrokeRecorder::Record, the code
+// CSampleCredential runs - edit diff, draining and pairing key events, and
+// recording the keystroke. Backspace removes the last character. The
+// report gives the mean cost per keystroke, heap allocations per keystroke
+// and the 99th percentile time the lock is held. Unpaced replays run the
+// process clock on virtual time, advanced to each event's recorded offset,
+// so pairing sees exactly the trace's timing; costs are always measured
+// with the performance counter.
+
+#include "KeystrokeRecorder.h"
+#include "Clock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <vector>
+
+#define VK_BACKSPACE            0x08
+
+static std::atomic<ULONGLONG> s_cAllocations(0);
+
+void* operator new(size_t cb)
+{
+    s_cAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* pv = malloc(cb ? cb : 1);
+    if (!pv)
+    {
+        throw std::bad_alloc();
+    }
+    return pv;
+}
+
+void* operator new[](size_t cb)
+{
+    return operator new(cb);
+}
+
+void operator delete(void* pv) noexcept
+{
+    free(pv);
+}
+
+void operator delete[](void* pv) noexcept
+{
+    free(pv);
+}
+
+void operator delete(void* pv, size_t) noexcept
+{
+    free(pv);
+}
+
+void operator delete[](void* pv, size_t) noexcept
+{
+    free(pv);
+}
+
+struct TraceEvent
+{
+    ULONGLONG offsetUs;
+    WORD virtualKey;
+    WORD flags;
+};
+
+struct BenchmarkOptions
+{
+    const char* pszTracePath;
+    DWORD dwSpeedPercent;
+    DWORD cAttempts;
+    DWORD cchPassword;
+};
+
+// State SetStringValue works on, as in CSampleCredential
+struct CaptureState
+{
+    CRITICAL_SECTION cs;
+    KeystrokeBuffer keystrokes;
+    KeystrokeRecorder recorder;
+};
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: CaptureBenchmark [-trace file] [-speed n] [-attempts n] [-length n] [-quick]\n");
+}
+
+static BOOL ParseOptions(int argc, char** argv, BenchmarkOptions* pOptions)
+{
+    pOptions->pszTracePath = nullptr;
+    pOptions->dwSpeedPercent = 0;
+    pOptions->cAttempts = 2000;
+    pOptions->cchPassword = 12;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-quick") == 0)
+        {
+            pOptions->cAttempts = 50;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            return FALSE;
+        }
+
+        const char* pszValue = argv[++i];
+        if (strcmp(argv[i - 1], "-trace") == 0)
+        {
+            pOptions->pszTracePath = pszValue;
+        }
+        else if (strcmp(argv[i - 1], "-speed") == 0)
+        {
+            pOptions->dwSpeedPercent = static_cast<DWORD>(strtoul(pszValue, nullptr, 10));
+        }
+        else if (strcmp(argv[i - 1], "-attempts") == 0)
+        {
+            pOptions->cAttempts = static_cast<DWORD>(strtoul(pszValue, nullptr, 10));
+        }
+        else if (strcmp(argv[i - 1], "-length") == 0)
+        {
+            pOptions->cchPassword = static_cast<DWORD>(strtoul(pszValue, nullptr, 10));
+        }
+        else
+        {
+            return FALSE;
+        }
+    }
+
+    return pOptions->cAttempts > 0 &&
+           pOptions->cchPassword > 0 && pOptions->cchPassword <= KEYSTROKE_CAPTURE_MAX_LENGTH;
+}
+
+// "D <vk> <us>" / "U <vk> <us>" lines, as ReplayKeyEventSource reads them
+static BOOL LoadTrace(const char* pszPath, std::vector<TraceEvent>* pEvents)
+{
+    FILE* pFile = fopen(pszPath, "r");
+    if (!pFile)
+    {
+        return FALSE;
+    }
+
+    char szLine[128];
+    while (fgets(szLine, sizeof(szLine), pFile))
+    {
+        if (szLine[0] == 'D' || szLine[0] == 'U')
+        {
+            char* pszEnd = nullptr;
+            TraceEvent event;
+            event.virtualKey = static_cast<WORD>(strtoul(szLine + 1, &pszEnd, 0));
+            event.offsetUs = strtoull(pszEnd, nullptr, 10);
+            event.flags = (szLine[0] == 'U') ? KEY_EVENT_FLAG_UP : 0;
+            pEvents->push_back(event);
+        }
+    }
+
+    fclose(pFile);
+    return !pEvents->empty();
+}
+
+// Typing with overlapping keys: 70-130 ms holds, 90-250 ms between presses,
+// a mistyped character fixed with backspace now and then, and a pause
+// between attempts that exceeds the stale key window
+static void GenerateTrace(DWORD cAttempts, DWORD cchPassword, std::vector<TraceEvent>* pEvents)
+{
+    ULONG ulSeed = 0x2545F491;
+    auto next = [&ulSeed](ULONG ulRange) -> ULONG
+    {
+        ulSeed = ulSeed * 1664525 + 1013904223;
+        return (ulSeed >> 8) % ulRange;
+    };
+
+    std::vector<TraceEvent> attempt;
+    ULONGLONG offsetUs = 0;
+    for (DWORD iAttempt = 0; iAttempt < cAttempts; iAttempt++)
+    {
+        attempt.clear();
+        for (DWORD i = 0; i < cchPassword; i++)
+        {
+            BOOL fTypo = next(20) == 0;
+            for (DWORD iPress = 0; iPress < (fTypo ? 3u : 1u); iPress++)
+            {
+                WORD vk = (iPress == 1) ? static_cast<WORD>(VK_BACKSPACE) : static_cast<WORD>('A' + (i * 7) % 26);
+                ULONGLONG downUs = offsetUs;
+                ULONGLONG upUs = downUs + 70000 + next(60000);
+
+                TraceEvent down = { downUs, vk, 0 };
+                TraceEvent up = { upUs, vk, KEY_EVENT_FLAG_UP };
+                attempt.push_back(down);
+                attempt.push_back(up);
+
+                offsetUs += 90000 + next(160000);
+            }
+        }
+
+        std::stable_sort(attempt.begin(), attempt.end(),
+            [](const TraceEvent& a, const TraceEvent& b) { return a.offsetUs < b.offsetUs; });
+        pEvents->insert(pEvents->end(), attempt.begin(), attempt.end());
+
+        offsetUs += 2000000;
+    }
+}
+
+static void ResetCapture(CaptureState* pState)
+{
+    pState->keystrokes.Clear();
+    pState->recorder.Reset(L"");
+    pState->recorder.ResetKeyEvents();
+}
+
+static LONGLONG ReadTimer()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+// Hold off until the trace says the event happens; spin for the last
+// millisecond so the pace stays accurate
+static void WaitUntil(LONGLONG due)
+{
+    Clock& clock = GetClock();
+    for (;;)
+    {
+        LONGLONG now = clock.Now();
+        if (now >= due)
+        {
+            break;
+        }
+
+        if (clock.TicksToMicroseconds(due - now) > 2000)
+        {
+            Sleep(1);
+        }
+        else
+        {
+            YieldProcessor();
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, &options))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    std::vector<TraceEvent> events;
+    if (options.pszTracePath)
+    {
+        if (!LoadTrace(options.pszTracePath, &events))
+        {
+            fprintf(stderr, "Cannot read trace %s\n", options.pszTracePath);
+            return 1;
+        }
+    }
+    else
+    {
+        GenerateTrace(options.cAttempts, options.cchPassword, &events);
+    }
+
+    HRESULT hr = (options.dwSpeedPercent > 0) ? InitializeClock(CLOCK_SOURCE_AUTO) : InitializeVirtualClock();
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Cannot initialize the clock (0x%08x)\n", static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    Clock& clock = GetClock();
+    LARGE_INTEGER timerFrequency;
+    QueryPerformanceFrequency(&timerFrequency);
+
+    CaptureState* pState = new CaptureState();
+    InitializeCriticalSection(&pState->cs);
+    pState->recorder.Initialize(&pState->keystrokes, clock.MicrosecondsToTicks(KEY_EVENT_STALE_MS * 1000ULL));
+    ResetCapture(pState);
+
+    std::vector<LONGLONG> holdTicks;
+    holdTicks.reserve(events.size());
+
+    WCHAR szValue[KEYSTROKE_CAPTURE_MAX_LENGTH + 1] = {};
+    DWORD cchValue = 0;
+    ULONGLONG cKeystrokes = 0;
+    LONGLONG llCaptureTicks = 0;
+    ULONGLONG cAllocations = 0;
+    ULONGLONG lastOffsetUs = 0;
+
+    LONGLONG start = clock.Now();
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const TraceEvent& event = events[i];
+
+        // A long gap starts the next attempt, as a fresh credential would
+        if (event.offsetUs - lastOffsetUs > 1500000 && cchValue > 0)
+        {
+            cchValue = 0;
+            szValue[0] = L'\0';
+            ResetCapture(pState);
+        }
+        lastOffsetUs = event.offsetUs;
+
+        if (options.dwSpeedPercent > 0)
+        {
+            WaitUntil(start + clock.MicrosecondsToTicks(event.offsetUs * 100 / options.dwSpeedPercent));
+        }
+        else
+        {
+            clock.AdvanceVirtual(event.offsetUs - static_cast<ULONGLONG>(clock.Now() - start));
+        }
+
+        LONGLONG now = clock.Now();
+        KeyEvent keyEvent = { now, event.virtualKey, event.flags };
+        pState->recorder.GetKeyEventSink()->OnKeyEvent(keyEvent);
+
+        // Only key downs change the field
+        if (event.flags & KEY_EVENT_FLAG_UP)
+        {
+            continue;
+        }
+
+        if (event.virtualKey == VK_BACKSPACE)
+        {
+            if (cchValue == 0)
+            {
+                continue;
+            }
+            szValue[--cchValue] = L'\0';
+        }
+        else if (cchValue < KEYSTROKE_CAPTURE_MAX_LENGTH)
+        {
+            szValue[cchValue++] = static_cast<WCHAR>(event.virtualKey | 0x20);
+            szValue[cchValue] = L'\0';
+        }
+        else
+        {
+            continue;
+        }
+
+        ULONGLONG cAllocationsBefore = s_cAllocations.load(std::memory_order_relaxed);
+        LONGLONG enter = ReadTimer();
+        EnterCriticalSection(&pState->cs);
+        LONGLONG acquired = ReadTimer();
+
+        KeystrokeEdit edit;
+        hr = pState->recorder.Record(szValue, cchValue, clock.Now(), &edit);
+
+        LONGLONG released = ReadTimer();
+        LeaveCriticalSection(&pState->cs);
+        cAllocations += s_cAllocations.load(std::memory_order_relaxed) - cAllocationsBefore;
+
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "Capture failed at event %zu (0x%08x)\n", i, static_cast<unsigned int>(hr));
+            return 1;
+        }
+
+        holdTicks.push_back(released - acquired);
+        llCaptureTicks += released - enter;
+        cKeystrokes++;
+    }
+
+    if (cKeystrokes == 0)
+    {
+        fprintf(stderr, "The trace produced no keystrokes\n");
+        return 1;
+    }
+
+    std::sort(holdTicks.begin(), holdTicks.end());
+    LONGLONG p99Ticks = holdTicks[(holdTicks.size() - 1) * 99 / 100];
+
+    if (options.dwSpeedPercent > 0)
+    {
+        printf("%zu events, %llu keystrokes at %lu%% speed\n", events.size(), cKeystrokes,
+               static_cast<unsigned long>(options.dwSpeedPercent));
+    }
+    else
+    {
+        printf("%zu events, %llu keystrokes unpaced on virtual time\n", events.size(), cKeystrokes);
+    }
+    double nsPerTick = 1e9 / static_cast<double>(timerFrequency.QuadPart);
+    printf("capture       %.1f ns/keystroke\n", static_cast<double>(llCaptureTicks) * nsPerTick / static_cast<double>(cKeystrokes));
+    printf("allocations   %.3f /keystroke\n", static_cast<double>(cAllocations) / static_cast<double>(cKeystrokes));
+    printf("lock hold p99 %.1f ns\n", static_cast<double>(p99Ticks) * nsPerTick);
+    printf("dropped       %ld key events\n", static_cast<long>(pState->recorder.GetDroppedKeyEventCount()));
+
+    DeleteCriticalSection(&pState->cs);
+    delete pState;
+
+    return (cAllocations == 0) ? 0 : 1;
+}
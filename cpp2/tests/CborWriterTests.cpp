@@ -0,0 +1,234 @@
+// CborWriter output against golden bytes, and its failure modes
+
+#include "CborWriter.h"
+#include "TestHarness.h"
+#include <math.h>
+#include <string.h>
+
+#define TEST_BUFFER_SIZE    256
+#define CANARY              0x5A
+
+// Run a writer over a buffer of cbBuffer bytes followed by canaries, and
+// check nothing was written past the end
+template <typename TWrite>
+static HRESULT Write(TWrite write, size_t cbBuffer, BYTE* pbOut, size_t* pcbWritten)
+{
+    BYTE rgb[TEST_BUFFER_SIZE + 16];
+    memset(rgb, CANARY, sizeof(rgb));
+
+    CborWriter cbor(rgb, cbBuffer);
+    write(cbor);
+    HRESULT hr = cbor.Finish(pcbWritten);
+
+    for (size_t i = cbBuffer; i < sizeof(rgb); i++)
+    {
+        CHECK(rgb[i] == CANARY);
+    }
+    memcpy(pbOut, rgb, *pcbWritten);
+    return hr;
+}
+
+// The document must come out as exactly the golden bytes, and every buffer
+// one byte short or more must fail cleanly
+template <typename TWrite, size_t N>
+static void CheckGolden(TWrite write, const BYTE (&rgbGolden)[N])
+{
+    BYTE rgbOut[TEST_BUFFER_SIZE];
+    size_t cbWritten = 0;
+
+    CHECK(SUCCEEDED(Write(write, TEST_BUFFER_SIZE, rgbOut, &cbWritten)));
+    CHECK(cbWritten == N);
+    if (cbWritten != N || memcmp(rgbOut, rgbGolden, N) != 0)
+    {
+        fprintf(stderr, "expected");
+        for (size_t i = 0; i < N; i++)
+        {
+            fprintf(stderr, " %02x", rgbGolden[i]);
+        }
+        fprintf(stderr, "\n     got");
+        for (size_t i = 0; i < cbWritten; i++)
+        {
+            fprintf(stderr, " %02x", rgbOut[i]);
+        }
+        fprintf(stderr, "\n");
+        CHECK(!"output differs from the golden bytes");
+    }
+
+    CHECK(SUCCEEDED(Write(write, N, rgbOut, &cbWritten)));
+    for (size_t cbBuffer = 0; cbBuffer < N; cbBuffer++)
+    {
+        CHECK(Write(write, cbBuffer, rgbOut, &cbWritten) == E_NOT_SUFFICIENT_BUFFER);
+        CHECK(cbWritten == 0);
+    }
+}
+
+// The keystroke layout CreateCBORPayload writes. Keys are UTF-16 code
+// units, so the lone high surrogate of a character typed as two
+// keystrokes arrives intact; the username is text, where it cannot.
+static void TestKeystrokeDocument()
+{
+    static const BYTE s_rgbGolden[] =
+    {
+        0xA2,                                                               // map(2)
+        0x6A, 'k', 'e', 'y', 's', 't', 'r', 'o', 'k', 'e', 's',             // "keystrokes"
+        0x82,                                                               // array(2)
+        0x85, 0x18, 0x70, 0x00, 0x1A, 0x00, 0x01, 0x73, 0x18, 0x00, 0x00,   // [0x70, 0, 95000, 0, 0]
+        0x85, 0x19, 0xD8, 0x3D, 0x1A, 0x00, 0x02, 0xDA, 0x78,               // [0xD83D, 187000,
+        0x1A, 0x00, 0x04, 0x01, 0x64, 0x01, 0x01,                           //  262500, 1, 1]
+        0x68, 'u', 's', 'e', 'r', 'n', 'a', 'm', 'e',                       // "username"
+        0x64, 'b', 0xEF, 0xBF, 0xBD,                                        // "b" U+FFFD
+    };
+
+    CheckGolden([](CborWriter& cbor)
+    {
+        WCHAR rgKeys[] = { L'p', 0xD83D };
+        UINT32 rgDown[] = { 0, 187000 };
+        UINT32 rgUp[] = { 95000, 262500 };
+        WCHAR rgchUsername[] = { L'b', 0xD83D };
+
+        cbor.BeginMap(2);
+        cbor.Name("keystrokes");
+        cbor.BeginArray(ARRAYSIZE(rgKeys));
+        for (DWORD i = 0; i < ARRAYSIZE(rgKeys); i++)
+        {
+            cbor.BeginArray(5);
+            cbor.UInt(rgKeys[i]);
+            cbor.UInt(rgDown[i]);
+            cbor.UInt(rgUp[i]);
+            cbor.UInt(i);
+            cbor.UInt(i);
+        }
+        cbor.Name("username");
+        cbor.String(rgchUsername, ARRAYSIZE(rgchUsername));
+    }, s_rgbGolden);
+}
+
+// Every head length at its boundaries
+static void TestIntegers()
+{
+    static const BYTE s_rgbGolden[] =
+    {
+        0x90,                                                   // array(16)
+        0x00, 0x17, 0x18, 0x18, 0x18, 0xFF, 0x19, 0x01, 0x00,   // 0, 23, 24, 255, 256
+        0x19, 0xFF, 0xFF, 0x1A, 0x00, 0x01, 0x00, 0x00,         // 65535, 65536
+        0x1B, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,   // 2^32
+        0x1B, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,   // 2^64 - 1
+        0x20, 0x37, 0x38, 0x18, 0x38, 0xFF, 0x39, 0x01, 0x00,   // -1, -24, -25, -256, -257
+        0x3B, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,   // INT64_MIN
+        0x05,                                                   // Int(5)
+    };
+
+    CheckGolden([](CborWriter& cbor)
+    {
+        cbor.BeginArray(16);
+        cbor.UInt(0);
+        cbor.UInt(23);
+        cbor.UInt(24);
+        cbor.UInt(255);
+        cbor.UInt(256);
+        cbor.UInt(65535);
+        cbor.UInt(65536);
+        cbor.UInt(0x100000000ULL);
+        cbor.UInt(0xFFFFFFFFFFFFFFFFULL);
+        cbor.Int(-1);
+        cbor.Int(-24);
+        cbor.Int(-25);
+        cbor.Int(-256);
+        cbor.Int(-257);
+        cbor.Int(-9223372036854775807LL - 1);
+        cbor.Int(5);
+    }, s_rgbGolden);
+}
+
+// Single precision when exact, double otherwise
+static void TestNumbers()
+{
+    static const BYTE s_rgbGolden[] =
+    {
+        0x86,                                                   // array(6)
+        0xFA, 0x3F, 0xC0, 0x00, 0x00,                           // 1.5
+        0xFA, 0x47, 0xB9, 0x8C, 0x40,                           // 95000.5
+        0xFB, 0x3F, 0xB9, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9A,   // 0.1
+        0xFA, 0x80, 0x00, 0x00, 0x00,                           // -0.0
+        0xFA, 0x7F, 0x80, 0x00, 0x00,                           // Infinity
+        0xFA, 0x7F, 0xC0, 0x00, 0x00,                           // NaN
+    };
+
+    CheckGolden([](CborWriter& cbor)
+    {
+        cbor.BeginArray(6);
+        cbor.Number(1.5);
+        cbor.Number(95000.5);
+        cbor.Number(0.1);
+        cbor.Number(-0.0);
+        cbor.Number(INFINITY);
+        cbor.Number(NAN);
+    }, s_rgbGolden);
+}
+
+static void TestStrings()
+{
+    static const BYTE s_rgbGolden[] =
+    {
+        0x84,                                       // array(4)
+        0x60,                                       // ""
+        0x63, 'a', '"', '\\',                       // text is not escaped
+        0x69, 0xC3, 0xA9, 0xE2, 0x82, 0xAC,         // U+00E9 U+20AC
+        0xF0, 0x9F, 0x98, 0x80,                     // U+1F600 from a pair
+        0x67, 0xEF, 0xBF, 0xBD, 'x',                // unpaired surrogates
+        0xEF, 0xBF, 0xBD,
+    };
+
+    CheckGolden([](CborWriter& cbor)
+    {
+        WCHAR rgchUnicode[] = { 0x00E9, 0x20AC, 0xD83D, 0xDE00 };
+        WCHAR rgchLone[] = { 0xDE00, L'x', 0xD83D };
+
+        cbor.BeginArray(4);
+        cbor.String(L"", 0);
+        cbor.String(L"a\"\\", 3);
+        cbor.String(rgchUnicode, ARRAYSIZE(rgchUnicode));
+        cbor.String(rgchLone, ARRAYSIZE(rgchLone));
+    }, s_rgbGolden);
+}
+
+static void TestLengthErrors()
+{
+    BYTE rgbOut[TEST_BUFFER_SIZE];
+    size_t cbWritten = 0;
+
+    // A member short
+    CHECK(Write([](CborWriter& cbor)
+    {
+        cbor.BeginMap(2);
+        cbor.Name("a");
+        cbor.UInt(1);
+        cbor.Name("b");
+    }, TEST_BUFFER_SIZE, rgbOut, &cbWritten) == E_UNEXPECTED);
+
+    // An element too many
+    CHECK(Write([](CborWriter& cbor)
+    {
+        cbor.BeginArray(1);
+        cbor.UInt(1);
+        cbor.UInt(2);
+    }, TEST_BUFFER_SIZE, rgbOut, &cbWritten) == E_UNEXPECTED);
+
+    // A second top-level item
+    CHECK(Write([](CborWriter& cbor)
+    {
+        cbor.UInt(1);
+        cbor.UInt(2);
+    }, TEST_BUFFER_SIZE, rgbOut, &cbWritten) == E_UNEXPECTED);
+    CHECK(cbWritten == 0);
+}
+
+int main()
+{
+    RUN_TEST(TestKeystrokeDocument);
+    RUN_TEST(TestIntegers);
+    RUN_TEST(TestNumbers);
+    RUN_TEST(TestStrings);
+    RUN_TEST(TestLengthErrors);
+    return TestResult();
+}
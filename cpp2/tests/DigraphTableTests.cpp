@@ -0,0 +1,89 @@
+// Keyed pair hashes against the SipHash-2-4 reference vectors, and tables
+// built from them
+
+#include "DigraphTable.h"
+#include "TestHarness.h"
+#include <string.h>
+
+// From the SipHash paper's reference implementation: key 00 01 .. 0f and
+// messages 00 01 .. (n - 1)
+static void TestSipHashVectors()
+{
+    ULONGLONG k0 = 0x0706050403020100ull;
+    ULONGLONG k1 = 0x0F0E0D0C0B0A0908ull;
+    BYTE rgb[64];
+    for (DWORD i = 0; i < ARRAYSIZE(rgb); i++)
+    {
+        rgb[i] = static_cast<BYTE>(i);
+    }
+
+    CHECK(DigraphSipHash(k0, k1, rgb, 0) == 0x726FDB47DD0E0E31ull);
+    CHECK(DigraphSipHash(k0, k1, rgb, 4) == 0xCF2794E0277187B7ull);
+    CHECK(DigraphSipHash(k0, k1, rgb, 8) == 0x93F5F5799A932462ull);
+    CHECK(DigraphSipHash(k0, k1, rgb, 15) == 0xA129CA6149BE45E5ull);
+    CHECK(DigraphSipHash(k0, k1, rgb, 63) == 0x958A324CEB064572ull);
+}
+
+// The same pair hashes differently under another user's key
+static void TestKeysDependOnKey()
+{
+    DigraphHashKey first = { 0x0123456789ABCDEFull, 0xFEDCBA9876543210ull, 1 };
+    DigraphHashKey second = first;
+    second.k1 ^= 1;
+
+    DWORD cSame = 0;
+    for (WCHAR ch = L'a'; ch <= L'z'; ch++)
+    {
+        CHECK(DigraphKey(ch, L'x', first) == DigraphKey(ch, L'x', first));
+        cSame += (DigraphKey(ch, L'x', first) == DigraphKey(ch, L'x', second)) ? 1 : 0;
+    }
+    CHECK(cSame == 0);
+    CHECK(DigraphKey(L'a', L'b', first) != DigraphKey(L'b', L'a', first));
+}
+
+static void TestBuildAndFind()
+{
+    DigraphHashKey key = { 0x1111111111111111ull, 0x2222222222222222ull, 0x5EED };
+    KeystrokeTimeline timeline;
+    ZeroMemory(&timeline, sizeof(timeline));
+
+    // A repeated pair, so the table holds fewer pairs than the timeline
+    PCWSTR pszTyped = L"correct horse battery staple correct";
+    timeline.count = static_cast<DWORD>(wcslen(pszTyped));
+    INT32 rgLatencyUs[MAX_KEYSTROKE_COUNT];
+    for (DWORD i = 0; i < timeline.count; i++)
+    {
+        timeline.keyId[i] = pszTyped[i];
+        rgLatencyUs[i] = 100000 + 1000 * static_cast<INT32>(i);
+    }
+
+    UINT32 rgKeys[MAX_KEYSTROKE_COUNT];
+    ComputeDigraphKeys(timeline, key, rgKeys);
+
+    DigraphTable* pTable = new DigraphTable();
+    CHECK(SUCCEEDED(BuildDigraphTable(pTable, key.id, rgKeys, rgLatencyUs, timeline.count - 1)));
+    CHECK(pTable->keyId == key.id);
+    CHECK(pTable->pairCount > 0 && pTable->pairCount < timeline.count - 1);
+    CHECK(IsValidDigraphTable(*pTable));
+
+    for (DWORD i = 0; i + 1 < timeline.count; i++)
+    {
+        INT32 slot = FindDigraph(*pTable, rgKeys[i]);
+        CHECK(slot >= 0 && pTable->key[slot] == rgKeys[i]);
+    }
+    CHECK(FindDigraph(*pTable, DigraphKey(L'q', L'z', key)) == -1);
+
+    double distance = -1.0;
+    CHECK(ComputeDigraphDistance(*pTable, rgKeys, rgLatencyUs, timeline.count - 1, &distance) == S_OK);
+    CHECK(distance >= 0.0);
+
+    delete pTable;
+}
+
+int main()
+{
+    RUN_TEST(TestSipHashVectors);
+    RUN_TEST(TestKeysDependOnKey);
+    RUN_TEST(TestBuildAndFind);
+    return TestResult();
+}
@@ -0,0 +1,147 @@
+// Timing feature kernels: the SSE4.1 and AVX2 kernels against the scalar
+// ones, over random timelines of every length
+
+#include "FeatureKernels.h"
+#include "BucketKernels.h"
+#include "TestHarness.h"
+#include <string.h>
+#include <random>
+
+// Typing-like timelines: key downs 20-400 ms apart, keys held 30-200 ms,
+// so held keys overlap the next press (rollover) and UP_DOWN goes negative
+static void FillTimeline(std::mt19937* pRandom, DWORD cKeys, KeystrokeTimeline* pTimeline)
+{
+    std::uniform_int_distribution<UINT32> gap(20000, 400000);
+    std::uniform_int_distribution<UINT32> dwell(30000, 200000);
+
+    ZeroMemory(pTimeline, sizeof(*pTimeline));
+    UINT32 keyDownUs = 0;
+    for (DWORD i = 0; i < cKeys; i++)
+    {
+        pTimeline->keyDownUs[i] = keyDownUs;
+        pTimeline->keyUpUs[i] = keyDownUs + dwell(*pRandom);
+        pTimeline->keyId[i] = static_cast<WCHAR>(L'a' + i % 26);
+        pTimeline->position[i] = static_cast<BYTE>(i);
+        keyDownUs += gap(*pRandom);
+    }
+    pTimeline->count = cKeys;
+}
+
+// Vector kernels differ from scalar only in the order squared deviations
+// are summed; everything else is exact
+static void CheckSameFeatures(const TimingFeatureSet& expected, const TimingFeatureSet& actual, DWORD cKeys)
+{
+    for (DWORD f = 0; f < TF_NUM_FEATURES; f++)
+    {
+        const TimingFeatureStats& e = expected.stats[f];
+        const TimingFeatureStats& a = actual.stats[f];
+        DWORD cValues = (f == TF_DWELL) ? cKeys : ((cKeys > 0) ? cKeys - 1 : 0);
+
+        CHECK(a.count == cValues);
+        CHECK(memcmp(expected.values[f], actual.values[f], cValues * sizeof(INT32)) == 0);
+        CHECK(a.count == e.count);
+        CHECK(a.mean == e.mean);
+        CHECK_NEAR(a.stdDev, e.stdDev, 1e-9 * (1.0 + e.stdDev));
+        CHECK(a.min == e.min);
+        CHECK(a.max == e.max);
+        CHECK(a.p50 == e.p50);
+        CHECK(a.p90 == e.p90);
+
+        // The scoring buckets read up to the bucket size
+        for (DWORD i = cValues; i < SelectLengthBucket(cValues); i++)
+        {
+            CHECK(actual.values[f][i] == 0);
+        }
+    }
+}
+
+static void TestVectorKernelsMatchScalar()
+{
+    FEATURE_KERNEL_ISA isaMax = GetFeatureKernelIsa();
+    printf("CPU supports %s\n", (isaMax == FKI_AVX2) ? "AVX2" : (isaMax == FKI_SSE41) ? "SSE4.1" : "scalar only");
+
+    std::mt19937 random(11);
+    KeystrokeTimeline* pTimeline = new KeystrokeTimeline();
+    TimingFeatureSet* pScalar = new TimingFeatureSet();
+    TimingFeatureSet* pVector = new TimingFeatureSet();
+
+    FEATURE_KERNEL_ISA rgIsas[] = { FKI_SSE41, FKI_AVX2 };
+    for (DWORD cKeys = 0; cKeys <= MAX_KEYSTROKE_COUNT; cKeys++)
+    {
+        for (DWORD iRound = 0; iRound < 4; iRound++)
+        {
+            FillTimeline(&random, cKeys, pTimeline);
+            CHECK(SUCCEEDED(ExtractTimingFeaturesWith(FKI_SCALAR, *pTimeline, pScalar)));
+
+            // Output left over from a longer attempt must not show past the count
+            for (DWORD i = 0; i < ARRAYSIZE(rgIsas); i++)
+            {
+                memset(pVector, 0xA5, sizeof(*pVector));
+                CHECK(SUCCEEDED(ExtractTimingFeaturesWith(rgIsas[i], *pTimeline, pVector)));
+                CheckSameFeatures(*pScalar, *pVector, cKeys);
+            }
+
+            // The dispatched path, which takes the length buckets for short
+            // passwords
+            memset(pVector, 0xA5, sizeof(*pVector));
+            CHECK(SUCCEEDED(ExtractTimingFeatures(*pTimeline, pVector)));
+            CheckSameFeatures(*pScalar, *pVector, cKeys);
+        }
+    }
+
+    delete pVector;
+    delete pScalar;
+    delete pTimeline;
+}
+
+// Known values, so scalar is checked against something other than itself
+static void TestKnownTimeline()
+{
+    KeystrokeTimeline* pTimeline = new KeystrokeTimeline();
+    TimingFeatureSet* pFeatures = new TimingFeatureSet();
+    ZeroMemory(pTimeline, sizeof(*pTimeline));
+
+    UINT32 rgDown[] = { 0, 100, 250, 300 };
+    UINT32 rgUp[] = { 80, 260, 290, 400 };
+    for (DWORD i = 0; i < ARRAYSIZE(rgDown); i++)
+    {
+        pTimeline->keyDownUs[i] = rgDown[i];
+        pTimeline->keyUpUs[i] = rgUp[i];
+    }
+    pTimeline->count = ARRAYSIZE(rgDown);
+
+    FEATURE_KERNEL_ISA rgIsas[] = { FKI_SCALAR, FKI_SSE41, FKI_AVX2 };
+    for (DWORD i = 0; i < ARRAYSIZE(rgIsas); i++)
+    {
+        CHECK(SUCCEEDED(ExtractTimingFeaturesWith(rgIsas[i], *pTimeline, pFeatures)));
+
+        // Dwell 80, 160, 40, 100
+        CHECK(pFeatures->stats[TF_DWELL].count == 4);
+        CHECK(pFeatures->stats[TF_DWELL].mean == 95.0);
+        CHECK_NEAR(pFeatures->stats[TF_DWELL].stdDev, 50.0, 1e-9);
+        CHECK(pFeatures->stats[TF_DWELL].min == 40);
+        CHECK(pFeatures->stats[TF_DWELL].max == 160);
+        CHECK(pFeatures->stats[TF_DWELL].p50 == 80);
+        CHECK(pFeatures->stats[TF_DWELL].p90 == 100);
+
+        // Up-down 20, -10, 10: the second key was still held
+        CHECK(pFeatures->values[TF_UP_DOWN][1] == -10);
+        CHECK(pFeatures->stats[TF_UP_DOWN].min == -10);
+        CHECK(pFeatures->stats[TF_DOWN_DOWN].mean == 100.0);
+        CHECK(pFeatures->values[TF_DOWN_UP][2] == 150);
+    }
+
+    pTimeline->count = MAX_KEYSTROKE_COUNT + 1;
+    CHECK(ExtractTimingFeatures(*pTimeline, pFeatures) == E_INVALIDARG);
+    CHECK(ExtractTimingFeaturesWith(FKI_AVX2, *pTimeline, nullptr) == E_INVALIDARG);
+
+    delete pFeatures;
+    delete pTimeline;
+}
+
+int main()
+{
+    RUN_TEST(TestKnownTimeline);
+    RUN_TEST(TestVectorKernelsMatchScalar);
+    return TestResult();
+}
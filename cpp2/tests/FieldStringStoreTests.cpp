@@ -0,0 +1,215 @@
+// FieldStringStore: reads during concurrent writes, buffer reclamation,
+// and read/write throughput
+
+#include "FieldStringStore.h"
+#include "TestHarness.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define TEST_FIELD_MAX_LENGTH   64
+#define READER_THREADS          4
+
+// Value number k of the writer: a run of one repeated character whose
+// length and character both derive from k, so a torn or wiped string is
+// never a valid value
+static DWORD WriteValue(PWSTR psz, ULONGLONG k)
+{
+    DWORD cch = 1 + static_cast<DWORD>(k % 40);
+    for (DWORD i = 0; i < cch; i++)
+    {
+        psz[i] = static_cast<WCHAR>(L'a' + k % 26);
+    }
+    psz[cch] = L'\0';
+    return cch;
+}
+
+static bool IsValidValue(PCWSTR psz, DWORD* pcch)
+{
+    DWORD cch = 0;
+    while (cch <= TEST_FIELD_MAX_LENGTH && psz[cch] != L'\0')
+    {
+        if (psz[cch] != psz[0] || psz[0] < L'a' || psz[0] > L'z')
+        {
+            return false;
+        }
+        cch++;
+    }
+
+    *pcch = cch;
+    return cch >= 1 && cch <= 40;
+}
+
+static void TestSetAndRead()
+{
+    FieldStringStore store;
+    PCWSTR rgpszInitial[] = { L"user", L"" };
+    DWORD rgcchMax[] = { 0, TEST_FIELD_MAX_LENGTH };
+    CHECK(SUCCEEDED(store.Initialize(ARRAYSIZE(rgpszInitial), rgpszInitial, rgcchMax)));
+
+    DWORD cch = 0;
+    CHECK(SUCCEEDED(store.Set(1, L"secret", &cch)));
+    CHECK(cch == 6);
+
+    {
+        FieldStringStore::ReadGuard guard(store);
+        CHECK(wcscmp(guard.Get(0), L"user") == 0);
+        CHECK(wcscmp(guard.Get(1), L"secret") == 0);
+        CHECK(guard.Get(2) == nullptr);
+    }
+
+    PWSTR pszCopy = nullptr;
+    CHECK(SUCCEEDED(store.CopyTo(1, &pszCopy)));
+    CHECK(pszCopy && wcscmp(pszCopy, L"secret") == 0);
+    CoTaskMemFree(pszCopy);
+
+    // Field 0 was sized to its initial value
+    CHECK(store.Set(0, L"longer name", nullptr) == E_NOT_SUFFICIENT_BUFFER);
+    CHECK(store.Set(2, L"x", nullptr) == E_INVALIDARG);
+}
+
+// A reader holding a guard pins every version retired since it started,
+// so the writer can publish into the spares only; once the reader leaves,
+// reclamation recycles them all
+static void TestPinnedVersionSurvivesWrites()
+{
+    FieldStringStore store;
+    PCWSTR rgpszInitial[] = { L"" };
+    DWORD rgcchMax[] = { TEST_FIELD_MAX_LENGTH };
+    CHECK(SUCCEEDED(store.Initialize(1, rgpszInitial, rgcchMax)));
+
+    WCHAR sz[TEST_FIELD_MAX_LENGTH + 1];
+    WriteValue(sz, 7);
+    store.Set(0, sz, nullptr);
+
+    {
+        FieldStringStore::ReadGuard guard(store);
+        PCWSTR pszPinned = guard.Get(0);
+
+        for (ULONGLONG k = 100; k < 100 + FIELD_STRING_VERSIONS - 1; k++)
+        {
+            WriteValue(sz, k);
+            CHECK(SUCCEEDED(store.Set(0, sz, nullptr)));
+        }
+
+        WriteValue(sz, 7);
+        CHECK(wcscmp(pszPinned, sz) == 0);
+        CHECK(wcscmp(guard.Get(0), sz) != 0);
+    }
+
+    // Far more writes than there are versions
+    for (ULONGLONG k = 200; k < 200 + 10 * FIELD_STRING_VERSIONS; k++)
+    {
+        WriteValue(sz, k);
+        CHECK(SUCCEEDED(store.Set(0, sz, nullptr)));
+    }
+
+    FieldStringStore::ReadGuard guard(store);
+    CHECK(wcscmp(guard.Get(0), sz) == 0);
+}
+
+static void TestConcurrentReadersAndWriter()
+{
+    FieldStringStore store;
+    PCWSTR rgpszInitial[] = { L"a" };
+    DWORD rgcchMax[] = { TEST_FIELD_MAX_LENGTH };
+    CHECK(SUCCEEDED(store.Initialize(1, rgpszInitial, rgcchMax)));
+
+    std::atomic<bool> fStop(false);
+    std::atomic<ULONGLONG> cBadReads(0);
+    std::vector<ULONGLONG> rgcReads(READER_THREADS, 0);
+    ULONGLONG cWrites = 0;
+
+    // Readers check each value, hold it across a yield and check it again,
+    // so a buffer reclaimed while pinned shows up as a wiped or changed
+    // string. Every other read goes through CopyTo as GetStringValue does.
+    std::vector<std::thread> readers;
+    for (DWORD t = 0; t < READER_THREADS; t++)
+    {
+        readers.emplace_back([&, t]()
+        {
+            ULONGLONG cReads = 0;
+            while (!fStop.load(std::memory_order_relaxed))
+            {
+                DWORD cch = 0;
+                if (cReads & 1)
+                {
+                    PWSTR pszCopy = nullptr;
+                    if (FAILED(store.CopyTo(0, &pszCopy)) || !IsValidValue(pszCopy, &cch))
+                    {
+                        cBadReads.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    CoTaskMemFree(pszCopy);
+                }
+                else
+                {
+                    FieldStringStore::ReadGuard guard(store);
+                    PCWSTR psz = guard.Get(0);
+                    WCHAR ch = psz[0];
+
+                    bool fValid = IsValidValue(psz, &cch);
+                    if ((cReads & 0xFF) == 0)
+                    {
+                        std::this_thread::yield();
+                    }
+
+                    DWORD cchAgain = 0;
+                    if (!fValid || !IsValidValue(psz, &cchAgain) || cchAgain != cch || psz[0] != ch)
+                    {
+                        cBadReads.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                cReads++;
+            }
+            rgcReads[t] = cReads;
+        });
+    }
+
+    WCHAR sz[TEST_FIELD_MAX_LENGTH + 1];
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::milliseconds(300);
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        WriteValue(sz, cWrites);
+        if (FAILED(store.Set(0, sz, nullptr)))
+        {
+            cBadReads.fetch_add(1, std::memory_order_relaxed);
+        }
+        cWrites++;
+    }
+
+    fStop.store(true, std::memory_order_relaxed);
+    for (size_t t = 0; t < readers.size(); t++)
+    {
+        readers[t].join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ULONGLONG cReads = 0;
+    for (DWORD t = 0; t < READER_THREADS; t++)
+    {
+        cReads += rgcReads[t];
+    }
+
+    printf("%u readers: %.0f writes/s, %.0f reads/s, %llu bad reads\n", READER_THREADS,
+           static_cast<double>(cWrites) / seconds, static_cast<double>(cReads) / seconds,
+           static_cast<unsigned long long>(cBadReads.load()));
+    CHECK(cBadReads.load() == 0);
+    CHECK(cWrites > 0 && cReads > 0);
+
+    // Once the readers are gone the last value is still intact
+    DWORD cch = 0;
+    FieldStringStore::ReadGuard guard(store);
+    WriteValue(sz, cWrites - 1);
+    CHECK(IsValidValue(guard.Get(0), &cch));
+    CHECK(wcscmp(guard.Get(0), sz) == 0);
+}
+
+int main()
+{
+    RUN_TEST(TestSetAndRead);
+    RUN_TEST(TestPinnedVersionSurvivesWrites);
+    RUN_TEST(TestConcurrentReadersAndWriter);
+    return TestResult();
+}
@@ -0,0 +1,190 @@
+// JsonWriter output against golden bytes, and its failure modes
+
+#include "JsonWriter.h"
+#include "TestHarness.h"
+#include <math.h>
+#include <string.h>
+
+#define TEST_BUFFER_SIZE    512
+#define CANARY              '\x5A'
+
+// Run a writer over a buffer of cchBuffer bytes followed by canaries, and
+// check nothing was written past the end
+template <typename TWrite>
+static HRESULT Write(TWrite write, size_t cchBuffer, char* pchOut, size_t* pcchWritten)
+{
+    char rgch[TEST_BUFFER_SIZE + 16];
+    memset(rgch, CANARY, sizeof(rgch));
+
+    JsonWriter json(rgch, cchBuffer);
+    write(json);
+    HRESULT hr = json.Finish(pcchWritten);
+
+    for (size_t i = cchBuffer; i < sizeof(rgch); i++)
+    {
+        CHECK(rgch[i] == CANARY);
+    }
+    memcpy(pchOut, rgch, *pcchWritten);
+    pchOut[*pcchWritten] = '\0';
+    return hr;
+}
+
+// The document must come out as exactly the golden bytes, and every buffer
+// one byte short or more must fail cleanly
+template <typename TWrite>
+static void CheckGolden(TWrite write, const char* pszGolden)
+{
+    char szOut[TEST_BUFFER_SIZE + 1];
+    size_t cchWritten = 0;
+    size_t cchGolden = strlen(pszGolden);
+
+    CHECK(SUCCEEDED(Write(write, TEST_BUFFER_SIZE, szOut, &cchWritten)));
+    CHECK(cchWritten == cchGolden);
+    if (cchWritten != cchGolden || memcmp(szOut, pszGolden, cchGolden) != 0)
+    {
+        fprintf(stderr, "expected %s\n     got %s\n", pszGolden, szOut);
+        CHECK(!"output differs from the golden bytes");
+    }
+
+    CHECK(SUCCEEDED(Write(write, cchGolden, szOut, &cchWritten)));
+    for (size_t cchBuffer = 0; cchBuffer < cchGolden; cchBuffer++)
+    {
+        CHECK(Write(write, cchBuffer, szOut, &cchWritten) == E_NOT_SUFFICIENT_BUFFER);
+        CHECK(cchWritten == 0);
+    }
+}
+
+// The schema 1 keystroke shape CreateJSONPayload writes
+static void TestKeystrokeDocument()
+{
+    CheckGolden([](JsonWriter& json)
+    {
+        WCHAR rgKeys[] = { L'p', L'"' };
+        UINT32 rgDown[] = { 0, 187000 };
+        UINT32 rgUp[] = { 95000, 262500 };
+
+        json.BeginObject();
+        json.Name("keystrokes");
+        json.BeginArray();
+        for (DWORD i = 0; i < ARRAYSIZE(rgKeys); i++)
+        {
+            json.BeginObject();
+            json.Name("key");
+            json.String(&rgKeys[i], 1);
+            json.Name("keyDownTime");
+            json.UInt(rgDown[i]);
+            json.Name("keyUpTime");
+            json.UInt(rgUp[i]);
+            json.Name("position");
+            json.UInt(i);
+            json.EndObject();
+        }
+        json.EndArray();
+        json.Name("totalTypingTime");
+        json.Int(-1);
+        json.Name("edits");
+        json.BeginObject();
+        json.EndObject();
+        json.Name("empty");
+        json.BeginArray();
+        json.EndArray();
+        json.EndObject();
+    },
+    "{\"keystrokes\":["
+        "{\"key\":\"p\",\"keyDownTime\":0,\"keyUpTime\":95000,\"position\":0},"
+        "{\"key\":\"\\\"\",\"keyDownTime\":187000,\"keyUpTime\":262500,\"position\":1}],"
+    "\"totalTypingTime\":-1,\"edits\":{},\"empty\":[]}");
+}
+
+static void TestNumbers()
+{
+    CheckGolden([](JsonWriter& json)
+    {
+        json.BeginArray();
+        json.Number(0.1);
+        json.Number(95000.5);
+        json.Number(-0.0);
+        json.Number(1e21);
+        json.Number(1e-7);
+        json.Number(1.0 / 3.0);
+        json.Number(NAN);
+        json.Number(-INFINITY);
+        json.Int(-9223372036854775807LL - 1);
+        json.UInt(18446744073709551615ULL);
+        json.EndArray();
+    },
+    "[0.1,95000.5,-0,1e+21,1e-07,0.3333333333333333,null,null,"
+    "-9223372036854775808,18446744073709551615]");
+}
+
+static void TestStrings()
+{
+    CheckGolden([](JsonWriter& json)
+    {
+        // Escapes, then 2-, 3- and 4-byte UTF-8, then lone surrogates,
+        // which UTF-8 cannot carry
+        PCWSTR pwzEscapes = L"a\"b\\c\n\x01\x1f/";
+        WCHAR rgchUnicode[] = { 0x00E9, 0x20AC, 0xD83D, 0xDE00 };
+        WCHAR rgchLone[] = { 0xD83D, L'x', 0xDE00 };
+
+        json.BeginArray();
+        json.String(pwzEscapes, wcslen(pwzEscapes));
+        json.String(rgchUnicode, ARRAYSIZE(rgchUnicode));
+        json.String(rgchLone, ARRAYSIZE(rgchLone));
+        json.String(rgchLone, 1);
+        json.String(L"", 0);
+        json.EndArray();
+    },
+    "[\"a\\\"b\\\\c\\u000a\\u0001\\u001f/\","
+    "\"\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\","
+    "\"\\ud83dx\\ude00\","
+    "\"\\ud83d\","
+    "\"\"]");
+}
+
+static void TestStructureErrors()
+{
+    char szOut[TEST_BUFFER_SIZE + 1];
+    size_t cchWritten = 0;
+
+    // Left open
+    CHECK(Write([](JsonWriter& json) { json.BeginObject(); }, TEST_BUFFER_SIZE, szOut, &cchWritten) == E_UNEXPECTED);
+
+    // A name with no value
+    CHECK(Write([](JsonWriter& json)
+    {
+        json.BeginObject();
+        json.Name("dangling");
+    }, TEST_BUFFER_SIZE, szOut, &cchWritten) == E_UNEXPECTED);
+
+    // Closed once too often
+    CHECK(FAILED(Write([](JsonWriter& json)
+    {
+        json.BeginArray();
+        json.EndArray();
+        json.EndArray();
+    }, TEST_BUFFER_SIZE, szOut, &cchWritten)));
+
+    // Nested past the depth the writer tracks
+    CHECK(FAILED(Write([](JsonWriter& json)
+    {
+        for (DWORD i = 0; i < JSON_WRITER_MAX_DEPTH; i++)
+        {
+            json.BeginArray();
+        }
+        for (DWORD i = 0; i < JSON_WRITER_MAX_DEPTH; i++)
+        {
+            json.EndArray();
+        }
+    }, TEST_BUFFER_SIZE, szOut, &cchWritten)));
+    CHECK(cchWritten == 0);
+}
+
+int main()
+{
+    RUN_TEST(TestKeystrokeDocument);
+    RUN_TEST(TestNumbers);
+    RUN_TEST(TestStrings);
+    RUN_TEST(TestStructureErrors);
+    return TestResult();
+}
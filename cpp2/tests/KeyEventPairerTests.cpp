@@ -0,0 +1,276 @@
+// KeyEventPairer pairing and the KeyEventQueue between source and credential
+
+#include "KeyEventPairer.h"
+#include "TestHarness.h"
+#include <thread>
+
+#define STALE_TICKS     1000
+
+static KeyEvent Down(WORD vk, LONGLONG timestamp)
+{
+    KeyEvent keyEvent = { timestamp, vk, 0 };
+    return keyEvent;
+}
+
+static KeyEvent Up(WORD vk, LONGLONG timestamp)
+{
+    KeyEvent keyEvent = { timestamp, vk, KEY_EVENT_FLAG_UP };
+    return keyEvent;
+}
+
+// Ingest an event that must not complete a keystroke
+static void IngestQuietly(KeyEventPairer* pPairer, const KeyEvent& keyEvent)
+{
+    LONGLONG llDown = 0;
+    LONGLONG llUp = 0;
+    CHECK(!pPairer->Ingest(keyEvent, &llDown, &llUp));
+}
+
+static void TestClaimWhileHeld()
+{
+    KeyEventPairer pairer;
+    IngestQuietly(&pairer, Down('A', 100));
+
+    // The character arrives while the key is still down
+    LONGLONG llDown = 0;
+    LONGLONG llUp = -1;
+    CHECK(pairer.ClaimKeyDown(110, STALE_TICKS, &llDown, &llUp));
+    CHECK(llDown == 100);
+    CHECK(llUp == 0);
+
+    // Its release completes the keystroke
+    CHECK(pairer.Ingest(Up('A', 180), &llDown, &llUp));
+    CHECK(llDown == 100);
+    CHECK(llUp == 180);
+}
+
+static void TestClaimAfterRelease()
+{
+    KeyEventPairer pairer;
+    IngestQuietly(&pairer, Down('B', 100));
+    IngestQuietly(&pairer, Up('B', 150));
+
+    LONGLONG llDown = 0;
+    LONGLONG llUp = 0;
+    CHECK(pairer.ClaimKeyDown(160, STALE_TICKS, &llDown, &llUp));
+    CHECK(llDown == 100);
+    CHECK(llUp == 150);
+
+    // Nothing is left to claim
+    CHECK(!pairer.ClaimKeyDown(170, STALE_TICKS, &llDown, &llUp));
+}
+
+// Fast typists press the next key before releasing the previous one
+static void TestRollover()
+{
+    KeyEventPairer pairer;
+    LONGLONG llDown = 0;
+    LONGLONG llUp = 0;
+
+    IngestQuietly(&pairer, Down('A', 100));
+    CHECK(pairer.ClaimKeyDown(101, STALE_TICKS, &llDown, &llUp));
+    CHECK(llDown == 100);
+
+    IngestQuietly(&pairer, Down('S', 140));
+    CHECK(pairer.ClaimKeyDown(141, STALE_TICKS, &llDown, &llUp));
+    CHECK(llDown == 140);
+
+    IngestQuietly(&pairer, Down('D', 170));
+
+    CHECK(pairer.Ingest(Up('A', 190), &llDown, &llUp));
+    CHECK(llDown == 100 && llUp == 190);
+
+    CHECK(pairer.ClaimKeyDown(195, STALE_TICKS, &llDown, &llUp));
+    CHECK(llDown == 170 && llUp == 0);
+
+    CHECK(pairer.Ingest(Up('S', 200), &llDown, &llUp));
+    CHECK(llDown == 140 && llUp == 200);
+    CHECK(pairer.Ingest(Up('D', 260), &llDown, &llUp));
+    CHECK(llDown == 170 && llUp == 260);
+}
+
+// Key downs are claimed in press order even when several queue up
+static void TestClaimOrder()
+{
+    KeyEventPairer pairer;
+    IngestQuietly(&pairer, Down('Q', 10));
+    IngestQuietly(&pairer, Down('W', 20));
+    IngestQuietly(&pairer, Up('Q', 30));
+    IngestQuietly(&pairer, Down('E', 40));
+
+    LONGLONG rgExpectedDown[] = { 10, 20, 40 };
+    LONGLONG rgExpectedUp[] = { 30, 0, 0 };
+    for (DWORD i = 0; i < ARRAYSIZE(rgExpectedDown); i++)
+    {
+        LONGLONG llDown = 0;
+        LONGLONG llUp = 0;
+        CHECK(pairer.ClaimKeyDown(50, STALE_TICKS, &llDown, &llUp));
+        CHECK(llDown == rgExpectedDown[i]);
+        CHECK(llUp == rgExpectedUp[i]);
+    }
+}
+
+static void TestAutoRepeatAndModifiers()
+{
+    KeyEventPairer pairer;
+
+    // Modifiers and editing keys never pair
+    IngestQuietly(&pairer, Down(VK_SHIFT, 5));
+    IngestQuietly(&pairer, Down(VK_BACK, 6));
+
+    // Held key repeats are one keystroke
+    IngestQuietly(&pairer, Down('K', 10));
+    IngestQuietly(&pairer, Down('K', 40));
+    IngestQuietly(&pairer, Down('K', 70));
+
+    LONGLONG llDown = 0;
+    LONGLONG llUp = 0;
+    CHECK(pairer.ClaimKeyDown(80, STALE_TICKS, &llDown, &llUp));
+    CHECK(llDown == 10);
+    CHECK(!pairer.ClaimKeyDown(81, STALE_TICKS, &llDown, &llUp));
+
+    CHECK(pairer.Ingest(Up('K', 90), &llDown, &llUp));
+    CHECK(llDown == 10 && llUp == 90);
+    IngestQuietly(&pairer, Up(VK_SHIFT, 95));
+}
+
+static void TestStaleKeyDown()
+{
+    KeyEventPairer pairer;
+    IngestQuietly(&pairer, Down('Z', 100));
+    IngestQuietly(&pairer, Down('X', 2000));
+
+    // 'Z' is too old to belong to a character typed now
+    LONGLONG llDown = 0;
+    LONGLONG llUp = 0;
+    CHECK(pairer.ClaimKeyDown(2050, STALE_TICKS, &llDown, &llUp));
+    CHECK(llDown == 2000);
+
+    // Its release then completes nothing
+    IngestQuietly(&pairer, Up('Z', 2100));
+}
+
+// A paste or selection edit consumes no key down; the pending ones must
+// not be attributed to the next typed character
+static void TestDiscardUnclaimed()
+{
+    KeyEventPairer pairer;
+    IngestQuietly(&pairer, Down('V', 10));
+    IngestQuietly(&pairer, Down('C', 20));
+    IngestQuietly(&pairer, Up('C', 25));
+    pairer.DiscardUnclaimed();
+
+    LONGLONG llDown = 0;
+    LONGLONG llUp = 0;
+    CHECK(!pairer.ClaimKeyDown(30, STALE_TICKS, &llDown, &llUp));
+    IngestQuietly(&pairer, Up('V', 40));
+
+    // The same keys pair normally afterwards
+    IngestQuietly(&pairer, Down('V', 50));
+    CHECK(pairer.ClaimKeyDown(55, STALE_TICKS, &llDown, &llUp));
+    CHECK(pairer.Ingest(Up('V', 60), &llDown, &llUp));
+    CHECK(llDown == 50 && llUp == 60);
+}
+
+// More unclaimed key downs than the pairer tracks drop the oldest
+static void TestUnclaimedOverflow()
+{
+    KeyEventPairer pairer;
+    WORD rgKeys[20];
+    for (WORD i = 0; i < ARRAYSIZE(rgKeys); i++)
+    {
+        rgKeys[i] = static_cast<WORD>('A' + i);
+        IngestQuietly(&pairer, Down(rgKeys[i], 100 + i));
+    }
+
+    LONGLONG llDown = 0;
+    LONGLONG llUp = 0;
+    DWORD cClaimed = 0;
+    while (pairer.ClaimKeyDown(200, STALE_TICKS, &llDown, &llUp))
+    {
+        CHECK(llDown == 104 + cClaimed);
+        cClaimed++;
+    }
+    CHECK(cClaimed == 16);
+}
+
+static void TestQueueOrderAndOverflow()
+{
+    KeyEventQueue* pQueue = new KeyEventQueue();
+
+    for (LONGLONG i = 0; i < KEY_EVENT_QUEUE_SIZE + 10; i++)
+    {
+        pQueue->OnKeyEvent(Down('A', i));
+    }
+    CHECK(pQueue->GetDroppedCount() == 10);
+
+    KeyEvent keyEvent;
+    LONGLONG llExpected = 0;
+    while (pQueue->TryPop(&keyEvent))
+    {
+        CHECK(keyEvent.timestamp == llExpected);
+        llExpected++;
+    }
+    CHECK(llExpected == KEY_EVENT_QUEUE_SIZE);
+
+    pQueue->OnKeyEvent(Down('A', 1));
+    pQueue->Discard();
+    CHECK(!pQueue->TryPop(&keyEvent));
+
+    delete pQueue;
+}
+
+// One producer and one consumer, as the hook thread and the credential
+static void TestQueueAcrossThreads()
+{
+    KeyEventQueue* pQueue = new KeyEventQueue();
+    const LONGLONG cEvents = 200000;
+
+    std::thread producer([&]()
+    {
+        for (LONGLONG i = 1; i <= cEvents; i++)
+        {
+            pQueue->OnKeyEvent(Down('A', i));
+        }
+    });
+
+    LONGLONG llLast = 0;
+    LONGLONG cReceived = 0;
+    KeyEvent keyEvent;
+    while (llLast < cEvents && cReceived + pQueue->GetDroppedCount() < cEvents)
+    {
+        while (pQueue->TryPop(&keyEvent))
+        {
+            CHECK(keyEvent.timestamp > llLast);
+            llLast = keyEvent.timestamp;
+            cReceived++;
+        }
+        std::this_thread::yield();
+    }
+    producer.join();
+
+    while (pQueue->TryPop(&keyEvent))
+    {
+        CHECK(keyEvent.timestamp > llLast);
+        llLast = keyEvent.timestamp;
+        cReceived++;
+    }
+
+    CHECK(cReceived + pQueue->GetDroppedCount() == cEvents);
+    delete pQueue;
+}
+
+int main()
+{
+    RUN_TEST(TestClaimWhileHeld);
+    RUN_TEST(TestClaimAfterRelease);
+    RUN_TEST(TestRollover);
+    RUN_TEST(TestClaimOrder);
+    RUN_TEST(TestAutoRepeatAndModifiers);
+    RUN_TEST(TestStaleKeyDown);
+    RUN_TEST(TestDiscardUnclaimed);
+    RUN_TEST(TestUnclaimedOverflow);
+    RUN_TEST(TestQueueOrderAndOverflow);
+    RUN_TEST(TestQueueAcrossThreads);
+    return TestResult();
+}
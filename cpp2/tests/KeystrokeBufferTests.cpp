@@ -0,0 +1,174 @@
+// KeystrokeBuffer: writer-side bookkeeping and Snapshot() consistency
+// under a concurrent writer
+
+#include "KeystrokeBuffer.h"
+#include "TestHarness.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Each generation of the writer fills the buffer with entries whose lanes
+// all derive from (generation, index), so a snapshot mixing two writes
+// shows up as a mismatch
+#define GENERATION_SPAN_US      1000000
+#define KEY_HOLD_US             500
+
+static UINT32 KeyDownFor(DWORD dwGeneration, DWORD i)
+{
+    return (dwGeneration % 1000) * GENERATION_SPAN_US + i * 1000;
+}
+
+static WCHAR KeyIdFor(DWORD dwGeneration)
+{
+    return static_cast<WCHAR>(L'a' + dwGeneration % 1000 % 26);
+}
+
+static void TestAppendAndRemove()
+{
+    KeystrokeBuffer buffer;
+    CHECK(buffer.IsEmpty());
+
+    for (DWORD i = 0; i < 4; i++)
+    {
+        CHECK(SUCCEEDED(buffer.Append(KeyIdFor(0), KeyDownFor(0, i), KeyDownFor(0, i), i, 0)));
+    }
+
+    buffer.SetKeyUp(KeyDownFor(0, 3), KeyDownFor(0, 3) + KEY_HOLD_US);
+    buffer.RemovePositions(1, 1);
+
+    const KeystrokeTimeline& timeline = buffer.GetTimeline();
+    CHECK(buffer.GetCount() == 3);
+    CHECK(timeline.count == 3);
+    CHECK(timeline.keyDownUs[1] == KeyDownFor(0, 2));
+    CHECK(timeline.position[1] == 1);
+    CHECK(timeline.position[2] == 2);
+    CHECK(timeline.keyUpUs[2] == KeyDownFor(0, 3) + KEY_HOLD_US);
+
+    buffer.RemoveLast();
+    CHECK(buffer.GetCount() == 2);
+
+    buffer.Clear();
+    CHECK(buffer.IsEmpty());
+    CHECK((buffer.GetSequence() & 1) == 0);
+}
+
+static void TestSnapshotMatchesWriter()
+{
+    KeystrokeBuffer buffer;
+    for (DWORD i = 0; i < 10; i++)
+    {
+        buffer.Append(KeyIdFor(1), KeyDownFor(1, i), KeyDownFor(1, i) + KEY_HOLD_US, i, 0);
+    }
+
+    KeystrokeTimeline snapshot;
+    ULONG ulSequence = 0;
+    DWORD cEntries = buffer.Snapshot(&snapshot, &ulSequence);
+
+    CHECK(cEntries == 10);
+    CHECK(snapshot.count == 10);
+    CHECK(ulSequence == buffer.GetSequence());
+    for (DWORD i = 0; i < cEntries; i++)
+    {
+        CHECK(snapshot.keyDownUs[i] == KeyDownFor(1, i));
+        CHECK(snapshot.keyId[i] == KeyIdFor(1));
+    }
+}
+
+static void TestSnapshotUnderConcurrentWriter()
+{
+    KeystrokeBuffer* pBuffer = new KeystrokeBuffer();
+    std::atomic<bool> fStop(false);
+    std::atomic<DWORD> cGenerations(0);
+
+    // The writer types, completes key ups, backspaces and clears, as the
+    // LogonUI thread would
+    std::thread writer([&]()
+    {
+        for (DWORD dwGeneration = 0; !fStop.load(std::memory_order_relaxed); dwGeneration++)
+        {
+            pBuffer->Clear();
+
+            DWORD cEntries = 1 + dwGeneration % 40;
+            for (DWORD i = 0; i < cEntries; i++)
+            {
+                UINT32 keyDownUs = KeyDownFor(dwGeneration, i);
+                pBuffer->Append(KeyIdFor(dwGeneration), keyDownUs, keyDownUs, i, 0);
+                if (i % 3 != 0)
+                {
+                    pBuffer->SetKeyUp(keyDownUs, keyDownUs + KEY_HOLD_US);
+                }
+            }
+
+            if (dwGeneration % 5 == 0)
+            {
+                pBuffer->RemoveLast();
+            }
+
+            cGenerations.store(dwGeneration + 1, std::memory_order_relaxed);
+        }
+    });
+
+    KeystrokeTimeline* pSnapshot = new KeystrokeTimeline();
+    ULONG ulLastSequence = 0;
+    DWORD cSnapshots = 0;
+    DWORD cTorn = 0;
+    DWORD cNonEmpty = 0;
+
+    // Run long enough for the scheduler to preempt the writer mid-write
+    // many times, even on a single core
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+    while (std::chrono::steady_clock::now() < deadline || cGenerations.load(std::memory_order_relaxed) < 1000)
+    {
+        ULONG ulSequence = 0;
+        DWORD cEntries = pBuffer->Snapshot(pSnapshot, &ulSequence);
+        cSnapshots++;
+
+        CHECK((ulSequence & 1) == 0);
+        CHECK(ulSequence >= ulLastSequence);
+        CHECK(cEntries == pSnapshot->count);
+        CHECK(cEntries <= 40);
+        ulLastSequence = ulSequence;
+
+        if (cEntries == 0)
+        {
+            continue;
+        }
+        cNonEmpty++;
+
+        DWORD dwGeneration = pSnapshot->keyDownUs[0] / GENERATION_SPAN_US;
+        for (DWORD i = 0; i < cEntries; i++)
+        {
+            UINT32 keyDownUs = pSnapshot->keyDownUs[i];
+            UINT32 keyUpUs = pSnapshot->keyUpUs[i];
+
+            if (keyDownUs != dwGeneration * GENERATION_SPAN_US + i * 1000 ||
+                (keyUpUs != keyDownUs && keyUpUs != keyDownUs + KEY_HOLD_US) ||
+                pSnapshot->keyId[i] != KeyIdFor(dwGeneration) ||
+                pSnapshot->position[i] != i)
+            {
+                cTorn++;
+                break;
+            }
+        }
+    }
+
+    fStop.store(true, std::memory_order_relaxed);
+    writer.join();
+
+    printf("%lu snapshots (%lu non-empty) across %lu writer generations, %lu torn\n",
+           static_cast<unsigned long>(cSnapshots), static_cast<unsigned long>(cNonEmpty),
+           static_cast<unsigned long>(cGenerations.load()), static_cast<unsigned long>(cTorn));
+    CHECK(cTorn == 0);
+    CHECK(cNonEmpty > 0);
+
+    delete pSnapshot;
+    delete pBuffer;
+}
+
+int main()
+{
+    RUN_TEST(TestAppendAndRemove);
+    RUN_TEST(TestSnapshotMatchesWriter);
+    RUN_TEST(TestSnapshotUnderConcurrentWriter);
+    return TestResult();
+}
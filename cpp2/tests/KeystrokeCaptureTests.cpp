@@ -0,0 +1,246 @@
+// Edit diffs produced by KeystrokeEditTracker::Update
+
+#include "KeystrokeCapture.h"
+#include "TestHarness.h"
+#include <wchar.h>
+
+// Feed the tracker a new value and check the edit it reports
+static KeystrokeEdit Apply(KeystrokeEditTracker* pTracker, PCWSTR pwzValue)
+{
+    KeystrokeEdit edit;
+    HRESULT hr = pTracker->Update(pwzValue, static_cast<DWORD>(wcslen(pwzValue)), &edit);
+    CHECK(SUCCEEDED(hr));
+    return edit;
+}
+
+static bool InsertedEquals(const KeystrokeEdit& edit, PCWSTR pwzExpected)
+{
+    return edit.cchInserted == wcslen(pwzExpected) &&
+           wmemcmp(edit.pwzInserted, pwzExpected, edit.cchInserted) == 0;
+}
+
+static void TestTypingAtEnd()
+{
+    KeystrokeEditTracker tracker;
+    tracker.Reset(L"");
+
+    PCWSTR rgpszValues[] = { L"p", L"pa", L"pas", L"pass" };
+    for (DWORD i = 0; i < ARRAYSIZE(rgpszValues); i++)
+    {
+        KeystrokeEdit edit = Apply(&tracker, rgpszValues[i]);
+        CHECK(edit.kind == KEK_INSERT);
+        CHECK(edit.position == i);
+        CHECK(edit.cchRemoved == 0);
+        CHECK(edit.cchNewLength == i + 1);
+        CHECK(InsertedEquals(edit, rgpszValues[i] + i));
+    }
+    CHECK(tracker.GetLength() == 4);
+}
+
+static void TestBackspaceAtEnd()
+{
+    KeystrokeEditTracker tracker;
+    tracker.Reset(L"pass");
+
+    KeystrokeEdit edit = Apply(&tracker, L"pas");
+    CHECK(edit.kind == KEK_DELETE);
+    CHECK(edit.position == 3);
+    CHECK(edit.cchRemoved == 1);
+    CHECK(edit.cchInserted == 0);
+
+    edit = Apply(&tracker, L"pa");
+    CHECK(edit.kind == KEK_DELETE);
+    CHECK(edit.position == 2);
+
+    // Down to empty and back up again
+    Apply(&tracker, L"p");
+    edit = Apply(&tracker, L"");
+    CHECK(edit.kind == KEK_DELETE);
+    CHECK(edit.position == 0);
+    CHECK(edit.cchNewLength == 0);
+
+    edit = Apply(&tracker, L"x");
+    CHECK(edit.kind == KEK_INSERT);
+    CHECK(edit.position == 0);
+}
+
+static void TestInsertInMiddle()
+{
+    KeystrokeEditTracker tracker;
+    tracker.Reset(L"abcd");
+
+    KeystrokeEdit edit = Apply(&tracker, L"abXcd");
+    CHECK(edit.kind == KEK_INSERT);
+    CHECK(edit.position == 2);
+    CHECK(edit.cchRemoved == 0);
+    CHECK(InsertedEquals(edit, L"X"));
+
+    // Typing at the end afterwards diffs against the updated mirror
+    edit = Apply(&tracker, L"abXcde");
+    CHECK(edit.kind == KEK_INSERT);
+    CHECK(edit.position == 5);
+}
+
+static void TestDeleteInMiddle()
+{
+    KeystrokeEditTracker tracker;
+    tracker.Reset(L"abcd");
+
+    KeystrokeEdit edit = Apply(&tracker, L"acd");
+    CHECK(edit.kind == KEK_DELETE);
+    CHECK(edit.position == 1);
+    CHECK(edit.cchRemoved == 1);
+
+    // Delete at the start of the field
+    edit = Apply(&tracker, L"cd");
+    CHECK(edit.kind == KEK_DELETE);
+    CHECK(edit.position == 0);
+    CHECK(edit.cchRemoved == 1);
+}
+
+static void TestSelectionEdits()
+{
+    KeystrokeEditTracker tracker;
+    tracker.Reset(L"abcdef");
+
+    // Selection deleted
+    KeystrokeEdit edit = Apply(&tracker, L"aef");
+    CHECK(edit.kind == KEK_DELETE);
+    CHECK(edit.position == 1);
+    CHECK(edit.cchRemoved == 3);
+
+    // Selection overwritten by one typed character
+    edit = Apply(&tracker, L"aZ");
+    CHECK(edit.kind == KEK_REPLACE);
+    CHECK(edit.position == 1);
+    CHECK(edit.cchRemoved == 2);
+    CHECK(InsertedEquals(edit, L"Z"));
+
+    // Whole field replaced by a paste
+    edit = Apply(&tracker, L"12345");
+    CHECK(edit.kind == KEK_REPLACE);
+    CHECK(edit.position == 0);
+    CHECK(edit.cchRemoved == 2);
+    CHECK(InsertedEquals(edit, L"12345"));
+}
+
+static void TestPaste()
+{
+    KeystrokeEditTracker tracker;
+    tracker.Reset(L"ab");
+
+    KeystrokeEdit edit = Apply(&tracker, L"a123b");
+    CHECK(edit.kind == KEK_PASTE);
+    CHECK(edit.position == 1);
+    CHECK(InsertedEquals(edit, L"123"));
+
+    edit = Apply(&tracker, L"a123bxy");
+    CHECK(edit.kind == KEK_PASTE);
+    CHECK(edit.position == 5);
+    CHECK(InsertedEquals(edit, L"xy"));
+}
+
+static void TestNoChange()
+{
+    KeystrokeEditTracker tracker;
+    tracker.Reset(L"same");
+
+    KeystrokeEdit edit = Apply(&tracker, L"same");
+    CHECK(edit.kind == KEK_NONE);
+    CHECK(edit.cchInserted == 0);
+    CHECK(edit.cchRemoved == 0);
+}
+
+// Repeated characters leave the edit ambiguous; the diff must still
+// reproduce the new value
+static void TestRepeatedCharacters()
+{
+    KeystrokeEditTracker tracker;
+    tracker.Reset(L"aaa");
+
+    KeystrokeEdit edit = Apply(&tracker, L"aaaa");
+    CHECK(edit.kind == KEK_INSERT);
+    CHECK(edit.position == 3);
+
+    edit = Apply(&tracker, L"aa");
+    CHECK(edit.kind == KEK_DELETE);
+    CHECK(edit.cchRemoved == 2);
+    CHECK(edit.cchNewLength == 2);
+
+    // A mid-field edit that breaks the repetition takes the full scan
+    edit = Apply(&tracker, L"aba");
+    CHECK(edit.kind == KEK_INSERT);
+    CHECK(edit.position == 1);
+    CHECK(InsertedEquals(edit, L"b"));
+}
+
+// An edit in front of a repeated tail leaves the last character in place,
+// so only the full prefix compare tells it from an edit at the end
+static void TestEditBeforeRepeatedTail()
+{
+    KeystrokeEditTracker tracker;
+    tracker.Reset(L"pass11");
+
+    KeystrokeEdit edit = Apply(&tracker, L"paXss11");
+    CHECK(edit.kind == KEK_INSERT);
+    CHECK(edit.position == 2);
+    CHECK(InsertedEquals(edit, L"X"));
+
+    edit = Apply(&tracker, L"pass11");
+    CHECK(edit.kind == KEK_DELETE);
+    CHECK(edit.position == 2);
+    CHECK(edit.cchRemoved == 1);
+
+    edit = Apply(&tracker, L"pas11");
+    CHECK(edit.kind == KEK_DELETE);
+    CHECK(edit.position == 3);
+    CHECK(edit.cchRemoved == 1);
+
+    // The mirror followed both edits, so typing at the end is seen there
+    edit = Apply(&tracker, L"pas112");
+    CHECK(edit.kind == KEK_INSERT);
+    CHECK(edit.position == 5);
+    CHECK(InsertedEquals(edit, L"2"));
+
+    edit = Apply(&tracker, L"1pas112");
+    CHECK(edit.kind == KEK_INSERT);
+    CHECK(edit.position == 0);
+    CHECK(InsertedEquals(edit, L"1"));
+}
+
+static void TestNullAndOverflow()
+{
+    KeystrokeEditTracker tracker;
+    tracker.Reset(L"ab");
+
+    // A null value clears the field
+    KeystrokeEdit edit;
+    CHECK(SUCCEEDED(tracker.Update(nullptr, 0, &edit)));
+    CHECK(edit.kind == KEK_DELETE);
+    CHECK(edit.cchRemoved == 2);
+    CHECK(tracker.GetLength() == 0);
+
+    WCHAR szLong[KEYSTROKE_CAPTURE_MAX_LENGTH + 2];
+    wmemset(szLong, L'x', ARRAYSIZE(szLong) - 1);
+    szLong[ARRAYSIZE(szLong) - 1] = L'\0';
+    CHECK(tracker.Update(szLong, KEYSTROKE_CAPTURE_MAX_LENGTH + 1, &edit) == E_NOT_SUFFICIENT_BUFFER);
+    CHECK(tracker.GetLength() == 0);
+
+    CHECK(tracker.Update(L"a", 1, nullptr) == E_INVALIDARG);
+    CHECK(tracker.Reset(szLong) == E_NOT_SUFFICIENT_BUFFER);
+}
+
+int main()
+{
+    RUN_TEST(TestTypingAtEnd);
+    RUN_TEST(TestBackspaceAtEnd);
+    RUN_TEST(TestInsertInMiddle);
+    RUN_TEST(TestDeleteInMiddle);
+    RUN_TEST(TestSelectionEdits);
+    RUN_TEST(TestPaste);
+    RUN_TEST(TestNoChange);
+    RUN_TEST(TestRepeatedCharacters);
+    RUN_TEST(TestEditBeforeRepeatedTail);
+    RUN_TEST(TestNullAndOverflow);
+    return TestResult();
+}
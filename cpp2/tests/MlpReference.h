@@ -0,0 +1,243 @@
+#pragma once
+
+// Float forward pass over mlp-model.json, the model MlpWeights.h is
+// generated from. MlpScorerTests checks the int8 network against it and
+// ScorerBenchmark times it next to the int8 one, so it is laid out as a
+// plain float implementation would be: dense row-major weights, no
+// quantization, no padding.
+
+#include "MlpScorer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Widest layer the reference evaluates without allocating
+#define MLP_REFERENCE_MAX_WIDTH     256
+
+// Just enough JSON for the model file: objects, arrays, numbers and strings
+struct JsonValue
+{
+    std::string text;
+    double number = 0.0;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue* Find(const char* pszName) const
+    {
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            if (members[i].first == pszName)
+            {
+                return &members[i].second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+struct MlpReferenceLayer
+{
+    DWORD cInputs;
+    DWORD cOutputs;
+    std::vector<float> weights;     // cOutputs rows of cInputs
+    std::vector<float> bias;
+    bool fRelu;
+    float outputMax;                // ReLU layers saturate here, as the int8 ones do
+};
+
+struct MlpReference
+{
+    float inputMax;
+    std::vector<MlpReferenceLayer> layers;
+};
+
+static void SkipSpace(const char** ppsz)
+{
+    while (**ppsz == ' ' || **ppsz == '\t' || **ppsz == '\r' || **ppsz == '\n')
+    {
+        (*ppsz)++;
+    }
+}
+
+static bool ParseJson(const char** ppsz, JsonValue* pValue)
+{
+    SkipSpace(ppsz);
+    const char* psz = *ppsz;
+    bool fOk = true;
+
+    if (*psz == '{' || *psz == '[')
+    {
+        bool fObject = (*psz == '{');
+        char chClose = fObject ? '}' : ']';
+        psz++;
+        SkipSpace(&psz);
+        while (fOk && *psz != chClose)
+        {
+            JsonValue item;
+            std::string name;
+            if (fObject)
+            {
+                JsonValue key;
+                fOk = ParseJson(&psz, &key);
+                name = key.text;
+                SkipSpace(&psz);
+                fOk = fOk && (*psz++ == ':');
+            }
+
+            fOk = fOk && ParseJson(&psz, &item);
+            if (fObject)
+            {
+                pValue->members.emplace_back(name, item);
+            }
+            else
+            {
+                pValue->items.push_back(item);
+            }
+
+            SkipSpace(&psz);
+            if (*psz == ',')
+            {
+                psz++;
+                SkipSpace(&psz);
+            }
+            else
+            {
+                fOk = fOk && (*psz == chClose);
+            }
+        }
+        psz++;
+    }
+    else if (*psz == '"')
+    {
+        for (psz++; *psz && *psz != '"'; psz++)
+        {
+            if (*psz == '\\' && psz[1])
+            {
+                psz++;
+            }
+            pValue->text += *psz;
+        }
+        fOk = (*psz++ == '"');
+    }
+    else
+    {
+        char* pszEnd = nullptr;
+        pValue->number = strtod(psz, &pszEnd);
+        fOk = (pszEnd != psz);
+        psz = pszEnd;
+    }
+
+    *ppsz = psz;
+    return fOk;
+}
+
+// Reads the model and checks it was trained on the verifier's inputs and
+// ends in a single logit
+static bool LoadMlpReference(const char* pszPath, MlpReference* pReference)
+{
+    FILE* pFile = fopen(pszPath, "rb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    std::string json;
+    char rgch[4096];
+    size_t cb;
+    while ((cb = fread(rgch, 1, sizeof(rgch), pFile)) > 0)
+    {
+        json.append(rgch, cb);
+    }
+    fclose(pFile);
+
+    JsonValue model;
+    const char* psz = json.c_str();
+    if (!ParseJson(&psz, &model) || !model.Find("input_count") || !model.Find("input_max") || !model.Find("layers") ||
+        model.Find("input_count")->number != MLP_FEATURE_INPUTS)
+    {
+        return false;
+    }
+
+    pReference->inputMax = static_cast<float>(model.Find("input_max")->number);
+    pReference->layers.clear();
+
+    DWORD cInputs = MLP_FEATURE_INPUTS;
+    const JsonValue& layers = *model.Find("layers");
+    for (size_t l = 0; l < layers.items.size(); l++)
+    {
+        const JsonValue& layer = layers.items[l];
+        const JsonValue* pWeights = layer.Find("weights");
+        const JsonValue* pBias = layer.Find("bias");
+        const JsonValue* pActivation = layer.Find("activation");
+        if (!pWeights || !pBias || !pActivation ||
+            pWeights->items.empty() || pWeights->items.size() > MLP_REFERENCE_MAX_WIDTH ||
+            pBias->items.size() != pWeights->items.size())
+        {
+            return false;
+        }
+
+        MlpReferenceLayer reference;
+        reference.cInputs = cInputs;
+        reference.cOutputs = static_cast<DWORD>(pWeights->items.size());
+        reference.fRelu = (pActivation->text == "relu");
+        reference.outputMax = reference.fRelu && layer.Find("output_max") ?
+                              static_cast<float>(layer.Find("output_max")->number) : 0.0f;
+        for (DWORD o = 0; o < reference.cOutputs; o++)
+        {
+            if (pWeights->items[o].items.size() != cInputs)
+            {
+                return false;
+            }
+            for (DWORD i = 0; i < cInputs; i++)
+            {
+                reference.weights.push_back(static_cast<float>(pWeights->items[o].items[i].number));
+            }
+            reference.bias.push_back(static_cast<float>(pBias->items[o].number));
+        }
+
+        pReference->layers.push_back(reference);
+        cInputs = reference.cOutputs;
+    }
+
+    return !pReference->layers.empty() && !pReference->layers.back().fRelu && cInputs == 1;
+}
+
+static float ClampReference(float value, float limit)
+{
+    return (value < -limit) ? -limit : (value > limit) ? limit : value;
+}
+
+// The float network, saturating where the int8 one does: inputs at
+// input_max and hidden activations at output_max. Returns the logit.
+static double EvaluateMlpReference(const MlpReference& reference, const float rgInputs[MLP_FEATURE_INPUTS])
+{
+    float rgActivations[2][MLP_REFERENCE_MAX_WIDTH];
+    float* pIn = rgActivations[0];
+    float* pOut = rgActivations[1];
+    for (DWORD i = 0; i < MLP_FEATURE_INPUTS; i++)
+    {
+        pIn[i] = ClampReference(rgInputs[i], reference.inputMax);
+    }
+
+    for (size_t l = 0; l < reference.layers.size(); l++)
+    {
+        const MlpReferenceLayer& layer = reference.layers[l];
+        const float* pWeights = layer.weights.data();
+        for (DWORD o = 0; o < layer.cOutputs; o++)
+        {
+            float sum = layer.bias[o];
+            for (DWORD i = 0; i < layer.cInputs; i++)
+            {
+                sum += pWeights[o * layer.cInputs + i] * pIn[i];
+            }
+            pOut[o] = layer.fRelu ? ClampReference((sum > 0.0f) ? sum : 0.0f, layer.outputMax) : sum;
+        }
+
+        float* pSwap = pIn;
+        pIn = pOut;
+        pOut = pSwap;
+    }
+
+    return pIn[0];
+}
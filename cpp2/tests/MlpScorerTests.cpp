@@ -0,0 +1,138 @@
+// The int8 verifier baked into MlpWeights.h against a float forward pass
+// over the model it was generated from, mlp-model.json
+
+#include "MlpScorer.h"
+#include "MlpReference.h"
+#include "TypingScorer.h"
+#include "TestHarness.h"
+#include <math.h>
+#include <random>
+
+// Largest logit difference quantization may introduce. Each hidden
+// activation is rounded to half an int8 step; through the output weights
+// that is about 0.3 of logit for the baked model.
+#define MLP_LOGIT_TOLERANCE         0.5
+
+static double Logit(double probability)
+{
+    return log(probability / (1.0 - probability));
+}
+
+// An attempt and a template whose means sit a given number of spreads away
+// from it, so the inputs cover close matches through clear impostors
+static void MakeAttempt(std::mt19937* pRandom, DWORD cKeys, double offsetSpreads,
+                        KeystrokeTimeline* pTimeline, TimingFeatureSet* pFeatures, TypingTemplate* pTemplate)
+{
+    std::uniform_int_distribution<UINT32> gap(60000, 300000);
+    std::uniform_int_distribution<UINT32> dwell(50000, 150000);
+    std::uniform_real_distribution<float> spread(5000.0f, 40000.0f);
+    std::normal_distribution<double> offset(0.0, offsetSpreads);
+
+    ZeroMemory(pTimeline, sizeof(*pTimeline));
+    UINT32 keyDownUs = 0;
+    for (DWORD i = 0; i < cKeys; i++)
+    {
+        pTimeline->keyDownUs[i] = keyDownUs;
+        pTimeline->keyUpUs[i] = keyDownUs + dwell(*pRandom);
+        keyDownUs += gap(*pRandom);
+    }
+    pTimeline->count = cKeys;
+    ExtractTimingFeaturesWith(FKI_SCALAR, *pTimeline, pFeatures);
+
+    ZeroMemory(pTemplate, sizeof(*pTemplate));
+    pTemplate->keystrokeCount = cKeys;
+    for (DWORD f = 0; f < TF_NUM_FEATURES; f++)
+    {
+        for (DWORD i = 0; i < pFeatures->stats[f].count; i++)
+        {
+            float stdDev = spread(*pRandom);
+            pTemplate->stdDev[f][i] = stdDev;
+            pTemplate->meanAbsDeviation[f][i] = stdDev * 0.8f;
+            pTemplate->mean[f][i] = static_cast<float>(pFeatures->values[f][i] + offset(*pRandom) * stdDev);
+        }
+    }
+}
+
+static void TestMatchesFloatModel()
+{
+    MlpReference reference;
+    if (!LoadMlpReference(MLP_MODEL_PATH, &reference))
+    {
+        CHECK(!"mlp-model.json is missing or does not match the verifier inputs");
+        return;
+    }
+
+    std::mt19937 random(13);
+    KeystrokeTimeline* pTimeline = new KeystrokeTimeline();
+    TimingFeatureSet* pFeatures = new TimingFeatureSet();
+    TypingTemplate* pTemplate = new TypingTemplate();
+
+    double rgOffsets[] = { 0.25, 0.5, 1.0, 2.0, 4.0 };
+    double maxError = 0.0;
+    double sumError = 0.0;
+    DWORD cAccepting = 0;
+    DWORD cRejecting = 0;
+    for (DWORD iOffset = 0; iOffset < ARRAYSIZE(rgOffsets); iOffset++)
+    {
+        for (DWORD iRound = 0; iRound < 200; iRound++)
+        {
+            MakeAttempt(&random, 4 + iRound % 30, rgOffsets[iOffset], pTimeline, pFeatures, pTemplate);
+
+            float rgInputs[MLP_FEATURE_INPUTS];
+            BuildMlpInputs(*pFeatures, *pTemplate, rgInputs);
+            double expected = EvaluateMlpReference(reference, rgInputs);
+
+            double probability = -1.0;
+            CHECK(SUCCEEDED(EvaluateTypingMlp(*pFeatures, *pTemplate, &probability)));
+            CHECK(probability > 0.0 && probability < 1.0);
+            CHECK_NEAR(Logit(probability), expected, MLP_LOGIT_TOLERANCE);
+
+            double error = fabs(Logit(probability) - expected);
+            maxError = (error > maxError) ? error : maxError;
+            sumError += error;
+            cAccepting += (expected > Logit(0.9)) ? 1 : 0;
+            cRejecting += (expected < Logit(0.1)) ? 1 : 0;
+        }
+    }
+
+    // The attempts must exercise both ends of the sigmoid
+    DWORD cAttempts = ARRAYSIZE(rgOffsets) * 200;
+    printf("logit |int8 - float|: max %.3f, mean %.3f over %lu attempts (%lu near accept, %lu near reject)\n",
+           maxError, sumError / cAttempts, static_cast<unsigned long>(cAttempts),
+           static_cast<unsigned long>(cAccepting), static_cast<unsigned long>(cRejecting));
+    CHECK(cAccepting > 0 && cRejecting > 0);
+
+    delete pTemplate;
+    delete pFeatures;
+    delete pTimeline;
+}
+
+// A perfect match must score higher than an attempt far from the template
+static void TestOrdering()
+{
+    std::mt19937 random(14);
+    KeystrokeTimeline* pTimeline = new KeystrokeTimeline();
+    TimingFeatureSet* pFeatures = new TimingFeatureSet();
+    TypingTemplate* pTemplate = new TypingTemplate();
+
+    double close = 0.0;
+    double far = 0.0;
+    MakeAttempt(&random, 12, 0.01, pTimeline, pFeatures, pTemplate);
+    CHECK(SUCCEEDED(EvaluateTypingMlp(*pFeatures, *pTemplate, &close)));
+    MakeAttempt(&random, 12, 6.0, pTimeline, pFeatures, pTemplate);
+    CHECK(SUCCEEDED(EvaluateTypingMlp(*pFeatures, *pTemplate, &far)));
+    CHECK(close > far);
+
+    CHECK(EvaluateTypingMlp(*pFeatures, *pTemplate, nullptr) == E_INVALIDARG);
+
+    delete pTemplate;
+    delete pFeatures;
+    delete pTimeline;
+}
+
+int main()
+{
+    RUN_TEST(TestMatchesFloatModel);
+    RUN_TEST(TestOrdering);
+    return TestResult();
+}
@@ -0,0 +1,404 @@
+// PayloadBenchmark: cost and size of the request body sent to the AI model.
+//
+//     PayloadBenchmark [options]
+//
+//     -attempts <n>   Payloads to build per encoder (default 20000)
+//     -length <n>     Keystrokes per attempt (default 12)
+//     -quick          Short run, used by ctest to keep the target building
+//
+// Each encoder builds the body for the same attempt and reports the mean,
+// median and 99th percentile time, the body size and heap allocations per
+// body. CreateJSONPayload (both schemas) and CreateCBORPayload are timed
+// next to the two builders they replaced, reproduced here from the trees
+// they came from: the root provider's CreateJSONString, which streams
+// through a std::wstringstream, and the first cpp2 version, which
+// appends std::wstring pieces. Both of those also convert the result to
+// UTF-8 for WinHttpSendRequest, as their callers did, and are fed raw
+// performance counter ticks at 10 MHz, which is what they sent. The
+// current builders must not allocate; the run fails if they do.
+
+#include "BiometricProfile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::atomic<ULONGLONG> s_cAllocations(0);
+
+void* operator new(size_t cb)
+{
+    s_cAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* pv = malloc(cb ? cb : 1);
+    if (!pv)
+    {
+        throw std::bad_alloc();
+    }
+    return pv;
+}
+
+void* operator new[](size_t cb)
+{
+    return operator new(cb);
+}
+
+void operator delete(void* pv) noexcept
+{
+    free(pv);
+}
+
+void operator delete[](void* pv) noexcept
+{
+    free(pv);
+}
+
+void operator delete(void* pv, size_t) noexcept
+{
+    free(pv);
+}
+
+void operator delete[](void* pv, size_t) noexcept
+{
+    free(pv);
+}
+
+struct BenchmarkOptions
+{
+    DWORD cAttempts;
+    DWORD cKeystrokes;
+};
+
+// The keystroke record both earlier builders read
+struct LegacyKeystroke
+{
+    WCHAR key;
+    LONGLONG keyDownTime;
+    LONGLONG keyUpTime;
+    DWORD position;
+};
+
+struct LegacyProfile
+{
+    std::vector<LegacyKeystroke> keystrokes;
+    std::wstring username;
+    DWORD passwordLength;
+    LONGLONG totalTypingTime;
+};
+
+struct EncoderResult
+{
+    std::vector<LONGLONG> ticks;
+    size_t cbTotal;
+    ULONGLONG cAllocations;
+};
+
+// Performance counter ticks at 10 MHz, some hours after boot
+#define LEGACY_TICK_BASE        123456789012LL
+#define LEGACY_TICKS_PER_US     10
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: PayloadBenchmark [-attempts n] [-length n] [-quick]\n");
+}
+
+static BOOL ParseOptions(int argc, char** argv, BenchmarkOptions* pOptions)
+{
+    pOptions->cAttempts = 20000;
+    pOptions->cKeystrokes = 12;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-quick") == 0)
+        {
+            pOptions->cAttempts = 200;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            return FALSE;
+        }
+
+        const char* pszValue = argv[++i];
+        if (strcmp(argv[i - 1], "-attempts") == 0)
+        {
+            pOptions->cAttempts = static_cast<DWORD>(strtoul(pszValue, nullptr, 10));
+        }
+        else if (strcmp(argv[i - 1], "-length") == 0)
+        {
+            pOptions->cKeystrokes = static_cast<DWORD>(strtoul(pszValue, nullptr, 10));
+        }
+        else
+        {
+            return FALSE;
+        }
+    }
+
+    return pOptions->cAttempts > 0 && pOptions->cKeystrokes > 0 && pOptions->cKeystrokes <= MAX_KEYSTROKE_COUNT;
+}
+
+// 70-130 ms holds, 90-250 ms between presses, over printable ASCII
+static void GenerateProfile(DWORD cKeystrokes, BiometricProfile* pProfile, LegacyProfile* pLegacy)
+{
+    ULONG ulSeed = 0x2545F491;
+    auto next = [&ulSeed](ULONG ulRange) -> ULONG
+    {
+        ulSeed = ulSeed * 1664525 + 1013904223;
+        return (ulSeed >> 8) % ulRange;
+    };
+
+    pProfile->keystrokes.Clear();
+    pLegacy->keystrokes.clear();
+    UINT32 keyDownUs = 0;
+    UINT32 keyUpUs = 0;
+    for (DWORD i = 0; i < cKeystrokes; i++)
+    {
+        WCHAR key = static_cast<WCHAR>(L'!' + next(94));
+        keyUpUs = keyDownUs + 70000 + next(60000);
+        pProfile->keystrokes.Append(key, keyDownUs, keyUpUs, i, 0);
+
+        LegacyKeystroke legacy = { key, LEGACY_TICK_BASE + static_cast<LONGLONG>(keyDownUs) * LEGACY_TICKS_PER_US,
+                                   LEGACY_TICK_BASE + static_cast<LONGLONG>(keyUpUs) * LEGACY_TICKS_PER_US, i };
+        pLegacy->keystrokes.push_back(legacy);
+        keyDownUs += 90000 + next(160000);
+    }
+
+    pProfile->username = L"CONTOSO\\jdoe";
+    pProfile->passwordLength = cKeystrokes;
+    pProfile->totalTypingTime = keyUpUs;
+    ZeroMemory(pProfile->editCounts, sizeof(pProfile->editCounts));
+    pProfile->editCounts[KEK_INSERT] = cKeystrokes;
+    pProfile->keystrokes.GetFeatures(&pProfile->features);
+
+    pLegacy->username = pProfile->username;
+    pLegacy->passwordLength = cKeystrokes;
+    pLegacy->totalTypingTime = static_cast<LONGLONG>(keyUpUs) * LEGACY_TICKS_PER_US;
+}
+
+// Stands in for WideCharToMultiByte(CP_UTF8) in UnicodeToUtf8, with the
+// same sizing pass and the same std::string result
+static std::string WideToUtf8(const std::wstring& str)
+{
+    size_t cb = 0;
+    for (size_t i = 0; i < str.length(); i++)
+    {
+        cb += (str[i] < 0x80) ? 1 : (str[i] < 0x800) ? 2 : 3;
+    }
+
+    std::string result(cb, '\0');
+    size_t j = 0;
+    for (size_t i = 0; i < str.length(); i++)
+    {
+        UINT32 c = str[i];
+        if (c < 0x80)
+        {
+            result[j++] = static_cast<char>(c);
+        }
+        else if (c < 0x800)
+        {
+            result[j++] = static_cast<char>(0xC0 | (c >> 6));
+            result[j++] = static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else
+        {
+            result[j++] = static_cast<char>(0xE0 | (c >> 12));
+            result[j++] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            result[j++] = static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return result;
+}
+
+// The root provider's CreateJSONString
+static size_t BuildRootJson(const LegacyProfile& profile)
+{
+    std::wstringstream json;
+    json << L"{";
+    json << L"\"keystrokes\":[";
+
+    for (size_t i = 0; i < profile.keystrokes.size(); ++i)
+    {
+        const LegacyKeystroke& keystroke = profile.keystrokes[i];
+
+        json << L"{";
+        json << L"\"key\":\"" << keystroke.key << L"\",";
+        json << L"\"keyDownTime\":" << keystroke.keyDownTime << L",";
+        json << L"\"keyUpTime\":" << keystroke.keyUpTime << L",";
+        json << L"\"position\":" << keystroke.position;
+        json << L"}";
+
+        if (i < profile.keystrokes.size() - 1)
+        {
+            json << L",";
+        }
+    }
+
+    json << L"],";
+    json << L"\"passwordLength\":" << profile.passwordLength << L",";
+    json << L"\"totalTypingTime\":" << profile.totalTypingTime;
+    json << L"}";
+
+    std::wstring jsonOutput = json.str();
+    return WideToUtf8(jsonOutput).length();
+}
+
+// The first cpp2 CreateJSONString
+static size_t BuildWstringJson(const LegacyProfile& profile)
+{
+    std::wstring json = L"{";
+    json += L"\"keystrokes\": [";
+
+    for (size_t i = 0; i < profile.keystrokes.size(); ++i)
+    {
+        const LegacyKeystroke& keystroke = profile.keystrokes[i];
+
+        json += L"{";
+        json += L"\"key\": \"" + std::wstring(1, keystroke.key) + L"\",";
+        json += L"\"keyDownTime\": " + std::to_wstring(keystroke.keyDownTime) + L",";
+        json += L"\"keyUpTime\": " + std::to_wstring(keystroke.keyUpTime) + L",";
+        json += L"\"position\": " + std::to_wstring(keystroke.position);
+        json += L"}";
+
+        if (i < profile.keystrokes.size() - 1)
+        {
+            json += L",";
+        }
+    }
+
+    json += L"],";
+    json += L"\"passwordLength\": " + std::to_wstring(profile.passwordLength) + L",";
+    json += L"\"totalTypingTime\": " + std::to_wstring(profile.totalTypingTime) + L",";
+    json += L"\"username\": \"" + profile.username + L"\",";
+    json += L"\"timestamp\": " + std::to_wstring(GetTickCount64());
+    json += L"}";
+
+    return WideToUtf8(json).length();
+}
+
+static LONGLONG ReadTimer()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+template <typename TBuild>
+static HRESULT RunEncoder(const BenchmarkOptions& options, TBuild build, EncoderResult* pResult)
+{
+    pResult->ticks.clear();
+    pResult->ticks.reserve(options.cAttempts);
+    pResult->cbTotal = 0;
+    pResult->cAllocations = 0;
+
+    HRESULT hr = S_OK;
+    for (DWORD i = 0; i < options.cAttempts && SUCCEEDED(hr); i++)
+    {
+        size_t cb = 0;
+        ULONGLONG cAllocationsBefore = s_cAllocations.load(std::memory_order_relaxed);
+        LONGLONG start = ReadTimer();
+        hr = build(&cb);
+        LONGLONG end = ReadTimer();
+        pResult->cAllocations += s_cAllocations.load(std::memory_order_relaxed) - cAllocationsBefore;
+
+        pResult->ticks.push_back(end - start);
+        pResult->cbTotal += cb;
+    }
+
+    return hr;
+}
+
+static void Report(const char* pszEncoder, EncoderResult* pResult, DWORD cAttempts)
+{
+    LARGE_INTEGER timerFrequency;
+    QueryPerformanceFrequency(&timerFrequency);
+    double nsPerTick = 1e9 / static_cast<double>(timerFrequency.QuadPart);
+
+    std::vector<LONGLONG>& ticks = pResult->ticks;
+    LONGLONG llTotal = 0;
+    for (size_t i = 0; i < ticks.size(); i++)
+    {
+        llTotal += ticks[i];
+    }
+
+    std::sort(ticks.begin(), ticks.end());
+    printf("%-18s mean %8.1f ns  p50 %8.1f ns  p99 %8.1f ns  %6.0f bytes  %5.1f allocations\n", pszEncoder,
+           static_cast<double>(llTotal) * nsPerTick / static_cast<double>(ticks.size()),
+           static_cast<double>(ticks[(ticks.size() - 1) / 2]) * nsPerTick,
+           static_cast<double>(ticks[(ticks.size() - 1) * 99 / 100]) * nsPerTick,
+           static_cast<double>(pResult->cbTotal) / cAttempts,
+           static_cast<double>(pResult->cAllocations) / cAttempts);
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, &options))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    static BiometricProfile profile;
+    LegacyProfile legacy;
+    GenerateProfile(options.cKeystrokes, &profile, &legacy);
+    std::vector<char> buffer(JSON_PAYLOAD_CAPACITY);
+    printf("%lu payloads of %lu keystrokes\n", static_cast<unsigned long>(options.cAttempts),
+           static_cast<unsigned long>(options.cKeystrokes));
+
+    EncoderResult result;
+    HRESULT hr = RunEncoder(options, [&](size_t* pcb) { *pcb = BuildRootJson(legacy); return S_OK; }, &result);
+    Report("root wstringstream", &result, options.cAttempts);
+
+    hr = RunEncoder(options, [&](size_t* pcb) { *pcb = BuildWstringJson(legacy); return S_OK; }, &result);
+    Report("cpp2 wstring", &result, options.cAttempts);
+
+    // The builders the credential runs, into its preallocated buffer
+    static const struct
+    {
+        const char* pszName;
+        DWORD dwSchema;
+    } rgSchemas[] =
+    {
+        { "json schema 1", PAYLOAD_SCHEMA_OBJECTS },
+        { "json schema 2", PAYLOAD_SCHEMA_COLUMNAR },
+    };
+
+    BOOL fAllocated = FALSE;
+    for (DWORD s = 0; s < ARRAYSIZE(rgSchemas) && SUCCEEDED(hr); s++)
+    {
+        hr = RunEncoder(options, [&](size_t* pcb)
+        {
+            return CreateJSONPayload(profile, rgSchemas[s].dwSchema, buffer.data(), buffer.size(), pcb);
+        }, &result);
+        Report(rgSchemas[s].pszName, &result, options.cAttempts);
+        fAllocated = fAllocated || (result.cAllocations > 0);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = RunEncoder(options, [&](size_t* pcb)
+        {
+            return CreateCBORPayload(profile, reinterpret_cast<BYTE*>(buffer.data()), buffer.size(), pcb);
+        }, &result);
+        Report("cbor", &result, options.cAttempts);
+        fAllocated = fAllocated || (result.cAllocations > 0);
+    }
+
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Building the payload failed (0x%08x)\n", static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    if (fAllocated)
+    {
+        fprintf(stderr, "The payload builders allocated\n");
+        return 1;
+    }
+
+    return 0;
+}
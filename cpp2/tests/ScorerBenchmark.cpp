@@ -0,0 +1,524 @@
+// ScorerBenchmark: latency of the local scoring models on one attempt.
+//
+//     ScorerBenchmark [options]
+//
+//     -attempts <n>   Attempts to score (default 20000)
+//     -length <n>     Keystrokes per attempt (default 12)
+//     -trees <n>      Trees in the synthetic ensemble; 0 runs 100, 300
+//                     and 1000 (default)
+//     -depth <n>      Depth of every tree (default 6)
+//     -quick          Short run, used by ctest to keep the target building
+//
+// Attempts are synthetic timelines scored against a template near them,
+// with the features already extracted, so the numbers are the model alone.
+// Each model reports the mean, median and 99th percentile per attempt.
+// Tree ensembles are also walked node by node through child indices, as
+// a straightforward implementation would, for comparison, and the int8
+// verifier is timed against a float forward pass over mlp-model.json, the
+// model it was quantized from. Feature extraction is timed on its own,
+// once per instruction set the CPU has and once through the length
+// buckets, and the distance kernels through the buckets and as plain
+// loops; past 64 keystrokes both take the plain loops.
+
+#include "BucketKernels.h"
+#include "MlpScorer.h"
+#include "MlpReference.h"
+#include "TreeEnsemble.h"
+#include "TypingScorer.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define BENCHMARK_MODEL_PATH            "ScorerBenchmark.model"
+
+struct BenchmarkOptions
+{
+    DWORD cAttempts;
+    DWORD cKeystrokes;
+    DWORD cTrees;
+    DWORD dwTreeDepth;
+};
+
+// Attempts are generated up front and scored round robin
+#define BENCHMARK_DISTINCT_ATTEMPTS     64
+
+struct BenchmarkAttempt
+{
+    KeystrokeTimeline timeline;
+    TimingFeatureSet features;
+    TypingTemplate typingTemplate;
+    float rgInputs[MLP_FEATURE_INPUTS];
+};
+
+struct BenchmarkNode
+{
+    int feature;            // -1 for a leaf
+    float value;            // Threshold, or leaf value
+    int left;
+    int right;
+};
+
+typedef std::vector<BenchmarkNode> BenchmarkTree;
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: ScorerBenchmark [-attempts n] [-length n] [-trees n] [-depth n] [-quick]\n");
+}
+
+static BOOL ParseOptions(int argc, char** argv, BenchmarkOptions* pOptions)
+{
+    pOptions->cAttempts = 20000;
+    pOptions->cKeystrokes = 12;
+    pOptions->cTrees = 0;
+    pOptions->dwTreeDepth = 6;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-quick") == 0)
+        {
+            pOptions->cAttempts = 200;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            return FALSE;
+        }
+
+        const char* pszValue = argv[++i];
+        if (strcmp(argv[i - 1], "-attempts") == 0)
+        {
+            pOptions->cAttempts = static_cast<DWORD>(strtoul(pszValue, nullptr, 10));
+        }
+        else if (strcmp(argv[i - 1], "-length") == 0)
+        {
+            pOptions->cKeystrokes = static_cast<DWORD>(strtoul(pszValue, nullptr, 10));
+        }
+        else if (strcmp(argv[i - 1], "-trees") == 0)
+        {
+            pOptions->cTrees = static_cast<DWORD>(strtoul(pszValue, nullptr, 10));
+        }
+        else if (strcmp(argv[i - 1], "-depth") == 0)
+        {
+            pOptions->dwTreeDepth = static_cast<DWORD>(strtoul(pszValue, nullptr, 10));
+        }
+        else
+        {
+            return FALSE;
+        }
+    }
+
+    return pOptions->cAttempts > 0 &&
+           pOptions->cKeystrokes > 1 && pOptions->cKeystrokes <= MAX_KEYSTROKE_COUNT &&
+           pOptions->dwTreeDepth > 0 && pOptions->dwTreeDepth <= TREE_ENSEMBLE_MAX_DEPTH;
+}
+
+// 70-130 ms holds, 90-250 ms between presses; the template sits within a
+// spread or so of each attempt
+static void GenerateAttempts(DWORD cKeystrokes, std::vector<BenchmarkAttempt>* pAttempts)
+{
+    ULONG ulSeed = 0x2545F491;
+    auto next = [&ulSeed](ULONG ulRange) -> ULONG
+    {
+        ulSeed = ulSeed * 1664525 + 1013904223;
+        return (ulSeed >> 8) % ulRange;
+    };
+
+    for (size_t a = 0; a < pAttempts->size(); a++)
+    {
+        BenchmarkAttempt& attempt = (*pAttempts)[a];
+        KeystrokeTimeline* pTimeline = &attempt.timeline;
+
+        ZeroMemory(pTimeline, sizeof(*pTimeline));
+        UINT32 keyDownUs = 0;
+        for (DWORD i = 0; i < cKeystrokes; i++)
+        {
+            pTimeline->keyDownUs[i] = keyDownUs;
+            pTimeline->keyUpUs[i] = keyDownUs + 70000 + next(60000);
+            keyDownUs += 90000 + next(160000);
+        }
+        pTimeline->count = cKeystrokes;
+        ExtractTimingFeatures(*pTimeline, &attempt.features);
+
+        ZeroMemory(&attempt.typingTemplate, sizeof(attempt.typingTemplate));
+        attempt.typingTemplate.keystrokeCount = cKeystrokes;
+        for (DWORD f = 0; f < TF_NUM_FEATURES; f++)
+        {
+            for (DWORD i = 0; i < attempt.features.stats[f].count; i++)
+            {
+                float stdDev = 10000.0f + next(20000);
+                attempt.typingTemplate.stdDev[f][i] = stdDev;
+                attempt.typingTemplate.meanAbsDeviation[f][i] = stdDev * 0.8f;
+                attempt.typingTemplate.mean[f][i] = attempt.features.values[f][i] +
+                                                    (static_cast<float>(next(2001)) - 1000.0f) * stdDev / 1000.0f;
+            }
+        }
+
+        BuildMlpInputs(attempt.features, attempt.typingTemplate, attempt.rgInputs);
+    }
+}
+
+static LONGLONG ReadTimer()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+static void Report(const char* pszModel, std::vector<LONGLONG>* pTicks, double checksum)
+{
+    LARGE_INTEGER timerFrequency;
+    QueryPerformanceFrequency(&timerFrequency);
+    double nsPerTick = 1e9 / static_cast<double>(timerFrequency.QuadPart);
+
+    LONGLONG llTotal = 0;
+    for (size_t i = 0; i < pTicks->size(); i++)
+    {
+        llTotal += (*pTicks)[i];
+    }
+
+    std::sort(pTicks->begin(), pTicks->end());
+    printf("%-16s mean %8.1f ns  p50 %8.1f ns  p99 %8.1f ns  (checksum %.6f)\n", pszModel,
+           static_cast<double>(llTotal) * nsPerTick / static_cast<double>(pTicks->size()),
+           static_cast<double>((*pTicks)[(pTicks->size() - 1) / 2]) * nsPerTick,
+           static_cast<double>((*pTicks)[(pTicks->size() - 1) * 99 / 100]) * nsPerTick,
+           checksum);
+}
+
+// Feature extraction from the timeline, on each instruction set up to the
+// one the CPU has
+static HRESULT BenchmarkFeatures(const BenchmarkOptions& options, const std::vector<BenchmarkAttempt>& attempts)
+{
+    static const struct
+    {
+        FEATURE_KERNEL_ISA isa;
+        const char* pszName;
+    } rgIsas[] =
+    {
+        { FKI_SCALAR, "extract scalar" },
+        { FKI_SSE41, "extract sse4.1" },
+        { FKI_AVX2, "extract avx2" }
+    };
+
+    TimingFeatureSet* pFeatures = new TimingFeatureSet();
+    HRESULT hr = S_OK;
+    for (DWORD k = 0; k < ARRAYSIZE(rgIsas) && rgIsas[k].isa <= GetFeatureKernelIsa() && SUCCEEDED(hr); k++)
+    {
+        std::vector<LONGLONG> ticks;
+        ticks.reserve(options.cAttempts);
+        double checksum = 0.0;
+
+        for (DWORD i = 0; i < options.cAttempts && SUCCEEDED(hr); i++)
+        {
+            const BenchmarkAttempt& attempt = attempts[i % attempts.size()];
+
+            LONGLONG start = ReadTimer();
+            hr = ExtractTimingFeaturesWith(rgIsas[k].isa, attempt.timeline, pFeatures);
+            ticks.push_back(ReadTimer() - start);
+
+            checksum += pFeatures->stats[TF_DWELL].stdDev + pFeatures->stats[TF_DOWN_DOWN].mean;
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            Report(rgIsas[k].pszName, &ticks, checksum / options.cAttempts);
+        }
+    }
+
+    // What the credential runs: the length buckets up to 16 keys
+    std::vector<LONGLONG> ticks;
+    ticks.reserve(options.cAttempts);
+    double checksum = 0.0;
+    for (DWORD i = 0; i < options.cAttempts && SUCCEEDED(hr); i++)
+    {
+        const BenchmarkAttempt& attempt = attempts[i % attempts.size()];
+
+        LONGLONG start = ReadTimer();
+        hr = ExtractTimingFeatures(attempt.timeline, pFeatures);
+        ticks.push_back(ReadTimer() - start);
+
+        checksum += pFeatures->stats[TF_DWELL].stdDev + pFeatures->stats[TF_DOWN_DOWN].mean;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        Report("extract bucket", &ticks, checksum / options.cAttempts);
+    }
+
+    delete pFeatures;
+    return hr;
+}
+
+// Scaled Manhattan and Mahalanobis sums over every feature, through the
+// length buckets and as the plain loops longer passwords take
+static void BenchmarkDistances(const BenchmarkOptions& options, const std::vector<BenchmarkAttempt>& attempts)
+{
+    std::vector<LONGLONG> bucketTicks;
+    std::vector<LONGLONG> genericTicks;
+    bucketTicks.reserve(options.cAttempts);
+    genericTicks.reserve(options.cAttempts);
+    double bucketChecksum = 0.0;
+    double genericChecksum = 0.0;
+
+    for (DWORD i = 0; i < options.cAttempts; i++)
+    {
+        const BenchmarkAttempt& attempt = attempts[i % attempts.size()];
+        const TimingFeatureSet& features = attempt.features;
+        const TypingTemplate& typingTemplate = attempt.typingTemplate;
+
+        LONGLONG start = ReadTimer();
+        double bucket = 0.0;
+        for (DWORD f = 0; f < TF_NUM_FEATURES; f++)
+        {
+            DWORD c = features.stats[f].count;
+            bucket += ScaledAbsoluteDeviation(features.values[f], typingTemplate.mean[f], typingTemplate.meanAbsDeviation[f],
+                                              TYPING_TEMPLATE_MIN_SPREAD_US, c);
+            bucket += SquaredZ(features.values[f], typingTemplate.mean[f], typingTemplate.stdDev[f],
+                               TYPING_TEMPLATE_MIN_SPREAD_US, c);
+        }
+        LONGLONG middle = ReadTimer();
+        double generic = 0.0;
+        for (DWORD f = 0; f < TF_NUM_FEATURES; f++)
+        {
+            DWORD c = features.stats[f].count;
+            generic += ScaledAbsoluteDeviationGeneric(features.values[f], typingTemplate.mean[f],
+                                                      typingTemplate.meanAbsDeviation[f], TYPING_TEMPLATE_MIN_SPREAD_US, c);
+            generic += SquaredZGeneric(features.values[f], typingTemplate.mean[f], typingTemplate.stdDev[f],
+                                       TYPING_TEMPLATE_MIN_SPREAD_US, c);
+        }
+        LONGLONG end = ReadTimer();
+
+        bucketTicks.push_back(middle - start);
+        genericTicks.push_back(end - middle);
+        bucketChecksum += bucket;
+        genericChecksum += generic;
+    }
+
+    Report("distance bucket", &bucketTicks, bucketChecksum / options.cAttempts);
+    Report("distance generic", &genericTicks, genericChecksum / options.cAttempts);
+}
+
+// The quantized verifier, including the distance inputs it builds from
+// the template, then the float network it was quantized from on the same
+// inputs. The checksums differ by the quantization error.
+static HRESULT BenchmarkMlp(const BenchmarkOptions& options, const std::vector<BenchmarkAttempt>& attempts)
+{
+    std::vector<LONGLONG> ticks;
+    ticks.reserve(options.cAttempts);
+    double checksum = 0.0;
+
+    for (DWORD i = 0; i < options.cAttempts; i++)
+    {
+        const BenchmarkAttempt& attempt = attempts[i % attempts.size()];
+        double probability = 0.0;
+
+        LONGLONG start = ReadTimer();
+        HRESULT hr = EvaluateTypingMlp(attempt.features, attempt.typingTemplate, &probability);
+        ticks.push_back(ReadTimer() - start);
+
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        checksum += probability;
+    }
+
+    Report("mlp int8", &ticks, checksum / options.cAttempts);
+
+    MlpReference reference;
+    if (!LoadMlpReference(MLP_MODEL_PATH, &reference))
+    {
+        printf("mlp float        skipped, cannot read %s\n", MLP_MODEL_PATH);
+        return S_OK;
+    }
+
+    ticks.clear();
+    checksum = 0.0;
+    for (DWORD i = 0; i < options.cAttempts; i++)
+    {
+        const BenchmarkAttempt& attempt = attempts[i % attempts.size()];
+        float rgInputs[MLP_FEATURE_INPUTS];
+
+        LONGLONG start = ReadTimer();
+        BuildMlpInputs(attempt.features, attempt.typingTemplate, rgInputs);
+        double probability = 1.0 / (1.0 + exp(-EvaluateMlpReference(reference, rgInputs)));
+        ticks.push_back(ReadTimer() - start);
+
+        checksum += probability;
+    }
+
+    Report("mlp float", &ticks, checksum / options.cAttempts);
+    return S_OK;
+}
+
+// Full trees over the verifier inputs, with thresholds in the range the
+// distances take and small leaf values, as boosting produces
+static int GrowTree(ULONG* pulSeed, BenchmarkTree* pTree, DWORD dwDepth, DWORD dwMaxDepth)
+{
+    auto next = [pulSeed](ULONG ulRange) -> ULONG
+    {
+        *pulSeed = *pulSeed * 1664525 + 1013904223;
+        return (*pulSeed >> 8) % ulRange;
+    };
+
+    int iNode = static_cast<int>(pTree->size());
+    pTree->push_back(BenchmarkNode());
+    if (dwDepth == dwMaxDepth)
+    {
+        BenchmarkNode leaf = { -1, (static_cast<float>(next(2001)) - 1000.0f) / 10000.0f, -1, -1 };
+        (*pTree)[iNode] = leaf;
+        return iNode;
+    }
+
+    int feature = static_cast<int>(next(MLP_FEATURE_INPUTS));
+    float threshold = static_cast<float>(next(4001)) / 1000.0f;
+    int left = GrowTree(pulSeed, pTree, dwDepth + 1, dwMaxDepth);
+    int right = GrowTree(pulSeed, pTree, dwDepth + 1, dwMaxDepth);
+    BenchmarkNode split = { feature, threshold, left, right };
+    (*pTree)[iNode] = split;
+    return iNode;
+}
+
+// Writes the trees in the model file format and loads them back
+static HRESULT BuildEnsemble(const std::vector<BenchmarkTree>& trees, TreeEnsemble* pEnsemble)
+{
+    FILE* pFile = fopen(BENCHMARK_MODEL_PATH, "w");
+    if (!pFile)
+    {
+        return E_FAIL;
+    }
+
+    fprintf(pFile, "E %d 0\n", MLP_FEATURE_INPUTS);
+    for (size_t t = 0; t < trees.size(); t++)
+    {
+        fprintf(pFile, "T\n");
+        for (size_t n = 0; n < trees[t].size(); n++)
+        {
+            const BenchmarkNode& node = trees[t][n];
+            if (node.feature < 0)
+            {
+                fprintf(pFile, "L %zu %.9g\n", n, node.value);
+            }
+            else
+            {
+                fprintf(pFile, "N %zu %d %.9g %d %d\n", n, node.feature, node.value, node.left, node.right);
+            }
+        }
+    }
+    fclose(pFile);
+
+    HRESULT hr = pEnsemble->Load(L"" BENCHMARK_MODEL_PATH);
+    remove(BENCHMARK_MODEL_PATH);
+    return hr;
+}
+
+static float EvaluateNodeWalk(const std::vector<BenchmarkTree>& trees, const float* pInputs)
+{
+    float sum = 0.0f;
+    for (size_t t = 0; t < trees.size(); t++)
+    {
+        const BenchmarkNode* rgNodes = trees[t].data();
+        int iNode = 0;
+        while (rgNodes[iNode].feature >= 0)
+        {
+            iNode = (pInputs[rgNodes[iNode].feature] > rgNodes[iNode].value) ? rgNodes[iNode].right : rgNodes[iNode].left;
+        }
+        sum += rgNodes[iNode].value;
+    }
+    return sum;
+}
+
+static HRESULT BenchmarkTrees(const BenchmarkOptions& options, const std::vector<BenchmarkAttempt>& attempts, DWORD cTrees)
+{
+    ULONG ulSeed = 0x9E3779B9 + cTrees;
+    std::vector<BenchmarkTree> trees(cTrees);
+    for (DWORD t = 0; t < cTrees; t++)
+    {
+        GrowTree(&ulSeed, &trees[t], 0, options.dwTreeDepth);
+    }
+
+    TreeEnsemble* pEnsemble = new TreeEnsemble();
+    HRESULT hr = BuildEnsemble(trees, pEnsemble);
+    if (FAILED(hr))
+    {
+        delete pEnsemble;
+        return hr;
+    }
+
+    std::vector<LONGLONG> flatTicks;
+    std::vector<LONGLONG> walkTicks;
+    flatTicks.reserve(options.cAttempts);
+    walkTicks.reserve(options.cAttempts);
+    double flatChecksum = 0.0;
+    double walkChecksum = 0.0;
+
+    for (DWORD i = 0; i < options.cAttempts; i++)
+    {
+        const float* pInputs = attempts[i % attempts.size()].rgInputs;
+
+        LONGLONG start = ReadTimer();
+        float flat = pEnsemble->Evaluate(pInputs);
+        LONGLONG middle = ReadTimer();
+        float walk = EvaluateNodeWalk(trees, pInputs);
+        LONGLONG end = ReadTimer();
+
+        flatTicks.push_back(middle - start);
+        walkTicks.push_back(end - middle);
+        flatChecksum += flat;
+        walkChecksum += walk;
+    }
+
+    char szName[32];
+    snprintf(szName, sizeof(szName), "trees %lu", static_cast<unsigned long>(cTrees));
+    Report(szName, &flatTicks, flatChecksum / options.cAttempts);
+    snprintf(szName, sizeof(szName), "  node walk");
+    Report(szName, &walkTicks, walkChecksum / options.cAttempts);
+
+    delete pEnsemble;
+    return S_OK;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, &options))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    std::vector<BenchmarkAttempt> attempts(BENCHMARK_DISTINCT_ATTEMPTS);
+    GenerateAttempts(options.cKeystrokes, &attempts);
+    printf("%lu attempts of %lu keystrokes, trees of depth %lu\n", static_cast<unsigned long>(options.cAttempts),
+           static_cast<unsigned long>(options.cKeystrokes), static_cast<unsigned long>(options.dwTreeDepth));
+
+    HRESULT hr = BenchmarkFeatures(options, attempts);
+    if (SUCCEEDED(hr))
+    {
+        BenchmarkDistances(options, attempts);
+        hr = BenchmarkMlp(options, attempts);
+    }
+
+    DWORD rgTreeCounts[] = { 100, 300, 1000 };
+    if (options.cTrees > 0)
+    {
+        rgTreeCounts[0] = options.cTrees;
+    }
+    DWORD cTreeCounts = (options.cTrees > 0) ? 1 : ARRAYSIZE(rgTreeCounts);
+    for (DWORD i = 0; i < cTreeCounts && SUCCEEDED(hr); i++)
+    {
+        hr = BenchmarkTrees(options, attempts, rgTreeCounts[i]);
+    }
+
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Scoring failed (0x%08x)\n", static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+// Minimal test harness: each test file is its own executable with a list
+// of test functions; CHECK records a failure and carries on.
+//
+//     static void TestSomething() { CHECK(x == 1); }
+//     int main() { RUN_TEST(TestSomething); return TestResult(); }
+
+#include <stdio.h>
+
+static int s_cTestFailures = 0;
+
+#define CHECK(expr) \
+    do \
+    { \
+        if (!(expr)) \
+        { \
+            fprintf(stderr, "%s(%d): CHECK failed: %s\n", __FILE__, __LINE__, #expr); \
+            s_cTestFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tolerance) \
+    do \
+    { \
+        double checkA = static_cast<double>(a); \
+        double checkB = static_cast<double>(b); \
+        if (!(checkA - checkB <= (tolerance) && checkB - checkA <= (tolerance))) \
+        { \
+            fprintf(stderr, "%s(%d): CHECK_NEAR failed: %s = %g, %s = %g\n", \
+                    __FILE__, __LINE__, #a, checkA, #b, checkB); \
+            s_cTestFailures++; \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) \
+    do \
+    { \
+        int cFailuresBefore = s_cTestFailures; \
+        test(); \
+        printf("%s %s\n", (s_cTestFailures == cFailuresBefore) ? "PASS" : "FAIL", #test); \
+    } while (0)
+
+inline int TestResult()
+{
+    return (s_cTestFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+// TreeEnsemble: the flattened branch-free walk against a plain pointer walk
+// of the trees as listed in the model file, and rejection of bad files
+
+#include "TreeEnsemble.h"
+#include "TestHarness.h"
+#include <stdio.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#define TEST_MODEL_PATH         "TreeEnsembleTests.model"
+#define TEST_FEATURE_COUNT      16
+
+struct TestNode
+{
+    int feature;            // -1 for a leaf
+    float value;            // Threshold, or leaf value
+    int left;
+    int right;
+};
+
+typedef std::vector<TestNode> TestTree;
+
+struct TestEnsemble
+{
+    float baseScore;
+    std::vector<TestTree> trees;
+};
+
+// Ragged trees: leaves turn up at every level, so the loader has to pad
+// early leaves out to the full depth
+static int GrowNode(std::mt19937* pRandom, TestTree* pTree, DWORD dwDepth, DWORD dwMaxDepth)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    int iNode = static_cast<int>(pTree->size());
+    pTree->push_back(TestNode());
+
+    if (dwDepth == dwMaxDepth || (dwDepth > 0 && (*pRandom)() % 4 == 0))
+    {
+        TestNode leaf = { -1, unit(*pRandom), -1, -1 };
+        (*pTree)[iNode] = leaf;
+        return iNode;
+    }
+
+    int feature = static_cast<int>((*pRandom)() % TEST_FEATURE_COUNT);
+    float threshold = unit(*pRandom) * 4.0f;
+    int left = GrowNode(pRandom, pTree, dwDepth + 1, dwMaxDepth);
+    int right = GrowNode(pRandom, pTree, dwDepth + 1, dwMaxDepth);
+    TestNode split = { feature, threshold, left, right };
+    (*pTree)[iNode] = split;
+    return iNode;
+}
+
+static void GrowEnsemble(std::mt19937* pRandom, DWORD cTrees, DWORD dwMaxDepth, TestEnsemble* pEnsemble)
+{
+    pEnsemble->baseScore = -0.25f;
+    pEnsemble->trees.assign(cTrees, TestTree());
+    for (DWORD t = 0; t < cTrees; t++)
+    {
+        GrowNode(pRandom, &pEnsemble->trees[t], 0, 1 + (*pRandom)() % dwMaxDepth);
+    }
+}
+
+// Nodes are written last to first; the format does not require any order
+static std::string FormatEnsemble(const TestEnsemble& ensemble)
+{
+    std::string text;
+    char szLine[128];
+    snprintf(szLine, sizeof(szLine), "E %d %.9g\n", TEST_FEATURE_COUNT, ensemble.baseScore);
+    text += szLine;
+
+    for (size_t t = 0; t < ensemble.trees.size(); t++)
+    {
+        const TestTree& tree = ensemble.trees[t];
+        text += "T\n";
+        for (size_t n = tree.size(); n-- > 0; )
+        {
+            const TestNode& node = tree[n];
+            if (node.feature < 0)
+            {
+                snprintf(szLine, sizeof(szLine), "L %zu %.9g\n", n, node.value);
+            }
+            else
+            {
+                snprintf(szLine, sizeof(szLine), "N %zu %d %.9g %d %d\n", n, node.feature, node.value, node.left, node.right);
+            }
+            text += szLine;
+        }
+    }
+    return text;
+}
+
+static HRESULT LoadText(TreeEnsemble* pEnsemble, const std::string& text)
+{
+    FILE* pFile = fopen(TEST_MODEL_PATH, "wb");
+    if (!pFile)
+    {
+        return E_FAIL;
+    }
+    fwrite(text.data(), 1, text.size(), pFile);
+    fclose(pFile);
+
+    HRESULT hr = pEnsemble->Load(L"" TEST_MODEL_PATH);
+    remove(TEST_MODEL_PATH);
+    return hr;
+}
+
+static double EvaluateNaive(const TestEnsemble& ensemble, const float* pFeatures)
+{
+    double sum = ensemble.baseScore;
+    for (size_t t = 0; t < ensemble.trees.size(); t++)
+    {
+        const TestTree& tree = ensemble.trees[t];
+        int iNode = 0;
+        while (tree[iNode].feature >= 0)
+        {
+            iNode = (pFeatures[tree[iNode].feature] > tree[iNode].value) ? tree[iNode].right : tree[iNode].left;
+        }
+        sum += tree[iNode].value;
+    }
+    return sum;
+}
+
+// Samples mix random values with the thresholds themselves, so ties take
+// the left branch in both walks
+static void MakeSample(std::mt19937* pRandom, const TestEnsemble& ensemble, float* pFeatures)
+{
+    std::uniform_real_distribution<float> value(-5.0f, 5.0f);
+    for (DWORD f = 0; f < TEST_FEATURE_COUNT; f++)
+    {
+        pFeatures[f] = value(*pRandom);
+        if ((*pRandom)() % 4 == 0)
+        {
+            const TestTree& tree = ensemble.trees[(*pRandom)() % ensemble.trees.size()];
+            const TestNode& node = tree[(*pRandom)() % tree.size()];
+            if (node.feature >= 0)
+            {
+                pFeatures[node.feature] = node.value;
+            }
+        }
+    }
+}
+
+static void TestMatchesNaiveWalk()
+{
+    std::mt19937 random(14);
+    DWORD rgTreeCounts[] = { 1, 3, 4, 7, 100, 1000 };
+    DWORD rgMaxDepths[] = { 1, 3, 6, TREE_ENSEMBLE_MAX_DEPTH };
+
+    for (DWORD iCount = 0; iCount < ARRAYSIZE(rgTreeCounts); iCount++)
+    {
+        for (DWORD iDepth = 0; iDepth < ARRAYSIZE(rgMaxDepths); iDepth++)
+        {
+            TestEnsemble reference;
+            GrowEnsemble(&random, rgTreeCounts[iCount], rgMaxDepths[iDepth], &reference);
+
+            TreeEnsemble ensemble;
+            CHECK(SUCCEEDED(LoadText(&ensemble, FormatEnsemble(reference))));
+            CHECK(ensemble.GetTreeCount() == rgTreeCounts[iCount]);
+            CHECK(ensemble.GetFeatureCount() == TEST_FEATURE_COUNT);
+            if (!ensemble.IsLoaded())
+            {
+                continue;
+            }
+
+            for (DWORD iSample = 0; iSample < 200; iSample++)
+            {
+                float rgFeatures[TEST_FEATURE_COUNT];
+                MakeSample(&random, reference, rgFeatures);
+
+                // Float sums in a different order, over at most 1000 leaves in [-1, 1]
+                double expected = EvaluateNaive(reference, rgFeatures);
+                CHECK_NEAR(ensemble.Evaluate(rgFeatures), expected, 1e-3);
+            }
+        }
+    }
+}
+
+static void TestRejectsBadModels()
+{
+    const char* rgpszModels[] =
+    {
+        // No header
+        "T\nN 0 0 0.5 1 2\nL 1 1\nL 2 2\n",
+        // Feature out of range
+        "E 2 0\nT\nN 0 2 0.5 1 2\nL 1 1\nL 2 2\n",
+        // Child that was never listed
+        "E 2 0\nT\nN 0 0 0.5 1 3\nL 1 1\nL 2 2\n",
+        // Node listed twice
+        "E 2 0\nT\nN 0 0 0.5 1 2\nL 1 1\nL 1 2\n",
+        // Cycle back to the root
+        "E 2 0\nT\nN 0 0 0.5 0 1\nL 1 1\n",
+        // No trees
+        "E 2 0\n",
+    };
+
+    for (DWORD i = 0; i < ARRAYSIZE(rgpszModels); i++)
+    {
+        TreeEnsemble ensemble;
+        HRESULT hr = LoadText(&ensemble, rgpszModels[i]);
+        if (hr != HRESULT_FROM_WIN32(ERROR_INVALID_DATA))
+        {
+            fprintf(stderr, "model %lu loaded as 0x%08x\n", static_cast<unsigned long>(i), static_cast<unsigned int>(hr));
+        }
+        CHECK(hr == HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+        CHECK(!ensemble.IsLoaded());
+    }
+
+    // A tree deeper than the flattened layout allows
+    std::string deep = "E 1 0\nT\n";
+    char szLine[64];
+    for (DWORD d = 0; d <= TREE_ENSEMBLE_MAX_DEPTH; d++)
+    {
+        snprintf(szLine, sizeof(szLine), "N %lu 0 0.5 %lu %lu\n", static_cast<unsigned long>(2 * d),
+                 static_cast<unsigned long>(2 * d + 1), static_cast<unsigned long>(2 * d + 2));
+        deep += szLine;
+        snprintf(szLine, sizeof(szLine), "L %lu 1\n", static_cast<unsigned long>(2 * d + 1));
+        deep += szLine;
+    }
+    snprintf(szLine, sizeof(szLine), "L %lu 1\n", static_cast<unsigned long>(2 * TREE_ENSEMBLE_MAX_DEPTH + 2));
+    deep += szLine;
+
+    TreeEnsemble ensemble;
+    CHECK(LoadText(&ensemble, deep) == HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    CHECK(FAILED(ensemble.Load(L"missing.model")));
+}
+
+int main()
+{
+    RUN_TEST(TestMatchesNaiveWalk);
+    RUN_TEST(TestRejectsBadModels);
+    return TestResult();
+}
@@ -0,0 +1,230 @@
+// TypingFeatureAccumulator, driven through KeystrokeBuffer as the capture
+// path drives it, against a full recompute over the surviving keystrokes
+
+#include "KeystrokeBuffer.h"
+#include "TestHarness.h"
+#include <math.h>
+#include <vector>
+
+// Random edit sequences per seed, and edits in each
+#define RANDOM_SEQUENCES        50
+#define RANDOM_EDITS            400
+
+// The field is cleared, as after a failed logon, once it grows this long
+#define RANDOM_MAX_LENGTH       48
+
+struct Recomputed
+{
+    DWORD keystrokeCount;
+    double dwellMean;
+    double dwellStdDev;
+    double upDownMean;
+    double upDownStdDev;
+    double downDownMean;
+    double downDownStdDev;
+    DWORD pauseCount;
+    LONGLONG totalTypingTimeUs;
+};
+
+static void MeanAndStdDev(const std::vector<double>& values, double* pMean, double* pStdDev)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        sum += values[i];
+    }
+    *pMean = values.empty() ? 0.0 : sum / values.size();
+
+    double squares = 0.0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        squares += (values[i] - *pMean) * (values[i] - *pMean);
+    }
+    *pStdDev = (values.size() > 1) ? sqrt(squares / (values.size() - 1)) : 0.0;
+}
+
+// Every feature from scratch, over the timeline as it stands
+static void Recompute(const KeystrokeTimeline& timeline, DWORD cEntries, Recomputed* pResult)
+{
+    std::vector<double> dwells;
+    std::vector<double> upDowns;
+    std::vector<double> downDowns;
+    pResult->pauseCount = 0;
+
+    for (DWORD i = 0; i < cEntries; i++)
+    {
+        dwells.push_back(static_cast<double>(timeline.keyUpUs[i]) - timeline.keyDownUs[i]);
+        if (i + 1 < cEntries)
+        {
+            double downDown = static_cast<double>(timeline.keyDownUs[i + 1]) - timeline.keyDownUs[i];
+            upDowns.push_back(static_cast<double>(timeline.keyDownUs[i + 1]) - timeline.keyUpUs[i]);
+            downDowns.push_back(downDown);
+            if (downDown > TYPING_PAUSE_THRESHOLD_US)
+            {
+                pResult->pauseCount++;
+            }
+        }
+    }
+
+    pResult->keystrokeCount = cEntries;
+    MeanAndStdDev(dwells, &pResult->dwellMean, &pResult->dwellStdDev);
+    MeanAndStdDev(upDowns, &pResult->upDownMean, &pResult->upDownStdDev);
+    MeanAndStdDev(downDowns, &pResult->downDownMean, &pResult->downDownStdDev);
+
+    LONGLONG total = (cEntries > 0) ?
+        static_cast<LONGLONG>(timeline.keyUpUs[cEntries - 1]) - timeline.keyDownUs[0] : 0;
+    pResult->totalTypingTimeUs = (total > 0) ? total : 0;
+}
+
+// Values are added and taken back out in a different order than the
+// recompute sums them, so the two round differently. Means agree to a
+// hundredth of a microsecond. A spread's rounding residue is square-rooted,
+// which makes it largest when the true spread is zero; a tenth of a
+// microsecond covers that and is still far below anything a scorer sees.
+#define MEAN_TOLERANCE_US       0.01
+#define SPREAD_TOLERANCE_US     0.1
+
+static void CheckMatches(const KeystrokeBuffer& buffer, DWORD cTyped, DWORD cRemoved)
+{
+    TypingFeatures features;
+    buffer.GetFeatures(&features);
+
+    Recomputed expected;
+    Recompute(buffer.GetTimeline(), buffer.GetCount(), &expected);
+
+    CHECK(features.keystrokeCount == expected.keystrokeCount);
+    CHECK_NEAR(features.dwellMeanUs, expected.dwellMean, MEAN_TOLERANCE_US);
+    CHECK_NEAR(features.dwellStdDevUs, expected.dwellStdDev, SPREAD_TOLERANCE_US);
+    CHECK_NEAR(features.upDownMeanUs, expected.upDownMean, MEAN_TOLERANCE_US);
+    CHECK_NEAR(features.upDownStdDevUs, expected.upDownStdDev, SPREAD_TOLERANCE_US);
+    CHECK_NEAR(features.downDownMeanUs, expected.downDownMean, MEAN_TOLERANCE_US);
+    CHECK_NEAR(features.downDownStdDevUs, expected.downDownStdDev, SPREAD_TOLERANCE_US);
+    CHECK(features.pauseCount == expected.pauseCount);
+    CHECK(features.totalTypingTimeUs == expected.totalTypingTimeUs);
+    CHECK_NEAR(features.backspaceRatio, (cTyped > 0) ? static_cast<double>(cRemoved) / cTyped : 0.0, 1e-12);
+}
+
+// Appends at the end or in the middle of the field, backspaces, removes
+// ranges, and releases held keys late, in random order. Some keys are
+// recorded while still held (key up == key down) and released later, and
+// some gaps are long enough to count as pauses.
+static void TestRandomEditsMatchRecompute()
+{
+    static KeystrokeBuffer buffer;
+
+    for (ULONG ulSequence = 0; ulSequence < RANDOM_SEQUENCES; ulSequence++)
+    {
+        ULONG ulSeed = 0x9E3779B9 + ulSequence;
+        auto next = [&ulSeed](ULONG ulRange) -> ULONG
+        {
+            ulSeed = ulSeed * 1664525 + 1013904223;
+            return (ulSeed >> 8) % ulRange;
+        };
+
+        buffer.Clear();
+        DWORD cTyped = 0;
+        DWORD cRemoved = 0;
+        UINT32 nowUs = next(1000);
+        std::vector<UINT32> heldDownUs;
+
+        for (DWORD e = 0; e < RANDOM_EDITS; e++)
+        {
+            DWORD cEntries = buffer.GetCount();
+            ULONG ulEdit = next(10);
+
+            if (cEntries >= RANDOM_MAX_LENGTH)
+            {
+                buffer.Clear();
+                heldDownUs.clear();
+                cTyped = 0;
+                cRemoved = 0;
+            }
+            else if (ulEdit < 5 || cEntries == 0)
+            {
+                // Type a key at the end, or in the middle of the field
+                nowUs += (next(8) == 0) ? 600000 + next(400000) : 40000 + next(200000);
+                DWORD dwPosition = (ulEdit == 0 && cEntries > 0) ? next(cEntries) : cEntries;
+                BOOL fHeld = (next(4) == 0);
+                UINT32 keyUpUs = fHeld ? nowUs : nowUs + 30000 + next(150000);
+
+                if (dwPosition < cEntries)
+                {
+                    buffer.ShiftPositions(dwPosition, 1);
+                }
+                CHECK(SUCCEEDED(buffer.Append(static_cast<WCHAR>(L'a' + next(26)), nowUs, keyUpUs, dwPosition, 0)));
+                if (fHeld)
+                {
+                    heldDownUs.push_back(nowUs);
+                }
+                cTyped++;
+            }
+            else if (ulEdit < 7)
+            {
+                // Backspace at the end of the field, the way KeystrokeRecorder
+                // takes it: RemoveLast when the last keystroke typed is there
+                if (buffer.GetTimeline().position[cEntries - 1] == cEntries - 1)
+                {
+                    buffer.RemoveLast();
+                }
+                else
+                {
+                    buffer.RemovePositions(cEntries - 1, 1);
+                }
+                cRemoved += cEntries - buffer.GetCount();
+            }
+            else if (ulEdit < 9)
+            {
+                // Delete or cut a range anywhere in the field
+                DWORD dwPosition = next(cEntries);
+                DWORD cchRemoved = 1 + next((cEntries - dwPosition < 3) ? cEntries - dwPosition : 3);
+                buffer.RemovePositions(dwPosition, cchRemoved);
+                cRemoved += cEntries - buffer.GetCount();
+            }
+            else if (!heldDownUs.empty())
+            {
+                // A held key is released, possibly after later keys went down
+                size_t iHeld = next(static_cast<ULONG>(heldDownUs.size()));
+                UINT32 keyDownUs = heldDownUs[iHeld];
+                heldDownUs.erase(heldDownUs.begin() + iHeld);
+                buffer.SetKeyUp(keyDownUs, keyDownUs + 20000 + next(300000));
+            }
+
+            CheckMatches(buffer, cTyped, cRemoved);
+        }
+    }
+}
+
+// Taking every keystroke back out leaves nothing behind, not even a
+// rounding residue in the spreads
+static void TestRemoveAllResets()
+{
+    static KeystrokeBuffer buffer;
+    buffer.Clear();
+
+    UINT32 rgDownUs[] = { 0, 180000, 200000, 900000, 1000000 };
+    for (DWORD i = 0; i < ARRAYSIZE(rgDownUs); i++)
+    {
+        CHECK(SUCCEEDED(buffer.Append(L'x', rgDownUs[i], rgDownUs[i] + 90000 + i * 7, i, 0)));
+    }
+
+    buffer.RemovePositions(1, 2);
+    buffer.RemoveLast();
+    buffer.RemoveLast();
+    buffer.RemoveLast();
+
+    TypingFeatures features;
+    buffer.GetFeatures(&features);
+    CHECK(features.keystrokeCount == 0);
+    CHECK(features.dwellMeanUs == 0.0 && features.dwellStdDevUs == 0.0);
+    CHECK(features.upDownMeanUs == 0.0 && features.upDownStdDevUs == 0.0);
+    CHECK(features.downDownMeanUs == 0.0 && features.downDownStdDevUs == 0.0);
+    CHECK(features.pauseCount == 0);
+    CHECK(features.backspaceRatio == 1.0);
+}
+
+int main()
+{
+    RUN_TEST(TestRandomEditsMatchRecompute);
+    RUN_TEST(TestRemoveAllResets);
+    return TestResult();
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// MSVC's CPUID and TSC intrinsics on GCC and Clang
+
+#include <x86intrin.h>
+
+inline void __cpuidex(int rgRegs[4], int nLeaf, int nSubLeaf)
+{
+    __asm__ __volatile__("cpuid"
+                         : "=a"(rgRegs[0]), "=b"(rgRegs[1]), "=c"(rgRegs[2]), "=d"(rgRegs[3])
+                         : "a"(nLeaf), "c"(nSubLeaf));
+}
+
+inline void __cpuid(int rgRegs[4], int nLeaf)
+{
+    __cpuidex(rgRegs, nLeaf, 0);
+}
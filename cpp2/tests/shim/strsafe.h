@@ -0,0 +1,105 @@
+#pragma once
+
+// The StringCch* functions the portable modules and the tests use, with
+// the truncation and error behaviour of <strsafe.h>
+
+#include <windows.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#define STRSAFE_MAX_CCH             2147483647
+#define STRSAFE_E_INSUFFICIENT_BUFFER   (static_cast<HRESULT>(0x8007007A))
+
+inline HRESULT StringCchLengthW(PCWSTR psz, size_t cchMax, size_t* pcchLength)
+{
+    if (!psz || cchMax == 0 || cchMax > STRSAFE_MAX_CCH)
+    {
+        return E_INVALIDARG;
+    }
+
+    size_t cch = wcsnlen(psz, cchMax);
+    if (cch == cchMax)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (pcchLength)
+    {
+        *pcchLength = cch;
+    }
+    return S_OK;
+}
+
+inline HRESULT StringCchCopyNW(PWSTR pszDest, size_t cchDest, PCWSTR pszSrc, size_t cchToCopy)
+{
+    if (cchDest == 0 || cchDest > STRSAFE_MAX_CCH)
+    {
+        return E_INVALIDARG;
+    }
+
+    size_t cch = wcsnlen(pszSrc, cchToCopy);
+    HRESULT hr = S_OK;
+    if (cch >= cchDest)
+    {
+        cch = cchDest - 1;
+        hr = STRSAFE_E_INSUFFICIENT_BUFFER;
+    }
+
+    wmemcpy(pszDest, pszSrc, cch);
+    pszDest[cch] = L'\0';
+    return hr;
+}
+
+inline HRESULT StringCchCopyW(PWSTR pszDest, size_t cchDest, PCWSTR pszSrc)
+{
+    return StringCchCopyNW(pszDest, cchDest, pszSrc, STRSAFE_MAX_CCH);
+}
+
+inline HRESULT StringCchCatW(PWSTR pszDest, size_t cchDest, PCWSTR pszSrc)
+{
+    size_t cchUsed = 0;
+    HRESULT hr = StringCchLengthW(pszDest, cchDest, &cchUsed);
+    if (SUCCEEDED(hr))
+    {
+        hr = StringCchCopyW(pszDest + cchUsed, cchDest - cchUsed, pszSrc);
+    }
+    return hr;
+}
+
+// Windows reads %s in a wide format as a wide string; glibc wants %ls
+inline HRESULT StringCchVPrintfW(PWSTR pszDest, size_t cchDest, PCWSTR pszFormat, va_list args)
+{
+    if (cchDest == 0 || cchDest > STRSAFE_MAX_CCH)
+    {
+        return E_INVALIDARG;
+    }
+
+    WCHAR szFormat[512];
+    size_t iOut = 0;
+    for (size_t i = 0; pszFormat[i] != L'\0' && iOut + 2 < ARRAYSIZE(szFormat); i++)
+    {
+        szFormat[iOut++] = pszFormat[i];
+        if (pszFormat[i] == L'%' && pszFormat[i + 1] == L's')
+        {
+            szFormat[iOut++] = L'l';
+        }
+    }
+    szFormat[iOut] = L'\0';
+
+    int cch = vswprintf(pszDest, cchDest, szFormat, args);
+    if (cch < 0)
+    {
+        pszDest[cchDest - 1] = L'\0';
+        return STRSAFE_E_INSUFFICIENT_BUFFER;
+    }
+    return S_OK;
+}
+
+inline HRESULT StringCchPrintfW(PWSTR pszDest, size_t cchDest, PCWSTR pszFormat, ...)
+{
+    va_list args;
+    va_start(args, pszFormat);
+    HRESULT hr = StringCchVPrintfW(pszDest, cchDest, pszFormat, args);
+    va_end(args);
+    return hr;
+}
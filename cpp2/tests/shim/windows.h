@@ -0,0 +1,446 @@
+#pragma once
+
+// Just enough of <windows.h> to build the provider's platform-independent
+// modules on Linux for the tests and benchmarks in this directory. Only
+// what those modules use is declared; anything that needs LogonUI, COM,
+// the registry or WinHTTP stays in the DLL build.
+//
+// WCHAR is the platform wchar_t, which is 32 bits here. The modules treat
+// WCHAR strings as UTF-16 code units, so tests that care about surrogates
+// build their strings from explicit code unit values.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// Basic types
+typedef int BOOL;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+// long long, as on Windows, so %lld and %llu match on every LP64 target
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef int INT;
+typedef unsigned int UINT;
+typedef int8_t INT8;
+typedef int16_t INT16;
+typedef int32_t INT32;
+typedef long long INT64;
+typedef uint8_t UINT8;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef unsigned long long UINT64;
+typedef size_t SIZE_T;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR;
+typedef uintptr_t UINT_PTR;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef WCHAR* PWSTR;
+typedef const WCHAR* PCWSTR;
+typedef char* PSTR;
+typedef const char* PCSTR;
+typedef BYTE* PBYTE;
+typedef void* PVOID;
+typedef void* LPVOID;
+typedef void* HANDLE;
+typedef int32_t HRESULT;
+typedef int32_t NTSTATUS;
+
+typedef union _LARGE_INTEGER
+{
+    struct
+    {
+        DWORD LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+#define TRUE                        1
+#define FALSE                       0
+#define CALLBACK
+#define WINAPI
+#define __cdecl
+#define FORCEINLINE                 inline
+#define INFINITE                    0xFFFFFFFF
+#define ANYSIZE_ARRAY               1
+#define MAXDWORD                    0xFFFFFFFFu
+#define MAXUINT32                   0xFFFFFFFFu
+#define MAXULONGLONG                (~static_cast<ULONGLONG>(0))
+#define FIELD_OFFSET(type, field)   (static_cast<LONG>(offsetof(type, field)))
+#define ARRAYSIZE(a)                (sizeof(a) / sizeof((a)[0]))
+#define UNREFERENCED_PARAMETER(p)   ((void)(p))
+
+// HRESULTs
+#define S_OK                        (static_cast<HRESULT>(0))
+#define S_FALSE                     (static_cast<HRESULT>(1))
+#define E_FAIL                      (static_cast<HRESULT>(0x80004005))
+#define E_NOTIMPL                   (static_cast<HRESULT>(0x80004001))
+#define E_POINTER                   (static_cast<HRESULT>(0x80004003))
+#define E_UNEXPECTED                (static_cast<HRESULT>(0x8000FFFF))
+#define E_ACCESSDENIED              (static_cast<HRESULT>(0x80070005))
+#define E_OUTOFMEMORY               (static_cast<HRESULT>(0x8007000E))
+#define E_INVALIDARG                (static_cast<HRESULT>(0x80070057))
+#define E_NOT_SUFFICIENT_BUFFER     (static_cast<HRESULT>(0x8007007A))
+#define E_NOT_VALID_STATE           (static_cast<HRESULT>(0x8007139F))
+#define SUCCEEDED(hr)               (static_cast<HRESULT>(hr) >= 0)
+#define FAILED(hr)                  (static_cast<HRESULT>(hr) < 0)
+#define HRESULT_FROM_WIN32(x)       (static_cast<HRESULT>(x) <= 0 ? static_cast<HRESULT>(x) : \
+                                     static_cast<HRESULT>(((x) & 0x0000FFFF) | (7 << 16) | 0x80000000))
+
+#define ERROR_FILE_NOT_FOUND        2L
+#define ERROR_ACCESS_DENIED         5L
+#define ERROR_INVALID_DATA          13L
+#define ERROR_HANDLE_EOF            38L
+#define ERROR_INSUFFICIENT_BUFFER   122L
+#define ERROR_NOT_FOUND             1168L
+
+inline DWORD GetLastError()
+{
+    return (errno == ENOENT) ? ERROR_FILE_NOT_FOUND : ERROR_ACCESS_DENIED;
+}
+
+// Memory
+#define ZeroMemory(p, cb)           memset((p), 0, (cb))
+#define FillMemory(p, cb, v)        memset((p), (v), (cb))
+#define CopyMemory(d, s, cb)        memcpy((d), (s), (cb))
+#define MoveMemory(d, s, cb)        memmove((d), (s), (cb))
+
+inline void* SecureZeroMemory(void* pv, SIZE_T cb)
+{
+    volatile BYTE* pb = static_cast<volatile BYTE*>(pv);
+    while (cb--)
+    {
+        *pb++ = 0;
+    }
+    return pv;
+}
+
+#define MEM_COMMIT                  0x00001000
+#define MEM_RESERVE                 0x00002000
+#define MEM_RELEASE                 0x00008000
+#define PAGE_READONLY               0x02
+#define PAGE_READWRITE              0x04
+
+// Page-granular allocations; the size is kept in front of the block so
+// VirtualFree can unmap it
+inline void* VirtualAlloc(void* pvAddress, SIZE_T cb, DWORD dwType, DWORD dwProtect)
+{
+    UNREFERENCED_PARAMETER(pvAddress);
+    UNREFERENCED_PARAMETER(dwType);
+    UNREFERENCED_PARAMETER(dwProtect);
+
+    SIZE_T cbPage = static_cast<SIZE_T>(sysconf(_SC_PAGESIZE));
+    void* pv = mmap(nullptr, cb + cbPage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pv == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    *static_cast<SIZE_T*>(pv) = cb + cbPage;
+    return static_cast<BYTE*>(pv) + cbPage;
+}
+
+inline BOOL VirtualFree(void* pv, SIZE_T cb, DWORD dwType)
+{
+    UNREFERENCED_PARAMETER(cb);
+    UNREFERENCED_PARAMETER(dwType);
+
+    SIZE_T cbPage = static_cast<SIZE_T>(sysconf(_SC_PAGESIZE));
+    BYTE* pbBase = static_cast<BYTE*>(pv) - cbPage;
+    return munmap(pbBase, *reinterpret_cast<SIZE_T*>(pbBase)) == 0;
+}
+
+inline BOOL VirtualLock(void* pv, SIZE_T cb)
+{
+    return mlock(pv, cb) == 0;
+}
+
+inline BOOL VirtualUnlock(void* pv, SIZE_T cb)
+{
+    return munlock(pv, cb) == 0;
+}
+
+inline void* CoTaskMemAlloc(SIZE_T cb)
+{
+    return malloc(cb);
+}
+
+inline void CoTaskMemFree(void* pv)
+{
+    free(pv);
+}
+
+// Interlocked operations
+inline LONG InterlockedIncrement(volatile LONG* p)
+{
+    return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedDecrement(volatile LONG* p)
+{
+    return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchange(volatile LONG* p, LONG value)
+{
+    return __atomic_exchange_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchangeAdd(volatile LONG* p, LONG value)
+{
+    return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedCompareExchange(volatile LONG* p, LONG exchange, LONG comparand)
+{
+    __atomic_compare_exchange_n(p, &comparand, exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+inline LONGLONG InterlockedIncrement64(volatile LONGLONG* p)
+{
+    return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONGLONG InterlockedExchangeAdd64(volatile LONGLONG* p, LONGLONG value)
+{
+    return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST);
+}
+
+// Threads and synchronization
+inline DWORD GetCurrentThreadId()
+{
+    return static_cast<DWORD>(syscall(SYS_gettid));
+}
+
+inline BOOL SwitchToThread()
+{
+    return sched_yield() == 0;
+}
+
+inline void YieldProcessor()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+inline void Sleep(DWORD dwMilliseconds)
+{
+    usleep(static_cast<useconds_t>(dwMilliseconds) * 1000);
+}
+
+typedef struct _SRWLOCK
+{
+    pthread_rwlock_t lock;
+} SRWLOCK, *PSRWLOCK;
+
+inline void InitializeSRWLock(PSRWLOCK pLock)
+{
+    pthread_rwlock_init(&pLock->lock, nullptr);
+}
+
+inline void AcquireSRWLockExclusive(PSRWLOCK pLock)
+{
+    pthread_rwlock_wrlock(&pLock->lock);
+}
+
+inline void ReleaseSRWLockExclusive(PSRWLOCK pLock)
+{
+    pthread_rwlock_unlock(&pLock->lock);
+}
+
+inline void AcquireSRWLockShared(PSRWLOCK pLock)
+{
+    pthread_rwlock_rdlock(&pLock->lock);
+}
+
+inline void ReleaseSRWLockShared(PSRWLOCK pLock)
+{
+    pthread_rwlock_unlock(&pLock->lock);
+}
+
+typedef struct _CRITICAL_SECTION
+{
+    pthread_mutex_t mutex;
+} CRITICAL_SECTION, *LPCRITICAL_SECTION;
+
+inline void InitializeCriticalSection(LPCRITICAL_SECTION pcs)
+{
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&pcs->mutex, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+}
+
+inline void DeleteCriticalSection(LPCRITICAL_SECTION pcs)
+{
+    pthread_mutex_destroy(&pcs->mutex);
+}
+
+inline void EnterCriticalSection(LPCRITICAL_SECTION pcs)
+{
+    pthread_mutex_lock(&pcs->mutex);
+}
+
+inline BOOL TryEnterCriticalSection(LPCRITICAL_SECTION pcs)
+{
+    return pthread_mutex_trylock(&pcs->mutex) == 0;
+}
+
+inline void LeaveCriticalSection(LPCRITICAL_SECTION pcs)
+{
+    pthread_mutex_unlock(&pcs->mutex);
+}
+
+// One-time initialization
+typedef struct _INIT_ONCE
+{
+    pthread_once_t once;
+} INIT_ONCE, *PINIT_ONCE;
+
+#define INIT_ONCE_STATIC_INIT       { PTHREAD_ONCE_INIT }
+
+typedef BOOL (CALLBACK* PINIT_ONCE_FN)(PINIT_ONCE pInitOnce, PVOID pvParameter, PVOID* ppvContext);
+
+// pthread_once takes no arguments, so the call in flight is parked here
+struct ShimInitOnceCall
+{
+    PINIT_ONCE pInitOnce;
+    PINIT_ONCE_FN pfnInit;
+    PVOID pvParameter;
+    PVOID* ppvContext;
+};
+
+inline ShimInitOnceCall& ShimCurrentInitOnceCall()
+{
+    static ShimInitOnceCall s_call;
+    return s_call;
+}
+
+inline void ShimRunInitOnce()
+{
+    ShimInitOnceCall& call = ShimCurrentInitOnceCall();
+    call.pfnInit(call.pInitOnce, call.pvParameter, call.ppvContext);
+}
+
+inline BOOL InitOnceExecuteOnce(PINIT_ONCE pInitOnce, PINIT_ONCE_FN pfnInit, PVOID pvParameter, PVOID* ppvContext)
+{
+    static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    pthread_mutex_lock(&s_mutex);
+    ShimInitOnceCall call = { pInitOnce, pfnInit, pvParameter, ppvContext };
+    ShimCurrentInitOnceCall() = call;
+    pthread_once(&pInitOnce->once, ShimRunInitOnce);
+    pthread_mutex_unlock(&s_mutex);
+    return TRUE;
+}
+
+// Performance counter, in nanoseconds
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER* pCount)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pCount->QuadPart = static_cast<LONGLONG>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+    return TRUE;
+}
+
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* pFrequency)
+{
+    pFrequency->QuadPart = 1000000000LL;
+    return TRUE;
+}
+
+inline ULONGLONG GetTickCount64()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<ULONGLONG>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+// Files, read-only and whole-file, as the model loaders use them
+#define INVALID_HANDLE_VALUE        (reinterpret_cast<HANDLE>(static_cast<intptr_t>(-1)))
+#define GENERIC_READ                0x80000000
+#define FILE_SHARE_READ             0x00000001
+#define OPEN_EXISTING               3
+#define FILE_ATTRIBUTE_NORMAL       0x00000080
+
+inline HANDLE CreateFileW(PCWSTR pszPath, DWORD dwAccess, DWORD dwShare, void* pSecurity,
+                          DWORD dwDisposition, DWORD dwFlags, HANDLE hTemplate)
+{
+    UNREFERENCED_PARAMETER(dwAccess);
+    UNREFERENCED_PARAMETER(dwShare);
+    UNREFERENCED_PARAMETER(pSecurity);
+    UNREFERENCED_PARAMETER(dwDisposition);
+    UNREFERENCED_PARAMETER(dwFlags);
+    UNREFERENCED_PARAMETER(hTemplate);
+
+    char szPath[4096];
+    if (wcstombs(szPath, pszPath, sizeof(szPath)) >= sizeof(szPath))
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    int fd = open(szPath, O_RDONLY);
+    return (fd < 0) ? INVALID_HANDLE_VALUE : reinterpret_cast<HANDLE>(static_cast<intptr_t>(fd));
+}
+
+inline BOOL GetFileSizeEx(HANDLE hFile, LARGE_INTEGER* pSize)
+{
+    struct stat status;
+    if (fstat(static_cast<int>(reinterpret_cast<intptr_t>(hFile)), &status) != 0)
+    {
+        return FALSE;
+    }
+
+    pSize->QuadPart = status.st_size;
+    return TRUE;
+}
+
+inline BOOL ReadFile(HANDLE hFile, void* pv, DWORD cb, DWORD* pcbRead, void* pOverlapped)
+{
+    UNREFERENCED_PARAMETER(pOverlapped);
+
+    ssize_t cbRead = read(static_cast<int>(reinterpret_cast<intptr_t>(hFile)), pv, cb);
+    if (cbRead < 0)
+    {
+        return FALSE;
+    }
+
+    *pcbRead = static_cast<DWORD>(cbRead);
+    return TRUE;
+}
+
+inline BOOL CloseHandle(HANDLE h)
+{
+    return close(static_cast<int>(reinterpret_cast<intptr_t>(h))) == 0;
+}
+
+// Virtual keys the key event pairer treats as characters
+#define VK_SPACE                    0x20
+#define VK_NUMPAD0                  0x60
+#define VK_DIVIDE                   0x6F
+#define VK_OEM_1                    0xBA
+#define VK_OEM_3                    0xC0
+#define VK_OEM_4                    0xDB
+#define VK_OEM_8                    0xDF
+#define VK_OEM_102                  0xE2
+#define VK_SHIFT                    0x10
+#define VK_BACK                     0x08
@@ -128,7 +128,18 @@ DWORD CalculateElapsedTime(const LARGE_INTEGER& start, const LARGE_INTEGER& end)
     return (DWORD)((elapsed * 1000) / g_PerformanceFrequency.QuadPart);
 }
 
-// Keystroke analysis utilities
+// Whole seconds and the remainder are scaled apart so the multiply cannot overflow
+LONGLONG CalculateElapsedMicroseconds(const LARGE_INTEGER& start, const LARGE_INTEGER& end)
+{
+    if (g_PerformanceFrequency.QuadPart == 0) return 0;
+    
+    LONGLONG elapsed = end.QuadPart - start.QuadPart;
+    LONGLONG seconds = elapsed / g_PerformanceFrequency.QuadPart;
+    LONGLONG remainder = elapsed % g_PerformanceFrequency.QuadPart;
+    return seconds * 1000000 + (remainder * 1000000) / g_PerformanceFrequency.QuadPart;
+}
+
+// Keystroke analysis utilities; timestamps are microseconds since the first keystroke
 HRESULT CaptureKeystrokeEvent(WCHAR key, LONGLONG timestamp, DWORD position, KeystrokeData& keystroke)
 {
     keystroke.key = key;
@@ -157,7 +168,7 @@ HRESULT AnalyzeKeystrokePattern(const std::vector<KeystrokeData>& keystrokes, Bi
 HRESULT ValidateKeystrokeData(const KeystrokeData& keystroke)
 {
     if (keystroke.key == 0) return E_INVALIDARG;
-    if (keystroke.keyDownTime <= 0) return E_INVALIDARG;
+    if (keystroke.keyDownTime < 0) return E_INVALIDARG;
     if (keystroke.keyUpTime < keystroke.keyDownTime) return E_INVALIDARG;
     
     return S_OK;
@@ -20,6 +20,7 @@ HRESULT SecureStringCopy(PWSTR pszDest, SIZE_T cchDest, PCWSTR pszSrc);
 HRESULT InitializePerformanceTimer();
 HRESULT GetCurrentTimeStamp(LARGE_INTEGER* pTimeStamp);
 DWORD CalculateElapsedTime(const LARGE_INTEGER& start, const LARGE_INTEGER& end);
+LONGLONG CalculateElapsedMicroseconds(const LARGE_INTEGER& start, const LARGE_INTEGER& end);
 
 // Keystroke analysis utilities
 HRESULT CaptureKeystrokeEvent(WCHAR key, LONGLONG timestamp, DWORD position, KeystrokeData& keystroke);